@@ -19,6 +19,267 @@ struct name_list {
  * free(currp); } }
  */
 
+/*
+ * With -b, messages are collected into binary frames (see
+ * util/aur_frame.h) rather than sent as one text line each. A frame is
+ * sent once it reaches this size, and before anything that waits on rcli.
+ *
+ * @bug magic number
+ */
+#define FRAME_SEND_SIZE (32 * 1024)
+
+static void sendMsg(
+    struct write_port *wport,
+    struct aur_frame *frame,
+    char *str,
+    unsigned int len)
+{
+    struct aur_msg msg;
+    size_t framerem = 0;
+
+    if (frame != NULL &&
+        aur_frame_parse(str, len, &framerem, &msg) == 1 && msg.valid &&
+        aur_frame_add(frame, msg.tag, msg.valu, msg.valulen))
+    {
+        LOG(LOG_DEBUG, "Framing %c %.*s", msg.tag, (int)msg.valulen,
+            msg.valu);
+        if (frame->len >= FRAME_SEND_SIZE)
+            outputFrame(wport, frame);
+        return;
+    }
+    if (frame != NULL)
+        outputFrame(wport, frame);
+    outputMsg(wport, str, len);
+}
+
+/*
+ * With -F, the rsync log is followed while rsync is still writing it, so
+ * that files are loaded as they arrive rather than after the whole
+ * transfer. The log ends at a line holding just FOLLOW_END, which the
+ * caller appends once rsync has exited.
+ */
+#define FOLLOW_END "rsync_aur: end of log"
+
+/** @bug magic number */
+#define FOLLOW_POLL_MSECS 200
+
+/*
+ * Strings held back to be dealt with later. These are the messages for
+ * the manifests of the current directory block, which are sent after the
+ * rest of the block (as in the two passes over a complete log), i.e. once
+ * rsync has moved on to another directory. They are also the log lines
+ * that wait for a received file to be renamed into place (see
+ * followLog()).
+ */
+struct held_msgs {
+    char **strs;
+    unsigned int *lens;
+    size_t n;
+    size_t alloc;
+};
+
+static void sendHeld(
+    struct write_port *wport,
+    struct aur_frame *frame,
+    struct held_msgs *held)
+{
+    size_t i;
+
+    for (i = 0; i < held->n; i++)
+    {
+        sendMsg(wport, frame, held->strs[i], held->lens[i]);
+        free(held->strs[i]);
+    }
+    held->n = 0;
+}
+
+static int holdMsg(
+    struct held_msgs *held,
+    char *str,
+    unsigned int len)
+{
+    size_t alloc;
+    char **strs;
+    unsigned int *lens;
+
+    if (held->n == held->alloc)
+    {
+        alloc = held->alloc ? held->alloc * 2 : 16;
+        strs = (char **)realloc(held->strs, alloc * sizeof(char *));
+        if (strs == NULL)
+            return FALSE;
+        held->strs = strs;
+        lens = (unsigned int *)realloc(held->lens,
+                                       alloc * sizeof(unsigned int));
+        if (lens == NULL)
+            return FALSE;
+        held->lens = lens;
+        held->alloc = alloc;
+    }
+    held->strs[held->n] = str;
+    held->lens[held->n] = len;
+    held->n++;
+    return TRUE;
+}
+
+/*
+ * Send the message for one complete line of a followed log, holding back
+ * the manifests of the current directory block.
+ */
+static void followLine(
+    const char *line,
+    struct write_port *wport,
+    struct aur_frame *frame,
+    struct held_msgs *held,
+    char *block_directory,
+    char flags)
+{
+    char fullpath[PATH_MAX];
+    char directory[PATH_MAX];
+    unsigned int retlen;
+    char *sendStr;
+
+    if (line_directory(line, fullpath, directory) != 0)
+        return;         /* Skip blank and malformed lines. */
+
+    if (strcmp(directory, block_directory) != 0)
+    {
+        sendHeld(wport, frame, held);
+        xstrlcpy(block_directory, directory, PATH_MAX);
+    }
+
+    retlen = 0;
+    sendStr = getMessageFromString(line, (unsigned int)strlen(line),
+                                   &retlen, flags);
+    if (!sendStr)
+    {
+        LOG(LOG_DEBUG, "Ignoring: %s", line);
+        return;
+    }
+    if (is_manifest(fullpath) && holdMsg(held, sendStr, retlen))
+        return;
+    sendMsg(wport, frame, sendStr, retlen);
+    free(sendStr);
+}
+
+static void followWaiting(
+    struct write_port *wport,
+    struct aur_frame *frame,
+    struct held_msgs *held,
+    char *block_directory,
+    char flags,
+    struct held_msgs *waiting)
+{
+    size_t i;
+
+    for (i = 0; i < waiting->n; i++)
+    {
+        followLine(waiting->strs[i], wport, frame, held, block_directory,
+                   flags);
+        free(waiting->strs[i]);
+    }
+    waiting->n = 0;
+}
+
+/*
+ * Send the messages for a log that is still being written, up to the
+ * FOLLOW_END line. Whenever the writer is behind, the frame being built is
+ * sent before waiting so that nothing sits in it. Returns TRUE on
+ * success.
+ *
+ * rsync logs a received file (a line starting with '>') before it renames
+ * the file into place, so such a line is only acted on once the next
+ * received file has been logged, or at FOLLOW_END. rsync receives one
+ * file at a time, so by then the earlier one is complete. Lines logged in
+ * between wait as well, so that the order of the log is kept.
+ */
+static int followLog(
+    FILE *fp,
+    struct write_port *wport,
+    struct aur_frame *frame,
+    char flags)
+{
+    const struct timespec poll_interval = {
+        FOLLOW_POLL_MSECS / 1000, (FOLLOW_POLL_MSECS % 1000) * 1000000
+    };
+    struct held_msgs held = { NULL, NULL, 0, 0 };
+    struct held_msgs waiting = { NULL, NULL, 0, 0 };
+    char block_directory[PATH_MAX] = "";
+    char line[PATH_MAX + 40];
+    char *copy;
+    size_t len;
+    size_t i;
+    long pos;
+    int ret = FALSE;
+
+    while (1)
+    {
+        pos = ftell(fp);
+        if (pos < 0)
+        {
+            LOG(LOG_ERR, "Can't tell position in rsync log: %s",
+                    strerror(errno));
+            break;
+        }
+        if (!fgets(line, sizeof(line), fp) ||
+            ((len = strlen(line)) < sizeof(line) - 1 &&
+             line[len - 1] != '\n'))
+        {
+            /*
+             * Nothing more, or only part of a line, has been written yet.
+             */
+            if (ferror(fp))
+            {
+                LOG(LOG_ERR, "Error reading rsync log");
+                break;
+            }
+            clearerr(fp);
+            if (fseek(fp, pos, SEEK_SET) != 0)
+            {
+                LOG(LOG_ERR, "Can't seek in rsync log: %s",
+                        strerror(errno));
+                break;
+            }
+            if (frame != NULL)
+                outputFrame(wport, frame);
+            nanosleep(&poll_interval, NULL);
+            continue;
+        }
+        rstrip(line, "\r\n");
+        if (strcmp(line, FOLLOW_END) == 0)
+        {
+            ret = TRUE;
+            break;
+        }
+
+        if (line[0] == '>')
+            followWaiting(wport, frame, &held, block_directory, flags,
+                          &waiting);
+        if (line[0] != '>' && waiting.n == 0)
+        {
+            followLine(line, wport, frame, &held, block_directory, flags);
+            continue;
+        }
+        copy = strdup(line);
+        if (copy == NULL || !holdMsg(&waiting, copy, 0))
+        {
+            LOG(LOG_ERR, "Out of memory following rsync log");
+            free(copy);
+            break;
+        }
+    }
+    if (ret)
+        followWaiting(wport, frame, &held, block_directory, flags, &waiting);
+    for (i = 0; i < waiting.n; i++)
+        free(waiting.strs[i]);
+    sendHeld(wport, frame, &held);
+    free(waiting.strs);
+    free(waiting.lens);
+    free(held.strs);
+    free(held.lens);
+    return ret;
+}
+
 static char *makeCDStr(
     unsigned int *retlenp,
     char *dir)
@@ -67,24 +328,29 @@ int main(
         nflag,
         fflag,
         sflag,
+        bflag,
+        Fflag,
         ch;
     int portno;
+    int worker;
     unsigned int retlen;
     FILE *fp;
     char *sendStr;
     char *topDir = NULL;
     struct write_port wport;
+    struct aur_frame frame;
     char flags;                 /* our warning flags bit fields */
     char **my_argv;             /* either real or from script file */
     int my_argc;                /* either real or from script file */
     const char *WHITESPACE = "\n\r\t ";
     char *inputLogFile = NULL;
 
-    tflag = uflag = nflag = fflag = sflag = ch = 0;
-    portno = retlen = 0;
+    tflag = uflag = nflag = fflag = sflag = bflag = Fflag = ch = 0;
+    portno = worker = retlen = 0;
     flags = 0;
 
     memset((char *)&wport, '\0', sizeof(struct write_port));
+    aur_frame_init(&frame);
 
     OPEN_LOG("rsync_aur", LOG_DAEMON);
 
@@ -148,7 +414,7 @@ int main(
         my_argc = argc;
     }
 
-    while ((ch = getopt(my_argc, my_argv, "tuf:d:nweish")) != -1)
+    while ((ch = getopt(my_argc, my_argv, "tuf:d:nweisbFhk:")) != -1)
     {
         switch (ch)
         {
@@ -183,6 +449,15 @@ int main(
         case 's':              /* synchronize with rcli */
             sflag = 1;
             break;
+        case 'b':              /* send binary frames */
+            bflag = 1;
+            break;
+        case 'F':              /* follow a log that rsync is still writing */
+            Fflag = 1;
+            break;
+        case 'k':              /* rcli loader worker */
+            worker = atoi(optarg);
+            break;
         case 'h':              /* help */
             myusage(argv[0]);
             exit(EXIT_SUCCESS);
@@ -204,6 +479,14 @@ int main(
         exit(EXIT_FAILURE);
     }
 
+    if (worker < 0 || worker > 0xffff - CONFIG_RPKI_PORT_get())
+    {
+        fprintf(stderr, "invalid loader worker. or -h for help\n");
+        exit(EXIT_FAILURE);
+    }
+    if (portno != 0)
+        portno += worker;
+
     /*
      * test for conflicting flags here...
      */
@@ -328,10 +611,13 @@ int main(
      */
   /****************************************************/
 
+    if (Fflag && !followLog(fp, &wport, bflag ? &frame : NULL, flags))
+        LOG(LOG_ERR, "Stopped following the rsync log before its end.");
+
     /*
      * Process entire log file, one directory block at a time.
      */
-    while (1)
+    while (!Fflag)
     {
         const char DELIMS[] = " \r\n\t";
         long this_dirblock_pos;
@@ -408,11 +694,11 @@ int main(
                 }
                 if (pass_num == NORMAL_PASS && !is_manifest(fullpath))
                 {
-                    outputMsg(&wport, sendStr, retlen);
+                    sendMsg(&wport, bflag ? &frame : NULL, sendStr, retlen);
                 }
                 else if (pass_num == MANIFEST_PASS && is_manifest(fullpath))
                 {
-                    outputMsg(&wport, sendStr, retlen);
+                    sendMsg(&wport, bflag ? &frame : NULL, sendStr, retlen);
                 }
                 free(sendStr);
             }                   /* per available line */
@@ -421,6 +707,8 @@ int main(
                                  * at a time. */
 
     free(topDir);
+    outputFrame(&wport, &frame);
+    aur_frame_free(&frame);
 
     char c;
     if (sflag)
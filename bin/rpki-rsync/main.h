@@ -2,6 +2,7 @@
 #define __MAIN_H
 
 
+#include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -994,6 +994,44 @@ long next_dirblock(
 }
 
 
+/*
+ * Get the path named by one line of the rsync log and its directory, as
+ * next_dirblock() groups lines into directory blocks.  Both buffers are
+ * PATH_MAX long.  Returns 0 on success, 1 for a blank line and -1 for a
+ * malformed one.
+ */
+int line_directory(
+    const char *line,
+    char *fullpath,
+    char *directory)
+{
+    const char *delimiters = " \n\r\t";
+    char *fullpath_start;
+
+    if (!exists_non_delimiter(line, delimiters))
+        return 1;
+
+    fullpath_start = start_of_next_field(line, delimiters);
+    if (!fullpath_start)
+    {
+        LOG(LOG_ERR, "Malformed rsync log file line: %s", line);
+        return -1;
+    }
+    if (!this_field(fullpath, PATH_MAX, fullpath_start, delimiters))
+    {
+        LOG(LOG_ERR, "Insufficient buffer to hold path: %s", fullpath_start);
+        return -1;
+    }
+    if (!dirname(directory, PATH_MAX, fullpath))
+    {
+        LOG(LOG_ERR, "Insufficient buffer to hold directory.  Path = %s",
+                fullpath);
+        return -1;
+    }
+    return 0;
+}
+
+
 int is_manifest(
     const char *path)
 {
@@ -76,6 +76,10 @@ int has_newline(
  */
 long next_dirblock(
     FILE * fp);
+int line_directory(
+    const char *line,
+    char *fullpath,
+    char *directory);
 int is_manifest(
     const char *path);
 
@@ -109,25 +109,12 @@ int udpsocket(
     return (TRUE);
 }
 
-ssize_t outputMsg(
+static ssize_t outputBytes(
     struct write_port *wport,
-    char *str,
+    const char *str,
     unsigned int len)
 {
     ssize_t ret = -1;
-    char *str_copy = NULL;
-
-    /*
-     * Log a copy of str without newline(s)
-     */
-    str_copy = strdup(str);
-    if (str_copy)
-    {
-        rstrip(str_copy, "\r\n");
-        LOG(LOG_INFO, "Sending %s", str_copy);
-        FLUSH_LOG();
-        free(str_copy);
-    }
 
     if (wport->protocol == LOCAL)
     {
@@ -170,3 +157,42 @@ ssize_t outputMsg(
     }
     return (ret);
 }
+
+ssize_t outputMsg(
+    struct write_port *wport,
+    char *str,
+    unsigned int len)
+{
+    char *str_copy = NULL;
+
+    /*
+     * Log a copy of str without newline(s)
+     */
+    str_copy = strdup(str);
+    if (str_copy)
+    {
+        rstrip(str_copy, "\r\n");
+        LOG(LOG_INFO, "Sending %s", str_copy);
+        FLUSH_LOG();
+        free(str_copy);
+    }
+
+    return outputBytes(wport, str, len);
+}
+
+ssize_t outputFrame(
+    struct write_port *wport,
+    struct aur_frame *frame)
+{
+    size_t len = aur_frame_finish(frame);
+    ssize_t ret;
+
+    if (len == 0)
+        return (0);
+    LOG(LOG_INFO, "Sending frame of %zu messages (%zu bytes)",
+        frame->nrecords, len);
+    FLUSH_LOG();
+    ret = outputBytes(wport, (const char *)frame->buf, len);
+    aur_frame_reset(frame);
+    return (ret);
+}
@@ -19,6 +19,8 @@
 #include <netinet/in.h>
 #endif
 
+#include "util/aur_frame.h"
+
 #define LOCAL 0
 #define TCP 1
 #define UDP 2
@@ -40,6 +42,12 @@ ssize_t outputMsg(
     struct write_port *,
     char *,
     unsigned int);
+/*
+ * Send the messages collected in a frame, if any, and empty it.
+ */
+ssize_t outputFrame(
+    struct write_port *,
+    struct aur_frame *);
 
 
 #endif
@@ -32,5 +32,10 @@ void myusage(
     fprintf(stderr, "\t-e         \tcreate error message(s)\n");
     fprintf(stderr, "\t-i         \tcreate informational message(s)\n");
     fprintf(stderr, "\t-s         \tsynchronize with rcli at the end\n");
+    fprintf(stderr, "\t-b         \tsend messages in binary frames\n");
+    fprintf(stderr,
+            "\t-F         \tfollow the logfile while rsync writes it\n");
+    fprintf(stderr,
+            "\t-k worker  \tsend to rcli loader worker (RPKIPort+worker)\n");
     fprintf(stderr, "\t-h         \tthis help listing\n");
 }
@@ -21,8 +21,18 @@
  * and updates its state accordingly.
  **************/
 
+/*
+ * rcli keeps a batch open for up to RPKILoaderBatchInterval milliseconds,
+ * plus however long the object being loaded when it expires takes. A CRL
+ * row changed in such a batch carries the time of the change but only
+ * becomes visible when the batch commits, so the next sweep starts this
+ * many seconds, plus the batch interval, before the current one.
+ */
+#define CRL_SWEEP_SLACK 60
+
 /** @bug magic constant */
 static char currTimestamp[24];
+static char lastCRLSweep[24];
 static char theIssuer[SUBJSIZE];
 static char theAKI[SKISIZE];
 static unsigned int theID;      // for passing to callback
@@ -119,33 +129,51 @@ handleIfCurrent(
  * checks stale crls to see if another crl exists that is more recent;
  * if not, it sets all certs covered by this crl to have status
  * stale_crl
+ *
+ * The first two columns of the search are the issuer and aki; if there
+ * is a third, it is the local_id of a cert.
  */
 static scmsrcha *cntSrch = NULL;
 
-static sqlvaluefunc countCurrentCRLs;
+static sqlblockfunc countCurrentCRLs;
 err_code
 countCurrentCRLs(
     scmcon *conp,
     scmsrcha *s,
-    ssize_t numLine)
+    scmblock *blk)
 {
-    UNREFERENCED_PARAMETER(s);
-    UNREFERENCED_PARAMETER(numLine);
+    err_code sta = 0;
+    size_t row;
+    char *val;
+
     if (cntSrch == NULL)
     {
         cntSrch = newsrchscm(NULL, 1, 0, 1);
         /** @bug ignores error code without explanation */
         addcolsrchscm(cntSrch, "local_id", SQL_C_ULONG, 8);
     }
-    char escaped_aki[2 * strlen(theAKI) + 1];
-    char escaped_issuer[2 * strlen(theIssuer) + 1];
-    mysql_escape_string(escaped_aki, theAKI, strlen(theAKI));
-    mysql_escape_string(escaped_issuer, theIssuer, strlen(theIssuer));
-    xsnprintf(cntSrch->wherestr, WHERESTR_SIZE,
-              "issuer=\"%s\" and aki=\"%s\" and next_upd>=\"%s\"",
-              escaped_issuer, escaped_aki, currTimestamp);
-    return searchscm(conp, crlTable, cntSrch, countHandler, NULL,
-                     SCM_SRCH_DOCOUNT, NULL);
+    for (row = 0; row < blk->nrows; row++)
+    {
+        val = blockvalscm(s, blk, 0, row);
+        xsnprintf(theIssuer, sizeof(theIssuer), "%s", val ? val : "");
+        val = blockvalscm(s, blk, 1, row);
+        xsnprintf(theAKI, sizeof(theAKI), "%s", val ? val : "");
+        if (s->nused > 2)
+        {
+            val = blockvalscm(s, blk, 2, row);
+            theID = val ? *(unsigned int *)val : 0;
+        }
+        char escaped_aki[2 * strlen(theAKI) + 1];
+        char escaped_issuer[2 * strlen(theIssuer) + 1];
+        mysql_escape_string(escaped_aki, theAKI, strlen(theAKI));
+        mysql_escape_string(escaped_issuer, theIssuer, strlen(theIssuer));
+        xsnprintf(cntSrch->wherestr, WHERESTR_SIZE,
+                  "issuer=\"%s\" and aki=\"%s\" and next_upd>=\"%s\"",
+                  escaped_issuer, escaped_aki, currTimestamp);
+        sta = searchscm(conp, crlTable, cntSrch, countHandler, NULL,
+                        SCM_SRCH_DOCOUNT, NULL);
+    }
+    return sta;
 }
 
 /**
@@ -157,6 +185,8 @@ countCurrentCRLs(
 static char staleManStmt[MANFILES_SIZE];
 /** @bug magic constant */
 static char *staleManFiles[10000];
+/** manifest rows per fetch; the files column alone is MANFILES_SIZE */
+#define MANIFEST_BLOCK_ROWS 16
 static int numStaleManFiles = 0;
 
 static err_code
@@ -174,20 +204,31 @@ handleStaleMan2(
     return statementscm_no_data(conp, staleManStmt);
 }
 
-static sqlvaluefunc handleStaleMan;
+static sqlblockfunc handleStaleMan;
 err_code
 handleStaleMan(
     scmcon *conp,
     scmsrcha *s,
-    ssize_t numLine)
+    scmblock *blk)
 {
-    UNREFERENCED_PARAMETER(numLine);
     UNREFERENCED_PARAMETER(conp);
-    int len = *((unsigned int *)s->vec[1].valptr);
-    staleManFiles[numStaleManFiles] = malloc(len + 1);
-    memcpy(staleManFiles[numStaleManFiles], (char *)s->vec[0].valptr, len);
-    staleManFiles[numStaleManFiles][len] = 0;
-    numStaleManFiles++;
+    char *files;
+    unsigned int *lenp;
+    size_t row;
+    int len;
+
+    for (row = 0; row < blk->nrows; row++)
+    {
+        files = blockvalscm(s, blk, 0, row);
+        lenp = blockvalscm(s, blk, 1, row);
+        if (files == NULL || lenp == NULL)
+            continue;
+        len = *lenp;
+        staleManFiles[numStaleManFiles] = malloc(len + 1);
+        memcpy(staleManFiles[numStaleManFiles], files, len);
+        staleManFiles[numStaleManFiles][len] = 0;
+        numStaleManFiles++;
+    }
     return 0;
 }
 
@@ -255,6 +296,14 @@ int main(
             .valsize = sizeof(currTimestamp),
             .avalsize = 0,
         },
+        {
+            .colno = 2,
+            .sqltype = SQL_C_CHAR,
+            .colname = "crl_swept",
+            .valptr = lastCRLSweep,
+            .valsize = sizeof(lastCRLSweep),
+            .avalsize = 0,
+        },
     };
     scmsrcha srch1 = {
         .vec = srch1cols,
@@ -282,14 +331,27 @@ int main(
     /** @bug ignores error code without explanation */
     certificate_validity(scmp, connect);
 
-    // check for revoked certs
-    status = iterate_crl(scmp, connect, &revoke_cert_by_serial);
+    // check for certs revoked by CRLs changed since the last sweep
+    status = sweep_crl_revocations(scmp, connect,
+                                   lastCRLSweep[0] ? lastCRLSweep : NULL);
     if (status != 0 && status != ERR_SCM_NODATA)
     {
         fprintf(stderr, "Error checking for revoked certificates: %s\n",
                 err2string(status));
         exit(EXIT_FAILURE);
     }
+    xsnprintf(msg, sizeof(msg),
+              "update %s set crl_swept=\"%s\" - interval %zu second;",
+              metaTable->tabname, currTimestamp,
+              (CONFIG_RPKI_LOADER_BATCH_INTERVAL_get() + 999) / 1000 +
+              CRL_SWEEP_SLACK);
+    status = statementscm_no_data(connect, msg);
+    if (status < 0)
+    {
+        fprintf(stderr, "Error recording the revocation sweep: %s\n",
+                err2string(status));
+        exit(EXIT_FAILURE);
+    }
 
     // do check for stale crls (next update after last time and before this)
     // if no new crl replaced it (if count = 0 for crls with same issuer and
@@ -325,8 +387,8 @@ int main(
         .wherestr = msg,
     };
     countHandler = &handleIfStale;
-    status = searchscm(connect, crlTable, &srch2, NULL, &countCurrentCRLs,
-                       SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    status = searchblockscm(connect, crlTable, &srch2, &countCurrentCRLs,
+                            0, NULL, SCM_BLOCK_ROWS);
     if (status != 0 && status != ERR_SCM_NODATA)
     {
         fprintf(stderr, "Error searching for CRLs: %s\n",
@@ -368,8 +430,8 @@ int main(
         .wherestr = msg,
     };
     numStaleManFiles = 0;
-    status = searchscm(connect, manifestTable, &srch3, NULL, &handleStaleMan,
-                       SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    status = searchblockscm(connect, manifestTable, &srch3, &handleStaleMan,
+                            0, NULL, MANIFEST_BLOCK_ROWS);
     if (status != 0 && status != ERR_SCM_NODATA)
     {
         fprintf(stderr, "Error searching for manifests: %s\n",
@@ -395,8 +457,8 @@ int main(
     srch3.vald = 0;
     xsnprintf(msg, sizeof(msg), "next_upd>\"%s\"", currTimestamp);
     numStaleManFiles = 0;
-    status = searchscm(connect, manifestTable, &srch3, NULL, &handleStaleMan,
-                       SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    status = searchblockscm(connect, manifestTable, &srch3, &handleStaleMan,
+                            0, NULL, MANIFEST_BLOCK_ROWS);
     if (status != 0 && status != ERR_SCM_NODATA)
     {
         fprintf(stderr, "Error searching for manifests: %s\n",
@@ -457,8 +519,8 @@ int main(
         .wherestr = msg,
     };
     countHandler = &handleIfCurrent;
-    status = searchscm(connect, certTable, &srch4, NULL, &countCurrentCRLs,
-                       SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    status = searchblockscm(connect, certTable, &srch4, &countCurrentCRLs,
+                            0, NULL, SCM_BLOCK_ROWS);
     if (status != 0 && status != ERR_SCM_NODATA)
     {
         fprintf(stderr, "Error searching for certificates: %s\n",
@@ -181,7 +181,7 @@ doQuery(
     char *orderp)
 {
     scmtab *table = NULL;
-    scmsrcha srch;
+    scmsrcha srch = {0};
     scmsrch srch1[MAX_VALS];
     char whereStr[MAX_CONDS * 20];
     char errMsg[1024];
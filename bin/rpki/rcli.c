@@ -2,10 +2,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
-#include <sys/ioctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <ctype.h>
 #include <getopt.h>
 #include <time.h>
@@ -29,6 +37,8 @@
 #include "rpki/cms/roa_utils.h"
 #include "rpki/err.h"
 #include "config/config.h"
+#include "util/aur_frame.h"
+#include "util/file.h"
 #include "util/logging.h"
 #include "util/macros.h"
 #include "util/stringutils.h"
@@ -104,6 +114,11 @@ restoreState(
                     "Could not restore to table %s from file backup_%s", name,
                     name);
     }
+    // the cached directory and certificate state no longer match the
+    // tables. The id allocators are kept: the backup only holds ids that
+    // were handed out before it was taken, and those are never reused.
+    cleardircachescm(conp);
+    reset_cert_index(conp);
     return sta;
 }
 
@@ -254,7 +269,11 @@ static void usage(
     (void)printf("  -F file    add the indicated trusted file\n");
     (void)printf("  -l         add files listed one per line on stdin\n");
     (void)printf("  -L         add trusted files, one per line on stdin\n");
+    (void)printf("  -B dir     add all files under dir and validate them in\n");
+    (void)printf("             one pass (faster when loading a whole cache)\n");
     (void)printf("  -p         run the socket listener in perpetual mode\n");
+    (void)printf("  -j n       with -w, run n loader workers listening on\n");
+    (void)printf("             ports RPKIPort through RPKIPort+n-1\n");
     (void)printf("  -t topdir  create all database tables\n");
     (void)printf("  -w port    start an rsync listener on port\n");
     (void)printf("  -x         destroy all database tables\n");
@@ -379,6 +398,1245 @@ static char *afterwhite(
 
 static char *hdir = NULL;
 
+/*
+ * AUR operations are grouped into explicit transactions so that the
+ * database does not have to commit (and flush) after every object. A batch
+ * is committed once it holds RPKILoaderBatchSize objects, once it has been
+ * open for RPKILoaderBatchInterval milliseconds, or whenever the input goes
+ * idle. Each object is loaded under its own savepoint, so a failure only
+ * rolls back that object's partial changes.
+ */
+
+#define BATCH_SAVEPOINT "rcli_object"
+
+static struct {
+    size_t maxobjs;             /* 0 disables batching */
+    size_t maxmsecs;            /* maximum age of an open batch */
+    size_t nobjs;               /* objects in the open batch */
+    struct timespec started;    /* when the open batch began */
+} batch;
+
+static void batch_init(
+    void)
+{
+    batch.maxobjs = CONFIG_RPKI_LOADER_BATCH_SIZE_get();
+    batch.maxmsecs = CONFIG_RPKI_LOADER_BATCH_INTERVAL_get();
+    batch.nobjs = 0;
+}
+
+static size_t msecs_since(
+    const struct timespec *then)
+{
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+        return (0);
+    return (size_t)((now.tv_sec - then->tv_sec) * 1000 +
+                    (now.tv_nsec - then->tv_nsec) / 1000000);
+}
+
+static size_t batch_age(
+    void)
+{
+    return msecs_since(&batch.started);
+}
+
+/*
+ * With -j n, rcli forks n loader workers. Worker k listens on port
+ * RPKIPort + k, has its own database connection and allocates ids from its
+ * own share of the id space (see setidpartscm()). rsync_cord.py sends each
+ * publication point to the worker chosen by a CRC-32 of its directory (the
+ * one rsync_aur sends as the C message) relative to the repository, see
+ * loader_for_pubpt(). So every worker owns a disjoint set of directories.
+ *
+ * A CA certificate and its children can land in different workers. Every
+ * worker tells the parent process the directory of each session it
+ * handles. Once a worker has committed CA certificates that became valid,
+ * it sends the parent the local_id of each one together with the directory
+ * of its SIA. The parent passes the id on to the worker owning the
+ * outermost session directory that holds the SIA directory (rsync_cord.py
+ * fetches a publication point below another one with its parent), or the
+ * SIA directory itself if there is none yet. A worker receiving an id
+ * revalidates that certificate's children (see revalidate_children()).
+ */
+
+#define HANDOFF_MAX_IDS 256     /* ids per message to a worker */
+
+struct handoff {
+    unsigned int local_id;      /* 0: pubpt is a session's directory */
+    char pubpt[PATH_MAX];       /* relative to the repository */
+};
+
+/* the length of a handoff to send, up to the end of pubpt */
+#define HANDOFF_LEN(h) \
+    (offsetof(struct handoff, pubpt) + strlen((h)->pubpt) + 1)
+
+static struct {
+    int fd;                     /* to the parent, or -1 */
+    unsigned int worker;        /* this worker's number */
+    scm *scmp;
+    scmcon *conp;
+} loader = {
+    .fd = -1,
+};
+
+/*
+ * Copy the n characters at path to pubpt the way rsync_cord.py names a
+ * publication point: without empty segments and leading or trailing
+ * slashes. Returns nonzero if the result fits.
+ */
+
+static int pubpt_name(
+    char *pubpt,
+    size_t size,
+    const char *path,
+    size_t n)
+{
+    size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (path[i] == '/' && (len == 0 || pubpt[len - 1] == '/'))
+            continue;
+        if (len + 1 >= size)
+            return (0);
+        pubpt[len++] = path[i];
+    }
+    if (len > 0 && pubpt[len - 1] == '/')
+        len--;
+    pubpt[len] = '\0';
+    return (len > 0);
+}
+
+/*
+ * The publication point named by a certificate's SIA: the first rsync
+ * directory URI (the caRepository), or failing that the first rsync URI,
+ * without its scheme. Returns nonzero on success.
+ */
+
+static int sia_pubpt(
+    const char *sia,
+    char *pubpt,
+    size_t size)
+{
+    const char *uri;
+    const char *end;
+    const char *first = NULL;
+    size_t firstlen = 0;
+
+    for (uri = sia; *uri != '\0'; uri = (*end == ';') ? end + 1 : end)
+    {
+        end = uri + strcspn(uri, ";");
+        if ((size_t)(end - uri) <= strlen("rsync://") ||
+            strncasecmp(uri, "rsync://", strlen("rsync://")) != 0)
+            continue;
+        uri += strlen("rsync://");
+        if (end[-1] == '/')
+            return (pubpt_name(pubpt, size, uri, end - uri));
+        if (first == NULL)
+        {
+            first = uri;
+            firstlen = end - uri;
+        }
+    }
+    return (first != NULL && pubpt_name(pubpt, size, first, firstlen));
+}
+
+/*
+ * The worker that loads a publication point: the CRC-32 (as computed by
+ * zlib) of its name, modulo the number of workers.
+ */
+
+static unsigned int loader_for_pubpt(
+    const char *pubpt,
+    unsigned int nworkers)
+{
+    uint32_t crc = 0xffffffff;
+    int k;
+
+    for (; *pubpt != '\0'; pubpt++)
+    {
+        crc ^= (unsigned char)*pubpt;
+        for (k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ((~crc & 0xffffffff) % nworkers);
+}
+
+/*
+ * Tell the parent the directory of a session (see the C message). It must
+ * be within the repository to count.
+ */
+
+static void handoff_session(
+    const char *dir)
+{
+    struct handoff msg;
+    size_t len;
+
+    if (loader.fd < 0 || tdir == NULL)
+        return;
+    for (len = tdirlen; len > 0 && tdir[len - 1] == '/'; len--)
+        ;
+    if (strncmp(dir, tdir, len) != 0 || dir[len] != '/')
+        return;
+    msg.local_id = 0;
+    if (!pubpt_name(msg.pubpt, sizeof(msg.pubpt), dir + len,
+                    strlen(dir + len)))
+        return;
+    if (send(loader.fd, &msg, HANDOFF_LEN(&msg), MSG_NOSIGNAL) < 0)
+        LOG(LOG_ERR, "Could not tell the parent about %s: %s", dir,
+            strerror(errno));
+}
+
+/*
+ * Pass the CA certificates validated since the last call on to the
+ * workers owning their publication points. Call this only once the
+ * certificates have been committed.
+ */
+
+static void handoff_send(
+    scmcon *conp)
+{
+    struct handoff msg;
+    char sia[SIASIZE];
+    unsigned int *ids;
+    size_t nids;
+    size_t i;
+    err_code sta;
+
+    nids = take_validated_certs(conp, &ids);
+    for (i = 0; loader.fd >= 0 && i < nids; i++)
+    {
+        sta = get_cert_sia(loader.scmp, conp, ids[i], sia, sizeof(sia));
+        if (sta < 0)
+        {
+            if (sta != ERR_SCM_NODATA)
+                LOG(LOG_ERR, "Could not look up certificate %u: %s",
+                    ids[i], err2string(sta));
+            continue;
+        }
+        if (!sia_pubpt(sia, msg.pubpt, sizeof(msg.pubpt)))
+            continue;
+        msg.local_id = ids[i];
+        if (send(loader.fd, &msg, HANDOFF_LEN(&msg), MSG_NOSIGNAL) < 0)
+        {
+            LOG(LOG_ERR, "Could not hand off certificates: %s",
+                strerror(errno));
+            break;
+        }
+    }
+    free((void *)ids);
+}
+
+/*
+ * Commit the open batch, if any.
+ */
+
+static err_code
+batch_commit(
+    scmcon *conp)
+{
+    err_code sta;
+
+    if (conp == NULL)
+        return 0;
+    // pending signature verdicts go in with the objects that produced them
+    sta = sigval_cache_flush(conp);
+    if (sta < 0)
+        LOG(LOG_WARNING, "Could not record signature verdicts: %s",
+            geterrorscm(conp));
+    if (conp->intxn == 0)
+    {
+        handoff_send(conp);
+        return 0;
+    }
+    sta = committxnscm(conp);
+    if (sta < 0)
+    {
+        LOG(LOG_ERR, "Could not commit batch of %zu objects: %s",
+            batch.nobjs, geterrorscm(conp));
+        cert_index_rollback(conp, false);
+    }
+    else
+    {
+        LOG(LOG_DEBUG, "Committed batch of %zu objects", batch.nobjs);
+        cert_index_commit(conp);
+    }
+    batch.nobjs = 0;
+    // ids from a failed commit are harmless: the receivers won't find them
+    handoff_send(conp);
+    return (sta);
+}
+
+/*
+ * Prepare for one database operation: open a batch if none is open and set a
+ * savepoint for the operation. If this fails, the operation simply runs in
+ * autocommit mode.
+ */
+
+static void batch_begin_op(
+    scmcon *conp)
+{
+    if (batch.maxobjs == 0)
+        return;
+    if (conp->intxn == 0)
+    {
+        if (begintxnscm(conp) < 0)
+        {
+            LOG(LOG_WARNING, "Could not start transaction: %s",
+                geterrorscm(conp));
+            return;
+        }
+        batch.nobjs = 0;
+        if (clock_gettime(CLOCK_MONOTONIC, &batch.started) != 0)
+            memset(&batch.started, 0, sizeof(batch.started));
+    }
+    if (savepointscm(conp, BATCH_SAVEPOINT) < 0)
+    {
+        LOG(LOG_WARNING, "Could not set savepoint: %s", geterrorscm(conp));
+        (void)batch_commit(conp);
+        return;
+    }
+    cert_index_savepoint(conp);
+}
+
+/*
+ * Give up on the open batch after the server has lost the transaction.
+ */
+
+static void batch_discard(
+    scmcon *conp)
+{
+    (void)rollbacktxnscm(conp);
+    cert_index_rollback(conp, false);
+    batch.nobjs = 0;
+}
+
+/*
+ * Finish one database operation whose result was sta: keep its changes or
+ * roll them back to the savepoint, then commit the batch if it is full or
+ * old enough.
+ */
+
+static void batch_end_op(
+    scmcon *conp,
+    err_code sta)
+{
+    if (conp->intxn == 0)
+    {
+        // autocommit mode: the changes are already visible
+        handoff_send(conp);
+        return;
+    }
+    if (sta < 0)
+    {
+        if (rollbacktosavepointscm(conp, BATCH_SAVEPOINT) < 0)
+        {
+            /*
+             * The server already rolled back the whole transaction
+             * (e.g. deadlock), so the savepoint is gone.
+             */
+            LOG(LOG_ERR, "Could not roll back to savepoint, "
+                "discarding batch of %zu objects", batch.nobjs);
+            batch_discard(conp);
+            return;
+        }
+        cert_index_rollback(conp, true);
+    }
+    else if (releasesavepointscm(conp, BATCH_SAVEPOINT) < 0)
+    {
+        /*
+         * Likewise: the operation succeeded, but its changes went with the
+         * transaction.
+         */
+        LOG(LOG_ERR, "Could not release savepoint (%s), "
+            "discarding batch of %zu objects", geterrorscm(conp),
+            batch.nobjs + 1);
+        batch_discard(conp);
+        return;
+    }
+    batch.nobjs++;
+    if (batch.nobjs >= batch.maxobjs || batch_age() >= batch.maxmsecs)
+        (void)batch_commit(conp);
+}
+
+/*
+ * Revalidate the children of the certificates handed off by the other
+ * workers since the last call.
+ */
+
+static void handoff_receive(
+    void)
+{
+    unsigned int ids[HANDOFF_MAX_IDS];
+    ssize_t len;
+    size_t i;
+    err_code sta;
+
+    if (loader.fd < 0)
+        return;
+    while ((len = recv(loader.fd, ids, sizeof(ids), MSG_DONTWAIT)) > 0)
+    {
+        for (i = 0; i < (size_t)len / sizeof(ids[0]); i++)
+        {
+            batch_begin_op(loader.conp);
+            sta = revalidate_children(loader.scmp, loader.conp, ids[i]);
+            if (sta < 0)
+                LOG(LOG_WARNING,
+                    "Could not revalidate children of certificate %u: %s",
+                    ids[i], err2string(sta));
+            batch_end_op(loader.conp, sta);
+        }
+    }
+    if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        LOG(LOG_ERR, "Lost contact with the parent rcli process");
+        (void)close(loader.fd);
+        loader.fd = -1;
+    }
+    (void)batch_commit(loader.conp);
+}
+
+/*
+ * With RPKILoaderRevalidateInterval set, a certificate that becomes valid
+ * during a sync only marks its subtree dirty (see coalesce_revalidation()).
+ * The dirty subtrees are validated together at the end of the sync, when
+ * AUR asks to synchronize, or once the oldest mark is
+ * RPKILoaderRevalidateInterval milliseconds old, so that a subtree below
+ * several changed certificates is only walked once.
+ */
+
+static struct {
+    size_t maxmsecs;            /* 0 validates subtrees right away */
+    bool pending;               /* whether started is set */
+    struct timespec started;    /* when the oldest mark was noticed */
+} dirty;
+
+static void dirty_init(
+    scmcon *conp)
+{
+    dirty.maxmsecs = CONFIG_RPKI_LOADER_REVALIDATE_INTERVAL_get();
+    dirty.pending = false;
+    coalesce_revalidation(conp, dirty.maxmsecs > 0);
+}
+
+static void dirty_flush(
+    scm *scmp,
+    scmcon *conp)
+{
+    unsigned int *ids;
+    size_t nids;
+    size_t i;
+    err_code sta;
+
+    dirty.pending = false;
+    nids = take_dirty_certs(conp, &ids);
+    for (i = 0; i < nids; i++)
+    {
+        batch_begin_op(conp);
+        sta = revalidate_children(scmp, conp, ids[i]);
+        if (sta < 0)
+            LOG(LOG_WARNING,
+                "Could not revalidate children of certificate %u: %s",
+                ids[i], err2string(sta));
+        batch_end_op(conp, sta);
+    }
+    if (nids > 0)
+        LOG(LOG_DEBUG, "Revalidated below %zu dirty certificates", nids);
+    free((void *)ids);
+}
+
+/*
+ * Validate the dirty subtrees if they have waited long enough.
+ */
+
+static void dirty_poll(
+    scm *scmp,
+    scmcon *conp)
+{
+    if (dirty.maxmsecs == 0 || dirty_cert_count(conp) == 0)
+        return;
+    if (!dirty.pending)
+    {
+        dirty.pending =
+            clock_gettime(CLOCK_MONOTONIC, &dirty.started) == 0;
+        return;
+    }
+    if (msecs_since(&dirty.started) >= dirty.maxmsecs)
+        dirty_flush(scmp, conp);
+}
+
+/*
+ * Wait for a connection on the listening socket protos, handling hand-offs
+ * from the other workers in the meantime.
+ */
+
+static void handoff_wait(
+    int protos)
+{
+    struct pollfd pfd[2];
+
+    while (loader.fd >= 0)
+    {
+        pfd[0].fd = protos;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = loader.fd;
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        if (poll(pfd, 2, -1) < 0 && errno != EINTR)
+            return;
+        if (pfd[1].revents != 0)
+            handoff_receive();
+        if (pfd[0].revents != 0)
+            return;
+    }
+}
+
+static volatile sig_atomic_t loader_stopping = 0;
+
+static void loader_stop(
+    int sig)
+{
+    (void)sig;
+    loader_stopping = 1;
+}
+
+/*
+ * Append ids to a worker's queue of hand-offs. Returns nonzero on success.
+ */
+
+struct handoff_queue {
+    unsigned int *ids;
+    size_t len;
+    size_t alloc;
+};
+
+static int handoff_queue_add(
+    struct handoff_queue *q,
+    const unsigned int *ids,
+    size_t n)
+{
+    unsigned int *nids;
+    size_t nalloc;
+
+    if (q->len + n > q->alloc)
+    {
+        nalloc = q->alloc ? q->alloc : HANDOFF_MAX_IDS;
+        while (q->len + n > nalloc)
+            nalloc *= 2;
+        nids = (unsigned int *)realloc(q->ids, nalloc * sizeof(*nids));
+        if (nids == NULL)
+            return (0);
+        q->ids = nids;
+        q->alloc = nalloc;
+    }
+    memcpy(q->ids + q->len, ids, n * sizeof(*ids));
+    q->len += n;
+    return (1);
+}
+
+/*
+ * The session directories the workers have reported, see handoff_session().
+ */
+
+struct pubpt_list {
+    char **names;
+    size_t len;
+    size_t alloc;
+};
+
+static void pubpt_list_add(
+    struct pubpt_list *l,
+    const char *name)
+{
+    char **nnames;
+    size_t i;
+
+    for (i = 0; i < l->len; i++)
+        if (strcmp(l->names[i], name) == 0)
+            return;
+    if (l->len == l->alloc)
+    {
+        nnames = (char **)realloc(l->names, (l->alloc ? 2 * l->alloc : 64) *
+                                  sizeof(*nnames));
+        if (nnames == NULL)
+            return;
+        l->names = nnames;
+        l->alloc = l->alloc ? 2 * l->alloc : 64;
+    }
+    if ((l->names[l->len] = strdup(name)) != NULL)
+        l->len++;
+}
+
+/*
+ * The worker owning the outermost session directory that holds the
+ * publication point pubpt, or pubpt itself if there is none.
+ */
+
+static unsigned int pubpt_list_owner(
+    const struct pubpt_list *l,
+    const char *pubpt,
+    unsigned int nworkers)
+{
+    const char *owner = pubpt;
+    size_t len;
+    size_t i;
+
+    for (i = 0; i < l->len; i++)
+    {
+        len = strlen(l->names[i]);
+        if (len < strlen(owner) && strncmp(l->names[i], pubpt, len) == 0 &&
+            pubpt[len] == '/')
+            owner = l->names[i];
+    }
+    return (loader_for_pubpt(owner, nworkers));
+}
+
+/*
+ * The parent's side of the hand-offs: pass every id from a worker on to the
+ * worker owning its publication point until all workers have exited. Writes
+ * never block, so a busy worker cannot stall the others.
+ */
+
+static void run_loader_parent(
+    pid_t *pids,
+    int *fds,
+    unsigned int n)
+{
+    struct pollfd *pfd;
+    struct handoff_queue *queues;
+    struct pubpt_list sessions = {NULL, 0, 0};
+    struct handoff msg;
+    unsigned int alive = n;
+    unsigned int i;
+    unsigned int j;
+    ssize_t len;
+    size_t cnt;
+    size_t k;
+    pid_t pid;
+
+    pfd = (struct pollfd *)calloc(n, sizeof(*pfd));
+    queues = (struct handoff_queue *)calloc(n, sizeof(*queues));
+    if (pfd == NULL || queues == NULL)
+    {
+        LOG(LOG_ERR, "Out of memory; stopping the loader workers");
+        loader_stopping = 1;
+    }
+    while (alive > 0)
+    {
+        if (loader_stopping == 1)
+        {
+            for (i = 0; i < n; i++)
+                if (pids[i] > 0)
+                    (void)kill(pids[i], SIGTERM);
+            loader_stopping = 2;
+        }
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+        {
+            for (i = 0; i < n; i++)
+            {
+                if (pids[i] != pid)
+                    continue;
+                LOG(LOG_NOTICE, "Loader worker %u exited", i);
+                pids[i] = -1;
+                alive--;
+            }
+        }
+        if (alive == 0 || pfd == NULL || queues == NULL)
+        {
+            if (alive > 0)
+                (void)waitpid(-1, NULL, 0);
+            continue;
+        }
+        for (i = 0; i < n; i++)
+        {
+            pfd[i].fd = (pids[i] > 0) ? fds[i] : -1;
+            pfd[i].events = POLLIN | (queues[i].len > 0 ? POLLOUT : 0);
+            pfd[i].revents = 0;
+        }
+        if (poll(pfd, n, 1000) <= 0)
+            continue;
+        for (i = 0; i < n; i++)
+        {
+            while ((pfd[i].revents & POLLIN) &&
+                   (len = recv(fds[i], &msg, sizeof(msg) - 1,
+                               MSG_DONTWAIT)) >
+                   (ssize_t)offsetof(struct handoff, pubpt))
+            {
+                ((char *)&msg)[len] = '\0';
+                if (msg.local_id == 0)
+                {
+                    pubpt_list_add(&sessions, msg.pubpt);
+                    continue;
+                }
+                j = pubpt_list_owner(&sessions, msg.pubpt, n);
+                if (j < n && j != i && pids[j] > 0 &&
+                    !handoff_queue_add(&queues[j], &msg.local_id, 1))
+                    LOG(LOG_ERR, "Out of memory; dropped certificate %u "
+                        "for loader worker %u", msg.local_id, j);
+            }
+            if ((pfd[i].revents & POLLOUT) && queues[i].len > 0)
+            {
+                cnt = queues[i].len;
+                if (cnt > HANDOFF_MAX_IDS)
+                    cnt = HANDOFF_MAX_IDS;
+                len = send(fds[i], queues[i].ids,
+                           cnt * sizeof(queues[i].ids[0]),
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (len > 0)
+                {
+                    queues[i].len -= cnt;
+                    memmove(queues[i].ids, queues[i].ids + cnt,
+                            queues[i].len * sizeof(queues[i].ids[0]));
+                }
+            }
+        }
+    }
+    if (queues != NULL)
+        for (i = 0; i < n; i++)
+            free((void *)queues[i].ids);
+    for (k = 0; k < sessions.len; k++)
+        free((void *)sessions.names[k]);
+    free((void *)sessions.names);
+    free((void *)queues);
+    free((void *)pfd);
+    for (i = 0; i < n; i++)
+        (void)close(fds[i]);
+}
+
+/*
+ * Fork the loader workers. Returns 1 in each worker, with "loader" set up
+ * except for the database connection. Returns 0 in the parent once all
+ * workers have exited, and a negative error code if the workers could not
+ * be started.
+ */
+
+static int
+start_loader_workers(
+    unsigned int nworkers)
+{
+    struct sigaction sa;
+    pid_t *pids;
+    int *fds;
+    int sv[2];
+    unsigned int i;
+    unsigned int j;
+
+    pids = (pid_t *)calloc(nworkers, sizeof(*pids));
+    fds = (int *)calloc(nworkers, sizeof(*fds));
+    if (pids == NULL || fds == NULL)
+    {
+        free((void *)pids);
+        free((void *)fds);
+        return ERR_SCM_NOMEM;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = loader_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGTERM, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    FLUSH_LOG();
+    for (i = 0; i < nworkers; i++)
+    {
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+        {
+            LOG(LOG_ERR, "Could not start loader worker %u: %s", i,
+                strerror(errno));
+            loader_stopping = 1;
+            break;
+        }
+        pids[i] = fork();
+        if (pids[i] < 0)
+        {
+            LOG(LOG_ERR, "Could not start loader worker %u: %s", i,
+                strerror(errno));
+            (void)close(sv[0]);
+            (void)close(sv[1]);
+            loader_stopping = 1;
+            break;
+        }
+        if (pids[i] == 0)
+        {
+            sa.sa_handler = SIG_DFL;
+            (void)sigaction(SIGTERM, &sa, NULL);
+            (void)sigaction(SIGINT, &sa, NULL);
+            for (j = 0; j < i; j++)
+                (void)close(fds[j]);
+            (void)close(sv[0]);
+            free((void *)pids);
+            free((void *)fds);
+            loader.fd = sv[1];
+            loader.worker = i;
+            return (1);
+        }
+        (void)close(sv[1]);
+        fds[i] = sv[0];
+        LOG(LOG_INFO, "Started loader worker %u (pid %ld)", i,
+            (long)pids[i]);
+    }
+    if (i == 0)
+    {
+        free((void *)pids);
+        free((void *)fds);
+        return ERR_SCM_UNSPECIFIED;
+    }
+    run_loader_parent(pids, fds, i);
+    free((void *)pids);
+    free((void *)fds);
+    return (0);
+}
+
+/*
+ * Socket input. rsync_aur sends text lines or binary frames holding many
+ * messages (see util/aur_frame.h). Both are parsed where they lie in one
+ * fixed buffer, so taking a message allocates and copies nothing; the
+ * unconsumed data is moved to the front only when the buffer fills up.
+ */
+
+/** @bug magic number */
+#define SOCKIN_SIZE (256 * 1024)
+
+static struct {
+    char buf[SOCKIN_SIZE];
+    size_t start;               /* first unconsumed byte */
+    size_t end;                 /* end of the received data */
+    size_t framerem;            /* bytes left in the frame at start */
+} sockin;
+
+static void sockin_reset(
+    void)
+{
+    sockin.start = sockin.end = sockin.framerem = 0;
+}
+
+/*
+ * Receive up to "max" more bytes, making room at the end of the buffer if
+ * needed. Returns what recv() returns, or -1 if a single message does not
+ * fit in the buffer.
+ */
+
+static ssize_t sockin_recv(
+    int s,
+    size_t max,
+    int flags)
+{
+    size_t room;
+    ssize_t got;
+
+    if (sockin.start == sockin.end)
+        sockin.start = sockin.end = 0;
+    else if (sockin.end == sizeof(sockin.buf) && sockin.start > 0)
+    {
+        memmove(sockin.buf, sockin.buf + sockin.start,
+                sockin.end - sockin.start);
+        sockin.end -= sockin.start;
+        sockin.start = 0;
+    }
+    room = sizeof(sockin.buf) - sockin.end;
+    if (room == 0)
+    {
+        LOG(LOG_ERR, "AUR message too long");
+        return (-1);
+    }
+    if (room > max)
+        room = max;
+    got = recv(s, sockin.buf + sockin.end, room, flags);
+    if (got > 0)
+        sockin.end += got;
+    return (got);
+}
+
+/*
+ * Find the next message at or after sockin.start + *offp, skipping frame
+ * headers. On success *offp and *framerem are moved past it. Returns 1 if
+ * a complete message is buffered, 0 if more data is needed and -1 if the
+ * input is malformed.
+ */
+
+static int sockin_parse(
+    size_t *offp,
+    size_t *framerem,
+    struct aur_msg *msg)
+{
+    size_t off = sockin.start + *offp;
+    size_t rem = *framerem;
+    int ret;
+
+    while ((ret = aur_frame_parse(sockin.buf + off, sockin.end - off,
+                                  &rem, msg)) == 1)
+    {
+        off += msg->size;
+        if (msg->tag != 0 || !msg->valid)
+            break;
+    }
+    if (ret == 1)
+    {
+        *offp = off - sockin.start;
+        *framerem = rem;
+    }
+    return (ret);
+}
+
+/*
+ * Socket sessions read ahead. The add and update requests that are already
+ * buffered are queued, up to RPKILoaderPrefetch of them, and a few reader
+ * threads read those files and hash them while the main thread waits for
+ * the database. aur() hands the contents and the hash to
+ * begin_update_object() and add_object_contents(), which decode the object
+ * from that buffer and store the hash without reading the file again. The
+ * queue is bounded: while it is full, no more socket data is read ahead
+ * either.
+ *
+ * The readers do not decode. Neither casn nor the OpenSSL setup in this
+ * program is safe to use from several threads.
+ */
+
+/** @bug magic number */
+#define PREFETCH_READERS 2      /* reader threads */
+/** @bug magic number */
+#define PREFETCH_FILL_MAX 65536 /* bytes read ahead from the socket at once */
+
+enum prefetch_state {
+    PREFETCH_QUEUED,
+    PREFETCH_READING,
+    PREFETCH_DONE
+};
+
+struct prefetch_entry {
+    struct prefetch_entry *next;
+    enum prefetch_state state;
+    bool read;                  /* contents is set */
+    struct file_contents contents;
+    char hash[HASHSIZE];        /* empty if it could not be computed */
+    char fullname[];
+};
+
+static struct {
+    size_t maxdepth;            /* 0 disables prefetching */
+    pthread_t readers[PREFETCH_READERS];
+    size_t nreaders;
+    pthread_mutex_t lock;       /* protects everything below */
+    pthread_cond_t queued;      /* an entry was queued, or stopping */
+    pthread_cond_t done;        /* an entry was read */
+    int stopping;
+    struct prefetch_entry *head;        /* next object aur() will load */
+    struct prefetch_entry *tail;
+    size_t depth;               /* entries in the queue */
+    /*
+     * Used by the main thread only: how many bytes of buffered input have
+     * been scanned, the frame state there, and the current directory after
+     * those messages.
+     */
+    size_t ahead;
+    size_t framerem;
+    char *hdir;
+    /*
+     * Statistics for the current session: of the queued objects that aur()
+     * got to, how many had been read, were still being read or had not
+     * been started.
+     */
+    size_t ready;
+    size_t waited;
+    size_t unread;
+    size_t depthsum;            /* queue depth summed over claims */
+    size_t depthmax;
+} prefetch = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .queued = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void *prefetch_reader(
+    void *arg)
+{
+    struct prefetch_entry *ent;
+
+    (void)arg;
+    pthread_mutex_lock(&prefetch.lock);
+    while (!prefetch.stopping)
+    {
+        for (ent = prefetch.head; ent != NULL; ent = ent->next)
+            if (ent->state == PREFETCH_QUEUED)
+                break;
+        if (ent == NULL)
+        {
+            pthread_cond_wait(&prefetch.queued, &prefetch.lock);
+            continue;
+        }
+        // the main thread leaves an entry alone while it is being read
+        ent->state = PREFETCH_READING;
+        pthread_mutex_unlock(&prefetch.lock);
+        ent->read = file_contents_open(&ent->contents, ent->fullname);
+        if (ent->read &&
+            contents_hash(&ent->contents, ent->hash, sizeof(ent->hash)) != 0)
+            ent->hash[0] = 0;
+        pthread_mutex_lock(&prefetch.lock);
+        ent->state = PREFETCH_DONE;
+        pthread_cond_broadcast(&prefetch.done);
+    }
+    pthread_mutex_unlock(&prefetch.lock);
+    return (NULL);
+}
+
+/*
+ * Remove the oldest entry from the queue and return it. Call with the lock
+ * held.
+ */
+
+static struct prefetch_entry *prefetch_pop(
+    void)
+{
+    struct prefetch_entry *ent = prefetch.head;
+
+    while (ent->state == PREFETCH_READING)
+        pthread_cond_wait(&prefetch.done, &prefetch.lock);
+    prefetch.head = ent->next;
+    if (prefetch.head == NULL)
+        prefetch.tail = NULL;
+    prefetch.depth--;
+    return (ent);
+}
+
+/*
+ * Free an entry that is no longer queued. NULL is allowed.
+ */
+
+static void prefetch_free(
+    struct prefetch_entry *ent)
+{
+    if (ent == NULL)
+        return;
+    if (ent->read)
+        file_contents_close(&ent->contents);
+    free((void *)ent);
+}
+
+static void prefetch_start(
+    void)
+{
+    size_t i;
+
+    prefetch.maxdepth = CONFIG_RPKI_LOADER_PREFETCH_get();
+    if (prefetch.maxdepth == 0)
+        return;
+    prefetch.stopping = 0;
+    for (i = 0; i < PREFETCH_READERS; i++)
+    {
+        if (pthread_create(&prefetch.readers[i], NULL, prefetch_reader,
+                           NULL) != 0)
+        {
+            LOG(LOG_WARNING, "Could not start prefetch thread: %s",
+                strerror(errno));
+            break;
+        }
+    }
+    prefetch.nreaders = i;
+    if (prefetch.nreaders == 0)
+        prefetch.maxdepth = 0;
+}
+
+/*
+ * Forget everything queued, e.g. at the end of a session, and log the
+ * statistics.
+ */
+
+static void prefetch_reset(
+    void)
+{
+    size_t claims = prefetch.ready + prefetch.waited + prefetch.unread;
+
+    if (prefetch.nreaders == 0)
+        return;
+    pthread_mutex_lock(&prefetch.lock);
+    while (prefetch.head != NULL)
+        prefetch_free(prefetch_pop());
+    pthread_mutex_unlock(&prefetch.lock);
+    prefetch.ahead = 0;
+    prefetch.framerem = 0;
+    free((void *)prefetch.hdir);
+    prefetch.hdir = NULL;
+    if (claims > 0)
+        LOG(LOG_INFO, "Prefetch: %zu objects were read ahead, %zu were "
+            "still being read and %zu not yet read when needed; "
+            "average queue depth %.1f, maximum %zu of %zu",
+            prefetch.ready, prefetch.waited, prefetch.unread,
+            (double)prefetch.depthsum / claims, prefetch.depthmax,
+            prefetch.maxdepth);
+    prefetch.ready = prefetch.waited = prefetch.unread = 0;
+    prefetch.depthsum = prefetch.depthmax = 0;
+}
+
+static void prefetch_stop(
+    void)
+{
+    size_t i;
+
+    prefetch_reset();
+    pthread_mutex_lock(&prefetch.lock);
+    prefetch.stopping = 1;
+    pthread_cond_broadcast(&prefetch.queued);
+    pthread_mutex_unlock(&prefetch.lock);
+    for (i = 0; i < prefetch.nreaders; i++)
+        (void)pthread_join(prefetch.readers[i], NULL);
+    prefetch.nreaders = 0;
+}
+
+/*
+ * Queue the requests among the buffered messages that have not been
+ * scanned yet, until the queue is full.
+ */
+
+static void prefetch_scan(
+    void)
+{
+    struct prefetch_entry *ent;
+    struct aur_msg msg;
+    char *valu;
+    char *outdir;
+    char *outfile;
+    char *outfull;
+    char c;
+
+    if (prefetch.nreaders == 0)
+        return;
+    if (prefetch.ahead == 0)
+    {
+        free((void *)prefetch.hdir);
+        prefetch.hdir = hdir != NULL ? strdup(hdir) : NULL;
+        prefetch.framerem = sockin.framerem;
+    }
+    while (prefetch.depth < prefetch.maxdepth &&
+           sockin_parse(&prefetch.ahead, &prefetch.framerem, &msg) == 1)
+    {
+        if (!msg.valid)
+            continue;
+        c = toupper((int)(unsigned char)msg.tag);
+        if (c != 'C' && c != 'A' && c != 'U')
+            continue;
+        valu = strndup(msg.valu, msg.valulen);
+        if (valu == NULL)
+            continue;
+        if (c == 'C')
+        {
+            free((void *)prefetch.hdir);
+            prefetch.hdir = valu;
+            continue;
+        }
+        if (splitdf(prefetch.hdir, NULL, valu, &outdir, &outfile,
+                    &outfull) == 0)
+        {
+            ent = malloc(sizeof(*ent) + strlen(outfull) + 1);
+            if (ent != NULL)
+            {
+                ent->next = NULL;
+                ent->state = PREFETCH_QUEUED;
+                ent->read = false;
+                ent->hash[0] = 0;
+                strcpy(ent->fullname, outfull);
+                pthread_mutex_lock(&prefetch.lock);
+                if (prefetch.tail != NULL)
+                    prefetch.tail->next = ent;
+                else
+                    prefetch.head = ent;
+                prefetch.tail = ent;
+                prefetch.depth++;
+                if (prefetch.depth > prefetch.depthmax)
+                    prefetch.depthmax = prefetch.depth;
+                pthread_cond_signal(&prefetch.queued);
+                pthread_mutex_unlock(&prefetch.lock);
+            }
+            free((void *)outdir);
+            free((void *)outfile);
+            free((void *)outfull);
+        }
+        free((void *)valu);
+    }
+}
+
+/*
+ * The main thread has taken "size" bytes of buffered input.
+ */
+
+static void prefetch_consumed(
+    size_t size)
+{
+    prefetch.ahead = prefetch.ahead > size ? prefetch.ahead - size : 0;
+}
+
+/*
+ * If every buffered message has been scanned and the queue has room,
+ * receive whatever socket data has already arrived so that it can be
+ * scanned too. This never blocks.
+ */
+
+static void prefetch_fill(
+    int s)
+{
+    struct aur_msg msg;
+    size_t ahead = prefetch.ahead;
+    size_t framerem = prefetch.framerem;
+
+    if (prefetch.nreaders == 0 || prefetch.depth >= prefetch.maxdepth)
+        return;
+    if (ahead == 0)
+        framerem = sockin.framerem;
+    if (sockin_parse(&ahead, &framerem, &msg) != 0)
+        return;
+    (void)sockin_recv(s, PREFETCH_FILL_MAX, MSG_DONTWAIT);
+}
+
+/*
+ * Called by aur() before it loads an object, to wait until the readers are
+ * done with it and to take it off the queue. Objects are not necessarily
+ * loaded in the order they were queued (see aur_flush()), so only the
+ * matching entry is removed. Returns the entry, which the caller frees
+ * with prefetch_free(), or NULL if the object was not queued.
+ */
+
+static struct prefetch_entry *prefetch_claim(
+    const char *fullname)
+{
+    struct prefetch_entry *ent;
+    struct prefetch_entry *prev = NULL;
+
+    if (prefetch.nreaders == 0)
+        return (NULL);
+    pthread_mutex_lock(&prefetch.lock);
+    for (ent = prefetch.head; ent != NULL; prev = ent, ent = ent->next)
+        if (strcmp(ent->fullname, fullname) == 0)
+            break;
+    // requests that arrived with nothing buffered were never queued
+    if (ent != NULL)
+    {
+        prefetch.depthsum += prefetch.depth;
+        if (ent->state == PREFETCH_DONE)
+            prefetch.ready++;
+        else if (ent->state == PREFETCH_READING)
+            prefetch.waited++;
+        else
+            prefetch.unread++;
+        if (prev == NULL)
+        {
+            ent = prefetch_pop();
+        }
+        else
+        {
+            // only this thread changes the links, so prev stays valid
+            while (ent->state == PREFETCH_READING)
+                pthread_cond_wait(&prefetch.done, &prefetch.lock);
+            prev->next = ent->next;
+            if (prefetch.tail == ent)
+                prefetch.tail = prev;
+            prefetch.depth--;
+        }
+    }
+    pthread_mutex_unlock(&prefetch.lock);
+    return (ent);
+}
+
 static err_code
 aur(
     scm *scmp,
@@ -389,7 +1647,12 @@ aur(
     char *outdir;
     char *outfile;
     char *outfull;
+    struct prefetch_entry *pre = NULL;
+    struct file_contents *contents = NULL;
+    const char *hash = NULL;
     err_code sta;
+    err_code esta;
+    bool unchanged = false;
     int trusted = 0;
 
     sta = splitdf(hdir, NULL, valu, &outdir, &outfile, &outfull);
@@ -402,125 +1665,305 @@ aur(
         free((void *)outfull);
         return sta;
     }
+    if (what == 'a' || what == 'u')
+        pre = prefetch_claim(outfull);
+    if (pre != NULL && pre->read)
+    {
+        contents = &pre->contents;
+        hash = pre->hash;
+    }
     switch (what)
     {
     case 'a':
-        sta = add_object(scmp, conp, outfile, outdir, outfull, trusted);
+        batch_begin_op(conp);
+        sta = add_object_contents(scmp, conp, outfile, outdir, outfull,
+                                  trusted, contents, hash);
+        batch_end_op(conp, sta);
         break;
     case 'r':
+        batch_begin_op(conp);
         sta = delete_object(scmp, conp, outfile, outdir, outfull, 0);
+        batch_end_op(conp, sta);
         break;
     case 'u':
+        /*
+         * The delete and the add get separate savepoints so that a failed
+         * add does not resurrect the old version of the object. rsync also
+         * reports files whose contents did not change; those are left
+         * alone.
+         */
+        batch_begin_op(conp);
         /** @bug ignores error code without explanation */
-        (void)delete_object(scmp, conp, outfile, outdir, outfull, 0);
-        sta = add_object(scmp, conp, outfile, outdir, outfull, trusted);
+        sta = begin_update_object(scmp, conp, outfile, outdir, outfull, hash,
+                                  &unchanged);
+        batch_end_op(conp, sta);
+        if (unchanged)
+            break;
+        batch_begin_op(conp);
+        sta = add_object_contents(scmp, conp, outfile, outdir, outfull,
+                                  trusted, contents, hash);
+        batch_end_op(conp, sta);
+        batch_begin_op(conp);
+        esta = end_update_object(scmp, conp);
+        if (esta < 0)
+            LOG(LOG_ERR, "Could not finish updating %s: %s (%s)",
+                outfull, err2string(esta), err2name(esta));
+        batch_end_op(conp, esta);
         break;
     default:
         break;
     }
+    prefetch_free(pre);
     free((void *)outdir);
     free((void *)outfile);
     free((void *)outfull);
     return (sta);
 }
 
-static char *hasoneline(
-    char *inp,
-    char **nextp)
+/*
+ * rsync reports the files of a publication point in directory order, so
+ * objects often arrive before the CRL or manifest that applies to them.
+ * Loading them first means loading them twice, in effect: once without,
+ * and then again when the CRL revokes them or the manifest lists them.
+ * Instead, the add, update and remove requests for one directory are held
+ * until the directory is complete, i.e. until a request for another
+ * directory or any other message arrives, and then loaded in dependency
+ * order: CRLs, manifests, certificates and finally the other signed
+ * objects. A CRL and a manifest only depend on the issuer's certificate,
+ * which is in the parent's publication point. rsync lists the files of a
+ * directory before the contents of its subdirectories, so that
+ * certificate has already been loaded. A removal is ordered like an add
+ * or update of the same kind of object, so that the requests for one file
+ * are still loaded in the order they arrived.
+ */
+
+/** @bug magic number */
+#define AUR_PENDING_MAX 4096    /* requests held at once */
+
+struct aur_request {
+    char what;                  /* 'a', 'u' or 'r' */
+    int rank;                   /* load order */
+    size_t seq;                 /* arrival order */
+    char *valu;
+};
+
+static struct {
+    struct aur_request *reqs;
+    size_t n;
+    size_t alloc;
+    struct timespec started;    /* when the first was held */
+    char dir[PATH_MAX];         /* directory of the held requests */
+} pending;
+
+static int aur_rank(
+    const char *valu)
 {
-    char *crlf;
-    int leen;
-    int crleen;
+    switch (infer_filetype(valu))
+    {
+    case OT_CRL:
+    case OT_CRL_PEM:
+        return (0);
+    case OT_MAN:
+    case OT_MAN_PEM:
+        return (1);
+    case OT_CER:
+    case OT_CER_PEM:
+        return (2);
+    default:
+        return (3);
+    }
+}
 
-    *nextp = NULL;
-    if (inp == NULL)
-        return (NULL);
-    leen = strlen(inp);
-    crlf = strstr(inp, "\r\n");
-    if (crlf == NULL)
-        return (NULL);
-    *crlf++ = 0;
-    *crlf++ = 0;
-    if ((int)(crlf - inp) < leen)
+/*
+ * Length of the directory part of a request's value, including the last
+ * '/', or 0 if there is none.
+ */
+static size_t aur_dirlen(
+    const char *valu)
+{
+    const char *slash = strrchr(valu, '/');
+
+    return (slash == NULL ? 0 : (size_t)(slash - valu + 1));
+}
+
+static int aur_request_cmp(
+    const void *a,
+    const void *b)
+{
+    const struct aur_request *x = a;
+    const struct aur_request *y = b;
+
+    if (x->rank != y->rank)
+        return (x->rank < y->rank ? -1 : 1);
+    return (x->seq < y->seq ? -1 : x->seq > y->seq);
+}
+
+static int aur_is_request(
+    char c)
+{
+    c = toupper((int)(unsigned char)c);
+    return (c == 'A' || c == 'U' || c == 'R');
+}
+
+/*
+ * Load the held requests. Returns the status of the last one, as if they
+ * had been loaded as they arrived.
+ */
+
+static err_code
+aur_flush(
+    scm *scmp,
+    scmcon *conp)
+{
+    struct aur_request *req;
+    err_code sta = 0;
+    size_t i;
+
+    qsort(pending.reqs, pending.n, sizeof(pending.reqs[0]), aur_request_cmp);
+    for (i = 0; i < pending.n; i++)
+    {
+        req = &pending.reqs[i];
+        sta = aur(scmp, conp, req->what, req->valu);
+        if (sta < 0)
+            LOG(LOG_ERR, "Status was %s (%s)",
+                err2name(sta), err2string(sta));
+        else
+            LOG(LOG_DEBUG, "Status was %d", sta);
+        free((void *)req->valu);
+    }
+    pending.n = 0;
+    return (sta);
+}
+
+/*
+ * Hold an add, update or remove request until its directory is complete.
+ */
+
+static err_code
+aur_hold(
+    scm *scmp,
+    scmcon *conp,
+    char what,
+    char *valu)
+{
+    struct aur_request *reqs;
+    size_t alloc;
+    size_t dirlen = aur_dirlen(valu);
+
+    if (pending.n > 0 && (strlen(pending.dir) != dirlen ||
+                          strncmp(pending.dir, valu, dirlen) != 0))
+        (void)aur_flush(scmp, conp);
+    if (dirlen >= sizeof(pending.dir))
+    {
+        // too long to compare with the next one; load it now
+        (void)aur_flush(scmp, conp);
+        return aur(scmp, conp, what, valu);
+    }
+    if (pending.n == pending.alloc)
+    {
+        alloc = pending.alloc ? 2 * pending.alloc : 64;
+        reqs = realloc(pending.reqs, alloc * sizeof(reqs[0]));
+        if (reqs == NULL)
+        {
+            // load it now, in order
+            (void)aur_flush(scmp, conp);
+            return aur(scmp, conp, what, valu);
+        }
+        pending.reqs = reqs;
+        pending.alloc = alloc;
+    }
+    if (pending.n == 0)
+    {
+        (void)clock_gettime(CLOCK_MONOTONIC, &pending.started);
+        memcpy(pending.dir, valu, dirlen);
+        pending.dir[dirlen] = '\0';
+    }
+    pending.reqs[pending.n].what = what;
+    pending.reqs[pending.n].rank = aur_rank(valu);
+    pending.reqs[pending.n].seq = pending.n;
+    pending.reqs[pending.n].valu = strdup(valu);
+    if (pending.reqs[pending.n].valu == NULL)
     {
-        crleen = strlen(crlf);
-        *nextp = calloc(crleen + 1, sizeof(char));
-        strncpy(*nextp, crlf, crleen);
+        (void)aur_flush(scmp, conp);
+        return aur(scmp, conp, what, valu);
     }
-    return (inp);
+    pending.n++;
+    if (pending.n >= AUR_PENDING_MAX)
+        return aur_flush(scmp, conp);
+    return (0);
 }
 
 /*
- * This function processes socket data line by line. First, it looks in "left"
- * to see if this contains one or more lines. In such a case it returns a
- * pointer to the first such line, and modifies left so that that line is
- * deleted. If left does not contain a complete line this function will read
- * as much socket data as it can. It will stuff the first complete line (if
- * any) into 'line', and put the remaining stuff into left.
+ * This function takes the next message from the socket input. If none is
+ * buffered, it waits for more socket data and tries again. On return,
+ * *gotp says whether a message was taken; if so, its value is
+ * NUL-terminated in place and stays valid until the next call.
  */
 
 static err_code
 sock1line(
     int s,
-    char **leftp,
-    char **line)
+    struct aur_msg *msg,
+    int *gotp)
 {
-    char *left2;
-    char *left = *leftp;
-    char *next = NULL;
-    char *ptr;
-    int leen = 0;
-    int rd = 0;
-    int sta;
+    size_t off = 0;
+    int ret;
 
-    ptr = hasoneline(left, &next);
-    if (ptr != NULL)            // left had at least one line
+    *gotp = 0;
+    ret = sockin_parse(&off, &sockin.framerem, msg);
+    if (ret == 0)
     {
-        *leftp = next;
-        *line = ptr;
-        return 0;
+        if (sockin_recv(s, sizeof(sockin.buf), 0) <= 0)
+            return ERR_SCM_UNSPECIFIED; // 0 is orderly connection shutdown
+        ret = sockin_parse(&off, &sockin.framerem, msg);
     }
-    if (left != NULL)
-        leen = strlen(left);
-    sta = ioctl(s, FIONREAD, &rd);
-    if (sta < 0)
-        return ERR_SCM_UNSPECIFIED;
-    /*
-     * Blocking mode, by A. Chi, 3/18/11.  Even if no data is available yet,
-     * block until we can read at least one byte.
-     */
-    if (rd <= 0)
-        rd = 1;
-    left2 = (char *)calloc(leen + rd + 1, sizeof(char));
-    if (left2 == NULL)
+    if (ret < 0)
     {
+        LOG(LOG_ERR, "Invalid AUR message framing");
         return ERR_SCM_UNSPECIFIED;
     }
-    (void)strncpy(left2, left, leen);
-    sta = recv(s, left2 + leen, rd, MSG_WAITALL);
-    if (sta <= 0)               // 0 indicates orderly connection shutdown
-        return ERR_SCM_UNSPECIFIED;
-    left2[leen + sta] = 0;
-    // free((void *)left);
-    left = left2;
-    ptr = hasoneline(left, &next);
-    if (ptr != NULL)
-    {
-        free((void *)*leftp);
-        *leftp = next;
-        *line = ptr;
+    if (ret == 0)
         return 0;
-    }
-    free((void *)*leftp);
-    *leftp = left;
-    *line = NULL;
+    sockin.start += off;
+    prefetch_consumed(off);
+    ((char *)msg->valu)[msg->valulen] = 0;
+    *gotp = 1;
     return 0;
 }
 
 /*
- * Receive one or more lines of data over the socket and process them.  The
- * lines received will look like TAG whitespace VALUE CRLF. The following tags
- * are defined:
+ * Return nonzero if the open batch (or, with no batch open, the held
+ * requests) should be dealt with before reading more socket data, i.e. no
+ * complete message is buffered and nothing arrives on the socket before
+ * the batch reaches its maximum age.
+ */
+
+static int sockidle(
+    int s,
+    int intxn)
+{
+    struct aur_msg msg;
+    struct pollfd pfd;
+    size_t framerem = sockin.framerem;
+    size_t off = 0;
+    size_t age;
+
+    if (sockin_parse(&off, &framerem, &msg) != 0)
+        return (0);
+    age = intxn ? batch_age() : msecs_since(&pending.started);
+    if (age >= batch.maxmsecs)
+        return (1);
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return (poll(&pfd, 1, (int)(batch.maxmsecs - age)) <= 0);
+}
+
+/*
+ * Receive one or more messages over the socket and process them.  Each
+ * message is a TAG and a VALUE, sent either as a text line TAG whitespace
+ * VALUE CRLF or as a record in a binary frame (see util/aur_frame.h). The
+ * following tags are defined:
  *
  *
  * B (begin).  This is sent when the AUR program starts. Its VALUE is the
@@ -573,29 +2016,62 @@ sockline(
     scmcon *conp,
     int s)
 {
-    char *left = NULL;
-    char *ptr;
+    struct aur_msg msg;
     char *valu;
     char c;
+    int got;
     int done = 0;
     err_code sta = 0;
 
+    /*
+     * Other processes may have added or removed objects since the last
+     * session. The id allocators are left alone: they were seeded when the
+     * connection was made, and concurrent loaders draw from disjoint blocks
+     * (see setidpartscm()).
+     */
+    sta = refresh_cert_index(scmp, conp);
+    if (sta < 0)
+        LOG(LOG_WARNING, "Could not refresh certificate index: %s",
+            err2string(sta));
+    sta = 0;
+    handoff_receive();
+    sockin_reset();
     for (done = 0; !done;)
     {
-        sta = sock1line(s, &left, &ptr);
+        /*
+         * Don't hold a batch open, or requests back, while waiting for more
+         * input.
+         */
+        if ((conp->intxn != 0 || pending.n > 0) &&
+            sockidle(s, conp->intxn != 0))
+        {
+            if (pending.n > 0)
+                sta = aur_flush(scmp, conp);
+            (void)batch_commit(conp);
+            handoff_receive();
+        }
+        sta = sock1line(s, &msg, &got);
         if (sta != 0)
+        {
+            (void)aur_flush(scmp, conp);
+            dirty_flush(scmp, conp);
+            (void)batch_commit(conp);
+            prefetch_reset();
+            sockin_reset();
             return sta;
-        if (ptr == NULL)
+        }
+        if (!got)
             continue;
-        LOG(LOG_DEBUG, "Sockline: %s", ptr);
-        c = ptr[0];
-        if (!isspace((int)(unsigned char)(ptr[1])))
+        c = msg.tag;
+        valu = (char *)msg.valu;
+        LOG(LOG_DEBUG, "Sockline: %c %s", c, valu);
+        if (!msg.valid)
         {
             LOG(LOG_ERR, "Invalid line: ignored");
-            free((void *)ptr);
             continue;
         }
-        valu = afterwhite(ptr + 1);
+        if (pending.n > 0 && !aur_is_request(c))
+            sta = aur_flush(scmp, conp);
         switch (c)
         {
         case 'b':              /* begin */
@@ -605,6 +2081,7 @@ sockline(
         case 'e':
         case 'E':              /* end */
             LOG(LOG_INFO, "AUR ending at %s", valu);
+            dirty_flush(scmp, conp);
             done = 1;
             break;
         case 'c':
@@ -615,36 +2092,22 @@ sockline(
                 hdir = NULL;
             }
             hdir = strdup(valu);
+            handoff_session(valu);
             break;
         case 'a':
         case 'A':              /* add */
             LOG(LOG_INFO, "AUR add request: %s", valu);
-            sta = aur(scmp, conp, 'a', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'a', valu);
             break;
         case 'u':
         case 'U':              /* update */
             LOG(LOG_INFO, "AUR update request: %s", valu);
-            sta = aur(scmp, conp, 'u', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'u', valu);
             break;
         case 'r':
         case 'R':              /* remove */
             LOG(LOG_INFO, "AUR remove request: %s", valu);
-            sta = aur(scmp, conp, 'r', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'r', valu);
             break;
         case 'l':
         case 'L':              /* link */
@@ -669,16 +2132,20 @@ sockline(
             break;
         case 's':
         case 'S':              /* save */
+            (void)batch_commit(conp);
             /** @bug ignores error code without explanation */
             (void)saveState(conp, scmp);
             break;
         case 'v':
         case 'V':              /* restore */
+            (void)batch_commit(conp);
             /** @bug ignores error code without explanation */
             (void)restoreState(conp, scmp);
             break;
         case 'y':
         case 'Y':              /* synchronize */
+            dirty_flush(scmp, conp);
+            (void)batch_commit(conp);
             if (write(s, "Y", 1) != 1)
                 abort();
             break;
@@ -688,9 +2155,16 @@ sockline(
             LOG(LOG_INFO, "AUR invalid tag '%c' ignored", c);
             break;
         }
-        free((void *)ptr);
+        prefetch_fill(s);
+        prefetch_scan();
+        dirty_poll(scmp, conp);
     }
-    free((void *)left);
+    if (pending.n > 0)
+        sta = aur_flush(scmp, conp);
+    dirty_flush(scmp, conp);
+    (void)batch_commit(conp);
+    prefetch_reset();
+    sockin_reset();
     return (sta);
 }
 
@@ -706,6 +2180,11 @@ fileline(
     int done = 0;
     err_code sta = 0;
 
+    sta = refresh_cert_index(scmp, conp);
+    if (sta < 0)
+        LOG(LOG_WARNING, "Could not refresh certificate index: %s",
+            err2string(sta));
+    sta = 0;
     for (done = 0; !done;)
     {
         if (fgets(ptr, 1023, s) == NULL)
@@ -721,6 +2200,8 @@ fileline(
             continue;
         }
         valu = afterwhite(ptr + 1);
+        if (pending.n > 0 && !aur_is_request(c))
+            sta = aur_flush(scmp, conp);
         switch (c)
         {
         case 'b':              /* begin */
@@ -730,6 +2211,7 @@ fileline(
         case 'e':
         case 'E':              /* end */
             LOG(LOG_INFO, "AUR ending at %s", valu);
+            dirty_flush(scmp, conp);
             done = 1;
             break;
         case 'c':
@@ -744,32 +2226,17 @@ fileline(
         case 'a':
         case 'A':              /* add */
             LOG(LOG_INFO, "AUR add request: %s", valu);
-            sta = aur(scmp, conp, 'a', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'a', valu);
             break;
         case 'u':
         case 'U':              /* update */
             LOG(LOG_INFO, "AUR update request: %s", valu);
-            sta = aur(scmp, conp, 'u', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'u', valu);
             break;
         case 'r':
         case 'R':              /* remove */
             LOG(LOG_INFO, "AUR remove request: %s", valu);
-            sta = aur(scmp, conp, 'r', valu);
-            if (sta < 0)
-                LOG(LOG_ERR, "Status was %s (%s)",
-                    err2name(sta), err2string(sta));
-            else
-                LOG(LOG_DEBUG, "Status was %d", sta);
+            sta = aur_hold(scmp, conp, 'r', valu);
             break;
         case 'l':
         case 'L':              /* link */
@@ -794,16 +2261,20 @@ fileline(
             break;
         case 's':
         case 'S':              /* save */
+            (void)batch_commit(conp);
             /** @bug ignores error code without explanation */
             (void)saveState(conp, scmp);
             break;
         case 'v':
         case 'V':              /* restore */
+            (void)batch_commit(conp);
             /** @bug ignores error code without explanation */
             (void)restoreState(conp, scmp);
             break;
         case 'y':
         case 'Y':              /* synchronize */
+            dirty_flush(scmp, conp);
+            (void)batch_commit(conp);
             break;
         case 0:
             break;
@@ -811,7 +2282,160 @@ fileline(
             LOG(LOG_INFO, "AUR invalid tag '%c' ignored", c);
             break;
         }
+        dirty_poll(scmp, conp);
+    }
+    if (pending.n > 0)
+        sta = aur_flush(scmp, conp);
+    dirty_flush(scmp, conp);
+    (void)batch_commit(conp);
+    return (sta);
+}
+
+/*
+ * Bulk loading. Loading a whole rsync cache object by object spends most
+ * of its time looking for certification paths of objects whose parents
+ * have not been loaded yet, and then validating them again once the
+ * parents show up. Instead, every object is stored without validation and
+ * the tree is then validated once, from the trust anchors down.
+ */
+
+struct bulk_counts {
+    size_t files;
+    size_t added;
+    size_t failed;
+};
+
+static void bulk_add_file(
+    scm *scmp,
+    scmcon *conp,
+    char *path,
+    struct bulk_counts *counts)
+{
+    char *outdir;
+    char *outfile;
+    char *outfull;
+    err_code sta;
+
+    sta = splitdf(NULL, NULL, path, &outdir, &outfile, &outfull);
+    if (sta != 0)
+    {
+        LOG(LOG_ERR, "Error loading file %s: %s (%s)",
+            path, err2string(sta), err2name(sta));
+        counts->failed++;
+        return;
+    }
+    counts->files++;
+    batch_begin_op(conp);
+    sta = add_object(scmp, conp, outfile, outdir, outfull, 0);
+    batch_end_op(conp, sta);
+    if (sta < 0)
+    {
+        LOG(LOG_ERR, "Add failed: %s: error %s (%s)",
+            outfull, err2string(sta), err2name(sta));
+        counts->failed++;
+    }
+    else
+        counts->added++;
+    free((void *)outdir);
+    free((void *)outfile);
+    free((void *)outfull);
+}
+
+static err_code
+bulk_walk(
+    scm *scmp,
+    scmcon *conp,
+    const char *dir,
+    struct bulk_counts *counts)
+{
+    DIR *dp;
+    struct dirent *de;
+    struct stat st;
+    char *path;
+    size_t len;
+
+    dp = opendir(dir);
+    if (dp == NULL)
+    {
+        LOG(LOG_ERR, "Could not open directory %s: %s", dir,
+            strerror(errno));
+        return ERR_SCM_BADFILE;
+    }
+    while ((de = readdir(dp)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        len = strlen(dir) + strlen(de->d_name) + 2;
+        path = malloc(len);
+        if (path == NULL)
+        {
+            (void)closedir(dp);
+            return ERR_SCM_NOMEM;
+        }
+        xsnprintf(path, len, "%s/%s", dir, de->d_name);
+        if (lstat(path, &st) != 0)
+            LOG(LOG_WARNING, "Could not stat %s: %s", path, strerror(errno));
+        else if (S_ISDIR(st.st_mode))
+            (void)bulk_walk(scmp, conp, path, counts);
+        else if (S_ISREG(st.st_mode) &&
+                 infer_filetype(de->d_name) != OT_UNKNOWN)
+            bulk_add_file(scmp, conp, path, counts);
+        free((void *)path);
+    }
+    (void)closedir(dp);
+    return 0;
+}
+
+static err_code
+bulkload(
+    scm *scmp,
+    scmcon *conp,
+    const char *dir)
+{
+    struct bulk_counts counts = {0, 0, 0};
+    unsigned int *ids = NULL;
+    size_t nids = 0;
+    size_t i;
+    err_code sta;
+    err_code csta;
+
+    LOG(LOG_NOTICE, "Bulk loading %s", dir);
+    defer_validation(conp, true);
+    sta = bulk_walk(scmp, conp, dir, &counts);
+    defer_validation(conp, false);
+    csta = batch_commit(conp);
+    if (sta == 0)
+        sta = csta;
+    LOG(LOG_NOTICE, "Bulk load stored %zu of %zu objects (%zu failed)",
+        counts.added, counts.files, counts.failed);
+    if (sta < 0)
+        return sta;
+
+    /*
+     * Objects stored while validation was deferred are unknown, so the
+     * valid certificates are the trust anchors and whatever was valid
+     * before. Validating their children validates the rest of the tree.
+     */
+    sta = list_valid_certs(scmp, conp, &ids, &nids);
+    if (sta < 0)
+    {
+        LOG(LOG_ERR, "Could not list valid certificates: %s (%s)",
+            err2string(sta), err2name(sta));
+        return sta;
+    }
+    for (i = 0; i < nids; i++)
+    {
+        batch_begin_op(conp);
+        sta = revalidate_children(scmp, conp, ids[i]);
+        batch_end_op(conp, sta);
+        if (sta < 0)
+            LOG(LOG_ERR, "Could not validate below certificate %u: %s (%s)",
+                ids[i], err2string(sta), err2name(sta));
     }
+    free((void *)ids);
+    sta = batch_commit(conp);
+    LOG(LOG_NOTICE, "Bulk load validated the children of %zu certificates",
+        nids);
     return (sta);
 }
 
@@ -828,6 +2452,7 @@ fileline(
 // -w port operate in wrapper mode using the given socket port
 // -p with -w indicates to run perpetually, e.g. as a daemon
 // -z run from file list instead of port
+// -B dir load every object under dir, then validate them all at once
 
 int main(
     int argc,
@@ -840,6 +2465,7 @@ int main(
     char *thedelfile = NULL;
     char *topdir = NULL;
     char *thefile = NULL;
+    char *bulkdir = NULL;
     char *outfile = NULL;
     char *outfull = NULL;
     char *outdir = NULL;
@@ -854,6 +2480,7 @@ int main(
     int do_fileopts = 0;
     int use_filelist = 0;
     int perpetual = 0;
+    unsigned int nworkers = 1;
     int really = 0;
     int trusted = 0;
     int force = 0;
@@ -868,7 +2495,7 @@ int main(
         usage();
         return (1);
     }
-    while ((c = getopt(argc, argv, "t:xyhad:f:F:lLwz:pm:c:s")) != EOF)
+    while ((c = getopt(argc, argv, "t:xyhad:f:F:lLB:wz:pm:c:sj:")) != EOF)
     {
         switch (c)
         {
@@ -900,6 +2527,9 @@ int main(
         case 'l':
             use_filelist++;
             break;
+        case 'B':
+            bulkdir = optarg;
+            break;
         case 'w':
             do_sockopts++;
             break;
@@ -910,6 +2540,15 @@ int main(
         case 'p':
             perpetual++;
             break;
+        case 'j':
+            nworkers = (unsigned int)strtoul(optarg, &ne, 10);
+            if (*optarg == 0 || *ne != 0 || nworkers == 0)
+            {
+                (void)fprintf(stderr, "Invalid number of workers: %s\n",
+                              optarg);
+                return (1);
+            }
+            break;
         case 'h':
             usage();
             return (0);
@@ -930,8 +2569,15 @@ int main(
         usage();
         return (1);
     }
+    if (nworkers > 1 && do_sockopts == 0)
+    {
+        (void)printf("The -j option requires -w.\n");
+        usage();
+        return (1);
+    }
     if ((do_create + do_delete + do_sockopts + do_fileopts) == 0 &&
-        thefile == 0 && thedelfile == 0 && use_filelist == 0)
+        thefile == 0 && thedelfile == 0 && use_filelist == 0 &&
+        bulkdir == NULL)
     {
         (void)printf("You need to specify at least one operation "
                      "(e.g. -f file).\n");
@@ -1085,11 +2731,67 @@ int main(
         LOG(LOG_INFO, "Top level repository directory is %s", tdir);
         tdirlen = strlen(tdir);
     }
+    /*
+     * Split the socket listener into workers. Database connections must not
+     * be shared across fork(), so every worker opens its own.
+     */
+    if (sta == 0 && do_sockopts > 0 && nworkers > 1)
+    {
+        disconnectscm(realconp);
+        realconp = NULL;
+        sta = start_loader_workers(nworkers);
+        if (sta <= 0)
+        {
+            freescm(scmp);
+            free((void *)tdir);
+            LOG(LOG_NOTICE, "Rsync client session ended");
+            config_unload();
+            CLOSE_LOG();
+            return (sta);
+        }
+        sta = 0;
+        realconp = connectscm(scmp->dsn, errmsg, 1024);
+        if (realconp == NULL)
+        {
+            LOG(LOG_ERR, "Loader worker %u cannot connect to DSN %s: %s",
+                loader.worker, scmp->dsn, errmsg);
+            freescm(scmp);
+            free((void *)tdir);
+            return (-1);
+        }
+        sta = setidpartscm(realconp, loader.worker, nworkers);
+        loader.scmp = scmp;
+        loader.conp = realconp;
+        track_validated_certs(realconp, true);
+    }
+    /*
+     * Bulk loads look up the directory of every object, so fetch all known
+     * directories at once. Likewise, every object needs a certification
+     * path, so index the certificate table.
+     */
+    if (sta == 0 &&
+        ((use_filelist + do_sockopts + do_fileopts) > 0 || bulkdir != NULL))
+    {
+        err_code fsta = fill_dir_cache(scmp, realconp);
+        if (fsta < 0)
+            LOG(LOG_WARNING, "Could not preload directory cache: %s",
+                err2string(fsta));
+        fsta = load_cert_index(scmp, realconp);
+        if (fsta < 0)
+            LOG(LOG_WARNING, "Could not load certificate index: %s",
+                err2string(fsta));
+    }
+    if (sta == 0)
+        set_manifest_hash_threads(realconp,
+                                  CONFIG_RPKI_MANIFEST_HASH_THREADS_get());
     /*
      * Setup for actual SSL operations
      */
     OpenSSL_add_all_algorithms();
     ERR_load_crypto_strings();
+    batch_init();
+    if (sta == 0 && (do_sockopts + do_fileopts) > 0)
+        dirty_init(realconp);
     LOG(LOG_NOTICE, "Rsync client session started");
     if (thefile != NULL && sta == 0)
     {
@@ -1179,6 +2881,7 @@ int main(
                 LOG(LOG_WARNING, "%s is not in the repository", line);
 
             // Add
+            batch_begin_op(realconp);
             status = add_object(scmp, realconp, outfile, outdir, outfull,
                                 trusted);
             if (status == 0)
@@ -1196,13 +2899,20 @@ int main(
                         LOG(LOG_ERR, "\t%s", ne);
                 }
             }
+            batch_end_op(realconp, status);
             free((void *)outdir);
             free((void *)outfile);
             free((void *)outfull);
         }
 
+        (void)batch_commit(realconp);
         free(line);
     }
+    if (bulkdir != NULL && sta == 0)
+    {
+        setallowexpired(allowex);
+        sta = bulkload(scmp, realconp, bulkdir);
+    }
     if (thedelfile != NULL && sta == 0)
     {
         sta = splitdf(NULL, NULL, thedelfile, &outdir, &outfile, &outfull);
@@ -1236,11 +2946,15 @@ int main(
         int protos = (-1);
         const int max_makesock_attempts = 10;
         int makesock_failures = 0;
+        if (do_sockopts > 0)
+            prefetch_start();
         do
         {
             if (do_sockopts > 0)
             {
-                uint16_t port = CONFIG_RPKI_PORT_get();
+                uint16_t port = CONFIG_RPKI_PORT_get() + loader.worker;
+                if (protos >= 0)
+                    handoff_wait(protos);
                 s = makesock(port, &protos);
                 if (s < 0)
                 {
@@ -1292,9 +3006,20 @@ int main(
                 }
             }
         } while (perpetual > 0);
+        prefetch_stop();
         if (protos >= 0)
             (void)close(protos);
     }
+    if (realconp != NULL)
+    {
+        size_t hits;
+        size_t misses;
+
+        /** @bug ignores error code without explanation */
+        sigval_cache_flush(realconp);
+        sigval_cache_stats(realconp, &hits, &misses);
+        LOG(LOG_INFO, "Signature cache: %zu hits, %zu misses", hits, misses);
+    }
     sqcleanup();
     if (realconp != NULL)
         disconnectscm(realconp);
@@ -139,6 +139,16 @@ get_casn_file(
     const char *,
     int);
 
+/*
+ * Like get_casn_file(), but decode the contents of a file that has already
+ * been read into memory.
+ */
+int
+get_casn_buf(
+    struct casn *casnp,
+    uchar *,
+    long);
+
 int
 num_items(
     struct casn *casnp);
@@ -15,6 +15,7 @@ Cambridge, Ma. 02138
 
 #include "casn.h"
 #include "casn_private.h"
+#include "util/file.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -30,43 +31,26 @@ int get_casn_file(
     const char *name,
     int fd)
 {
-    long siz;
+    struct file_contents contents;
+    int ret;
+
+    // if name is NULL, we were passed an active file descriptor
+    if (name ? !file_contents_open(&contents, name) :
+        !file_contents_fd(&contents, fd))
+        return _casn_obj_err(casnp, ASN_FILE_ERR);
+    ret = get_casn_buf(casnp, contents.data, contents.size);
+    file_contents_close(&contents);
+    return ret;
+}
+
+int get_casn_buf(
+    struct casn *casnp,
+    uchar *b,
+    long siz)
+{
     long tmp;
-    uchar *b;
     uchar *c;
 
-    // if name is NULL, we were passed an active file descriptor
-    if (name)
-    {
-        struct stat statbuf;
-        if (stat(name, &statbuf) < 0 ||
-            !(b = (uchar *) calloc(1, statbuf.st_size + 4)) ||
-            (fd = open(name, (O_RDONLY | O_DOS))) < 0 ||
-            (siz = read(fd, b, statbuf.st_size + 1)) < 0)
-            return _casn_obj_err(casnp, ASN_FILE_ERR);
-        close(fd);
-    }
-    else
-    {
-        for (siz = 2048, b = c = (uchar *) calloc(1, siz); 1;)
-        {
-            if ((tmp = read(fd, c, 2048)) == 2048)
-            {
-                b = (uchar *) realloc(b, siz + 2048);
-                c = &b[siz];
-                siz += 2048;
-            }
-            else if (tmp < 0)
-            {
-                if (name)
-                    close(fd);  // if we opened it
-                return _casn_obj_err(casnp, ASN_FILE_ERR);
-            }
-            else
-                break;
-        }
-        siz = (siz - 1024 + tmp);
-    }
     // defend against a truncated file
     c = b;
     tmp = _get_tag(&c);
@@ -75,14 +59,9 @@ int get_casn_file(
     {
         tmp += (c - b);
         if (tmp != siz)
-        {
-            free(b);
             return _casn_obj_err(casnp, ASN_FILE_SIZE_ERR);
-        }
     }
-    tmp = decode_casn_lth(casnp, b, siz);
-    free(b);
-    return tmp;
+    return decode_casn_lth(casnp, b, siz);
 }
 
 int put_casn_file(
@@ -249,16 +249,6 @@ static const struct config_option config_options[] = {
      NULL, NULL,
      "\"" PKGCACHEDIR "\""},
 
-    // CONFIG_VRS_CACHE_DIR
-    {
-      "VRSCacheDir",
-      false,
-      config_type_path_converter, NULL,
-      config_type_path_converter_inverse, NULL,
-      free,
-      NULL, NULL,
-      "\"" VRSCACHEDIR "\""},
-
     // CONFIG_LOG_DIR
     {
      "LogDir",
@@ -289,6 +279,72 @@ static const struct config_option config_options[] = {
      free,
      NULL, NULL,
      "\"" PKGVARLIBDIR "/statistics\""},
+
+    // CONFIG_RPKI_LOADER_BATCH_SIZE
+    {
+     "RPKILoaderBatchSize",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "1000"},
+
+    // CONFIG_RPKI_LOADER_BATCH_INTERVAL
+    {
+     "RPKILoaderBatchInterval",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "2000"},
+
+    // CONFIG_RPKI_LOADER_WORKERS
+    {
+     "RPKILoaderWorkers",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "1"},
+
+    // CONFIG_RPKI_LOADER_PREFETCH
+    {
+     "RPKILoaderPrefetch",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "32"},
+
+    // CONFIG_RPKI_LOADER_REVALIDATE_INTERVAL
+    {
+     "RPKILoaderRevalidateInterval",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "0"},
+
+    // CONFIG_RPKI_MANIFEST_HASH_THREADS
+    {
+     "RPKIManifestHashThreads",
+     false,
+     config_type_sscanf_converter, &config_type_sscanf_arg_size_t,
+     config_type_sscanf_converter_inverse,
+     &config_type_sscanf_inverse_arg_size_t,
+     free,
+     NULL, NULL,
+     "4"},
 };
 
 
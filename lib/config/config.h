@@ -83,10 +83,15 @@ enum config_key {
     CONFIG_TEMPLATE_MANIFEST,
     CONFIG_TEMPLATE_ROA,
     CONFIG_RPKI_CACHE_DIR,
-    CONFIG_VRS_CACHE_DIR,
     CONFIG_LOG_DIR,
     CONFIG_LOG_RETENTION,
     CONFIG_RPKI_STATISTICS_DIR,
+    CONFIG_RPKI_LOADER_BATCH_SIZE,
+    CONFIG_RPKI_LOADER_BATCH_INTERVAL,
+    CONFIG_RPKI_LOADER_WORKERS,
+    CONFIG_RPKI_LOADER_PREFETCH,
+    CONFIG_RPKI_LOADER_REVALIDATE_INTERVAL,
+    CONFIG_RPKI_MANIFEST_HASH_THREADS,
 
     CONFIG_NUM_OPTIONS
 };
@@ -134,10 +139,15 @@ CONFIG_GET_HELPER(CONFIG_TEMPLATE_CRL, char)
 CONFIG_GET_HELPER(CONFIG_TEMPLATE_MANIFEST, char)
 CONFIG_GET_HELPER(CONFIG_TEMPLATE_ROA, char)
 CONFIG_GET_HELPER(CONFIG_RPKI_CACHE_DIR, char)
-CONFIG_GET_HELPER(CONFIG_VRS_CACHE_DIR, char)
 CONFIG_GET_HELPER(CONFIG_LOG_DIR, char)
 CONFIG_GET_HELPER_DEREFERENCE(CONFIG_LOG_RETENTION, size_t)
 CONFIG_GET_HELPER(CONFIG_RPKI_STATISTICS_DIR, char)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_LOADER_BATCH_SIZE, size_t)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_LOADER_BATCH_INTERVAL, size_t)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_LOADER_WORKERS, size_t)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_LOADER_PREFETCH, size_t)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_LOADER_REVALIDATE_INTERVAL, size_t)
+CONFIG_GET_HELPER_DEREFERENCE(CONFIG_RPKI_MANIFEST_HASH_THREADS, size_t)
 
 
 
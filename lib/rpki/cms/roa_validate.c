@@ -11,6 +11,7 @@
 #include "roa_utils.h"
 #include "rpki-object/certificate.h"
 #include "util/cryptlib_compat.h"
+#include "util/file.h"
 #include "util/logging.h"
 #include "util/hashutils.h"
 
@@ -243,32 +244,28 @@ int check_fileAndHash(
     int inhashlen,
     int inhashtotlen)
 {
-    uchar *contentsp;
+    struct file_contents contents;
+    uchar contentsp[40];        // the largest hash gen_hash() makes
     err_code err = 0;
     int hash_lth;
     int bit_lth;
-    int name_lth = lseek(ffd, 0, SEEK_END);
 
-    lseek(ffd, 0, SEEK_SET);
-    contentsp = (uchar *) calloc(1, name_lth + 2);
-    if (read(ffd, contentsp, name_lth + 2) != name_lth)
-    {
-        free(contentsp);
-        return (ERR_SCM_BADFILE);
-    }
-    if (inhash != NULL && inhashlen > 0 && inhashlen <= (name_lth + 2))
+    if (inhash != NULL && inhashlen > 0 && inhashlen <= (int)sizeof(contentsp))
     {
         memcpy(contentsp, inhash, inhashlen);
         hash_lth = inhashlen;
     }
     else
     {
-        hash_lth = gen_hash(contentsp, name_lth, contentsp, CRYPT_ALGO_SHA2);
+        // hash the file where it lies, without copying it
+        if (lseek(ffd, 0, SEEK_SET) != 0 ||
+            !file_contents_fd(&contents, ffd))
+            return (ERR_SCM_BADFILE);
+        hash_lth = gen_hash(contents.data, contents.size, contentsp,
+                            CRYPT_ALGO_SHA2);
+        file_contents_close(&contents);
         if (hash_lth < 0)
-        {
-            free(contentsp);
             return (ERR_SCM_BADMKHASH);
-        }
     }
     bit_lth = vsize_casn(&fahp->hash);
     uchar *hashp = (uchar *) calloc(1, bit_lth);
@@ -280,7 +277,6 @@ int check_fileAndHash(
     if (inhash != NULL && inhashtotlen >= hash_lth && inhashlen == 0
         && err == 0)
         memcpy(inhash, contentsp, hash_lth);
-    free(contentsp);
     return err == 0 ? hash_lth : err;
 }
 
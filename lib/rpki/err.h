@@ -174,6 +174,7 @@
     f(ERR_SCM_TRUNCATED, "Truncated data")                              \
     f(ERR_SCM_BREAK, "Stop iteration (no error)")                       \
     f(ERR_SCM_UNRES, "Certificate unnested resource")           \
+    f(ERR_SCM_NOIDS, "Local ID space exhausted")                        \
     // end of error codes list
 
 #define ERROR_ENUM_POS(NAME, DESCR) POS_##NAME,
@@ -405,7 +405,7 @@ display_ip_addrs(
     scmkv where_cols[1];
     scmkva where;
     char * order;
-    scmsrcha srch;
+    scmsrcha srch = {0};
 
     select[0].colno = 1;
     select[0].sqltype = SQL_C_BINARY;
@@ -2,6 +2,7 @@
 #define LIB_RPKI_SCMF_H
 
 #include "err.h"
+#include "util/hashtable.h"
 #include "util/macros.h"
 
 #include <inttypes.h>
@@ -24,12 +25,34 @@ typedef struct _stmtstk {
     struct _stmtstk *next;
 } stmtstk;
 
+/*
+ * Allocator for the integer ids (local_id, dir_id) of one table. The next
+ * id is handed out from memory instead of running SELECT MAX() before every
+ * insert.
+ */
+typedef struct _scmidalloc {
+    char *tabname;              /* table the ids belong to */
+    char *field;                /* id column */
+    unsigned int next;          /* next id to hand out */
+    unsigned int last;          /* last id of the current block */
+    struct _scmidalloc *nextp;
+} scmidalloc;
+
 typedef struct _scmcon          /* connection info */
 {
     SQLHENV henv;               /* environment handle */
     SQLHDBC hdbc;               /* database handle */
     stmtstk *hstmtp;            /* stack of statement handles */
     int connected;              /* are we connected? */
+    int intxn;                  /* inside an explicit transaction? */
+    scmidalloc *ids;            /* id allocators, one per table */
+    unsigned int idpart;        /* this process's share of the id space */
+    unsigned int nidparts;      /* number of shares (0 or 1: all ids) */
+    HashTable *dirids;          /* dirname -> dir_id cache */
+    size_t ndirtentative;       /* cached dirs created in the open txn */
+    HashTable *stmts;           /* prepared searches, keyed by SQL text */
+    void *vctx;                 /* state of higher layers (see sqhl.c) */
+    void (*freevctx)(void *);   /* frees vctx in disconnectscm() */
     scmstat mystat;             /* statistics and errors */
 } scmcon;
 
@@ -67,6 +90,9 @@ typedef struct _scmsrcha        /* used for a search (select) */
     scmkva *where;              /* optional "where" conditionals */
     char *wherestr;             /* optional "where" string */
     void *context;              /* context to be passed from callback */
+    const char **params;        /* values for ? markers in wherestr (not
+                                 * freed by freesrchscm) */
+    int nparams;                /* number of elements in params */
 } scmsrcha;
 
 /**
@@ -89,6 +115,29 @@ sqlvaluefunc(
     scmsrcha *s,
     ssize_t idx);
 
+/*
+ * A block of search results fetched by searchblockscm(). The values of
+ * column i are stored one after another in vals[i], each taking
+ * s->vec[i].valsize bytes, and lens[i] holds their lengths (or
+ * SQL_NULL_DATA). Use blockvalscm() to get at a single value.
+ */
+typedef struct _scmblock {
+    size_t nrows;               /* rows in this block */
+    ssize_t first;              /* index of the first row, from 1 */
+    void **vals;                /* per column values */
+    SQLLEN **lens;              /* per column lengths */
+} scmblock;
+
+/**
+ * @brief
+ *     callback function signature for a block of search results
+ */
+typedef err_code
+sqlblockfunc(
+    scmcon *conp,
+    scmsrcha *s,
+    scmblock *blk);
+
 // bitfields for how to do a search
 
 #define SCM_SRCH_DOCOUNT         0x1    /* call count func */
@@ -242,6 +291,41 @@ statementscm_no_data(
     scmcon *conp,
     char *stm);
 
+/*
+ * Explicit transaction control. By default every statement is committed on
+ * its own; begintxnscm() opens a transaction that stays open until
+ * committxnscm() or rollbacktxnscm() is called. Savepoints may only be used
+ * inside such a transaction. Note that InnoDB rolls back the entire
+ * transaction (and forgets its savepoints) on a deadlock or lock wait
+ * timeout, so callers must be prepared for rollbacktosavepointscm() to fail.
+ */
+err_code
+begintxnscm(
+    scmcon *conp);
+
+err_code
+committxnscm(
+    scmcon *conp);
+
+err_code
+rollbacktxnscm(
+    scmcon *conp);
+
+err_code
+savepointscm(
+    scmcon *conp,
+    char *name);
+
+err_code
+rollbacktosavepointscm(
+    scmcon *conp,
+    char *name);
+
+err_code
+releasesavepointscm(
+    scmcon *conp,
+    char *name);
+
 /*
  * Create a database and grant the mysql default user the standard set of
  * privileges for that database.
@@ -279,6 +363,41 @@ insertscm(
     scmtab *tabp,
     scmkva *arr);
 
+/*
+ * Cache of the rpki_dir table, mapping directory names to dir_id values, for
+ * the lifetime of the connection. Directories created inside an explicit
+ * transaction are dropped from the cache if the transaction (or a savepoint)
+ * is rolled back. deletescm() on the directory table clears the cache.
+ */
+
+/*
+ * Look up a directory in the cache. Returns 1 and sets *idp on a hit, 0 on a
+ * miss.
+ */
+int
+getdircachescm(
+    scmcon *conp,
+    const char *dirname,
+    unsigned int *idp);
+
+/*
+ * Add a directory to the cache. "created" indicates that the directory row
+ * was just inserted on this connection.
+ */
+void
+putdircachescm(
+    scmcon *conp,
+    const char *dirname,
+    unsigned int id,
+    int created);
+
+/*
+ * Empty the directory cache.
+ */
+void
+cleardircachescm(
+    scmcon *conp);
+
 /*
  * Get the maximum of the specified id field of the given table.  If table is
  * empty, then sets *ival to 0.
@@ -296,6 +415,52 @@ getuintscm(
     scmcon *conp,
     unsigned int *ival);
 
+/*
+ * Size of the blocks that the id space is divided into when several
+ * processes load into the same database. See setidpartscm().
+ */
+#define SCM_ID_BLOCK_SIZE 4096
+
+/*
+ * Get a fresh value for the specified id field of the given table. The
+ * allocator for the table is seeded with getmaxidscm() the first time it is
+ * used on a connection; after that ids are handed out from memory, so every
+ * other insert into that table must also go through this function (or the
+ * allocator must be reset with resetidsscm()). Ids handed out for inserts
+ * that are later rolled back are not reused.
+ */
+err_code
+getnextidscm(
+    scm *scmp,
+    scmcon *conp,
+    char *field,
+    scmtab *mtab,
+    unsigned int *ival);
+
+/*
+ * Let several processes allocate ids for the same tables concurrently
+ * without colliding. The id space is divided into blocks of
+ * SCM_ID_BLOCK_SIZE ids, and this connection only hands out ids from every
+ * nparts-th block, starting with block number part. All processes loading
+ * concurrently must use the same nparts and distinct values of part. This
+ * resets any allocators already seeded on the connection.
+ */
+err_code
+setidpartscm(
+    scmcon *conp,
+    unsigned int part,
+    unsigned int nparts);
+
+/*
+ * Forget all id allocators of a connection so that they are seeded again
+ * from the database on next use. Reseeding discards the rest of the current
+ * block, so this is only done when the connection's share of the id space
+ * changes (see setidpartscm()), not between loads.
+ */
+void
+resetidsscm(
+    scmcon *conp);
+
 /**
  * @brief
  *     searches in a database table for entries that match the stated
@@ -305,7 +470,17 @@ getuintscm(
  * be more than one cursor open at a time.  For this reason,
  * searchscm() must create its own STMT and then destroy it when it is
  * done.
+ *
+ * Searches are run as prepared statements. The values of the "where"
+ * array are always passed as parameters, and wherestr may contain ?
+ * markers whose values are given, in order, in srch->params. Statements
+ * with no values written into wherestr are kept on the connection (up to
+ * SCM_STMT_CACHE_SIZE of them) and reused by later searches of the same
+ * shape, so callers should prefer ? markers over formatting values into
+ * wherestr.
  */
+#define SCM_STMT_CACHE_SIZE 128
+
 err_code
 searchscm(
     scmcon *conp,
@@ -316,6 +491,42 @@ searchscm(
     int what,
     char *orderp);
 
+/**
+ * @brief
+ *     like searchscm(), but fetches up to maxrows rows at a time and
+ *     hands each block of rows to a single call of blocker
+ *
+ * The valptr fields of srch are not used; the rows are written to
+ * buffers allocated for the duration of the search. Only the join
+ * flags and SCM_SRCH_BREAK_VERR of "what" are used. Because every
+ * column takes maxrows * valsize bytes, keep maxrows small for wide
+ * columns.
+ *
+ * @return 0 on success, ERR_SCM_NODATA if there were no rows, or
+ *     another error code
+ */
+err_code
+searchblockscm(
+    scmcon *conp,
+    scmtab *tabp,
+    scmsrcha *srch,
+    sqlblockfunc *blocker,
+    int what,
+    char *orderp,
+    size_t maxrows);
+
+#define SCM_BLOCK_ROWS 512
+
+/*
+ * Get a value out of a block of results. Returns NULL if the value is
+ * NULL in the database.
+ */
+void *blockvalscm(
+    scmsrcha *srch,
+    scmblock *blk,
+    int col,
+    size_t row);
+
 /*
  * Add a new column to a search array. Note that this function does not grow
  * the size of the column array, so enough space must have already been
@@ -42,7 +42,9 @@ static scmtab scmtabbuilder[] = {
     {                           /* RPKI_CERT */
      /*
       * Usage notes: valfrom and valto are stored in GMT. local_id is a unique
-      * identifier with the new one obtained via max(local_id) + 1
+      * identifier handed out by getnextidscm(). vrs is the verified
+      * resource set of the certificate (RFC 8360), as written by
+      * add_cert_validation_reconsidered().
       */
      "rpki_cert",
      "CERTIFICATE",
@@ -66,7 +68,7 @@ static scmtab scmtabbuilder[] = {
      "ipb      BLOB,"
      "ts_mod   TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,"
      "local_id INT UNSIGNED NOT NULL UNIQUE,"
-     "vrs_file  VARCHAR(4096),"
+     "vrs      MEDIUMBLOB,"
      "         PRIMARY KEY (filename, dir_id),"
      "         KEY ski (ski, subject),"
      "         KEY aki (aki, issuer),"
@@ -78,15 +80,17 @@ static scmtab scmtabbuilder[] = {
     {                           /* RPKI_CRL */
      /*
       * Usage notes: this_upd and next_upd are stored in GMT. local_id is a
-      * unique identifier obtained as max(local_id) + 1 issuer is the actual
+      * unique identifier handed out by getnextidscm(). issuer is the actual
       * CRL issuer, obtained from the issuer field of the CRL (direct CRL).
       * snlist is the list of serial numbers for this issuer. It is an array
       * of 20-byte network byte order unsigned ints that are left-padded with
-      * zeroes to each be exactly 20 bytes long. The number of serials in the
-      * list is snlen. Some of these revocations may already have happened and
-      * the corresponding sn set to 0 in the list. sninuse keeps track of the
-      * number of serial numbers that are not zero in the list.  When this
-      * number drops to 0, the entire CRL may be deleted from the DB.
+      * zeroes to each be exactly 20 bytes long, sorted in ascending order.
+      * The number of serials in the list is snlen. Some of these revocations
+      * may already have happened and the corresponding sn set to 0 in the
+      * list. sninuse keeps track of the number of serial numbers that are
+      * not zero in the list.  When this number drops to 0, the entire CRL
+      * may be deleted from the DB. ts_mod is when the row last changed;
+      * garbage only sweeps CRLs changed since rpki_metadata.crl_swept.
       *
       * Note that snlist is of type MEDIUMBLOB, indicating that it can hold at
       * most 16M/20 = 838860 entries.
@@ -107,6 +111,7 @@ static scmtab scmtabbuilder[] = {
      "snlist   MEDIUMBLOB,"
      "flags    INT UNSIGNED DEFAULT 0,"
      "local_id INT UNSIGNED NOT NULL UNIQUE,"
+     "ts_mod   TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,"
      "         PRIMARY KEY (filename, dir_id),"
      "         KEY issuer (issuer),"
      "         KEY aki (aki),"
@@ -197,6 +202,7 @@ static scmtab scmtabbuilder[] = {
      "METADATA",
      "rootdir  VARCHAR(4096) NOT NULL,"
      "inited   TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+     "crl_swept TIMESTAMP NULL DEFAULT NULL,"
      "flags    INT UNSIGNED DEFAULT 0,"
      "local_id INT UNSIGNED DEFAULT 1,"
      "         PRIMARY KEY (local_id)",
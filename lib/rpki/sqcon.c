@@ -3,6 +3,8 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdbool.h>
 
 #include <mysql.h>
 
@@ -70,12 +72,60 @@ static void freehstack(
     }
 }
 
+/*
+ * Free a list of id allocators.
+ */
+
+static void freeidsscm(
+    scmidalloc *ida)
+{
+    scmidalloc *nextp;
+
+    while (ida != NULL)
+    {
+        nextp = ida->nextp;
+        free((void *)ida->tabname);
+        free((void *)ida->field);
+        free((void *)ida);
+        ida = nextp;
+    }
+}
+
+/*
+ * A prepared search statement, cached on the connection by its SQL text.
+ */
+typedef struct _scmpstmt {
+    SQLHSTMT hstmt;
+    int busy;                   /* in use by an active searchscm() */
+} scmpstmt;
+
+static void freepstmt(
+    void *ptr)
+{
+    scmpstmt *ps = (scmpstmt *) ptr;
+
+    if (ps == NULL)
+        return;
+    if (ps->hstmt != NULL)
+        SQLFreeHandle(SQL_HANDLE_STMT, ps->hstmt);
+    free((void *)ps);
+}
+
 void disconnectscm(
     scmcon *conp)
 {
     if (conp == NULL)
         return;
+    if (conp->vctx != NULL && conp->freevctx != NULL)
+        conp->freevctx(conp->vctx);
+    conp->vctx = NULL;
     freehstack(conp->hstmtp);
+    freeidsscm(conp->ids);
+    conp->ids = NULL;
+    HashTable_free(conp->dirids, free);
+    conp->dirids = NULL;
+    HashTable_free(conp->stmts, freepstmt);
+    conp->stmts = NULL;
     if (conp->connected > 0)
     {
         SQLDisconnect(conp->hdbc);
@@ -334,6 +384,216 @@ done:
     return sta;
 }
 
+/*
+ * Run a transaction control statement, optionally naming a savepoint.
+ */
+
+static err_code
+txnstmtscm(
+    scmcon *conp,
+    char *verb,
+    char *savepoint)
+{
+    char stmt[128];
+
+    if (conp == NULL || conp->connected == 0 || verb == NULL)
+        return ERR_SCM_INVALARG;
+    if (savepoint == NULL)
+        xsnprintf(stmt, sizeof(stmt), "%s;", verb);
+    else
+        xsnprintf(stmt, sizeof(stmt), "%s %s;", verb, savepoint);
+    return statementscm_no_data(conp, stmt);
+}
+
+/*
+ * A cached directory entry. Directories created inside an explicit
+ * transaction are tentative until it commits.
+ */
+
+typedef struct _scmdirent {
+    unsigned int id;
+    int tentative;
+} scmdirent;
+
+static bool dirent_tentative(
+    void const *key,
+    size_t key_len,
+    void *value,
+    void *arg)
+{
+    (void)key;
+    (void)key_len;
+    (void)arg;
+    return ((scmdirent *)value)->tentative != 0;
+}
+
+static void dirent_commit(
+    void const *key,
+    size_t key_len,
+    void *value,
+    void *arg)
+{
+    (void)key;
+    (void)key_len;
+    (void)arg;
+    ((scmdirent *)value)->tentative = 0;
+}
+
+/*
+ * Update the directory cache after the open transaction (or part of it) has
+ * been committed or rolled back.
+ */
+
+static void settledircachescm(
+    scmcon *conp,
+    int committed)
+{
+    if (conp->dirids == NULL || conp->ndirtentative == 0)
+        return;
+    if (committed)
+        HashTable_foreach(conp->dirids, dirent_commit, NULL);
+    else
+        (void)HashTable_remove_if(conp->dirids, dirent_tentative, NULL, free);
+    conp->ndirtentative = 0;
+}
+
+int
+getdircachescm(
+    scmcon *conp,
+    const char *dirname,
+    unsigned int *idp)
+{
+    scmdirent *ent;
+
+    if (conp == NULL || conp->dirids == NULL || dirname == NULL)
+        return (0);
+    ent = HashTable_get(conp->dirids, dirname, strlen(dirname));
+    if (ent == NULL)
+        return (0);
+    *idp = ent->id;
+    return (1);
+}
+
+void
+putdircachescm(
+    scmcon *conp,
+    const char *dirname,
+    unsigned int id,
+    int created)
+{
+    scmdirent *ent;
+    void *old = NULL;
+
+    if (conp == NULL || dirname == NULL)
+        return;
+    if (conp->dirids == NULL)
+    {
+        conp->dirids = HashTable_new();
+        if (conp->dirids == NULL)
+            return;
+    }
+    ent = (scmdirent *)malloc(sizeof(scmdirent));
+    if (ent == NULL)
+        return;
+    ent->id = id;
+    ent->tentative = (created && conp->intxn);
+    if (!HashTable_put(conp->dirids, dirname, strlen(dirname), ent, &old))
+    {
+        free((void *)ent);
+        return;
+    }
+    free(old);
+    if (ent->tentative)
+        conp->ndirtentative++;
+}
+
+void
+cleardircachescm(
+    scmcon *conp)
+{
+    if (conp == NULL || conp->dirids == NULL)
+        return;
+    HashTable_clear(conp->dirids, free);
+    conp->ndirtentative = 0;
+}
+
+err_code
+begintxnscm(
+    scmcon *conp)
+{
+    err_code sta;
+
+    if (conp != NULL && conp->intxn != 0)
+        return ERR_SCM_INVALARG;
+    sta = txnstmtscm(conp, "START TRANSACTION", NULL);
+    if (sta == 0)
+        conp->intxn = 1;
+    return (sta);
+}
+
+err_code
+committxnscm(
+    scmcon *conp)
+{
+    err_code sta;
+
+    if (conp == NULL || conp->intxn == 0)
+        return ERR_SCM_INVALARG;
+    sta = txnstmtscm(conp, "COMMIT", NULL);
+    settledircachescm(conp, sta == 0);
+    conp->intxn = 0;
+    return (sta);
+}
+
+err_code
+rollbacktxnscm(
+    scmcon *conp)
+{
+    err_code sta;
+
+    if (conp == NULL || conp->intxn == 0)
+        return ERR_SCM_INVALARG;
+    sta = txnstmtscm(conp, "ROLLBACK", NULL);
+    settledircachescm(conp, 0);
+    conp->intxn = 0;
+    return (sta);
+}
+
+err_code
+savepointscm(
+    scmcon *conp,
+    char *name)
+{
+    if (conp == NULL || conp->intxn == 0 || name == NULL || name[0] == 0)
+        return ERR_SCM_INVALARG;
+    return txnstmtscm(conp, "SAVEPOINT", name);
+}
+
+err_code
+rollbacktosavepointscm(
+    scmcon *conp,
+    char *name)
+{
+    if (conp == NULL || conp->intxn == 0 || name == NULL || name[0] == 0)
+        return ERR_SCM_INVALARG;
+    /*
+     * Tentative entries from before the savepoint are dropped too; they will
+     * simply be looked up again.
+     */
+    settledircachescm(conp, 0);
+    return txnstmtscm(conp, "ROLLBACK TO SAVEPOINT", name);
+}
+
+err_code
+releasesavepointscm(
+    scmcon *conp,
+    char *name)
+{
+    if (conp == NULL || conp->intxn == 0 || name == NULL || name[0] == 0)
+        return ERR_SCM_INVALARG;
+    return txnstmtscm(conp, "RELEASE SAVEPOINT", name);
+}
+
 err_code
 createdbscm(
     scmcon *conp,
@@ -757,6 +1017,123 @@ done:
     return sta;
 }
 
+/*
+ * Position an id allocator at the start of the first block numbered "blk" or
+ * higher that belongs to this connection's share of the id space. Block b
+ * holds the ids b * SCM_ID_BLOCK_SIZE + 1 through (b + 1) * SCM_ID_BLOCK_SIZE.
+ */
+
+static err_code
+idblockscm(
+    scmcon *conp,
+    scmidalloc *ida,
+    unsigned long long blk)
+{
+    unsigned long long first;
+    unsigned long long last;
+
+    if (conp->nidparts <= 1)
+    {
+        ida->last = UINT_MAX;
+        return (0);
+    }
+    blk += (conp->idpart + conp->nidparts - blk % conp->nidparts) %
+        conp->nidparts;
+    first = blk * SCM_ID_BLOCK_SIZE + 1;
+    last = (blk + 1) * SCM_ID_BLOCK_SIZE;
+    if (first > UINT_MAX)
+        return (ERR_SCM_NOIDS);
+    ida->next = (unsigned int)first;
+    ida->last = (last > UINT_MAX) ? UINT_MAX : (unsigned int)last;
+    return (0);
+}
+
+void
+resetidsscm(
+    scmcon *conp)
+{
+    if (conp == NULL)
+        return;
+    freeidsscm(conp->ids);
+    conp->ids = NULL;
+}
+
+err_code
+setidpartscm(
+    scmcon *conp,
+    unsigned int part,
+    unsigned int nparts)
+{
+    if (conp == NULL || (nparts > 0 && part >= nparts))
+        return (ERR_SCM_INVALARG);
+    resetidsscm(conp);
+    conp->idpart = part;
+    conp->nidparts = nparts;
+    return (0);
+}
+
+err_code
+getnextidscm(
+    scm *scmp,
+    scmcon *conp,
+    char *field,
+    scmtab *mtab,
+    unsigned int *ival)
+{
+    scmidalloc *ida;
+    unsigned int mid;
+    err_code sta = 0;
+
+    if (scmp == NULL || conp == NULL || field == NULL || mtab == NULL ||
+        mtab->tabname == NULL || ival == NULL)
+        return (ERR_SCM_INVALARG);
+    for (ida = conp->ids; ida != NULL; ida = ida->nextp)
+    {
+        if (strcmp(ida->tabname, mtab->tabname) == 0 &&
+            strcmp(ida->field, field) == 0)
+            break;
+    }
+    if (ida == NULL)
+    {
+        // first use on this connection: seed from the database
+        sta = getmaxidscm(scmp, conp, field, mtab, &mid);
+        if (sta < 0)
+            return (sta);
+        ida = (scmidalloc *)calloc(1, sizeof(scmidalloc));
+        if (ida == NULL)
+            return (ERR_SCM_NOMEM);
+        ida->tabname = strdup(mtab->tabname);
+        ida->field = strdup(field);
+        if (ida->tabname == NULL || ida->field == NULL)
+        {
+            freeidsscm(ida);
+            return (ERR_SCM_NOMEM);
+        }
+        ida->next = mid + 1;
+        sta = idblockscm(conp, ida,
+                         mid == 0 ? 0 : (mid - 1) / SCM_ID_BLOCK_SIZE);
+        if (sta == 0 && ida->next <= mid)
+            ida->next = mid + 1;
+        if (sta < 0 || mid == UINT_MAX)
+        {
+            freeidsscm(ida);
+            return (ERR_SCM_NOIDS);
+        }
+        ida->nextp = conp->ids;
+        conp->ids = ida;
+    }
+    if (ida->next == 0 || ida->next > ida->last)
+    {
+        if (ida->last == UINT_MAX)
+            return (ERR_SCM_NOIDS);
+        sta = idblockscm(conp, ida, ida->last / SCM_ID_BLOCK_SIZE);
+        if (sta < 0)
+            return (sta);
+    }
+    *ival = ida->next++;
+    return (0);
+}
+
 /**
  * @brief
  *     Validate a search array struct
@@ -793,30 +1170,232 @@ validsrchscm(
     return (0);
 }
 
-err_code
-searchscm(
+/*
+ * Parameter storage for one execution of a search. The buffers must stay
+ * valid from binding until the statement has been executed.
+ */
+typedef struct _paramdata {
+    int nparams;
+    SQLLEN *lens;               /* length of each parameter value */
+    void **bufs;                /* decoded ^x values, NULL otherwise */
+} paramdata;
+
+static void freeparambufs(
+    paramdata *pd)
+{
+    int i;
+
+    if (pd == NULL)
+        return;
+    if (pd->bufs != NULL)
+    {
+        for (i = 0; i < pd->nparams; i++)
+            if (pd->bufs[i] != NULL)
+                free(pd->bufs[i]);
+        free((void *)pd->bufs);
+    }
+    if (pd->lens != NULL)
+        free((void *)pd->lens);
+    free((void *)pd);
+}
+
+/*
+ * Get a prepared statement handle for the SELECT in stmt. Cacheable
+ * statements are prepared once per connection and reused by later searches
+ * of the same shape. If the cached statement is already in use (searchscm()
+ * was called recursively from a value callback), or the cache is full, a
+ * private statement is prepared and *cachedp is set to NULL.
+ */
+static err_code
+preparesrchscm(
+    scmcon *conp,
+    char *stmt,
+    int cacheable,
+    SQLHSTMT *hstmtp,
+    scmpstmt **cachedp)
+{
+    scmpstmt *ps = NULL;
+    SQLHSTMT hstmt = NULL;
+    SQLRETURN rc;
+    size_t len = strlen(stmt);
+
+    *hstmtp = NULL;
+    *cachedp = NULL;
+    if (cacheable && conp->stmts != NULL)
+    {
+        ps = (scmpstmt *) HashTable_get(conp->stmts, stmt, len);
+        if (ps != NULL && ps->busy == 0)
+        {
+            ps->busy = 1;
+            *hstmtp = ps->hstmt;
+            *cachedp = ps;
+            return (0);
+        }
+    }
+    rc = SQLAllocHandle(SQL_HANDLE_STMT, conp->hdbc, &hstmt);
+    if (!SQLOK(rc))
+        return (ERR_SCM_SQL);
+    rc = SQLSetStmtAttr(hstmt, SQL_ATTR_NOSCAN,
+                        (SQLPOINTER) SQL_NOSCAN_ON, SQL_IS_UINTEGER);
+    if (SQLOK(rc))
+    {
+        memset(conp->mystat.errmsg, 0, conp->mystat.emlen);
+        rc = SQLPrepare(hstmt, (SQLCHAR *) stmt, len);
+        if (!SQLOK(rc))
+        {
+            LOG(LOG_ERR, "SQLPrepare() failed for statement: %s", stmt);
+            heer(SQL_HANDLE_STMT, hstmt,
+                 conp->mystat.errmsg, conp->mystat.emlen);
+        }
+    }
+    if (!SQLOK(rc))
+    {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return (ERR_SCM_SQL);
+    }
+    *hstmtp = hstmt;
+    // a busy entry stays where it is; this statement is private
+    if (!cacheable || ps != NULL)
+        return (0);
+    if (conp->stmts == NULL)
+        conp->stmts = HashTable_new();
+    if (conp->stmts == NULL ||
+        HashTable_size(conp->stmts) >= SCM_STMT_CACHE_SIZE)
+        return (0);
+    ps = (scmpstmt *) calloc(1, sizeof(scmpstmt));
+    if (ps == NULL)
+        return (0);
+    ps->hstmt = hstmt;
+    ps->busy = 1;
+    if (!HashTable_put(conp->stmts, stmt, len, ps, NULL))
+    {
+        free((void *)ps);
+        return (0);
+    }
+    *cachedp = ps;
+    return (0);
+}
+
+/*
+ * Done with a search statement: close its cursor and either return it to
+ * the cache or free it.
+ */
+static void
+releasesrchscm(
+    SQLHSTMT hstmt,
+    scmpstmt *cached)
+{
+    if (cached == NULL)
+    {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return;
+    }
+    SQLFreeStmt(hstmt, SQL_CLOSE);
+    SQLFreeStmt(hstmt, SQL_UNBIND);
+    SQLFreeStmt(hstmt, SQL_RESET_PARAMS);
+    cached->busy = 0;
+}
+
+/*
+ * Bind the values of the "where" array, followed by srch->params, to the
+ * parameter markers of a prepared search. A "where" value beginning with
+ * ^x is hex-encoded binary, as for quote_value().
+ */
+static err_code
+bindsrchscm(
+    scmcon *conp,
+    SQLHSTMT hstmt,
+    scmsrcha *srch,
+    paramdata **pdp)
+{
+    paramdata *pd;
+    const char *val;
+    SQLPOINTER valp;
+    SQLSMALLINT ctype;
+    SQLSMALLINT sqltype;
+    SQLRETURN rc;
+    int nwhere = (srch->where == NULL) ? 0 : srch->where->nused;
+    int i;
+
+    *pdp = NULL;
+    if (nwhere + srch->nparams == 0)
+        return (0);
+    pd = (paramdata *) calloc(1, sizeof(paramdata));
+    if (pd == NULL)
+        return (ERR_SCM_NOMEM);
+    *pdp = pd;
+    pd->nparams = nwhere + srch->nparams;
+    pd->lens = (SQLLEN *) calloc(pd->nparams, sizeof(SQLLEN));
+    pd->bufs = (void **)calloc(pd->nparams, sizeof(void *));
+    if (pd->lens == NULL || pd->bufs == NULL)
+        return (ERR_SCM_NOMEM);
+    for (i = 0; i < pd->nparams; i++)
+    {
+        if (i < nwhere)
+            val = srch->where->vec[i].value;
+        else
+            val = srch->params[i - nwhere];
+        if (val == NULL)
+            return (ERR_SCM_INVALARG);
+        if (i < nwhere && strncmp(val, "^x", 2) == 0)
+        {
+            pd->lens[i] = strlen(val + 2) / 2;
+            if (pd->lens[i] > 0)
+            {
+                pd->bufs[i] = unhexify(strlen(val + 2), val + 2);
+                if (pd->bufs[i] == NULL)
+                    return (ERR_SCM_INVALARG);
+            }
+            valp = (pd->bufs[i] != NULL) ? pd->bufs[i] : (SQLPOINTER) "";
+            ctype = SQL_C_BINARY;
+            sqltype = SQL_VARBINARY;
+        }
+        else
+        {
+            pd->lens[i] = strlen(val);
+            valp = (SQLPOINTER) val;
+            ctype = SQL_C_CHAR;
+            sqltype = SQL_VARCHAR;
+        }
+        rc = SQLBindParameter(hstmt, (SQLUSMALLINT) (i + 1),
+                              SQL_PARAM_INPUT, ctype, sqltype,
+                              (pd->lens[i] > 0) ? pd->lens[i] : 1, 0,
+                              valp, pd->lens[i], &pd->lens[i]);
+        if (!SQLOK(rc))
+        {
+            LOG(LOG_ERR, "SQLBindParameter() failed for parameter %d",
+                i + 1);
+            heer(SQL_HANDLE_STMT, hstmt,
+                 conp->mystat.errmsg, conp->mystat.emlen);
+            return (ERR_SCM_SQL);
+        }
+    }
+    return (0);
+}
+
+/*
+ * Build the SELECT for a search, then prepare and execute it. On success
+ * the caller owns *hstmtp and must hand it to releasesrchscm().
+ */
+static err_code
+execsrchscm(
     scmcon *conp,
     scmtab *tabp,
     scmsrcha *srch,
-    sqlcountfunc *cnter,
-    sqlvaluefunc *valer,
     int what,
-    char *orderp)
+    char *orderp,
+    SQLHSTMT *hstmtp,
+    scmpstmt **cachedp)
 {
-    SQLLEN nrows = 0;
     SQLRETURN rc;
-    scmsrch *vecp;
     char *stmt = NULL;
-    char *quoted = NULL;
-    int docall;
+    SQLHSTMT hstmt = NULL;
+    scmpstmt *cached = NULL;
+    paramdata *pbufs = NULL;
     int leen = 100;
     err_code sta = 0;
-    int nfnd = 0;
     int bset = 0;
-    ssize_t ridx = 0;
-    int nok = 0;
     int didw = 0;
-    int fnd;
     int i;
 
     // validate arguments
@@ -849,10 +1428,7 @@ searchscm(
     if (srch->where != NULL)
     {
         for (i = 0; i < srch->where->nused; i++)
-        {
             leen += strlen(srch->where->vec[i].column) + 9;
-            leen += 2 * strlen(srch->where->vec[i].value);
-        }
     }
     if (srch->wherestr != NULL)
         leen += strlen(srch->wherestr) + 24;
@@ -897,31 +1473,12 @@ searchscm(
     {
         didw++;
         (void)strcat(stmt, " WHERE ");
-        (void)strcat(stmt, srch->where->vec[0].column);
-        (void)strcat(stmt, "=");
-        sta = quote_value(srch->where->vec[0].value, &quoted);
-        if (sta < 0)
-        {
-            free(stmt);
-            return sta;
-        }
-        (void)strcat(stmt, quoted);
-        free(quoted);
-        quoted = NULL;
-        for (i = 1; i < srch->where->nused; i++)
+        for (i = 0; i < srch->where->nused; i++)
         {
-            (void)strcat(stmt, " AND ");
+            if (i > 0)
+                (void)strcat(stmt, " AND ");
             (void)strcat(stmt, srch->where->vec[i].column);
-            (void)strcat(stmt, "=");
-            sta = quote_value(srch->where->vec[i].value, &quoted);
-            if (sta < 0)
-            {
-                free(stmt);
-                return sta;
-            }
-            (void)strcat(stmt, quoted);
-            free(quoted);
-            quoted = NULL;
+            (void)strcat(stmt, "=?");
         }
     }
     if ((srch->wherestr != NULL) && !(what & SCM_SRCH_DO_JOIN_SELF))
@@ -937,21 +1494,68 @@ searchscm(
 
     (void)strcat(stmt, ";");
 
-    // execute the select statement
-    rc = newhstmt(conp);
-    if (!SQLOK(rc))
+    /*
+     * Prepare (or reuse) the select statement and execute it with the
+     * values of the "where" array and srch->params bound to its parameter
+     * markers. A wherestr without params may have values baked into it, so
+     * such statements are not worth keeping.
+     */
+    sta = preparesrchscm(conp, stmt,
+                         srch->wherestr == NULL || srch->nparams > 0,
+                         &hstmt, &cached);
+    free((void *)stmt);
+    if (sta < 0)
+        return (sta);
+    sta = bindsrchscm(conp, hstmt, srch, &pbufs);
+    if (sta == 0)
     {
-        free((void *)stmt);
-        return (ERR_SCM_SQL);
+        memset(conp->mystat.errmsg, 0, conp->mystat.emlen);
+        rc = SQLExecute(hstmt);
+        if (!SQLOK(rc))
+        {
+            LOG(LOG_ERR, "SQLExecute() failed:");
+            heer(SQL_HANDLE_STMT, hstmt,
+                 conp->mystat.errmsg, conp->mystat.emlen);
+            sta = ERR_SCM_SQL;
+        }
     }
-    sta = statementscm(conp, stmt);
-    free((void *)stmt);
+    freeparambufs(pbufs);
     if (sta < 0)
     {
-        SQLCloseCursor(conp->hstmtp->hstmt);
-        pophstmt(conp);
+        releasesrchscm(hstmt, cached);
         return (sta);
     }
+    *hstmtp = hstmt;
+    *cachedp = cached;
+    return (0);
+}
+
+err_code
+searchscm(
+    scmcon *conp,
+    scmtab *tabp,
+    scmsrcha *srch,
+    sqlcountfunc *cnter,
+    sqlvaluefunc *valer,
+    int what,
+    char *orderp)
+{
+    SQLLEN nrows = 0;
+    SQLRETURN rc;
+    scmsrch *vecp;
+    SQLHSTMT hstmt = NULL;
+    scmpstmt *cached = NULL;
+    int docall;
+    err_code sta = 0;
+    int nfnd = 0;
+    ssize_t ridx = 0;
+    int nok = 0;
+    int fnd;
+    int i;
+
+    sta = execsrchscm(conp, tabp, srch, what, orderp, &hstmt, &cached);
+    if (sta < 0)
+        return (sta);
     // count rows and call counter function if requested
     if ((what & SCM_SRCH_DOCOUNT) && cnter != NULL)
     {
@@ -976,21 +1580,19 @@ searchscm(
          *     There may be alternative ways to reliably get the
          *     count; see http://stackoverflow.com/q/243782
          */
-        rc = SQLRowCount(conp->hstmtp->hstmt, &nrows);
+        rc = SQLRowCount(hstmt, &nrows);
         if (!SQLOK(rc) && (what & SCM_SRCH_BREAK_CERR))
         {
-            heer(SQL_HANDLE_STMT, conp->hstmtp->hstmt,
+            heer(SQL_HANDLE_STMT, hstmt,
                  conp->mystat.errmsg, conp->mystat.emlen);
-            SQLCloseCursor(conp->hstmtp->hstmt);
-            pophstmt(conp);
+            releasesrchscm(hstmt, cached);
             return (ERR_SCM_SQL);
         }
         /** @bug ignores error code without explanation */
         sta = (*cnter)(conp, srch, nrows);
         if (sta < 0 && (what & SCM_SRCH_BREAK_CERR))
         {
-            SQLCloseCursor(conp->hstmtp->hstmt);
-            pophstmt(conp);
+            releasesrchscm(hstmt, cached);
             return (sta);
         }
     }
@@ -1001,7 +1603,7 @@ searchscm(
         for (i = 0; i < srch->nused; i++)
         {
             vecp = (&srch->vec[i]);
-            SQLBindCol(conp->hstmtp->hstmt,
+            SQLBindCol(hstmt,
                        vecp->colno <= 0 ? i + 1 : vecp->colno, vecp->sqltype,
                        vecp->valptr, vecp->valsize,
                        &vecp->avalsize);
@@ -1009,7 +1611,7 @@ searchscm(
         while (1)
         {
             ridx++;
-            rc = SQLFetch(conp->hstmtp->hstmt);
+            rc = SQLFetch(hstmt);
             if (rc == SQL_NO_DATA)
                 break;
             if (!SQLOK(rc))
@@ -1050,8 +1652,7 @@ searchscm(
             }
         }
     }
-    SQLCloseCursor(conp->hstmtp->hstmt);
-    pophstmt(conp);
+    releasesrchscm(hstmt, cached);
     if (sta < 0)
         return (sta);
     if (nfnd == 0)
@@ -1060,6 +1661,141 @@ searchscm(
         return (0);
 }
 
+static void freeblockscm(
+    scmblock *blk,
+    int ncols)
+{
+    int i;
+
+    for (i = 0; i < ncols; i++)
+    {
+        if (blk->vals != NULL && blk->vals[i] != NULL)
+            free(blk->vals[i]);
+        if (blk->lens != NULL && blk->lens[i] != NULL)
+            free((void *)blk->lens[i]);
+    }
+    if (blk->vals != NULL)
+        free((void *)blk->vals);
+    if (blk->lens != NULL)
+        free((void *)blk->lens);
+}
+
+err_code
+searchblockscm(
+    scmcon *conp,
+    scmtab *tabp,
+    scmsrcha *srch,
+    sqlblockfunc *blocker,
+    int what,
+    char *orderp,
+    size_t maxrows)
+{
+    SQLULEN nfetched = 0;
+    SQLRETURN rc;
+    SQLHSTMT hstmt = NULL;
+    scmpstmt *cached = NULL;
+    scmsrch *vecp;
+    scmblock blk;
+    err_code sta = 0;
+    ssize_t ridx = 1;
+    int nfnd = 0;
+    int i;
+
+    if (blocker == NULL || maxrows == 0 || srch == NULL)
+        return (ERR_SCM_INVALARG);
+    sta = execsrchscm(conp, tabp, srch, what, orderp, &hstmt, &cached);
+    if (sta < 0)
+        return (sta);
+    // allocate and bind the column arrays
+    memset(&blk, 0, sizeof(blk));
+    blk.vals = (void **)calloc(srch->nused, sizeof(void *));
+    blk.lens = (SQLLEN **) calloc(srch->nused, sizeof(SQLLEN *));
+    if (blk.vals == NULL || blk.lens == NULL)
+        sta = ERR_SCM_NOMEM;
+    for (i = 0; sta == 0 && i < srch->nused; i++)
+    {
+        vecp = (&srch->vec[i]);
+        blk.vals[i] = calloc(maxrows, vecp->valsize);
+        blk.lens[i] = (SQLLEN *) calloc(maxrows, sizeof(SQLLEN));
+        if (blk.vals[i] == NULL || blk.lens[i] == NULL)
+        {
+            sta = ERR_SCM_NOMEM;
+            break;
+        }
+        rc = SQLBindCol(hstmt, vecp->colno <= 0 ? i + 1 : vecp->colno,
+                        vecp->sqltype, blk.vals[i], vecp->valsize,
+                        blk.lens[i]);
+        if (!SQLOK(rc))
+            sta = ERR_SCM_SQL;
+    }
+    if (sta == 0)
+    {
+        rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_BIND_TYPE,
+                            (SQLPOINTER) SQL_BIND_BY_COLUMN, 0);
+        if (SQLOK(rc))
+            rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE,
+                                (SQLPOINTER) maxrows, 0);
+        if (SQLOK(rc))
+            rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR,
+                                &nfetched, 0);
+        if (!SQLOK(rc))
+        {
+            LOG(LOG_ERR, "can't set up a %zu row fetch:", maxrows);
+            heer(SQL_HANDLE_STMT, hstmt,
+                 conp->mystat.errmsg, conp->mystat.emlen);
+            sta = ERR_SCM_SQL;
+        }
+    }
+    // loop over the blocks of results
+    if (sta == 0)
+    {
+        while (1)
+        {
+            rc = SQLFetch(hstmt);
+            if (rc == SQL_NO_DATA)
+                break;
+            if (!SQLOK(rc))
+            {
+                heer(SQL_HANDLE_STMT, hstmt,
+                     conp->mystat.errmsg, conp->mystat.emlen);
+                sta = ERR_SCM_SQL;
+                break;
+            }
+            if (nfetched == 0)
+                break;
+            blk.nrows = nfetched;
+            blk.first = ridx;
+            ridx += nfetched;
+            nfnd += nfetched;
+            sta = (*blocker)(conp, srch, &blk);
+            if (sta < 0 && (what & SCM_SRCH_BREAK_VERR))
+                break;
+        }
+    }
+    // a cached statement must go back to fetching single rows
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 1, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+    releasesrchscm(hstmt, cached);
+    freeblockscm(&blk, srch->nused);
+    if (sta < 0)
+        return (sta);
+    if (nfnd == 0)
+        return (ERR_SCM_NODATA);
+    return (0);
+}
+
+void *blockvalscm(
+    scmsrcha *srch,
+    scmblock *blk,
+    int col,
+    size_t row)
+{
+    if (srch == NULL || blk == NULL || col < 0 || col >= srch->nused ||
+        row >= blk->nrows || blk->lens[col][row] == SQL_NULL_DATA)
+        return (NULL);
+    return ((char *)blk->vals[col] + row * srch->vec[col].valsize);
+}
+
 void freesrchscm(
     scmsrcha *srch)
 {
@@ -1269,10 +2005,9 @@ searchorcreatescm(
             return (0);
         }
     }
-    sta = getmaxidscm(scmp, conp, "dir_id", tabp, &mid);
+    sta = getnextidscm(scmp, conp, "dir_id", tabp, &mid);
     if (sta < 0)
         return (sta);
-    mid++;
     free((void *)ins->vec[0].value);
     // assign NULL to avoid a double free() if the calloc() below
     // fails and ins->vec is reused
@@ -1376,6 +2111,8 @@ deletescm(
     // execute the DELETE statement
     sta = statementscm_no_data(conp, stmt);
     free((void *)stmt);
+    if (strcmp(tabp->tabname, "rpki_dir") == 0)
+        cleardircachescm(conp);
     return (sta);
 }
 
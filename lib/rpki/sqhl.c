@@ -4,6 +4,10 @@
 #include <ctype.h>
 #include <limits.h>
 #include <mysql.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,9 +27,12 @@
 #include "scmf.h"
 
 #include "cms/roa_utils.h"
+#include "util/file.h"
+#include "util/hashutils.h"
 #include "util/logging.h"
 #include "util/macros.h"
 #include "util/stringutils.h"
+#include "util/workpool.h"
 
 #define ADDCOL(a, b, c, d, e, f) ADDCOL2((a), (b), (c), (d), (e), return (f))
 
@@ -57,7 +64,10 @@ err_code validation_reconsidered(scmcon *conp, char *aki, char *issuer, X509 *x,
                                  _Bool isROA);
 void setallowexpired(int v) { allowex = (v == 0 ? 0 : 1); }
 
+static pthread_mutex_t initTablesLock = PTHREAD_MUTEX_INITIALIZER;
+
 static void initTables(scm *scmp) {
+  pthread_mutex_lock(&initTablesLock);
   if (theCertTable == NULL) {
     theDirTable = findtablescm(scmp, "DIRECTORY");
     if (theDirTable == NULL) {
@@ -101,6 +111,177 @@ static void initTables(scm *scmp) {
     }
     theSCMP = scmp;
   }
+  pthread_mutex_unlock(&initTablesLock);
+}
+
+/**
+ * @brief
+ *     structure containing data of children to propagate
+ */
+typedef struct _PropData {
+  char *ski;
+  char *subject;
+  unsigned int flags;
+  unsigned int id;
+  char *filename;
+  char *dirname;
+  char *aki;
+  char *issuer;
+} PropData;
+
+typedef struct _PropDataList {
+  int size;
+  int maxSize;
+  PropData *data;
+  bool busy; // a verifyOrNotChildren() further up the stack is using it
+} PropDataList;
+
+/*
+ * Validation context: everything that adding, verifying and propagating
+ * objects changes as it goes. It belongs to a database connection, which
+ * is passed to every function below anyway; getvctx() creates it on first
+ * use and disconnectscm() frees it. Threads can therefore load and
+ * validate in parallel as long as each uses its own connection. The table
+ * pointers above and setallowexpired() are process-wide settings.
+ */
+struct validation_ctx {
+  // so that manifest can get id of previous cert
+  unsigned int lastCertIDAdded;
+
+  // signature verdicts, see sigval_cache_get()
+  HashTable *sigvalCache;
+  size_t sigvalDirty;
+  size_t sigvalHits;
+  size_t sigvalMisses;
+
+  // see getVerifyStore()
+  X509_STORE *verifyStore;
+  int verifyPurpose;
+
+  // decoded certificates, see readCertFromFile()
+  HashTable *certCache;
+  struct cert_cache_entry *certCacheHead;
+  struct cert_cache_entry *certCacheTail;
+  size_t certCacheHits;
+  size_t certCacheMisses;
+
+  // AKI and issuer of the last cert found by find_cert()
+  char parentAKI[SKISIZE];
+  char parentIssuer[SUBJSIZE];
+
+  // see cert_revoked()
+  scmsrcha *revokedSrch;
+  const char *revokedParams[1];
+  unsigned int *revokedLid;
+  unsigned int *revokedSNLen;
+  char *revokedSig;
+  int isRevoked;
+  uint8_t *revokedSN;
+  HashTable *crlSerials; // local_id -> struct crl_serials
+  struct crl_serials *crlSerialsHead;
+  struct crl_serials *crlSerialsTail;
+  size_t crlSerialsBytes;
+
+  // certificate index, see find_cert_paths()
+  HashTable *certIndexGroups; // "ski\0subject" -> group
+  HashTable *certIndexIds;    // local_id -> node
+  bool certIndexWanted;
+  bool certIndexLoaded;
+  struct cert_index_change *certIndexChanges; // in the open transaction
+  size_t certIndexChangesSize;
+  size_t certIndexChangesAlloc;
+  size_t certIndexChangesMark; // size at the last savepoint
+  bool certIndexLoadedInTxn;
+  bool certIndexLoadedSinceSavepoint;
+
+  // see defer_validation()
+  bool deferValidation;
+
+  // see coalesce_revalidation()
+  bool dirtyWanted;
+  HashTable *dirtyCerts; // local_id -> NULL
+
+  // see begin_update_object()
+  bool replacePending;
+  unsigned int replaceLid;
+  char replaceSki[SKISIZE];
+  char replaceSubject[SUBJSIZE];
+  char replaceAki[SKISIZE];
+  char replaceIssuer[SUBJSIZE];
+
+  // see take_validated_certs()
+  bool validatedWanted;
+  unsigned int *validatedIds;
+  size_t validatedSize;
+  size_t validatedAlloc;
+
+  // see updateManifestObjs()
+  scmsrcha *updateManSrch;
+  scmsrcha *updateManSrch2;
+  const char *updateManParams[1];
+  unsigned int updateManLid;
+  char updateManPath[PATH_MAX];
+  char updateManHash[HASHSIZE];
+  size_t hashThreads;
+  struct work_pool *hashPool; // started on first use
+
+  // queries run for every child, set up once
+  scmsrcha *crlSrch;
+  scmsrcha *manSrch;
+  scmsrcha *roaSrch;
+  scmsrcha *invalidateCRLSrch;
+  scmsrcha *childrenSrch;
+  scmsrcha *validManSrch;
+  scmsrcha *certSigvalSrch;
+  scmsrcha *roaSigvalSrch;
+  scmsrcha *findCertsSrch;
+  scmsrcha *akiCertsSrch;
+  scmsrcha *taCertsSrch;
+  char validManPath[PATH_MAX];
+
+  // results of find_cert_by_aKI() and find_trust_anchors()
+  struct cert_answers akiAnswers;
+  struct cert_answers taAnswers;
+
+  // single place to allocate large amount of space for manifest files
+  // lists (MANFILES_SIZE bytes)
+  char *manFiles;
+
+  // serial number list of the CRL being processed
+  uint8_t *snlist;
+
+  // resource set of the parent being read, see validation_reconsidered()
+  uint8_t *vrsBuf;
+
+  // children still to be verified (vPropData) or invalidated (iPropData)
+  PropDataList vPropData;
+  PropDataList iPropData;
+  PropDataList *currPropData;
+};
+
+static void free_vctx(void *ptr);
+
+/*
+ * Get the validation context of a connection, creating it if needed.
+ */
+static struct validation_ctx *getvctx(scmcon *conp) {
+  struct validation_ctx *vc;
+
+  if (conp == NULL)
+    return NULL;
+  if (conp->vctx != NULL)
+    return conp->vctx;
+  vc = calloc(1, sizeof(*vc));
+  if (vc == NULL) {
+    LOG(LOG_ERR, "Unable to allocate a validation context");
+    exit(-1);
+  }
+  vc->verifyPurpose = -1;
+  vc->vPropData.maxSize = 200;
+  vc->iPropData.maxSize = 200;
+  conp->vctx = vc;
+  conp->freevctx = free_vctx;
+  return vc;
 }
 
 err_code findorcreatedir(scm *scmp, scmcon *conp, const char *dirname,
@@ -111,6 +292,8 @@ err_code findorcreatedir(scm *scmp, scmcon *conp, const char *dirname,
   if (conp == NULL || conp->connected == 0 || dirname == NULL ||
       dirname[0] == 0 || idp == NULL)
     return (ERR_SCM_INVALARG);
+  if (getdircachescm(conp, dirname, idp))
+    return (0);
   *idp = (unsigned int)(-1);
   conp->mystat.tabname = "DIRECTORY";
   initTables(scmp);
@@ -134,6 +317,43 @@ err_code findorcreatedir(scm *scmp, scmcon *conp, const char *dirname,
   srch->where = &where;
   sta = searchorcreatescm(scmp, conp, theDirTable, srch, &ins, idp);
   freesrchscm(srch);
+  if (sta == 0)
+    /*
+     * searchorcreatescm() does not say whether it created the row, so treat
+     * it as created; at worst the entry is looked up again after a rollback.
+     */
+    putdircachescm(conp, dirname, *idp, 1);
+  return (sta);
+}
+
+static sqlvaluefunc cache_dir_row;
+static err_code cache_dir_row(scmcon *conp, scmsrcha *s, ssize_t idx) {
+  UNREFERENCED_PARAMETER(idx);
+  putdircachescm(conp, (char *)s->vec[1].valptr,
+                 *(unsigned int *)s->vec[0].valptr, 0);
+  return (0);
+}
+
+err_code fill_dir_cache(scm *scmp, scmcon *conp) {
+  scmsrcha *srch;
+  err_code sta;
+
+  if (conp == NULL || conp->connected == 0)
+    return (ERR_SCM_INVALARG);
+  conp->mystat.tabname = "DIRECTORY";
+  initTables(scmp);
+  srch = newsrchscm("filldir", 2, 0, 0);
+  if (srch == NULL)
+    return (ERR_SCM_NOMEM);
+  sta = addcolsrchscm(srch, "dir_id", SQL_C_ULONG, sizeof(unsigned int));
+  if (sta == 0)
+    sta = addcolsrchscm(srch, "dirname", SQL_C_CHAR, DNAMESIZE);
+  if (sta == 0)
+    sta = searchscm(conp, theDirTable, srch, NULL, cache_dir_row,
+                    SCM_SRCH_DOVALUE_ANN, NULL);
+  freesrchscm(srch);
+  if (sta == ERR_SCM_NODATA)
+    sta = 0;
   return (sta);
 }
 
@@ -292,16 +512,13 @@ object_type infer_filetype(const char *fname) {
   return rulep->typ;
 }
 
-// so that manifest can get id of previous cert
-
-static unsigned int lastCertIDAdded = 0;
-
 static char *certf[CF_NFIELDS] = {"filename", "subject", "issuer", "sn",
                                   "valfrom",  "valto",   "sig",    "ski",
                                   "aki",      "sia",     "aia",    "crldp"};
 
 static err_code add_cert_internal(scm *scmp, scmcon *conp, cert_fields *cf,
                                   unsigned int *cert_id) {
+  struct validation_ctx *vc = getvctx(conp);
   scmkv cols[CF_NFIELDS + 5];
   char *wptr = NULL;
   char *ptr;
@@ -315,10 +532,9 @@ static err_code add_cert_internal(scm *scmp, scmcon *conp, cert_fields *cf,
   char *escaped_strings[CF_NFIELDS] = {NULL};
 
   initTables(scmp);
-  sta = getmaxidscm(scmp, conp, "local_id", theCertTable, cert_id);
+  sta = getnextidscm(scmp, conp, "local_id", theCertTable, cert_id);
   if (sta < 0)
     return (sta);
-  (*cert_id)++;
   // immediately check for duplicate signature
   sta = dupsigscm(scmp, conp, theCertTable, cf->fields[CF_FIELD_SIGNATURE]);
   if (sta < 0)
@@ -362,13 +578,33 @@ cleanup:
   if (wptr != NULL) {
     free(wptr);
   }
-  lastCertIDAdded = *cert_id;
+  vc->lastCertIDAdded = *cert_id;
   return (sta);
 }
 
 static char *crlf[CRF_NFIELDS] = {"filename", "issuer", "last_upd", "next_upd",
                                   "sig",      "crlno",  "aki"};
 
+static int serial_cmp(const void *a, const void *b) {
+  return memcmp(a, b, SER_NUM_MAX_SZ);
+}
+
+/*
+ * Sort a list of serial numbers, as stored in rpki_crl.snlist.  Serials
+ * are big-endian and left-padded with zeroes, so memcmp() order is
+ * numeric order.
+ */
+static void sort_serials(uint8_t *list, unsigned int snlen) {
+  unsigned int i;
+
+  for (i = 1; i < snlen; i++)
+    if (serial_cmp(&list[SER_NUM_MAX_SZ * (i - 1)],
+                   &list[SER_NUM_MAX_SZ * i]) > 0)
+      break;
+  if (i < snlen)
+    qsort(list, snlen, SER_NUM_MAX_SZ, serial_cmp);
+}
+
 static err_code add_crl_internal(scm *scmp, scmcon *conp, crl_fields *cf) {
   unsigned int crl_id = 0;
   scmkv cols[CRF_NFIELDS + 6];
@@ -388,18 +624,19 @@ static err_code add_crl_internal(scm *scmp, scmcon *conp, crl_fields *cf) {
   sta = dupsigscm(scmp, conp, theCRLTable, cf->fields[CRF_FIELD_SIGNATURE]);
   if (sta < 0)
     return (sta);
+  // store the serials sorted so that readers can binary search them
+  sort_serials(cf->snlist, cf->snlen);
   // the following statement could use a LOT of memory, so we try
   // it early in case it fails
   hexs = hexify(cf->snlen * SER_NUM_MAX_SZ, cf->snlist, HEXIFY_HAT);
   if (hexs == NULL)
     return (ERR_SCM_NOMEM);
   conp->mystat.tabname = "CRL";
-  sta = getmaxidscm(scmp, conp, "local_id", theCRLTable, &crl_id);
+  sta = getnextidscm(scmp, conp, "local_id", theCRLTable, &crl_id);
   if (sta < 0) {
     free((void *)hexs);
     return (sta);
   }
-  crl_id++;
   // fill in insertion structure
   for (i = 0; (size_t)i < ELTS(cols); i++)
     cols[i].value = NULL;
@@ -447,30 +684,32 @@ cleanup:
  */
 static sigval_state get_cert_sigval(scmcon *conp, const char *subj,
                                     const char *ski) {
-  static scmsrcha *sigsrch = NULL;
+  struct validation_ctx *vc = getvctx(conp);
   unsigned int *svalp;
   sigval_state sval;
   err_code sta = 0;
 
   if (theSCMP != NULL)
     initTables(theSCMP);
-  if (sigsrch == NULL) {
+  if (vc->certSigvalSrch == NULL) {
     /** @bug ignores error code (NULL) without explanation */
-    sigsrch = newsrchscm(NULL, 1, 0, 1);
+    vc->certSigvalSrch = newsrchscm(NULL, 1, 0, 1);
     /**
-     * @bug on error sigsrch will be left in a half-initialized
+     * @bug on error vc->certSigvalSrch will be left in a half-initialized
      * state and it will never be fully initialized
      */
-    ADDCOL(sigsrch, "sigval", SQL_C_ULONG, sizeof(unsigned int), sta,
+    ADDCOL(vc->certSigvalSrch, "sigval", SQL_C_ULONG, sizeof(unsigned int), sta,
            SIGVAL_UNKNOWN);
   }
-  xsnprintf(sigsrch->wherestr, WHERESTR_SIZE, "ski=\"%s\" and subject=\"%s\"",
-            ski, subj);
-  sta = searchscm(conp, theCertTable, sigsrch, NULL, &ok,
+  const char *params[2] = {ski, subj};
+  vc->certSigvalSrch->params = params;
+  vc->certSigvalSrch->nparams = 2;
+  xsnprintf(vc->certSigvalSrch->wherestr, WHERESTR_SIZE, "ski=? and subject=?");
+  sta = searchscm(conp, theCertTable, vc->certSigvalSrch, NULL, &ok,
                   SCM_SRCH_DOVALUE_ALWAYS, NULL);
   if (sta < 0)
     return SIGVAL_UNKNOWN;
-  svalp = (unsigned int *)(sigsrch->vec[0].valptr);
+  svalp = (unsigned int *)(vc->certSigvalSrch->vec[0].valptr);
   if (svalp == NULL)
     return SIGVAL_UNKNOWN;
   sval = *svalp;
@@ -480,29 +719,32 @@ static sigval_state get_cert_sigval(scmcon *conp, const char *subj,
 }
 
 static sigval_state get_roa_sigval(scmcon *conp, const char *ski) {
-  static scmsrcha *sigsrch = NULL;
+  struct validation_ctx *vc = getvctx(conp);
   unsigned int *svalp;
   sigval_state sval;
   err_code sta = 0;
 
   if (theSCMP != NULL)
     initTables(theSCMP);
-  if (sigsrch == NULL) {
+  if (vc->roaSigvalSrch == NULL) {
     /** @bug ignores error code (NULL) without explanation */
-    sigsrch = newsrchscm(NULL, 1, 0, 1);
+    vc->roaSigvalSrch = newsrchscm(NULL, 1, 0, 1);
     /**
-     * @bug on error sigsrch will be left in a half-initialized
+     * @bug on error vc->roaSigvalSrch will be left in a half-initialized
      * state and it will never be fully initialized
      */
-    ADDCOL(sigsrch, "sigval", SQL_C_ULONG, sizeof(unsigned int), sta,
+    ADDCOL(vc->roaSigvalSrch, "sigval", SQL_C_ULONG, sizeof(unsigned int), sta,
            SIGVAL_UNKNOWN);
   }
-  xsnprintf(sigsrch->wherestr, WHERESTR_SIZE, "ski=\"%s\"", ski);
-  sta = searchscm(conp, theROATable, sigsrch, NULL, &ok,
+  const char *params[1] = {ski};
+  vc->roaSigvalSrch->params = params;
+  vc->roaSigvalSrch->nparams = 1;
+  xsnprintf(vc->roaSigvalSrch->wherestr, WHERESTR_SIZE, "ski=?");
+  sta = searchscm(conp, theROATable, vc->roaSigvalSrch, NULL, &ok,
                   SCM_SRCH_DOVALUE_ALWAYS, NULL);
   if (sta < 0)
     return SIGVAL_UNKNOWN;
-  svalp = (unsigned int *)(sigsrch->vec[0].valptr);
+  svalp = (unsigned int *)(vc->roaSigvalSrch->vec[0].valptr);
   if (svalp == NULL)
     return SIGVAL_UNKNOWN;
   sval = *svalp;
@@ -590,11 +832,227 @@ static err_code set_sigval(scmcon *conp, object_type typ, const char *item1,
 typedef int vfunc(X509_STORE_CTX *);
 
 /*
- * Global variables used by the verification callback
+ * Process-local cache of certificate signature verdicts, keyed by the
+ * SHA-256 hash of the issuer's public key followed by the SHA-256 hash of
+ * the certificate. Since the key covers both the signed data and the key
+ * that signed it, a verdict never goes stale. Verdicts computed here are
+ * written back to the sigval column in batches by sigval_cache_flush().
+ */
+
+#define SIGVAL_KEY_SIZE (2 * SHA256_DIGEST_LENGTH)
+
+/** @bug magic numbers */
+#define SIGVAL_CACHE_MAX 1000000
+#define SIGVAL_FLUSH_BATCH 256
+
+typedef struct {
+  sigval_state sigval;
+  char *subj; // set until the verdict has been written to the db
+  char *ski;
+} sigval_entry;
+
+static void free_sigval_entry(void *value) {
+  sigval_entry *ent = (sigval_entry *)value;
+
+  free(ent->subj);
+  free(ent->ski);
+  free(ent);
+}
+
+static bool sigval_key(X509 *cert, EVP_PKEY *pkey,
+                       unsigned char key[SIGVAL_KEY_SIZE]) {
+  unsigned char *der = NULL;
+  unsigned int mdlen;
+  int derlen;
+  int ok;
+
+  derlen = i2d_PUBKEY(pkey, &der);
+  if (derlen <= 0)
+    return false;
+  ok = EVP_Digest(der, derlen, key, &mdlen, EVP_sha256(), NULL);
+  OPENSSL_free(der);
+  if (!ok)
+    return false;
+  return X509_digest(cert, EVP_sha256(), key + SHA256_DIGEST_LENGTH,
+                     &mdlen) != 0;
+}
+
+static sigval_state sigval_cache_get(scmcon *conp,
+                                     const unsigned char *key) {
+  struct validation_ctx *vc = getvctx(conp);
+  sigval_entry *ent = NULL;
+
+  if (vc->sigvalCache != NULL)
+    ent = HashTable_get(vc->sigvalCache, key, SIGVAL_KEY_SIZE);
+  if (ent == NULL) {
+    vc->sigvalMisses++;
+    return SIGVAL_UNKNOWN;
+  }
+  vc->sigvalHits++;
+  return ent->sigval;
+}
+
+/*
+ * Remember a verdict. If subj and ski are not NULL, the cache takes
+ * ownership of them and the verdict will be written to the db.
+ */
+static void sigval_cache_put(scmcon *conp, const unsigned char *key,
+                             sigval_state sigval, char *subj, char *ski) {
+  struct validation_ctx *vc = getvctx(conp);
+  sigval_entry *ent;
+  void *old = NULL;
+
+  if (vc->sigvalCache == NULL)
+    vc->sigvalCache = HashTable_new();
+  if (vc->sigvalCache != NULL &&
+      HashTable_size(vc->sigvalCache) >= SIGVAL_CACHE_MAX) {
+    /** @bug ignores error code without explanation */
+    sigval_cache_flush(conp);
+    HashTable_clear(vc->sigvalCache, free_sigval_entry);
+  }
+  ent = (sigval_entry *)calloc(1, sizeof(sigval_entry));
+  if (vc->sigvalCache == NULL || ent == NULL) {
+    free(ent);
+    free(subj);
+    free(ski);
+    return;
+  }
+  ent->sigval = sigval;
+  ent->subj = subj;
+  ent->ski = ski;
+  if (!HashTable_put(vc->sigvalCache, key, SIGVAL_KEY_SIZE, ent, &old)) {
+    free_sigval_entry(ent);
+    return;
+  }
+  if (old != NULL) {
+    if (((sigval_entry *)old)->subj != NULL)
+      vc->sigvalDirty--;
+    free_sigval_entry(old);
+  }
+  if (subj != NULL)
+    vc->sigvalDirty++;
+}
+
+/*
+ * Write a cached valid verdict to the db again with the next flush. The
+ * row it was written to may have been deleted and the certificate added
+ * again since, with the sigval column back at its default.
+ */
+static void sigval_cache_rewrite(scmcon *conp, const unsigned char *key,
+                                 X509 *cert) {
+  struct validation_ctx *vc = getvctx(conp);
+  sigval_entry *ent;
+  int x509sta = 0;
+  err_code sta = 0;
+
+  ent = HashTable_get(vc->sigvalCache, key, SIGVAL_KEY_SIZE);
+  if (ent == NULL || ent->subj != NULL)
+    return;
+  ent->subj = X509_to_subject(cert, &sta, &x509sta);
+  if (ent->subj != NULL)
+    ent->ski = X509_to_ski(cert, &sta, &x509sta);
+  if (ent->ski == NULL) {
+    free(ent->subj);
+    ent->subj = NULL;
+    return;
+  }
+  vc->sigvalDirty++;
+}
+
+typedef struct {
+  sigval_entry **ents;
+  size_t n;
+} sigval_dirty_list;
+
+static void collect_dirty_sigval(void const *key, size_t key_len, void *value,
+                                 void *arg) {
+  sigval_entry *ent = (sigval_entry *)value;
+  sigval_dirty_list *list = (sigval_dirty_list *)arg;
+
+  (void)key;
+  (void)key_len;
+  if (ent->subj != NULL && ent->ski != NULL)
+    list->ents[list->n++] = ent;
+}
+
+/*
+ * Write one batch of verdicts, all with the same sigval, in a single UPDATE.
  */
+static err_code flush_sigval_batch(scmcon *conp, sigval_entry **ents,
+                                   size_t n) {
+  char *stmt;
+  size_t len = 128 + strlen(theCertTable->tabname);
+  size_t used;
+  size_t i;
+  err_code sta;
+
+  for (i = 0; i < n; i++)
+    len += 2 * strlen(ents[i]->subj) + 2 * strlen(ents[i]->ski) + 16;
+  stmt = (char *)malloc(len);
+  if (stmt == NULL)
+    return ERR_SCM_NOMEM;
+  used = xsnprintf(stmt, len, "update %s set sigval=%d where (ski, subject) in (",
+                   theCertTable->tabname, ents[0]->sigval);
+  for (i = 0; i < n; i++) {
+    used += xsnprintf(stmt + used, len - used, "%s(\"", i > 0 ? ", " : "");
+    used += mysql_escape_string(stmt + used, ents[i]->ski,
+                                strlen(ents[i]->ski));
+    used += xsnprintf(stmt + used, len - used, "\", \"");
+    used += mysql_escape_string(stmt + used, ents[i]->subj,
+                                strlen(ents[i]->subj));
+    used += xsnprintf(stmt + used, len - used, "\")");
+  }
+  xsnprintf(stmt + used, len - used, ");");
+  sta = statementscm_no_data(conp, stmt);
+  free(stmt);
+  return sta;
+}
+
+err_code sigval_cache_flush(scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  sigval_dirty_list list = {NULL, 0};
+  err_code sta = 0;
+  err_code bsta;
+  size_t i;
+
+  if (vc->sigvalCache == NULL || vc->sigvalDirty == 0)
+    return 0;
+  if (theSCMP != NULL)
+    initTables(theSCMP);
+  if (conp == NULL || theCertTable == NULL)
+    return ERR_SCM_INVALARG;
+  list.ents = (sigval_entry **)calloc(vc->sigvalDirty, sizeof(sigval_entry *));
+  if (list.ents == NULL)
+    return ERR_SCM_NOMEM;
+  HashTable_foreach(vc->sigvalCache, collect_dirty_sigval, &list);
+  // only SIGVAL_VALID is ever recorded, so one batch is one statement
+  for (i = 0; i < list.n; i += SIGVAL_FLUSH_BATCH) {
+    bsta = flush_sigval_batch(conp, list.ents + i,
+                              list.n - i < SIGVAL_FLUSH_BATCH
+                                  ? list.n - i
+                                  : SIGVAL_FLUSH_BATCH);
+    if (bsta < 0 && sta == 0)
+      sta = bsta;
+  }
+  // the cache stays authoritative even if the db could not be updated
+  for (i = 0; i < list.n; i++) {
+    free(list.ents[i]->subj);
+    free(list.ents[i]->ski);
+    list.ents[i]->subj = NULL;
+    list.ents[i]->ski = NULL;
+  }
+  free(list.ents);
+  vc->sigvalDirty = 0;
+  return sta;
+}
 
-static vfunc *old_vfunc = NULL;
-static scmcon *thecon = NULL;
+void sigval_cache_stats(scmcon *conp, size_t *hits, size_t *misses) {
+  struct validation_ctx *vc = getvctx(conp);
+  if (hits != NULL)
+    *hits = vc->sigvalHits;
+  if (misses != NULL)
+    *misses = vc->sigvalMisses;
+}
 
 /*
  * Our replacement for X509_verify. Consults the database first to see if the
@@ -602,7 +1060,10 @@ static scmcon *thecon = NULL;
  * state in the db based on that. It returns 1 on success and 0 on failure.
  */
 
-static int local_verify(X509 *cert, EVP_PKEY *pkey) {
+static int local_verify(scmcon *conp, X509 *cert, EVP_PKEY *pkey) {
+  struct validation_ctx *vc = getvctx(conp);
+  unsigned char key[SIGVAL_KEY_SIZE];
+  bool havekey;
   int x509sta = 0;
   err_code sta = 0;
   sigval_state sigval = SIGVAL_UNKNOWN;
@@ -610,6 +1071,20 @@ static int local_verify(X509 *cert, EVP_PKEY *pkey) {
   char *subj = NULL;
   char *ski = NULL;
 
+  // check the in-memory cache before going to the database
+  havekey = sigval_key(cert, pkey, key);
+  if (havekey) {
+    sigval = sigval_cache_get(conp, key);
+    if (sigval == SIGVAL_VALID) {
+      sigval_cache_rewrite(conp, key, cert);
+      if (vc->sigvalDirty >= SIGVAL_FLUSH_BATCH)
+        /** @bug ignores error code without explanation */
+        sigval_cache_flush(conp);
+      return 1;
+    }
+    if (sigval == SIGVAL_INVALID)
+      return 0;
+  }
   // first, get the subject and the SKI
   /** @bug ignores error code without explanation */
   subj = X509_to_subject(cert, &sta, &x509sta);
@@ -617,31 +1092,39 @@ static int local_verify(X509 *cert, EVP_PKEY *pkey) {
     /** @bug ignores error code without explanation */
     ski = X509_to_ski(cert, &sta, &x509sta);
     if (ski != NULL) {
-      sigval = get_sigval(thecon, OT_CER, subj, ski);
+      sigval = get_sigval(conp, OT_CER, subj, ski);
     }
   }
   switch (sigval) {
-  case SIGVAL_VALID: /* already validated */
-    if (subj != NULL)
-      free((void *)subj);
-    if (ski != NULL)
-      free((void *)ski);
-    return 1;
+  case SIGVAL_VALID:   /* already validated */
   case SIGVAL_INVALID: /* already invalidated */
+    if (havekey)
+      sigval_cache_put(conp, key, sigval, NULL, NULL);
     if (subj != NULL)
       free((void *)subj);
     if (ski != NULL)
       free((void *)ski);
-    return 0;
+    return sigval == SIGVAL_VALID;
   case SIGVAL_UNKNOWN:
   case SIGVAL_NOTPRESENT:
   default:
     break; /* compute validity, then set in db */
   }
   mok = X509_verify(cert, pkey);
-  if (mok) {
+  if (mok > 0 && havekey && subj != NULL && ski != NULL) {
+    // the cache now owns subj and ski until they are written to the db
+    sigval_cache_put(conp, key, SIGVAL_VALID, subj, ski);
+    subj = NULL;
+    ski = NULL;
+    if (vc->sigvalDirty >= SIGVAL_FLUSH_BATCH)
+      /** @bug ignores error code without explanation */
+      sigval_cache_flush(conp);
+  } else if (mok > 0) {
     /** @bug ignores error code without explanation */
-    set_sigval(thecon, OT_CER, subj, ski, SIGVAL_VALID);
+    set_sigval(conp, OT_CER, subj, ski, SIGVAL_VALID);
+  } else if (mok == 0 && havekey) {
+    // a bad signature stays bad, but is not recorded in the db
+    sigval_cache_put(conp, key, SIGVAL_INVALID, NULL, NULL);
   }
   if (subj != NULL)
     free((void *)subj);
@@ -652,10 +1135,12 @@ static int local_verify(X509 *cert, EVP_PKEY *pkey) {
 
 /*
  * Our own internal verifier, replacing the internal_verify function in
- * openSSL (x509_vfy.c). It returns 1 on success and 0 on failure.
+ * openSSL (x509_vfy.c). It returns 1 on success and 0 on failure. The
+ * connection to use is the app data of ctx (see checkit()).
  */
 static vfunc our_verify;
 int our_verify(X509_STORE_CTX *ctx) {
+  scmcon *conp = (scmcon *)X509_STORE_CTX_get_app_data(ctx);
   int mok;
   int n;
   int (*cb)(int, X509_STORE_CTX *);
@@ -684,27 +1169,28 @@ int our_verify(X509_STORE_CTX *ctx) {
   }
   while (n >= 0) {
     ctx->error_depth = n;
-    if (!xsubject->valid) {
-      pkey = X509_get_pubkey(xissuer);
-      if (pkey == NULL) {
-        ctx->error = X509_V_ERR_UNABLE_TO_DECODE_ISSUER_PUBLIC_KEY;
-        ctx->current_cert = xissuer;
-        mok = cb(0, ctx);
-        if (!mok)
-          goto end;
-      } else if (local_verify(xsubject, pkey) <= 0) {
-        ctx->error = X509_V_ERR_CERT_SIGNATURE_FAILURE;
-        ctx->current_cert = xsubject;
-        mok = cb(0, ctx);
-        if (!mok) {
-          EVP_PKEY_free(pkey);
-          goto end;
-        }
+    // The certificates may be shared with the certificate cache, so
+    // ->valid is neither consulted nor set: a flag left by one chain
+    // would skip the check against a different issuer. local_verify()
+    // remembers verdicts itself.
+    pkey = X509_get_pubkey(xissuer);
+    if (pkey == NULL) {
+      ctx->error = X509_V_ERR_UNABLE_TO_DECODE_ISSUER_PUBLIC_KEY;
+      ctx->current_cert = xissuer;
+      mok = cb(0, ctx);
+      if (!mok)
+        goto end;
+    } else if (local_verify(conp, xsubject, pkey) <= 0) {
+      ctx->error = X509_V_ERR_CERT_SIGNATURE_FAILURE;
+      ctx->current_cert = xsubject;
+      mok = cb(0, ctx);
+      if (!mok) {
+        EVP_PKEY_free(pkey);
+        goto end;
       }
-      EVP_PKEY_free(pkey);
-      pkey = NULL;
     }
-    xsubject->valid = 1;
+    EVP_PKEY_free(pkey);
+    pkey = NULL;
     ctx->current_issuer = xissuer;
     ctx->current_cert = xsubject;
     mok = cb(1, ctx);
@@ -721,6 +1207,55 @@ end:
   return mok;
 }
 
+/**
+ * @brief
+ *     X509 store shared by every call to checkit() on a connection
+ *
+ * Built on first use and freed with the validation context. There are
+ * no lookup methods: the trust anchor and intermediate certs for each
+ * check are passed to the X509_STORE_CTX, so the system CA file and
+ * directory are never needed.
+ */
+static X509_STORE *getVerifyStore(struct validation_ctx *vc, err_code *stap) {
+  X509_VERIFY_PARAM *vpm = NULL;
+
+  if (vc->verifyStore != NULL)
+    return vc->verifyStore;
+  vc->verifyStore = X509_STORE_new();
+  if (vc->verifyStore == NULL) {
+    LOG(LOG_DEBUG, "X509_STORE_new() returned NULL");
+    *stap = ERR_SCM_CERTCTX;
+    return NULL;
+  }
+  // initialize the purpose
+  /**
+   * @bug ignores error codes from X509_PURPOSE_get_by_sname() (< 0)
+   * without explanation
+   */
+  /**
+   * @bug ignores error code from X509_PURPOSE_get0() (NULL) without
+   * explanation
+   */
+  vc->verifyPurpose =
+      X509_PURPOSE_get_id(X509_PURPOSE_get0(X509_PURPOSE_get_by_sname("any")));
+  // setup the verification parameters
+  vpm = X509_VERIFY_PARAM_new();
+  if (vpm == NULL) {
+    LOG(LOG_DEBUG, "X509_VERIFY_PARAM_new() returned NULL");
+    X509_STORE_free(vc->verifyStore);
+    vc->verifyStore = NULL;
+    *stap = ERR_SCM_CERTCTX;
+    return NULL;
+  }
+  /** @bug ignores error codes (not 1) without explanation */
+  X509_VERIFY_PARAM_set_purpose(vpm, vc->verifyPurpose);
+  /** @bug ignores error codes (not 1) without explanation */
+  X509_STORE_set1_param(vc->verifyStore, vpm);
+  X509_VERIFY_PARAM_free(vpm);
+  X509_STORE_set_flags(vc->verifyStore, 0);
+  return vc->verifyStore;
+}
+
 /**
  * @brief
  *     This is the routine that actually calls X509_verify_cert().
@@ -729,13 +1264,13 @@ end:
  * following steps(+):
  *
  *   1. creates an X509_STORE_CTX
- *   2. sets the flags to 0
- *   3. initializes the CTX with the X509_STORE, X509 cert being
- *      checked, and the stack of untrusted X509 certs
- *   4. sets the trusted stack of X509 certs in the CTX
- *   5. sets the purpose in the CTX (which we had set outside of this
+ *   2. initializes the CTX with the shared X509_STORE (see
+ *      getVerifyStore()), X509 cert being checked, and the stack of
+ *      untrusted X509 certs
+ *   3. sets the trusted stack of X509 certs in the CTX
+ *   4. sets the purpose in the CTX (which we had set outside of this
  *      function to the OpenSSL definition of "any")
- *   6. calls X509_verify_cert
+ *   5. calls X509_verify_cert
  *
  * This function is modified from check() in apps/verify.c of the
  * OpenSSL source
@@ -743,71 +1278,20 @@ end:
 static err_code checkit(scmcon *conp, X509 *cert,
                         STACK_OF(X509) * intermediate_path,
                         X509 *trust_anchor) {
+  struct validation_ctx *vc = getvctx(conp);
+  vfunc *old_vfunc;
   LOG(LOG_DEBUG, "checkit(conp=%p, cert=%p"
                  ", intermediate_path=%p, trust_anchor=%p)",
       conp, cert, intermediate_path, trust_anchor);
 
   STACK_OF(X509) *sk_trusted = NULL;
-  X509_VERIFY_PARAM *vpm = NULL;
   X509_STORE *cert_store = NULL;
   X509_STORE_CTX *ctx = NULL;
   err_code sta = 0;
 
-  // create X509 store
-  cert_store = X509_STORE_new();
-  if (cert_store == NULL) {
-    LOG(LOG_DEBUG, "X509_STORE_new() returned NULL");
-    sta = ERR_SCM_CERTCTX;
+  cert_store = getVerifyStore(vc, &sta);
+  if (cert_store == NULL)
     goto done;
-  }
-  // initialize the purpose
-  /**
-   * @bug ignores error codes from X509_PURPOSE_get_by_sname() (< 0)
-   * without explanation
-   */
-  /**
-   * @bug ignores error code from X509_PURPOSE_get0() (NULL) without
-   * explanation
-   */
-  int purpose =
-      X509_PURPOSE_get_id(X509_PURPOSE_get0(X509_PURPOSE_get_by_sname("any")));
-  // setup the verification parameters
-  /** @bug ignores error code (NULL) without explanation */
-  vpm = X509_VERIFY_PARAM_new();
-  /** @bug ignores error codes (not 1) without explanation */
-  X509_VERIFY_PARAM_set_purpose(vpm, purpose);
-  /** @bug ignores error codes (not 1) without explanation */
-  X509_STORE_set1_param(cert_store, vpm);
-  /**
-   * @bug presumably X509_LOOKUP_file() could return NULL on error,
-   * but that's unclear because the current implementation will
-   * never return non-NULL
-   */
-  /**
-   * @bug ignores error code from X509_STORE_add_lookup() (NULL)
-   * without explanation
-   */
-  /**
-   * @bug ignores error codes from X509_LOOKUP_load_file() (not 1)
-   * without explanation
-   */
-  X509_LOOKUP_load_file(X509_STORE_add_lookup(cert_store, X509_LOOKUP_file()),
-                        NULL, X509_FILETYPE_DEFAULT);
-  /**
-   * @bug presumably X509_LOOKUP_hash_dir() could return NULL on
-   * error, but that's unclear because the current implementation
-   * will never return non-NULL
-   */
-  /**
-   * @bug ignores error code from X509_STORE_add_lookup() (NULL)
-   * without explanation
-   */
-  /**
-   * @bug ignores error codes from X509_LOOKUP_add_dir() (not 1)
-   * without explanation
-   */
-  X509_LOOKUP_add_dir(X509_STORE_add_lookup(cert_store, X509_LOOKUP_hash_dir()),
-                      NULL, X509_FILETYPE_DEFAULT);
 
   ERR_clear_error();
   // set up certificate stacks
@@ -826,23 +1310,20 @@ static err_code checkit(scmcon *conp, X509 *cert,
     sta = ERR_SCM_STORECTX;
     goto done;
   }
-  X509_STORE_set_flags(cert_store, 0);
   if (!X509_STORE_CTX_init(ctx, cert_store, cert, intermediate_path)) {
     LOG(LOG_DEBUG, "X509_STORE_CTX_init() returned 0");
     sta = ERR_SCM_STOREINIT;
     goto done;
   }
   X509_STORE_CTX_trusted_stack(ctx, sk_trusted);
-  if (purpose >= 0)
+  if (vc->verifyPurpose >= 0)
     /** @bug ignores error codes (not 1) without explanation */
-    X509_STORE_CTX_set_purpose(ctx, purpose);
+    X509_STORE_CTX_set_purpose(ctx, vc->verifyPurpose);
   old_vfunc = cert_store->verify;
-  thecon = conp;
+  X509_STORE_CTX_set_app_data(ctx, conp);
   ctx->verify = &our_verify;
   int ret = X509_verify_cert(ctx);
   ctx->verify = old_vfunc;
-  old_vfunc = NULL;
-  thecon = NULL;
   if (ret <= 0) {
     if (ctx->error == X509_V_ERR_UNNESTED_RESOURCE)
       sta = ERR_SCM_UNRES;
@@ -858,34 +1339,42 @@ done:
     assert(!sk_X509_num(sk_trusted));
   }
   sk_X509_pop_free(sk_trusted, X509_free);
-  X509_STORE_free(cert_store);
-  X509_VERIFY_PARAM_free(vpm);
   LOG(LOG_DEBUG, "checkit() returning %s: %s", err2name(sta), err2string(sta));
   return sta;
 }
 
 /**
  * @brief
- *     Read cert data from a file
+ *     Read cert data from a file, bypassing the certificate cache
  *
- * Unlike cert2fields(), this just fills in the X509 structure, not
- * the certfields
- *
- * @param[out] stap
- *     Error code.  On error, the value at this location is set to a
- *     non-zero value.  Otherwise, it is set to 0.  This parameter may
- *     be NULL.
- * @return
- *     NULL on error, non-NULL otherwise.
+ * See readCertFromFile().
  */
-static X509 *readCertFromFile(char *ofullname, err_code *stap) {
+static X509 *readCertFromFileUncached(const char *ofullname, err_code *stap) {
   X509 *px = NULL;
   BIO *bcert = NULL;
   object_type typ;
   int x509sta;
+  struct file_contents contents;
+  const unsigned char *p;
 
-  // open the file
   typ = infer_filetype(ofullname);
+  if (typ < OT_PEM_OFFSET) {
+    // decode straight from the file's pages
+    if (!file_contents_open(&contents, ofullname)) {
+      if (stap) {
+        *stap = ERR_SCM_X509;
+      }
+      return (NULL);
+    }
+    p = contents.data;
+    px = d2i_X509(NULL, &p, contents.size);
+    file_contents_close(&contents);
+    if (stap) {
+      *stap = (px == NULL) ? ERR_SCM_BADCERT : 0;
+    }
+    return (px);
+  }
+  // open the file
   bcert = BIO_new(BIO_s_file());
   if (bcert == NULL) {
     if (stap) {
@@ -901,11 +1390,7 @@ static X509 *readCertFromFile(char *ofullname, err_code *stap) {
     }
     return (NULL);
   }
-  // read the cert based on the input type
-  if (typ < OT_PEM_OFFSET)
-    px = d2i_X509_bio(bcert, NULL);
-  else
-    px = PEM_read_bio_X509_AUX(bcert, NULL, NULL, NULL);
+  px = PEM_read_bio_X509_AUX(bcert, NULL, NULL, NULL);
   BIO_free_all(bcert);
   if (stap) {
     if (px == NULL) {
@@ -917,50 +1402,221 @@ static X509 *readCertFromFile(char *ofullname, err_code *stap) {
   return (px);
 }
 
-static char parentAKI[SKISIZE];
-static char parentIssuer[SUBJSIZE];
-
-/**
- * @brief
- *     initialize an SQL search structure for certificate searches
- *
- * @param[out] certSrchp
- *     On success the value at this location will be set to the
- *     location of an initialized SQL search structure.  The caller is
- *     responsible for freeing the structure via freesrchscm().
- * @return
- *     0 on success, a non-zero error code otherwise.
+/*
+ * Process-local LRU cache of decoded certificates, keyed by file name.
+ * The same few CA certificates are parents of most objects, so they would
+ * otherwise be read and decoded again for every path search. An entry is
+ * used only while the file's inode, size and mtime are unchanged.
  */
-static err_code init_certSrch(scmsrcha **certSrchp) {
-  LOG(LOG_DEBUG, "init_certSrch(certSrchp=%p)", certSrchp);
 
-  err_code sta = 0;
-  scmsrcha *certSrch = newsrchscm(NULL, 6, 0, 1);
-  if (!certSrch) {
-    LOG(LOG_ERR, "Unable to allocate memory to construct an SQL query");
-    sta = ERR_SCM_NOMEM;
-    goto done;
-  }
-  ADDCOL2(certSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, goto done);
-  ADDCOL2(certSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, goto done);
-  ADDCOL2(certSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, goto done);
-  ADDCOL2(certSrch, "aki", SQL_C_CHAR, SKISIZE, sta, goto done);
-  ADDCOL2(certSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, goto done);
-  ADDCOL2(certSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
-          goto done);
+/** @bug magic number */
+#define CERT_CACHE_MAX 4096
 
-  assert(!sta);
-  if (certSrchp) {
-    *certSrchp = certSrch;
-  } else {
-    freesrchscm(certSrch);
-  }
-  certSrch = NULL;
+typedef struct cert_cache_entry {
+  struct cert_cache_entry *prev; // toward most recently used
+  struct cert_cache_entry *next; // toward least recently used
+  X509 *cert;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  size_t namelen;
+  char name[];
+} cert_cache_entry;
 
-done:
-  if (sta && certSrch) {
-    freesrchscm(certSrch);
-  }
+/*
+ * Take another reference to a certificate. The caller releases it with
+ * X509_free() as usual.
+ */
+static X509 *cert_ref(X509 *cert) {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  CRYPTO_add(&cert->references, 1, CRYPTO_LOCK_X509);
+#else
+  X509_up_ref(cert);
+#endif
+  return cert;
+}
+
+static void cert_cache_unlink(struct validation_ctx *vc,
+                              cert_cache_entry *ent) {
+  if (ent->prev != NULL)
+    ent->prev->next = ent->next;
+  else
+    vc->certCacheHead = ent->next;
+  if (ent->next != NULL)
+    ent->next->prev = ent->prev;
+  else
+    vc->certCacheTail = ent->prev;
+  ent->prev = ent->next = NULL;
+}
+
+static void cert_cache_push(struct validation_ctx *vc, cert_cache_entry *ent) {
+  ent->prev = NULL;
+  ent->next = vc->certCacheHead;
+  if (vc->certCacheHead != NULL)
+    vc->certCacheHead->prev = ent;
+  else
+    vc->certCacheTail = ent;
+  vc->certCacheHead = ent;
+}
+
+static void free_cert_cache_entry(void *value) {
+  cert_cache_entry *ent = (cert_cache_entry *)value;
+
+  X509_free(ent->cert);
+  free(ent);
+}
+
+static void cert_cache_drop(struct validation_ctx *vc, cert_cache_entry *ent) {
+  cert_cache_unlink(vc, ent);
+  HashTable_remove(vc->certCache, ent->name, ent->namelen, NULL);
+  free_cert_cache_entry(ent);
+}
+
+static void clear_cert_cache(struct validation_ctx *vc) {
+  if (vc->certCache == NULL)
+    return;
+  LOG(LOG_DEBUG, "certificate cache: %zu hits, %zu misses", vc->certCacheHits,
+      vc->certCacheMisses);
+  HashTable_free(vc->certCache, free_cert_cache_entry);
+  vc->certCache = NULL;
+  vc->certCacheHead = vc->certCacheTail = NULL;
+}
+
+/*
+ * Remember a decoded certificate. On failure the certificate just isn't
+ * cached.
+ */
+static void cert_cache_put(struct validation_ctx *vc, const char *name,
+                           size_t namelen, const struct stat *st, X509 *cert) {
+  cert_cache_entry *ent;
+
+  if (vc->certCache == NULL && (vc->certCache = HashTable_new()) == NULL)
+    return;
+  if ((ent = HashTable_get(vc->certCache, name, namelen)) != NULL)
+    cert_cache_drop(vc, ent);
+  while (vc->certCacheTail != NULL &&
+         HashTable_size(vc->certCache) >= CERT_CACHE_MAX)
+    cert_cache_drop(vc, vc->certCacheTail);
+  ent = malloc(sizeof(*ent) + namelen);
+  if (ent == NULL)
+    return;
+  ent->cert = cert_ref(cert);
+  ent->ino = st->st_ino;
+  ent->size = st->st_size;
+  ent->mtime = st->st_mtime;
+  ent->namelen = namelen;
+  memcpy(ent->name, name, namelen);
+  if (!HashTable_put(vc->certCache, ent->name, ent->namelen, ent, NULL)) {
+    free_cert_cache_entry(ent);
+    return;
+  }
+  cert_cache_push(vc, ent);
+}
+
+/**
+ * @brief
+ *     Read cert data from a file, or get it from the certificate cache
+ *
+ * Unlike cert2fields(), this just fills in the X509 structure, not
+ * the certfields
+ *
+ * @param[out] stap
+ *     Error code.  On error, the value at this location is set to a
+ *     non-zero value.  Otherwise, it is set to 0.  This parameter may
+ *     be NULL.
+ * @return
+ *     NULL on error, non-NULL otherwise.  The certificate may be
+ *     shared with the cache, so it MUST NOT be modified.  Release it
+ *     with X509_free().
+ */
+static X509 *readCertFromFile(struct validation_ctx *vc, char *ofullname,
+                              err_code *stap) {
+  size_t namelen = strlen(ofullname);
+  cert_cache_entry *ent = NULL;
+  struct stat st;
+  X509 *px;
+
+  if (stat(ofullname, &st) != 0) {
+    if (vc->certCache != NULL &&
+        (ent = HashTable_get(vc->certCache, ofullname, namelen)) != NULL)
+      cert_cache_drop(vc, ent);
+    return readCertFromFileUncached(ofullname, stap);
+  }
+  if (vc->certCache != NULL)
+    ent = HashTable_get(vc->certCache, ofullname, namelen);
+  if (ent != NULL) {
+    if (ent->ino == st.st_ino && ent->size == st.st_size &&
+        ent->mtime == st.st_mtime) {
+      vc->certCacheHits++;
+      cert_cache_unlink(vc, ent);
+      cert_cache_push(vc, ent);
+      if (stap)
+        *stap = 0;
+      return cert_ref(ent->cert);
+    }
+    cert_cache_drop(vc, ent);
+  }
+  vc->certCacheMisses++;
+  px = readCertFromFileUncached(ofullname, stap);
+  if (px != NULL)
+    cert_cache_put(vc, ofullname, namelen, &st, px);
+  return px;
+}
+
+/*
+ * Get the certificate that was last decoded from a file, even if the file
+ * has changed since, or NULL if there is none in the cache.
+ */
+static X509 *cachedCert(struct validation_ctx *vc, const char *ofullname) {
+  cert_cache_entry *ent;
+
+  if (vc->certCache == NULL)
+    return NULL;
+  ent = HashTable_get(vc->certCache, ofullname, strlen(ofullname));
+  return ent != NULL ? cert_ref(ent->cert) : NULL;
+}
+
+/**
+ * @brief
+ *     initialize an SQL search structure for certificate searches
+ *
+ * @param[out] certSrchp
+ *     On success the value at this location will be set to the
+ *     location of an initialized SQL search structure.  The caller is
+ *     responsible for freeing the structure via freesrchscm().
+ * @return
+ *     0 on success, a non-zero error code otherwise.
+ */
+static err_code init_certSrch(scmsrcha **certSrchp) {
+  LOG(LOG_DEBUG, "init_certSrch(certSrchp=%p)", certSrchp);
+
+  err_code sta = 0;
+  scmsrcha *certSrch = newsrchscm(NULL, 6, 0, 1);
+  if (!certSrch) {
+    LOG(LOG_ERR, "Unable to allocate memory to construct an SQL query");
+    sta = ERR_SCM_NOMEM;
+    goto done;
+  }
+  ADDCOL2(certSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, goto done);
+  ADDCOL2(certSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, goto done);
+  ADDCOL2(certSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, goto done);
+  ADDCOL2(certSrch, "aki", SQL_C_CHAR, SKISIZE, sta, goto done);
+  ADDCOL2(certSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, goto done);
+  ADDCOL2(certSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+          goto done);
+
+  assert(!sta);
+  if (certSrchp) {
+    *certSrchp = certSrch;
+  } else {
+    freesrchscm(certSrch);
+  }
+  certSrch = NULL;
+
+done:
+  if (sta && certSrch) {
+    freesrchscm(certSrch);
+  }
   LOG(LOG_DEBUG, "init_certSrch() returning %s: %s", err2name(sta),
       err2string(sta));
   return sta;
@@ -1049,10 +1705,10 @@ static err_code find_certs(scmcon *conp, const char *ski, const char *subject,
                  ", found_certsp=%p)",
       conp, ski, subject, found_certsp);
 
+  struct validation_ctx *vc = getvctx(conp);
   err_code sta = 0;
   struct cert_answers *found_certs = NULL;
-  static scmsrcha *certSrch = NULL;
-  INIT_CERTSRCH(certSrch, sta, goto done);
+  INIT_CERTSRCH(vc->findCertsSrch, sta, goto done);
 
   found_certs = malloc(sizeof(*found_certs));
   if (!found_certs) {
@@ -1062,20 +1718,20 @@ static err_code find_certs(scmcon *conp, const char *ski, const char *subject,
   }
   found_certs->cert_ansrp = NULL;
   found_certs->num_ansrs = 0;
-  certSrch->context = found_certs;
+  vc->findCertsSrch->context = found_certs;
 
   // find the entry whose subject is our issuer and whose ski is our aki,
   // e.g. our parent
   if (subject != NULL) {
     char escaped[strlen(subject) * 2 + 1];
     mysql_escape_string(escaped, subject, strlen(subject));
-    xsnprintf(certSrch->wherestr, WHERESTR_SIZE,
+    xsnprintf(vc->findCertsSrch->wherestr, WHERESTR_SIZE,
               "ski=\'%s\' and subject=\'%s\'", ski, escaped);
   } else
-    xsnprintf(certSrch->wherestr, WHERESTR_SIZE, "ski=\'%s\'", ski);
-  addFlagTest(certSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+    xsnprintf(vc->findCertsSrch->wherestr, WHERESTR_SIZE, "ski=\'%s\'", ski);
+  addFlagTest(vc->findCertsSrch->wherestr, SCM_FLAG_VALID, 1, 1);
 
-  sta = searchscm(conp, theCertTable, certSrch, NULL, &addCert2List,
+  sta = searchscm(conp, theCertTable, vc->findCertsSrch, NULL, &addCert2List,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
   LOG(LOG_DEBUG, "searchscm() returned %s: %s", err2name(sta), err2string(sta));
   if (ERR_SCM_NODATA == sta) {
@@ -1135,6 +1791,7 @@ done:
  */
 static X509 *find_cert(scmcon *conp, const char *ski, const char *subject,
                        err_code *stap, int *flagsp) {
+  struct validation_ctx *vc = getvctx(conp);
   LOG(LOG_DEBUG, "find_cert(conp=%p, ski=\"%s\", subject=\"%s\", stap=%p"
                  ", flagsp=%p)",
       conp, ski, subject, stap, flagsp);
@@ -1170,11 +1827,11 @@ static X509 *find_cert(scmcon *conp, const char *ski, const char *subject,
     /** @bug shouldn't sta be set to an error code? */
     goto done;
   }
-  xstrlcpy(parentAKI, cert_ansrp->aki, sizeof(parentAKI));
-  xstrlcpy(parentIssuer, cert_ansrp->issuer, sizeof(parentIssuer));
+  xstrlcpy(vc->parentAKI, cert_ansrp->aki, sizeof(vc->parentAKI));
+  xstrlcpy(vc->parentIssuer, cert_ansrp->issuer, sizeof(vc->parentIssuer));
   if (flagsp)
     *flagsp = cert_ansrp->flags;
-  ret = readCertFromFile(cert_ansrp->fullname, &sta);
+  ret = readCertFromFile(vc, cert_ansrp->fullname, &sta);
 done:
   if (cert_answersp) {
     free(cert_answersp->cert_ansrp);
@@ -1190,28 +1847,27 @@ done:
 
 struct cert_answers *find_cert_by_aKI(char *ski, char *aki, scm *scmp,
                                       scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
   err_code sta = 0;
-  static struct cert_answers cert_answers;
   struct cert_answers *found_certs = NULL;
   initTables(scmp);
-  static scmsrcha *certSrch = NULL;
-  INIT_CERTSRCH(certSrch, sta, return NULL);
+  INIT_CERTSRCH(vc->akiCertsSrch, sta, return NULL);
 
-  found_certs = &cert_answers;
+  found_certs = &vc->akiAnswers;
   if (found_certs->cert_ansrp) {
     free(found_certs->cert_ansrp);
   }
   found_certs->cert_ansrp = NULL;
   found_certs->num_ansrs = 0;
-  certSrch->context = found_certs;
+  vc->akiCertsSrch->context = found_certs;
 
   if (ski)
-    xsnprintf(certSrch->wherestr, WHERESTR_SIZE, "ski=\'%s\'", ski);
+    xsnprintf(vc->akiCertsSrch->wherestr, WHERESTR_SIZE, "ski=\'%s\'", ski);
   else
-    xsnprintf(certSrch->wherestr, WHERESTR_SIZE, "aki=\'%s\'", aki);
-  addFlagTest(certSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+    xsnprintf(vc->akiCertsSrch->wherestr, WHERESTR_SIZE, "aki=\'%s\'", aki);
+  addFlagTest(vc->akiCertsSrch->wherestr, SCM_FLAG_VALID, 1, 1);
 
-  sta = searchscm(conp, theCertTable, certSrch, NULL, &addCert2List,
+  sta = searchscm(conp, theCertTable, vc->akiCertsSrch, NULL, &addCert2List,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
   if (sta < 0) {
     found_certs->num_ansrs = sta;
@@ -1220,24 +1876,23 @@ struct cert_answers *find_cert_by_aKI(char *ski, char *aki, scm *scmp,
 }
 
 struct cert_answers *find_trust_anchors(scm *scmp, scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
   err_code sta = 0;
-  static struct cert_answers cert_answers;
   struct cert_answers *found_certs = NULL;
   initTables(scmp);
-  static scmsrcha *certSrch = NULL;
-  INIT_CERTSRCH(certSrch, sta, return NULL);
+  INIT_CERTSRCH(vc->taCertsSrch, sta, return NULL);
 
-  found_certs = &cert_answers;
+  found_certs = &vc->taAnswers;
   if (found_certs->cert_ansrp) {
     free(found_certs->cert_ansrp);
   }
   found_certs->cert_ansrp = NULL;
   found_certs->num_ansrs = 0;
-  certSrch->context = found_certs;
+  vc->taCertsSrch->context = found_certs;
 
-  addFlagTest(certSrch->wherestr, SCM_FLAG_TRUSTED, 1, 0);
+  addFlagTest(vc->taCertsSrch->wherestr, SCM_FLAG_TRUSTED, 1, 0);
 
-  sta = searchscm(conp, theCertTable, certSrch, NULL, &addCert2List,
+  sta = searchscm(conp, theCertTable, vc->taCertsSrch, NULL, &addCert2List,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
   if (sta < 0) {
     found_certs->num_ansrs = sta;
@@ -1245,16 +1900,157 @@ struct cert_answers *find_trust_anchors(scm *scmp, scmcon *conp) {
   return found_certs;
 }
 
-// static variables for efficiency, so only need to set up query once
+/*
+ * Serial number lists of CRLs, sorted and cached by local_id for
+ * cert_revoked().  local_ids are reused and other processes may replace a
+ * CRL, so an entry is only used while the CRL with its local_id still has
+ * the same signature.  Entries are dropped when this process deletes the
+ * CRL, and the least recently used ones are evicted once the lists take
+ * more than CRL_SERIALS_CACHE_MAX bytes, which also bounds the space held
+ * by CRLs that other processes deleted.
+ */
 
-static scmsrcha *revokedSrch = NULL;
-static uint8_t *revokedSNList;
-static unsigned int *revokedSNLen;
+/** @bug magic number */
+#define CRL_SERIALS_CACHE_MAX (64 * 1024 * 1024)
 
-// static variables to pass to callback
+struct crl_serials {
+  struct crl_serials *prev; // toward most recently used
+  struct crl_serials *next; // toward least recently used
+  unsigned int lid;
+  char sig[SIGSIZE];
+  unsigned int snlen;
+  uint8_t list[]; // snlen serials of SER_NUM_MAX_SZ bytes each, sorted
+};
 
-static int isRevoked;
-static uint8_t *revokedSN = NULL;
+static void crl_serials_unlink(struct validation_ctx *vc,
+                               struct crl_serials *entry) {
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    vc->crlSerialsHead = entry->next;
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    vc->crlSerialsTail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void crl_serials_push(struct validation_ctx *vc,
+                             struct crl_serials *entry) {
+  entry->prev = NULL;
+  entry->next = vc->crlSerialsHead;
+  if (vc->crlSerialsHead != NULL)
+    vc->crlSerialsHead->prev = entry;
+  else
+    vc->crlSerialsTail = entry;
+  vc->crlSerialsHead = entry;
+}
+
+static void crl_serials_drop(struct validation_ctx *vc,
+                             struct crl_serials *entry) {
+  crl_serials_unlink(vc, entry);
+  HashTable_remove(vc->crlSerials, &entry->lid, sizeof(entry->lid), NULL);
+  vc->crlSerialsBytes -= (size_t)entry->snlen * SER_NUM_MAX_SZ;
+  free(entry);
+}
+
+/*
+ * Forget the cached serial list of a CRL that is being deleted.
+ */
+static void forget_crl_serials(scmcon *conp, unsigned int lid) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct crl_serials *entry;
+
+  if (vc->crlSerials == NULL)
+    return;
+  entry = HashTable_get(vc->crlSerials, &lid, sizeof(lid));
+  if (entry != NULL)
+    crl_serials_drop(vc, entry);
+}
+
+static sqlvaluefunc crlSerialsHandler;
+err_code crlSerialsHandler(scmcon *conp, scmsrcha *s, ssize_t numLine) {
+  UNREFERENCED_PARAMETER(conp);
+  UNREFERENCED_PARAMETER(s);
+  UNREFERENCED_PARAMETER(numLine);
+  return 0;
+}
+
+/*
+ * Get the sorted serial number list of a CRL, reading it from the database
+ * into a buffer of exactly its size if it is not already cached.
+ */
+static err_code get_crl_serials(scmcon *conp, unsigned int lid,
+                                unsigned int snlen, const char *sig,
+                                struct crl_serials **entryp) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct crl_serials *entry;
+  size_t size = (size_t)snlen * SER_NUM_MAX_SZ;
+  char where[64];
+  err_code sta;
+
+  if (vc->crlSerials == NULL && (vc->crlSerials = HashTable_new()) == NULL)
+    return ERR_SCM_NOMEM;
+  entry = HashTable_get(vc->crlSerials, &lid, sizeof(lid));
+  if (entry != NULL && entry->snlen == snlen && strcmp(entry->sig, sig) == 0) {
+    crl_serials_unlink(vc, entry);
+    crl_serials_push(vc, entry);
+    *entryp = entry;
+    return 0;
+  }
+  if (entry != NULL)
+    crl_serials_drop(vc, entry);
+  while (vc->crlSerialsTail != NULL &&
+         vc->crlSerialsBytes + size > CRL_SERIALS_CACHE_MAX)
+    crl_serials_drop(vc, vc->crlSerialsTail);
+
+  entry = malloc(sizeof(*entry) + size);
+  if (entry == NULL)
+    return ERR_SCM_NOMEM;
+  entry->lid = lid;
+  xsnprintf(entry->sig, sizeof(entry->sig), "%s", sig);
+  entry->snlen = snlen;
+  if (snlen > 0) {
+    scmsrch srch1[] = {
+        {
+            .colno = 1,
+            .sqltype = SQL_C_BINARY,
+            .colname = "snlist",
+            .valptr = entry->list,
+            .valsize = size,
+            .avalsize = 0,
+        },
+    };
+    scmsrcha srch = {
+        .vec = srch1,
+        .sname = NULL,
+        .ntot = ELTS(srch1),
+        .nused = ELTS(srch1),
+        .vald = 0,
+        .where = NULL,
+        .wherestr = where,
+    };
+    xsnprintf(where, sizeof(where), "local_id=%u", lid);
+    sta = searchscm(conp, theCRLTable, &srch, NULL, &crlSerialsHandler,
+                    SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    if (sta == 0 && srch1[0].avalsize != (SQLLEN)size)
+      sta = ERR_SCM_SQL;
+    if (sta < 0) {
+      free(entry);
+      return sta;
+    }
+    sort_serials(entry->list, snlen);
+  }
+  if (!HashTable_put(vc->crlSerials, &entry->lid, sizeof(entry->lid), entry,
+                     NULL)) {
+    free(entry);
+    return ERR_SCM_NOMEM;
+  }
+  crl_serials_push(vc, entry);
+  vc->crlSerialsBytes += size;
+  *entryp = entry;
+  return 0;
+}
 
 /**
  * @brief
@@ -1262,23 +2058,21 @@ static uint8_t *revokedSN = NULL;
  */
 static sqlvaluefunc revokedHandler;
 err_code revokedHandler(scmcon *conp, scmsrcha *s, ssize_t numLine) {
-  UNREFERENCED_PARAMETER(conp);
+  struct validation_ctx *vc = getvctx(conp);
+  struct crl_serials *entry;
+  err_code sta;
   UNREFERENCED_PARAMETER(s);
   UNREFERENCED_PARAMETER(numLine);
-  unsigned int i;
-  LOG(LOG_DEBUG, "number of revoked certs in CRL: %u", *revokedSNLen);
-  for (i = 0; i < *revokedSNLen; i++) {
-    uint8_t *entry = &revokedSNList[SER_NUM_MAX_SZ * i];
-    if (LOG_DEBUG <= LOG_LEVEL) {
-      char *x = hexify(SER_NUM_MAX_SZ, entry, HEXIFY_X);
-      LOG(LOG_DEBUG, "  checking entry %u: %s", i, x);
-      free(x);
-    }
-    if (memcmp(entry, revokedSN, SER_NUM_MAX_SZ) == 0) {
-      isRevoked = 1;
-      break;
-    }
-  }
+  if (vc->isRevoked)
+    return 0;
+  sta = get_crl_serials(conp, *vc->revokedLid, *vc->revokedSNLen,
+                        vc->revokedSig, &entry);
+  if (sta < 0)
+    return sta;
+  LOG(LOG_DEBUG, "number of revoked certs in CRL: %u", entry->snlen);
+  if (entry->snlen > 0 && bsearch(vc->revokedSN, entry->list, entry->snlen,
+                                  SER_NUM_MAX_SZ, serial_cmp) != NULL)
+    vc->isRevoked = 1;
   return 0;
 }
 
@@ -1291,6 +2085,7 @@ err_code revokedHandler(scmcon *conp, scmsrcha *s, ssize_t numLine) {
  *     revoked, or other error code
  */
 static err_code cert_revoked(scm *scmp, scmcon *conp, char *sn, char *issuer) {
+  struct validation_ctx *vc = getvctx(conp);
   LOG(LOG_DEBUG, "cert_revoked(scmp=%p, conp=%p, sn=\"%s\", issuer=\"%s\")",
       scmp, conp, sn, issuer);
 
@@ -1298,39 +2093,44 @@ static err_code cert_revoked(scm *scmp, scmcon *conp, char *sn, char *issuer) {
   int sn_len;
 
   // set up query once first time through and then just modify
-  if (revokedSrch == NULL) {
-    revokedSrch = newsrchscm(NULL, 2, 0, 1);
+  if (vc->revokedSrch == NULL) {
+    vc->revokedSrch = newsrchscm(NULL, 3, 0, 1);
     initTables(scmp);
-    ADDCOL(revokedSrch, "snlen", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    /** @bug magic number */
-    ADDCOL(revokedSrch, "snlist", SQL_C_BINARY, 16 * 1024 * 1024, sta, sta);
-    revokedSNLen = revokedSrch->vec[0].valptr;
-    revokedSNList = revokedSrch->vec[1].valptr;
-  }
-  // query for crls such that issuer = issuer, and flags & valid
-  // and set isRevoked = 1 in the callback if sn is in snlist
-  char escaped[strlen(issuer) * 2 + 1];
-  mysql_escape_string(escaped, issuer, strlen(issuer));
-  xsnprintf(revokedSrch->wherestr, WHERESTR_SIZE, "issuer=\"%s\"", escaped);
-  addFlagTest(revokedSrch->wherestr, SCM_FLAG_VALID, 1, 1);
-  isRevoked = 0;
+    ADDCOL(vc->revokedSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+           sta);
+    ADDCOL(vc->revokedSrch, "snlen", SQL_C_ULONG, sizeof(unsigned int), sta,
+           sta);
+    ADDCOL(vc->revokedSrch, "sig", SQL_C_CHAR, SIGSIZE, sta, sta);
+    vc->revokedLid = vc->revokedSrch->vec[0].valptr;
+    vc->revokedSNLen = vc->revokedSrch->vec[1].valptr;
+    vc->revokedSig = vc->revokedSrch->vec[2].valptr;
+    // query for crls such that issuer = issuer, and flags & valid
+    // and set vc->isRevoked = 1 in the callback if sn is in the CRL's
+    // cached serial list
+    xsnprintf(vc->revokedSrch->wherestr, WHERESTR_SIZE, "issuer=?");
+    addFlagTest(vc->revokedSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+    vc->revokedSrch->params = vc->revokedParams;
+    vc->revokedSrch->nparams = 1;
+  }
+  vc->revokedParams[0] = issuer;
+  vc->isRevoked = 0;
   sn_len = strlen(sn);
   if (sn_len != 2 + 2 * SER_NUM_MAX_SZ) // "^x" followed by hex
   {
     sta = ERR_SCM_INVALARG;
     goto done;
   }
-  revokedSN = unhexify(sn_len - 2, sn + 2); // 2 for the "^x" prefix
-  if (revokedSN == NULL) {
+  vc->revokedSN = unhexify(sn_len - 2, sn + 2); // 2 for the "^x" prefix
+  if (vc->revokedSN == NULL) {
     sta = ERR_SCM_NOMEM;
     goto done;
   }
   /** @bug ignores error code without explanation */
-  sta = searchscm(conp, theCRLTable, revokedSrch, NULL, &revokedHandler,
+  sta = searchscm(conp, theCRLTable, vc->revokedSrch, NULL, &revokedHandler,
                   SCM_SRCH_DOVALUE_ALWAYS, NULL);
-  free(revokedSN);
-  revokedSN = NULL;
-  sta = isRevoked ? ERR_SCM_REVOKED : 0;
+  free(vc->revokedSN);
+  vc->revokedSN = NULL;
+  sta = vc->isRevoked ? ERR_SCM_REVOKED : 0;
 
 done:
   LOG(LOG_DEBUG, "cert_revoked() returning %s: %s", err2name(sta),
@@ -1338,6 +2138,749 @@ done:
   return sta;
 }
 
+/*
+ * In-memory index of the valid CA certificates, used by find_cert_paths()
+ * instead of one query per level of the certification path. Certs are
+ * grouped by (SKI, subject), and each cert points at the group of its
+ * possible issuers, i.e. the group for its (AKI, issuer). Groups are
+ * never freed while the index is loaded, so those pointers stay good.
+ *
+ * The index is only used after load_cert_index() has been called. It is
+ * kept current by this process's own adds, deletes and validity changes,
+ * which are undone again if their transaction or savepoint is rolled back
+ * (see cert_index_rollback()). Changes made by other processes are picked
+ * up by refresh_cert_index().
+ */
+
+struct cert_index_group;
+
+struct cert_index_node {
+  unsigned int local_id;
+  unsigned int flags;
+  char *fullname;
+  struct cert_index_group *group;  // group for (SKI, subject)
+  struct cert_index_group *issuer; // group for (AKI, issuer)
+  struct cert_index_node *next;    // next cert in the same group
+};
+
+struct cert_index_group {
+  struct cert_index_node *certs;
+};
+
+/*
+ * A change to the index made inside a transaction. A removed node is kept
+ * until the transaction ends, so that it can be put back.
+ */
+struct cert_index_change {
+  enum {
+    CERT_INDEX_ADDED,
+    CERT_INDEX_REMOVED,
+    CERT_INDEX_FLAGS,
+  } what;
+  struct cert_index_node *node;
+  unsigned int flags; // before a CERT_INDEX_FLAGS change
+};
+
+static bool is_indexed_cert(unsigned int flags) {
+  return (flags & (SCM_FLAG_CA | SCM_FLAG_VALID)) ==
+         (SCM_FLAG_CA | SCM_FLAG_VALID);
+}
+
+static void free_cert_index_node(struct cert_index_node *node) {
+  free(node->fullname);
+  free(node);
+}
+
+static void free_cert_index_group(void *value) {
+  struct cert_index_group *group = value;
+  struct cert_index_node *node;
+
+  while ((node = group->certs) != NULL) {
+    group->certs = node->next;
+    free_cert_index_node(node);
+  }
+  free(group);
+}
+
+/*
+ * Forget the changes recorded for the current transaction, freeing the
+ * nodes they removed.
+ */
+static void forget_cert_index_changes(struct validation_ctx *vc) {
+  size_t i;
+
+  for (i = 0; i < vc->certIndexChangesSize; i++) {
+    if (vc->certIndexChanges[i].what == CERT_INDEX_REMOVED)
+      free_cert_index_node(vc->certIndexChanges[i].node);
+  }
+  vc->certIndexChangesSize = 0;
+  vc->certIndexChangesMark = 0;
+  vc->certIndexLoadedInTxn = false;
+  vc->certIndexLoadedSinceSavepoint = false;
+}
+
+static void clear_cert_index(struct validation_ctx *vc) {
+  forget_cert_index_changes(vc);
+  // the nodes are owned by their groups
+  HashTable_free(vc->certIndexIds, NULL);
+  HashTable_free(vc->certIndexGroups, free_cert_index_group);
+  vc->certIndexIds = NULL;
+  vc->certIndexGroups = NULL;
+  vc->certIndexLoaded = false;
+}
+
+static struct cert_index_group *cert_index_group(struct validation_ctx *vc,
+                                                 const char *ski,
+                                                 const char *subject,
+                                                 bool create) {
+  size_t ski_len = strlen(ski);
+  size_t key_len = ski_len + 1 + strlen(subject);
+  char key[key_len + 1];
+  struct cert_index_group *group;
+
+  memcpy(key, ski, ski_len + 1);
+  strcpy(key + ski_len + 1, subject);
+  group = HashTable_get(vc->certIndexGroups, key, key_len);
+  if (group != NULL || !create)
+    return group;
+  group = calloc(1, sizeof(*group));
+  if (group == NULL)
+    return NULL;
+  if (!HashTable_put(vc->certIndexGroups, key, key_len, group, NULL)) {
+    free(group);
+    return NULL;
+  }
+  return group;
+}
+
+static bool cert_index_link(struct validation_ctx *vc,
+                            struct cert_index_node *node) {
+  if (!HashTable_put(vc->certIndexIds, &node->local_id,
+                     sizeof(node->local_id), node, NULL))
+    return false;
+  node->next = node->group->certs;
+  node->group->certs = node;
+  return true;
+}
+
+static void cert_index_unlink(struct validation_ctx *vc,
+                              struct cert_index_node *node) {
+  struct cert_index_node **nodep;
+
+  (void)HashTable_remove(vc->certIndexIds, &node->local_id,
+                         sizeof(node->local_id), NULL);
+  // the group itself stays, since other certs may point at it
+  for (nodep = &node->group->certs; *nodep != NULL; nodep = &(*nodep)->next) {
+    if (*nodep == node) {
+      *nodep = node->next;
+      break;
+    }
+  }
+}
+
+static struct cert_index_node *
+cert_index_insert(struct validation_ctx *vc, unsigned int local_id,
+                  unsigned int flags, const char *ski, const char *subject,
+                  const char *aki, const char *issuer, const char *fullname) {
+  struct cert_index_node *node;
+
+  node = calloc(1, sizeof(*node));
+  if (node == NULL)
+    return NULL;
+  node->local_id = local_id;
+  node->flags = flags;
+  node->fullname = strdup(fullname);
+  node->group = cert_index_group(vc, ski, subject, true);
+  // trust anchors are not looked up through their issuer
+  if (!(flags & SCM_FLAG_TRUSTED) && aki != NULL && issuer != NULL)
+    node->issuer = cert_index_group(vc, aki, issuer, true);
+  if (node->fullname == NULL || node->group == NULL ||
+      (!(flags & SCM_FLAG_TRUSTED) && node->issuer == NULL) ||
+      !cert_index_link(vc, node)) {
+    free_cert_index_node(node);
+    return NULL;
+  }
+  return node;
+}
+
+/*
+ * Remember a CA certificate that became valid, to be handed off to the
+ * loader process that owns its publication point. Other certificates have
+ * no children to revalidate. See take_validated_certs().
+ */
+static void note_validated_cert(struct validation_ctx *vc,
+                                unsigned int local_id, unsigned int flags) {
+  unsigned int *ids;
+  size_t alloc;
+
+  if (!vc->validatedWanted || !is_indexed_cert(flags))
+    return;
+  if (vc->validatedSize == vc->validatedAlloc) {
+    alloc = vc->validatedAlloc ? 2 * vc->validatedAlloc : 64;
+    ids = realloc(vc->validatedIds, alloc * sizeof(*ids));
+    if (ids == NULL) {
+      LOG(LOG_ERR, "out of memory; certificate %u is not handed off",
+          local_id);
+      return;
+    }
+    vc->validatedIds = ids;
+    vc->validatedAlloc = alloc;
+  }
+  vc->validatedIds[vc->validatedSize++] = local_id;
+}
+
+void track_validated_certs(scmcon *conp, bool enable) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  vc->validatedWanted = enable;
+  if (!enable)
+    vc->validatedSize = 0;
+}
+
+size_t take_validated_certs(scmcon *conp, unsigned int **ids) {
+  struct validation_ctx *vc = getvctx(conp);
+  size_t n = vc->validatedSize;
+
+  *ids = vc->validatedIds;
+  vc->validatedIds = NULL;
+  vc->validatedSize = vc->validatedAlloc = 0;
+  return n;
+}
+
+/*
+ * Put off validating the children of a certificate that became valid. See
+ * coalesce_revalidation(). Returns false if the children must be validated
+ * now.
+ */
+static bool mark_dirty_cert(struct validation_ctx *vc, unsigned int local_id) {
+  if (!vc->dirtyWanted)
+    return false;
+  if (vc->dirtyCerts == NULL && (vc->dirtyCerts = HashTable_new()) == NULL)
+    return false;
+  return HashTable_put(vc->dirtyCerts, &local_id, sizeof(local_id), NULL,
+                       NULL);
+}
+
+void coalesce_revalidation(scmcon *conp, bool enable) {
+  getvctx(conp)->dirtyWanted = enable;
+}
+
+size_t dirty_cert_count(scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  return vc->dirtyCerts == NULL ? 0 : HashTable_size(vc->dirtyCerts);
+}
+
+struct dirty_cert_list {
+  unsigned int *ids;
+  size_t n;
+};
+
+static void collect_dirty_cert(void const *key, size_t key_len, void *value,
+                               void *arg) {
+  struct dirty_cert_list *list = arg;
+
+  UNREFERENCED_PARAMETER(key_len);
+  UNREFERENCED_PARAMETER(value);
+  memcpy(&list->ids[list->n++], key, sizeof(list->ids[0]));
+}
+
+static int compare_local_ids(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+
+  return (x > y) - (x < y);
+}
+
+size_t take_dirty_certs(scmcon *conp, unsigned int **ids) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct dirty_cert_list list = {NULL, 0};
+  size_t n = dirty_cert_count(conp);
+
+  *ids = NULL;
+  if (n == 0)
+    return 0;
+  list.ids = malloc(n * sizeof(*list.ids));
+  if (list.ids == NULL) {
+    LOG(LOG_ERR, "out of memory; revalidating below %zu certificates later",
+        n);
+    return 0;
+  }
+  HashTable_foreach(vc->dirtyCerts, collect_dirty_cert, &list);
+  HashTable_clear(vc->dirtyCerts, NULL);
+  // oldest first, which tends to be parents before children
+  qsort(list.ids, list.n, sizeof(*list.ids), compare_local_ids);
+  *ids = list.ids;
+  return list.n;
+}
+
+/*
+ * Record a change to the index in the current transaction, if any. Returns
+ * false if there is no memory for it.
+ */
+static bool cert_index_note_change(scmcon *conp, int what,
+                                   struct cert_index_node *node,
+                                   unsigned int flags) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct cert_index_change *changes;
+  size_t alloc;
+
+  if (!conp->intxn)
+    return true;
+  if (vc->certIndexChangesSize == vc->certIndexChangesAlloc) {
+    alloc = vc->certIndexChangesAlloc ? 2 * vc->certIndexChangesAlloc : 64;
+    changes = realloc(vc->certIndexChanges, alloc * sizeof(*changes));
+    if (changes == NULL)
+      return false;
+    vc->certIndexChanges = changes;
+    vc->certIndexChangesAlloc = alloc;
+  }
+  changes = &vc->certIndexChanges[vc->certIndexChangesSize++];
+  changes->what = what;
+  changes->node = node;
+  changes->flags = flags;
+  return true;
+}
+
+static void cert_index_remove(scmcon *conp, struct cert_index_node *node) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  cert_index_unlink(vc, node);
+  if (!conp->intxn) {
+    free_cert_index_node(node);
+  } else if (!cert_index_note_change(conp, CERT_INDEX_REMOVED, node, 0)) {
+    free_cert_index_node(node);
+    clear_cert_index(vc);
+  }
+}
+
+/*
+ * Bring the index up to date with one certificate. If it is not in the
+ * index yet, it can only be added if ski is not NULL. On failure the
+ * index is dropped, which is safe: it is reloaded the next time it is
+ * needed.
+ */
+static void cert_index_update(scmcon *conp, unsigned int local_id,
+                              unsigned int flags, const char *ski,
+                              const char *subject, const char *aki,
+                              const char *issuer, const char *fullname) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct cert_index_node *node;
+
+  if (!vc->certIndexLoaded)
+    return;
+  node = HashTable_get(vc->certIndexIds, &local_id, sizeof(local_id));
+  if (node != NULL) {
+    if (!is_indexed_cert(flags)) {
+      cert_index_remove(conp, node);
+    } else if (node->flags != flags) {
+      if (!cert_index_note_change(conp, CERT_INDEX_FLAGS, node, node->flags))
+        clear_cert_index(vc);
+      else
+        node->flags = flags;
+    }
+    return;
+  }
+  if (!is_indexed_cert(flags) || ski == NULL)
+    return;
+  node = cert_index_insert(vc, local_id, flags, ski, subject, aki, issuer,
+                           fullname);
+  if (node == NULL)
+    clear_cert_index(vc);
+  else if (!cert_index_note_change(conp, CERT_INDEX_ADDED, node, 0))
+    clear_cert_index(vc);
+}
+
+/*
+ * Add a certificate that just became a valid CA certificate, reading what
+ * the index needs from the database.
+ */
+static void cert_index_fetch(scmcon *conp, unsigned int local_id) {
+  unsigned int flags = 0;
+  char ski[SKISIZE] = "";
+  char subject[SUBJSIZE] = "";
+  char aki[SKISIZE] = "";
+  char issuer[SUBJSIZE] = "";
+  char dirname[DNAMESIZE] = "";
+  char filename[FNAMESIZE] = "";
+  char fullname[PATH_MAX];
+  char lid[24];
+  char where[WHERESTR_SIZE] = "local_id=?";
+  const char *params[1] = {lid};
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "flags",
+       .valptr = &flags, .valsize = sizeof(flags)},
+      {.colno = 2, .sqltype = SQL_C_CHAR, .colname = "ski",
+       .valptr = ski, .valsize = sizeof(ski)},
+      {.colno = 3, .sqltype = SQL_C_CHAR, .colname = "subject",
+       .valptr = subject, .valsize = sizeof(subject)},
+      {.colno = 4, .sqltype = SQL_C_CHAR, .colname = "aki",
+       .valptr = aki, .valsize = sizeof(aki)},
+      {.colno = 5, .sqltype = SQL_C_CHAR, .colname = "issuer",
+       .valptr = issuer, .valsize = sizeof(issuer)},
+      {.colno = 6, .sqltype = SQL_C_CHAR, .colname = "dirname",
+       .valptr = dirname, .valsize = sizeof(dirname)},
+      {.colno = 7, .sqltype = SQL_C_CHAR, .colname = "filename",
+       .valptr = filename, .valsize = sizeof(filename)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where, .params = params, .nparams = 1,
+  };
+  err_code sta;
+
+  xsnprintf(lid, sizeof(lid), "%u", local_id);
+  sta = searchscm(conp, theCertTable, &srch, NULL, &ok,
+                  SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
+  if (sta == ERR_SCM_NODATA)
+    return;
+  if (sta < 0) {
+    clear_cert_index(getvctx(conp));
+    return;
+  }
+  xsnprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
+  cert_index_update(conp, local_id, flags, ski, subject, aki, issuer,
+                    fullname);
+}
+
+/*
+ * Record a change to the certificate table.
+ */
+static void cert_index_added(scmcon *conp, unsigned int local_id,
+                             unsigned int flags, const char *ski,
+                             const char *subject, const char *aki,
+                             const char *issuer, const char *fullname) {
+  note_validated_cert(getvctx(conp), local_id, flags);
+  cert_index_update(conp, local_id, flags, ski, subject, aki, issuer,
+                    fullname);
+}
+
+static void cert_index_set_flags(scmcon *conp, unsigned int local_id,
+                                 unsigned int flags) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  note_validated_cert(vc, local_id, flags);
+  if (!vc->certIndexLoaded)
+    return;
+  if (is_indexed_cert(flags) &&
+      HashTable_get(vc->certIndexIds, &local_id, sizeof(local_id)) == NULL)
+    cert_index_fetch(conp, local_id);
+  else
+    cert_index_update(conp, local_id, flags, NULL, NULL, NULL, NULL, NULL);
+}
+
+static void cert_index_deleted(scmcon *conp, unsigned int local_id) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct cert_index_node *node;
+
+  if (!vc->certIndexLoaded)
+    return;
+  node = HashTable_get(vc->certIndexIds, &local_id, sizeof(local_id));
+  if (node != NULL)
+    cert_index_remove(conp, node);
+}
+
+void cert_index_savepoint(scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  vc->certIndexChangesMark = vc->certIndexChangesSize;
+  vc->certIndexLoadedSinceSavepoint = false;
+}
+
+void cert_index_rollback(scmcon *conp, bool to_savepoint) {
+  struct validation_ctx *vc = getvctx(conp);
+  struct cert_index_change *change;
+  size_t mark = to_savepoint ? vc->certIndexChangesMark : 0;
+
+  // rows loaded from the database may be among those rolled back
+  if (to_savepoint ? vc->certIndexLoadedSinceSavepoint
+                   : vc->certIndexLoadedInTxn) {
+    clear_cert_index(vc);
+    return;
+  }
+  while (vc->certIndexChangesSize > mark) {
+    change = &vc->certIndexChanges[--vc->certIndexChangesSize];
+    switch (change->what) {
+    case CERT_INDEX_ADDED:
+      cert_index_unlink(vc, change->node);
+      free_cert_index_node(change->node);
+      break;
+    case CERT_INDEX_REMOVED:
+      if (!cert_index_link(vc, change->node)) {
+        free_cert_index_node(change->node);
+        clear_cert_index(vc);
+        return;
+      }
+      break;
+    case CERT_INDEX_FLAGS:
+      change->node->flags = change->flags;
+      break;
+    }
+  }
+  if (!to_savepoint)
+    forget_cert_index_changes(vc);
+}
+
+void cert_index_commit(scmcon *conp) {
+  forget_cert_index_changes(getvctx(conp));
+}
+
+static sqlblockfunc cert_index_rows;
+err_code cert_index_rows(scmcon *conp, scmsrcha *s, scmblock *blk) {
+  char fullname[PATH_MAX];
+  const char *dirname;
+  const char *filename;
+  unsigned int *lidp;
+  unsigned int *flagsp;
+  size_t row;
+
+  for (row = 0; row < blk->nrows; row++) {
+    lidp = blockvalscm(s, blk, 0, row);
+    flagsp = blockvalscm(s, blk, 1, row);
+    dirname = blockvalscm(s, blk, 6, row);
+    filename = blockvalscm(s, blk, 7, row);
+    if (lidp == NULL || flagsp == NULL || blockvalscm(s, blk, 2, row) == NULL ||
+        blockvalscm(s, blk, 3, row) == NULL || dirname == NULL ||
+        filename == NULL)
+      continue;
+    xsnprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
+    if (cert_index_insert(getvctx(conp), *lidp, *flagsp,
+                          blockvalscm(s, blk, 2, row),
+                          blockvalscm(s, blk, 3, row),
+                          blockvalscm(s, blk, 4, row),
+                          blockvalscm(s, blk, 5, row), fullname) == NULL)
+      return ERR_SCM_NOMEM;
+  }
+  return 0;
+}
+
+static err_code fill_cert_index(scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  unsigned int lid;
+  unsigned int flags;
+  char ski[SKISIZE];
+  char subject[SUBJSIZE];
+  char aki[SKISIZE];
+  char issuer[SUBJSIZE];
+  char dirname[DNAMESIZE];
+  char filename[FNAMESIZE];
+  char where[WHERESTR_SIZE] = "";
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "local_id",
+       .valptr = &lid, .valsize = sizeof(lid)},
+      {.colno = 2, .sqltype = SQL_C_ULONG, .colname = "flags",
+       .valptr = &flags, .valsize = sizeof(flags)},
+      {.colno = 3, .sqltype = SQL_C_CHAR, .colname = "ski",
+       .valptr = ski, .valsize = sizeof(ski)},
+      {.colno = 4, .sqltype = SQL_C_CHAR, .colname = "subject",
+       .valptr = subject, .valsize = sizeof(subject)},
+      {.colno = 5, .sqltype = SQL_C_CHAR, .colname = "aki",
+       .valptr = aki, .valsize = sizeof(aki)},
+      {.colno = 6, .sqltype = SQL_C_CHAR, .colname = "issuer",
+       .valptr = issuer, .valsize = sizeof(issuer)},
+      {.colno = 7, .sqltype = SQL_C_CHAR, .colname = "dirname",
+       .valptr = dirname, .valsize = sizeof(dirname)},
+      {.colno = 8, .sqltype = SQL_C_CHAR, .colname = "filename",
+       .valptr = filename, .valsize = sizeof(filename)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where,
+  };
+  err_code sta;
+
+  clear_cert_index(vc);
+  if (theCertTable == NULL)
+    return ERR_SCM_NOSUCHTAB;
+  vc->certIndexGroups = HashTable_new();
+  vc->certIndexIds = HashTable_new();
+  if (vc->certIndexGroups == NULL || vc->certIndexIds == NULL) {
+    clear_cert_index(vc);
+    return ERR_SCM_NOMEM;
+  }
+  addFlagTest(where, SCM_FLAG_CA, 1, 0);
+  addFlagTest(where, SCM_FLAG_VALID, 1, 1);
+  // rows are about 6KB, mostly dirname
+  sta = searchblockscm(conp, theCertTable, &srch, &cert_index_rows,
+                       SCM_SRCH_DO_JOIN | SCM_SRCH_BREAK_VERR, NULL, 256);
+  if (sta == ERR_SCM_NODATA)
+    sta = 0;
+  if (sta < 0) {
+    clear_cert_index(vc);
+    return sta;
+  }
+  vc->certIndexLoaded = true;
+  vc->certIndexLoadedInTxn = conp->intxn != 0;
+  vc->certIndexLoadedSinceSavepoint = conp->intxn != 0;
+  LOG(LOG_DEBUG, "loaded %zu certificates into the certificate index",
+      HashTable_size(vc->certIndexIds));
+  return 0;
+}
+
+err_code load_cert_index(scm *scmp, scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  initTables(scmp);
+  vc->certIndexWanted = true;
+  return fill_cert_index(conp);
+}
+
+void reset_cert_index(scmcon *conp) {
+  if (conp != NULL && conp->vctx != NULL)
+    clear_cert_index(conp->vctx);
+}
+
+/*
+ * See refresh_cert_index(). The valid CA certificates now in the table are
+ * collected by local_id, with their flags as the value.
+ */
+static sqlblockfunc cert_index_refresh_rows;
+err_code cert_index_refresh_rows(scmcon *conp, scmsrcha *s, scmblock *blk) {
+  HashTable *current = s->context;
+  unsigned int *lidp;
+  unsigned int *flagsp;
+  size_t row;
+
+  UNREFERENCED_PARAMETER(conp);
+  for (row = 0; row < blk->nrows; row++) {
+    lidp = blockvalscm(s, blk, 0, row);
+    flagsp = blockvalscm(s, blk, 1, row);
+    if (lidp == NULL || flagsp == NULL)
+      continue;
+    if (!HashTable_put(current, lidp, sizeof(*lidp),
+                       (void *)(uintptr_t)*flagsp, NULL))
+      return ERR_SCM_NOMEM;
+  }
+  return 0;
+}
+
+static bool cert_index_gone(void const *key, size_t key_len, void *value,
+                            void *arg) {
+  UNREFERENCED_PARAMETER(value);
+  return !HashTable_contains(arg, key, key_len);
+}
+
+static void free_unlinked_cert_index_node(void *value) {
+  struct cert_index_node *node = value;
+  struct cert_index_node **nodep;
+
+  for (nodep = &node->group->certs; *nodep != NULL; nodep = &(*nodep)->next) {
+    if (*nodep == node) {
+      *nodep = node->next;
+      break;
+    }
+  }
+  free_cert_index_node(node);
+}
+
+struct cert_index_refresh {
+  struct validation_ctx *vc;
+  unsigned int *missing;
+  size_t nmissing;
+  size_t alloc;
+  bool nomem;
+};
+
+static void cert_index_refresh_one(void const *key, size_t key_len,
+                                   void *value, void *arg) {
+  struct cert_index_refresh *refresh = arg;
+  struct cert_index_node *node;
+  unsigned int *missing;
+  size_t alloc;
+
+  node = HashTable_get(refresh->vc->certIndexIds, key, key_len);
+  if (node != NULL) {
+    node->flags = (unsigned int)(uintptr_t)value;
+    return;
+  }
+  if (refresh->nmissing == refresh->alloc) {
+    alloc = refresh->alloc ? 2 * refresh->alloc : 64;
+    missing = realloc(refresh->missing, alloc * sizeof(*missing));
+    if (missing == NULL) {
+      refresh->nomem = true;
+      return;
+    }
+    refresh->missing = missing;
+    refresh->alloc = alloc;
+  }
+  memcpy(&refresh->missing[refresh->nmissing++], key, sizeof(*missing));
+}
+
+err_code refresh_cert_index(scm *scmp, scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  unsigned int lid;
+  unsigned int flags;
+  char where[WHERESTR_SIZE] = "";
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "local_id",
+       .valptr = &lid, .valsize = sizeof(lid)},
+      {.colno = 2, .sqltype = SQL_C_ULONG, .colname = "flags",
+       .valptr = &flags, .valsize = sizeof(flags)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where,
+  };
+  struct cert_index_refresh refresh = {.vc = vc};
+  HashTable *current;
+  err_code sta;
+  size_t i;
+
+  if (!vc->certIndexLoaded)
+    return 0;
+  if (conp->intxn) {
+    // changes would have to be undone on rollback; just load it again
+    clear_cert_index(vc);
+    return 0;
+  }
+  initTables(scmp);
+  current = HashTable_new();
+  if (current == NULL) {
+    clear_cert_index(vc);
+    return ERR_SCM_NOMEM;
+  }
+  srch.context = current;
+  addFlagTest(where, SCM_FLAG_CA, 1, 0);
+  addFlagTest(where, SCM_FLAG_VALID, 1, 1);
+  sta = searchblockscm(conp, theCertTable, &srch, &cert_index_refresh_rows,
+                       SCM_SRCH_BREAK_VERR, NULL, 4096);
+  if (sta == ERR_SCM_NODATA)
+    sta = 0;
+  if (sta < 0) {
+    clear_cert_index(vc);
+    HashTable_free(current, NULL);
+    return sta;
+  }
+  (void)HashTable_remove_if(vc->certIndexIds, cert_index_gone, current,
+                            free_unlinked_cert_index_node);
+  HashTable_foreach(current, cert_index_refresh_one, &refresh);
+  HashTable_free(current, NULL);
+  if (refresh.nomem) {
+    clear_cert_index(vc);
+    sta = ERR_SCM_NOMEM;
+  }
+  for (i = 0; i < refresh.nmissing && vc->certIndexLoaded; i++)
+    cert_index_fetch(conp, refresh.missing[i]);
+  free(refresh.missing);
+  LOG(LOG_DEBUG, "refreshed the certificate index, %zu new certificates",
+      refresh.nmissing);
+  return sta;
+}
+
+/*
+ * Make sure the index is usable if it was asked for. Returns false if
+ * find_cert_paths() should use the database instead.
+ */
+static bool have_cert_index(scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  if (!vc->certIndexWanted)
+    return false;
+  if (!vc->certIndexLoaded) {
+    /** @bug ignores error code without explanation */
+    fill_cert_index(conp);
+  }
+  return vc->certIndexLoaded;
+}
+
 /**
  * @brief
  *     Callback that is executed whenever a certification path is
@@ -1382,6 +2925,7 @@ typedef err_code find_cert_paths_cb(void *cb_context,
  *     Internal data for find_cert_paths() and its helper functions
  */
 struct find_cert_paths_context {
+  struct validation_ctx *vc;
   find_cert_paths_cb *cb;
   void *cb_context;
   STACK_OF(X509) * cert_path;
@@ -1449,7 +2993,7 @@ err_code find_cert_paths_handle_row(scmcon *conp, scmsrcha *s, ssize_t idx) {
       xsnprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
   assert(dirname_len + 1 + filename_len == fullname_len);
 
-  X509 *cert = readCertFromFile(fullname, &sta);
+  X509 *cert = readCertFromFile(ctx->vc, fullname, &sta);
   if (sta) {
     goto done;
   }
@@ -1481,6 +3025,42 @@ done:
   return sta;
 }
 
+/**
+ * @brief
+ *     Helper function for find_cert_paths() that walks the certificate
+ *     index instead of querying the database
+ */
+static err_code find_cert_paths_indexed(struct cert_index_group *group,
+                                        struct find_cert_paths_context *ctx) {
+  struct cert_index_node *node;
+  err_code sta = 0;
+
+  for (node = group->certs; node != NULL && sta == 0; node = node->next) {
+    if (!(node->flags & SCM_FLAG_VALID))
+      continue;
+    X509 *cert = readCertFromFile(ctx->vc, node->fullname, &sta);
+    if (sta) {
+      break;
+    }
+    assert(cert);
+    if (node->flags & SCM_FLAG_TRUSTED) {
+      // cert is a trust anchor.  call the callback
+      if (ctx->cb) {
+        sta = (*ctx->cb)(ctx->cb_context, ctx->cert_path, cert);
+      }
+    } else if (sk_X509_push(ctx->cert_path, cert) <= 0) {
+      LOG(LOG_ERR, "sk_X509_push() failed");
+      sta = ERR_SCM_X509STACK;
+    } else {
+      sta = find_cert_paths_indexed(node->issuer, ctx);
+      X509 *popped = sk_X509_pop(ctx->cert_path);
+      assert(popped == cert);
+    }
+    X509_free(cert);
+  }
+  return sta;
+}
+
 err_code find_cert_paths_internal(scmcon *conp, const char *ski,
                                   const char *subject,
                                   struct find_cert_paths_context *ctx) {
@@ -1601,14 +3181,24 @@ static err_code find_cert_paths(scmcon *conp, const char *ski,
 
   err_code sta = 0;
   struct find_cert_paths_context ctx = {
-      .cb = cb, .cb_context = cb_context, .cert_path = sk_X509_new_null(),
+      .vc = getvctx(conp),
+      .cb = cb,
+      .cb_context = cb_context,
+      .cert_path = sk_X509_new_null(),
   };
   if (ctx.cert_path == NULL) {
     LOG(LOG_ERR, "sk_X509_new_null() returned NULL");
     sta = ERR_SCM_X509STACK;
     goto done;
   }
-  sta = find_cert_paths_internal(conp, ski, subject, &ctx);
+  if (have_cert_index(conp)) {
+    struct cert_index_group *group =
+        cert_index_group(ctx.vc, ski, subject, false);
+    if (group != NULL)
+      sta = find_cert_paths_indexed(group, &ctx);
+  } else {
+    sta = find_cert_paths_internal(conp, ski, subject, &ctx);
+  }
   assert(!sk_X509_num(ctx.cert_path));
   sk_X509_pop_free(ctx.cert_path, X509_free);
 
@@ -1693,6 +3283,11 @@ static err_code verify_cert(scmcon *conp, X509 *cert, int isTrusted,
   }
 
   // not a trust anchor
+  if (getvctx(conp)->deferValidation) {
+    // stored as if the parent had not arrived; see defer_validation()
+    sta = ERR_SCM_NOTVALID;
+    goto done;
+  }
   struct verify_cert_context ctx = {
       .conp = conp, .cert = cert,
   };
@@ -1850,24 +3445,33 @@ static err_code updateValidFlags(scmcon *conp, scmtab *tabp, unsigned int id,
   char stmt[150];
   int flags =
       isValid ? (prevFlags | SCM_FLAG_VALID) : (prevFlags & (~SCM_FLAG_VALID));
+  err_code sta;
   xsnprintf(stmt, sizeof(stmt), "update %s set flags=%d where local_id=%d;",
             tabp->tabname, flags, id);
-  return statementscm_no_data(conp, stmt);
+  sta = statementscm_no_data(conp, stmt);
+  if (sta == 0 && tabp == theCertTable)
+    cert_index_set_flags(conp, id, flags);
+  return sta;
 }
 
 // Used by rpwork
 err_code set_cert_flag(scmcon *conp, unsigned int id, unsigned int flags) {
   char stmt[150];
+  err_code sta;
   xsnprintf(stmt, sizeof(stmt), "update %s set flags=%d where local_id=%d;",
             theCertTable->tabname, flags, id);
-  return statementscm_no_data(conp, stmt);
+  sta = statementscm_no_data(conp, stmt);
+  if (sta == 0)
+    cert_index_set_flags(conp, id, flags);
+  return sta;
 }
 
 // Allowed CRL extension oids
 // FIXME: move this to crl_profile_chk()
 static struct goodoid goodoids[3];
+static pthread_once_t goodoidsOnce = PTHREAD_ONCE_INIT;
 
-static int make_goodoids(void) {
+static void make_goodoids(void) {
   struct casn casn;
   simple_constructor(&casn, (ushort)0, ASN_OBJ_ID);
   uchar oid[8];
@@ -1884,7 +3488,6 @@ static int make_goodoids(void) {
   goodoids[2].lth = 0;
   goodoids[2].oid = NULL;
   delete_casn(&casn);
-  return lth;
 }
 
 /**
@@ -1909,8 +3512,7 @@ err_code verifyChildCRL(scmcon *conp, scmsrcha *s, ssize_t idx) {
   if (s->nused < 4)
     return ERR_SCM_INVALARG;
 
-  if (!goodoids[0].lth)
-    make_goodoids();
+  pthread_once(&goodoidsOnce, make_goodoids);
   // try verifying crl
   xsnprintf(pathname, PATH_MAX, "%s/%s", (char *)s->vec[0].valptr,
             (char *)s->vec[1].valptr);
@@ -1990,17 +3592,6 @@ err_code verifyChildROA(scmcon *conp, scmsrcha *s, ssize_t idx) {
   return 0;
 }
 
-/*
- * set onman flag from all objects on newly validated manifest
- * plus, delete those objects with bad hashes
- */
-
-static scmsrcha *updateManSrch = NULL;
-static scmsrcha *updateManSrch2 = NULL;
-static unsigned int updateManLid;
-static char updateManPath[PATH_MAX];
-static char updateManHash[HASHSIZE];
-
 /**
  * @brief
  *     the model revocation function for certificates
@@ -2022,123 +3613,250 @@ static sqlvaluefunc revoke_cert_and_children;
 
 static sqlvaluefunc handleUpdateMan;
 err_code handleUpdateMan(scmcon *conp, scmsrcha *s, ssize_t idx) {
-  (void)conp;
+  struct validation_ctx *vc = getvctx(conp);
   (void)s;
   (void)idx;
-  updateManLid = *((unsigned int *)updateManSrch->vec[1].valptr);
-  xsnprintf(updateManPath, PATH_MAX, "%s/",
-            (char *)updateManSrch->vec[0].valptr);
-  xsnprintf(updateManHash, HASHSIZE, "%s",
-            (char *)updateManSrch->vec[2].valptr);
+  vc->updateManLid = *((unsigned int *)vc->updateManSrch->vec[1].valptr);
+  xsnprintf(vc->updateManPath, PATH_MAX, "%s/",
+            (char *)vc->updateManSrch->vec[0].valptr);
+  xsnprintf(vc->updateManHash, HASHSIZE, "%s",
+            (char *)vc->updateManSrch->vec[2].valptr);
   return 0;
 }
 
+/*
+ * One file listed on a manifest, see updateManifestObjs(). The thread that
+ * owns the connection fills in everything but the verdict, then
+ * check_manifest_entry() runs in the hashing pool, touching nothing but
+ * its own entry.
+ */
+struct manifest_entry {
+  char file[NAME_MAX + 1];
+  char *path;
+  scmtab *tabp;
+  unsigned int lid;
+  uchar listed[40]; // hash given by the manifest
+  int listedlen;    // -1 if it is too long to be any hash we make
+  uchar hash[40];   // hash of the file, from the database or computed
+  int hashlen;      // 0 until known
+  bool gothash;     // whether the database had a hash
+  bool missing;     // the file could not be opened
+  err_code sta;
+};
+
+void set_manifest_hash_threads(scmcon *conp, size_t nthreads) {
+  struct validation_ctx *vc = getvctx(conp);
+
+  if (vc->hashPool != NULL && nthreads != vc->hashThreads) {
+    work_pool_free(vc->hashPool);
+    vc->hashPool = NULL;
+  }
+  vc->hashThreads = nthreads;
+}
+
+/*
+ * Open the file of a manifest entry and compare its hash with the one on
+ * the manifest, hashing the file unless the database already knew its
+ * hash.
+ */
+static void check_manifest_entry(void *item, void *arg) {
+  struct manifest_entry *ent = item;
+  struct file_contents contents;
+  int fd;
+
+  UNREFERENCED_PARAMETER(arg);
+  fd = open(ent->path, O_RDONLY);
+  if (fd < 0) {
+    ent->missing = true;
+    return;
+  }
+  if (ent->sta == 0 && ent->hashlen == 0) {
+    // hash the file where it lies, without copying it
+    if (!file_contents_fd(&contents, fd)) {
+      ent->sta = ERR_SCM_BADFILE;
+    } else {
+      ent->hashlen = gen_hash(contents.data, (int)contents.size, ent->hash,
+                              CRYPT_ALGO_SHA2);
+      file_contents_close(&contents);
+      if (ent->hashlen < 0)
+        ent->sta = ERR_SCM_BADMKHASH;
+    }
+  }
+  (void)close(fd);
+  if (ent->sta == 0 && (ent->hashlen != ent->listedlen ||
+                        memcmp(ent->hash, ent->listed, ent->hashlen) != 0))
+    ent->sta = ERR_SCM_BADMFTHASH;
+}
+
+/*
+ * Look up the object named by a manifest entry. Returns false if the entry
+ * is not for an object in the database that still needs its ONMAN flag.
+ */
+static bool find_manifest_entry(scmcon *conp, struct FileAndHash *fahp,
+                                struct manifest_entry *ent) {
+  struct validation_ctx *vc = getvctx(conp);
+  uchar listed[sizeof(ent->listed) + 1];
+  uchar *bhash;
+  int bhashlen;
+  int bit_lth;
+  size_t len;
+
+  if (strstr(ent->file, ".cer"))
+    ent->tabp = theCertTable;
+  else if (strstr(ent->file, ".crl"))
+    ent->tabp = theCRLTable;
+  else if (strstr(ent->file, ".roa"))
+    ent->tabp = theROATable;
+  else if (strstr(ent->file, ".gbr"))
+    ent->tabp = theGBRTable;
+  else
+    return false;
+  vc->updateManParams[0] = ent->file;
+  vc->updateManLid = 0;
+  memset(vc->updateManHash, 0, sizeof(vc->updateManHash));
+  /** @bug ignores error code without explanation */
+  searchscm(conp, ent->tabp, vc->updateManSrch, NULL, &handleUpdateMan,
+            SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
+  if (!vc->updateManLid)
+    return false;
+  len = strlen(vc->updateManPath);
+  xsnprintf(vc->updateManPath + len, PATH_MAX - len, "%s", ent->file);
+  ent->path = strdup(vc->updateManPath);
+  if (ent->path == NULL)
+    return false;
+  ent->lid = vc->updateManLid;
+
+  // the hash is a BIT STRING, read with its unused-bits octet first
+  bit_lth = vsize_casn(&fahp->hash);
+  if (bit_lth < 1 || bit_lth > (int)sizeof(listed)) {
+    ent->listedlen = -1;
+  } else {
+    read_casn(&fahp->hash, listed);
+    ent->listedlen = bit_lth - 1;
+    memcpy(ent->listed, &listed[1], ent->listedlen);
+  }
+
+  /*
+   * Note that the hash is stored in the db as a string, but it is
+   * compared as a byte array.
+   */
+  if (vc->updateManHash[0] != 0) {
+    ent->gothash = true;
+    bhashlen = strlen(vc->updateManHash);
+    bhash = unhexify(bhashlen, vc->updateManHash);
+    if (bhash == NULL) {
+      /**
+       * @bug
+       *     there are many ways bhash could end up NULL; is
+       *     this really the most appropriate error code?
+       */
+      ent->sta = ERR_SCM_BADMFTDBHASH;
+    } else {
+      bhashlen /= 2;
+      // a hash too long to be one of ours is recomputed from the file
+      if (bhashlen > 0 && bhashlen <= (int)sizeof(ent->hash)) {
+        memcpy(ent->hash, bhash, bhashlen);
+        ent->hashlen = bhashlen;
+      }
+      free(bhash);
+    }
+  }
+  return true;
+}
+
+/*
+ * set onman flag from all objects on newly validated manifest
+ * plus, delete those objects with bad hashes
+ *
+ * The objects are looked up first, then their files are read and hashed
+ * in parallel (see set_manifest_hash_threads()), and finally all the
+ * verdicts are written to the database by this thread.
+ */
 static err_code updateManifestObjs(scmcon *conp, struct Manifest *manifest) {
+  struct validation_ctx *vc = getvctx(conp);
   struct FileAndHash *fahp = NULL;
-  uchar file[NAME_MAX + 1];
-  char escaped_file[NAME_MAX * 2 + 1];
-  uchar bytehash[HASHSIZE / 2];
-  uchar *bhash;
-  scmtab *tabp;
+  struct manifest_entry *ents = NULL;
+  struct manifest_entry *ent;
+  size_t nents = 0;
+  size_t i;
+  char lid[24];
   char flagStmt[200 + HASHSIZE];
-  int bhashlen;
-  int gothash;
   err_code sta;
-  int fd;
-  int len;
+  int count;
 
   // set up part of query
-  if (updateManSrch == NULL) {
-    updateManSrch = newsrchscm(NULL, 3, 0, 1);
-    ADDCOL(updateManSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
-    ADDCOL(updateManSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
-           sta);
-    ADDCOL(updateManSrch, "hash", SQL_C_CHAR, HASHSIZE, sta, sta);
-  }
-  if (updateManSrch2 == NULL) {
-    updateManSrch2 = newsrchscm(NULL, 4, 0, 1);
-    ADDCOL(updateManSrch2, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
-           sta);
-    ADDCOL(updateManSrch2, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
-    ADDCOL(updateManSrch2, "subject", SQL_C_CHAR, SUBJSIZE, sta, sta);
-    ADDCOL(updateManSrch2, "flags", SQL_C_ULONG, sizeof(unsigned int), sta,
+  if (vc->updateManSrch == NULL) {
+    vc->updateManSrch = newsrchscm(NULL, 3, 0, 1);
+    ADDCOL(vc->updateManSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
+    ADDCOL(vc->updateManSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int),
+           sta, sta);
+    ADDCOL(vc->updateManSrch, "hash", SQL_C_CHAR, HASHSIZE, sta, sta);
+    xsnprintf(vc->updateManSrch->wherestr, WHERESTR_SIZE, "filename=?");
+    addFlagTest(vc->updateManSrch->wherestr, SCM_FLAG_ONMAN, 0, 1);
+    vc->updateManSrch->params = vc->updateManParams;
+    vc->updateManSrch->nparams = 1;
+  }
+  if (vc->updateManSrch2 == NULL) {
+    vc->updateManSrch2 = newsrchscm(NULL, 4, 0, 1);
+    ADDCOL(vc->updateManSrch2, "local_id", SQL_C_ULONG, sizeof(unsigned int),
+           sta, sta);
+    ADDCOL(vc->updateManSrch2, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
+    ADDCOL(vc->updateManSrch2, "subject", SQL_C_CHAR, SUBJSIZE, sta, sta);
+    ADDCOL(vc->updateManSrch2, "flags", SQL_C_ULONG, sizeof(unsigned int), sta,
            sta);
   }
-  // loop over files and hashes
+
+  // look up the objects on the manifest
+  count = num_items(&manifest->fileList.self);
+  if (count <= 0)
+    return 0;
+  ents = calloc(count, sizeof(*ents));
+  if (ents == NULL)
+    return ERR_SCM_NOMEM;
   for (fahp = (struct FileAndHash *)member_casn(&manifest->fileList.self, 0);
-       fahp != NULL; fahp = (struct FileAndHash *)next_of(&fahp->self)) {
-    int hashlen;
-    if (vsize_casn(&fahp->file) + 1 > (int)sizeof(file)) {
+       fahp != NULL && nents < (size_t)count;
+       fahp = (struct FileAndHash *)next_of(&fahp->self)) {
+    ent = &ents[nents];
+    if (vsize_casn(&fahp->file) + 1 > (int)sizeof(ent->file)) {
+      // reject the whole manifest before touching any of its objects
+      for (i = 0; i < nents; i++)
+        free(ents[i].path);
+      free(ents);
       return ERR_SCM_BADMFTFILENAME;
     }
-    int flth = read_casn(&fahp->file, file);
-    file[flth] = 0;
-    if (strstr((char *)file, ".cer"))
-      tabp = theCertTable;
-    else if (strstr((char *)file, ".crl"))
-      tabp = theCRLTable;
-    else if (strstr((char *)file, ".roa"))
-      tabp = theROATable;
-    else if (strstr((char *)file, ".gbr"))
-      tabp = theGBRTable;
+    int flth = read_casn(&fahp->file, (uchar *)ent->file);
+    ent->file[flth] = 0;
+    if (find_manifest_entry(conp, fahp, ent))
+      nents++;
     else
+      memset(ent, 0, sizeof(*ent));
+  }
+
+  // check all their files at once
+  if (vc->hashPool == NULL && vc->hashThreads > 0 && nents > 1)
+    vc->hashPool = work_pool_new(vc->hashThreads);
+  work_pool_run(vc->hashPool, ents, nents, sizeof(*ents), check_manifest_entry,
+                NULL);
+
+  // and record the verdicts
+  for (i = 0; i < nents; i++) {
+    ent = &ents[i];
+    if (ent->missing)
       continue;
-    mysql_escape_string(escaped_file, (char *)file, strlen((char *)file));
-    xsnprintf(updateManSrch->wherestr, WHERESTR_SIZE, "filename=\"%s\"",
-              escaped_file);
-    addFlagTest(updateManSrch->wherestr, SCM_FLAG_ONMAN, 0, 1);
-    updateManLid = 0;
-    memset(updateManHash, 0, sizeof(updateManHash));
-    /** @bug ignores error code without explanation */
-    searchscm(conp, tabp, updateManSrch, NULL, &handleUpdateMan,
-              SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
-    if (!updateManLid)
-      continue;
-    len = strlen(updateManPath);
-    xsnprintf(updateManPath + len, PATH_MAX - len, "%s", file);
-    fd = open(updateManPath, O_RDONLY);
-    if (fd < 0)
-      continue;
-    /*
-     * Note that the hash is stored in the db as a string, but the
-     * function check_fileAndHash wants it as a byte array.
-     */
-    if (updateManHash[0] != 0) {
-      gothash = 1;
-      bhashlen = strlen(updateManHash);
-      bhash = unhexify(bhashlen, updateManHash);
-      if (bhash == NULL)
-        /**
-         * @bug
-         *     there are many ways bhash could end up NULL; is
-         *     this really the most appropriate error code?
-         */
-        hashlen = ERR_SCM_BADMFTDBHASH;
-      else {
-        bhashlen /= 2;
-        memcpy(bytehash, bhash, bhashlen);
-        free(bhash);
-        hashlen = check_fileAndHash(fahp, fd, bytehash, bhashlen, HASHSIZE / 2);
-      }
-    } else {
-      gothash = 0;
-      memset(bytehash, 0, sizeof(bytehash));
-      hashlen = check_fileAndHash(fahp, fd, bytehash, 0, HASHSIZE / 2);
-    }
-    (void)close(fd);
-    if (hashlen >= 0) {
+    if (ent->sta == 0) {
       // if hash okay, set ONMAN flag and optionally the hash if we just
-      // computed it
-      if (gothash == 1)
+      // computed it (the flag is or-ed in, since a manifest that lists a
+      // file twice yields two entries for it)
+      if (ent->gothash)
         xsnprintf(flagStmt, sizeof(flagStmt),
-                  "update %s set flags=flags+%d where local_id=%d;",
-                  tabp->tabname, SCM_FLAG_ONMAN, updateManLid);
+                  "update %s set flags=flags|%d where local_id=%d;",
+                  ent->tabp->tabname, SCM_FLAG_ONMAN, ent->lid);
       else {
-        char *h = hexify(hashlen, bytehash, HEXIFY_NO);
+        char *h = hexify(ent->hashlen, ent->hash, HEXIFY_NO);
         xsnprintf(flagStmt, sizeof(flagStmt),
-                  "update %s set flags=flags+%d, hash=\"%s\""
+                  "update %s set flags=flags|%d, hash=\"%s\""
                   " where local_id=%d;",
-                  tabp->tabname, SCM_FLAG_ONMAN, h, updateManLid);
+                  ent->tabp->tabname, SCM_FLAG_ONMAN, h, ent->lid);
         free(h);
       }
       /** @bug ignores error code without explanation */
@@ -2146,28 +3864,34 @@ static err_code updateManifestObjs(scmcon *conp, struct Manifest *manifest) {
     } else {
       /**
        * @bug
-       *     There are many ways check_fileAndHash() could fail,
+       *     There are many ways check_manifest_entry() could fail,
        *     and perhaps not all of them mean that the file's
        *     hash is bad (e.g., maybe there was a crypto library
        *     problem).  Thus, deleting the object and
        *     invalidating its children might not be the correct
        *     action to take.
        */
-      LOG(LOG_ERR, "Hash not ok on file %s", file);
+      LOG(LOG_ERR, "Hash not ok on file %s", ent->file);
       // if hash not okay, delete object, and if cert, invalidate
       // children
-      if (tabp == theCertTable) {
-        xsnprintf(updateManSrch2->wherestr, WHERESTR_SIZE, "local_id=\"%d\"",
-                  updateManLid);
+      if (ent->tabp == theCertTable) {
+        xsnprintf(lid, sizeof(lid), "%u", ent->lid);
+        xsnprintf(vc->updateManSrch2->wherestr, WHERESTR_SIZE, "local_id=?");
+        vc->updateManSrch2->params = vc->updateManParams;
+        vc->updateManSrch2->nparams = 1;
+        vc->updateManParams[0] = lid;
         /** @bug ignores error code without explanation */
-        searchscm(conp, tabp, updateManSrch2, NULL, &revoke_cert_and_children,
-                  SCM_SRCH_DOVALUE_ALWAYS, NULL);
+        searchscm(conp, ent->tabp, vc->updateManSrch2, NULL,
+                  &revoke_cert_and_children, SCM_SRCH_DOVALUE_ALWAYS, NULL);
       } else {
         /** @bug ignores error code without explanation */
-        deletebylid(conp, tabp, updateManLid);
+        deletebylid(conp, ent->tabp, ent->lid);
       }
     }
   }
+  for (i = 0; i < nents; i++)
+    free(ents[i].path);
+  free(ents);
   return 0;
 }
 
@@ -2219,41 +3943,12 @@ err_code verifyChildGhostbusters(scmcon *conp, scmsrcha *s, ssize_t idx) {
   return 0;
 }
 
-/**
- * @brief
- *     structure containing data of children to propagate
- */
-typedef struct _PropData {
-  char *ski;
-  char *subject;
-  unsigned int flags;
-  unsigned int id;
-  char *filename;
-  char *dirname;
-  char *aki;
-  char *issuer;
-} PropData;
-
-/**
- * @brief
- *     static variables for efficiency, so only need to set up query
- *     once
- */
-static scmsrcha *crlSrch = NULL;
-static scmsrcha *manSrch = NULL;
-
-/**
- * @brief
- *     single place to allocate large amount of space for manifest
- *     files lists
- */
-static char manFiles[MANFILES_SIZE];
-
 /**
  * @brief
  *     utility function for verifyOrNotChildren()
  */
 static err_code verifyChildCert(scmcon *conp, PropData *data, int doVerify) {
+  struct validation_ctx *vc = getvctx(conp);
   LOG(LOG_DEBUG, "verifyChildCert(conp=%p"
                  ", data=%p{.ski=\"%s\", .subject=\"%s\"}, doVerify=%i)",
       conp, data, data->ski, data->subject, doVerify);
@@ -2261,11 +3956,12 @@ static err_code verifyChildCert(scmcon *conp, PropData *data, int doVerify) {
   X509 *x = NULL;
   err_code sta;
   char pathname[PATH_MAX];
+  const char *params[2];
 
   if (doVerify) {
     xsnprintf(pathname, PATH_MAX, "%s/%s", data->dirname, data->filename);
     /** @bug ignores error code without explanation */
-    x = readCertFromFile(pathname, &sta);
+    x = readCertFromFile(vc, pathname, &sta);
     if (x == NULL) {
       sta = ERR_SCM_X509;
       goto done;
@@ -2274,19 +3970,15 @@ static err_code verifyChildCert(scmcon *conp, PropData *data, int doVerify) {
 
     // validation reconsidered
     RS *result = InitializeRSNode();
-    char *vrs_dir = config_get_string(config_find("VRSCacheDir"));
-    char vrs_file_path[4096];
-    sprintf(vrs_file_path, "%s/%s.txt", vrs_dir, data->filename);
+    if (result == NULL) {
+      sta = ERR_SCM_NOMEM;
+      goto done;
+    }
 
     err_code verify_result = sta;
     sta = validation_reconsidered(conp, data->aki, data->issuer, x, result,
                                   verify_result, isROA_file(data->filename));
 
-    if (verify_result != ERR_SCM_NOTVALID) {
-      // save to file
-      save_node_as_file(result, vrs_file_path);
-    }
-    freeRSNode(result);
     if (sta == ERR_SCM_NODATA) {
       sta = ((data->flags & SCM_FLAG_TRUSTED) != 0) ? 0 : ERR_SCM_NOTVALID;
     }
@@ -2294,60 +3986,75 @@ static err_code verifyChildCert(scmcon *conp, PropData *data, int doVerify) {
     if (sta < 0) {
       // either the cert is not (yet) valid or there was a
       // problem processing the cert.  either way, return.
+      freeRSNode(result);
       goto done;
     }
     /** @bug ignores error code without explanation */
     updateValidFlags(conp, theCertTable, data->id, data->flags, 1);
 
     if (verify_result != ERR_SCM_NOTVALID) {
-      if ((sta = add_cert_validation_reconsidered(
-               conp, data->ski, data->subject, data->id, vrs_file_path))) {
-        LOG(LOG_DEBUG, "add_cert_validation_reconsidered() returned %s: %s",
-            err2name(sta), err2string(sta));
-        goto done;
-      }
+      sta = add_cert_validation_reconsidered(conp, data->ski, data->subject,
+                                             data->id, result);
+    }
+    freeRSNode(result);
+    if (sta) {
+      LOG(LOG_DEBUG, "add_cert_validation_reconsidered() returned %s: %s",
+          err2name(sta), err2string(sta));
+      goto done;
     }
   }
 
   /* Check for subordinate CRLs */
-  if (crlSrch == NULL) {
-    crlSrch = newsrchscm(NULL, 4, 0, 1);
-    ADDCOL(crlSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
-    ADDCOL(crlSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
-    ADDCOL(crlSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    ADDCOL(crlSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-  }
-  xsnprintf(crlSrch->wherestr, WHERESTR_SIZE, "aki=\"%s\" and issuer=\"%s\"",
-            data->ski, data->subject);
-  addFlagTest(crlSrch->wherestr, SCM_FLAG_VALID, 0, 1);
+  if (vc->crlSrch == NULL) {
+    vc->crlSrch = newsrchscm(NULL, 4, 0, 1);
+    ADDCOL(vc->crlSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
+    ADDCOL(vc->crlSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
+    ADDCOL(vc->crlSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+           sta);
+    ADDCOL(vc->crlSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
+  }
+  params[0] = data->ski;
+  params[1] = data->subject;
+  vc->crlSrch->params = params;
+  vc->crlSrch->nparams = 2;
+  xsnprintf(vc->crlSrch->wherestr, WHERESTR_SIZE, "aki=? and issuer=?");
+  addFlagTest(vc->crlSrch->wherestr, SCM_FLAG_VALID, 0, 1);
   /** @bug ignores error code without explanation */
-  sta = searchscm(conp, theCRLTable, crlSrch, NULL, &verifyChildCRL,
+  sta = searchscm(conp, theCRLTable, vc->crlSrch, NULL, &verifyChildCRL,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
 
   /* Check for associated GBRs */
-  xsnprintf(crlSrch->wherestr, WHERESTR_SIZE, "ski=\"%s\"", data->ski);
+  vc->crlSrch->params = params;
+  vc->crlSrch->nparams = 1;
+  xsnprintf(vc->crlSrch->wherestr, WHERESTR_SIZE, "ski=?");
   /** @bug ignores error code without explanation */
-  searchscm(conp, theGBRTable, crlSrch, NULL, &verifyChildGhostbusters,
+  searchscm(conp, theGBRTable, vc->crlSrch, NULL, &verifyChildGhostbusters,
             SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
 
   /* Check for associated ROA */
-  xsnprintf(crlSrch->wherestr, WHERESTR_SIZE, "ski=\"%s\"", data->ski);
-  addFlagTest(crlSrch->wherestr, SCM_FLAG_VALID, 0, 1);
+  vc->crlSrch->params = params;
+  vc->crlSrch->nparams = 1;
+  xsnprintf(vc->crlSrch->wherestr, WHERESTR_SIZE, "ski=?");
+  addFlagTest(vc->crlSrch->wherestr, SCM_FLAG_VALID, 0, 1);
   /** @bug ignores error code without explanation */
-  sta = searchscm(conp, theROATable, crlSrch, NULL, &verifyChildROA,
+  sta = searchscm(conp, theROATable, vc->crlSrch, NULL, &verifyChildROA,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
 
   /* Check for associated Manifest */
-  if (manSrch == NULL) {
-    manSrch = newsrchscm(NULL, 4, 0, 1);
-    ADDCOL(manSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    ADDCOL(manSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    ADDCOL(manSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
-    ADDCOL(manSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
-  }
-  xsnprintf(manSrch->wherestr, WHERESTR_SIZE, "ski=\"%s\"", data->ski);
+  if (vc->manSrch == NULL) {
+    vc->manSrch = newsrchscm(NULL, 4, 0, 1);
+    ADDCOL(vc->manSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+           sta);
+    ADDCOL(vc->manSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
+    ADDCOL(vc->manSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
+    ADDCOL(vc->manSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
+  }
+  vc->manSrch->params = params;
+  vc->manSrch->nparams = 1;
+  xsnprintf(vc->manSrch->wherestr, WHERESTR_SIZE, "ski=?");
   /** @bug ignores error code without explanation */
-  sta = searchscm(conp, theManifestTable, manSrch, NULL, &verifyChildManifest,
+  sta = searchscm(conp, theManifestTable, vc->manSrch, NULL,
+                  &verifyChildManifest,
                   SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
   sta = 0;
 done:
@@ -2394,13 +4101,10 @@ static int countvalidparents(scmcon *conp, char *IS, char *AK) {
   char ws[256];
   char *now;
   err_code sta;
-  char escaped[(IS != NULL) ? strlen(IS) * 2 + 1 : 0];
 
   w[0] = (scmkv){"ski", AK};
-  if (IS != NULL) {
-    mysql_escape_string(escaped, IS, strlen(IS));
-    w[1] = (scmkv){"subject", escaped};
-  }
+  if (IS != NULL)
+    w[1] = (scmkv){"subject", IS};
   scmkva where = {
       .vec = w,
       .ntot = (IS == NULL) ? 1 : 2,
@@ -2441,11 +4145,6 @@ static int countvalidparents(scmcon *conp, char *IS, char *AK) {
   return mymcf.did;
 }
 
-// static variables for efficiency, so only need to set up query once
-
-static scmsrcha *roaSrch = NULL;
-static scmsrcha *invalidateCRLSrch = NULL;
-
 /**
  * @brief
  *     callback function for invalidateChildCert()
@@ -2559,7 +4258,9 @@ err_code invalidate_crl(scmcon *conp, scmsrcha *s, ssize_t idx) {
  */
 static err_code invalidateChildCert(scmcon *conp, PropData *data,
                                     int doUpdate) {
+  struct validation_ctx *vc = getvctx(conp);
   err_code sta;
+  const char *params[2];
 
   if (doUpdate) {
     /** @bug ignores error code without explanation */
@@ -2570,101 +4271,118 @@ static err_code invalidateChildCert(scmcon *conp, PropData *data,
       return sta;
   }
 
-  if (roaSrch == NULL) {
-    roaSrch = newsrchscm(NULL, 3, 0, 1);
-    ADDCOL(roaSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    ADDCOL(roaSrch, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
-    ADDCOL(roaSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-  }
-  xsnprintf(roaSrch->wherestr, WHERESTR_SIZE, "ski=\"%s\"", data->ski);
-  addFlagTest(roaSrch->wherestr, SCM_FLAG_VALID, 1, 1);
-
-  if (invalidateCRLSrch == NULL) {
-    invalidateCRLSrch = newsrchscm(NULL, 4, 0, 1);
-    ADDCOL(invalidateCRLSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int),
-           sta, sta);
-    ADDCOL(invalidateCRLSrch, "aki", SQL_C_CHAR, SKISIZE, sta, sta);
-    ADDCOL(invalidateCRLSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, sta);
-    ADDCOL(invalidateCRLSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta,
+  if (vc->roaSrch == NULL) {
+    vc->roaSrch = newsrchscm(NULL, 3, 0, 1);
+    ADDCOL(vc->roaSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
            sta);
+    ADDCOL(vc->roaSrch, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
+    ADDCOL(vc->roaSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
+  }
+  params[0] = data->ski;
+  params[1] = data->subject;
+  vc->roaSrch->params = params;
+  vc->roaSrch->nparams = 1;
+  xsnprintf(vc->roaSrch->wherestr, WHERESTR_SIZE, "ski=?");
+  addFlagTest(vc->roaSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+
+  if (vc->invalidateCRLSrch == NULL) {
+    vc->invalidateCRLSrch = newsrchscm(NULL, 4, 0, 1);
+    ADDCOL(vc->invalidateCRLSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int),
+           sta, sta);
+    ADDCOL(vc->invalidateCRLSrch, "aki", SQL_C_CHAR, SKISIZE, sta, sta);
+    ADDCOL(vc->invalidateCRLSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, sta);
+    ADDCOL(vc->invalidateCRLSrch, "flags", SQL_C_ULONG, sizeof(unsigned int),
+           sta, sta);
   }
-  char escaped[strlen(data->subject) * 2 + 1];
-  mysql_escape_string(escaped, data->subject, strlen(data->subject));
-  xsnprintf(invalidateCRLSrch->wherestr, WHERESTR_SIZE,
-            "aki=\"%s\" AND issuer=\"%s\"", data->ski, escaped);
-  addFlagTest(invalidateCRLSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+  vc->invalidateCRLSrch->params = params;
+  vc->invalidateCRLSrch->nparams = 2;
+  xsnprintf(vc->invalidateCRLSrch->wherestr, WHERESTR_SIZE,
+            "aki=? AND issuer=?");
+  addFlagTest(vc->invalidateCRLSrch->wherestr, SCM_FLAG_VALID, 1, 1);
 
   /** @bug ignores error code without explanation */
-  searchscm(conp, theROATable, roaSrch, NULL, &invalidate_roa,
+  searchscm(conp, theROATable, vc->roaSrch, NULL, &invalidate_roa,
             SCM_SRCH_DOVALUE_ALWAYS, NULL);
 
-  // reuse roaSrch for GBRs because the columns are the same
+  // reuse vc->roaSrch for GBRs because the columns are the same
   /** @bug ignores error code without explanation */
-  searchscm(conp, theGBRTable, roaSrch, NULL, &invalidate_gbr,
+  searchscm(conp, theGBRTable, vc->roaSrch, NULL, &invalidate_gbr,
             SCM_SRCH_DOVALUE_ALWAYS, NULL);
 
-  // reuse roaSrch for MFTs because the columns are the same
+  // reuse vc->roaSrch for MFTs because the columns are the same
   /** @bug ignores error code without explanation */
-  searchscm(conp, theManifestTable, roaSrch, NULL, &invalidate_mft,
+  searchscm(conp, theManifestTable, vc->roaSrch, NULL, &invalidate_mft,
             SCM_SRCH_DOVALUE_ALWAYS, NULL);
 
   /** @bug ignores error code without explanation */
-  searchscm(conp, theCRLTable, invalidateCRLSrch, NULL, &invalidate_crl,
+  searchscm(conp, theCRLTable, vc->invalidateCRLSrch, NULL, &invalidate_crl,
             SCM_SRCH_DOVALUE_ALWAYS, NULL);
 
   return 0;
 }
 
-// static variables for efficiency, so only need to set up query once
+// rows per fetch for childrenSrch; each row is about 6KB
+#define CHILDREN_BLOCK_ROWS 64
 
-static scmsrcha *childrenSrch = NULL;
-
-// static variables and structure to pass back from callback and hold data
+/**
+ * @brief
+ *     copy a string column out of a block of search results, treating
+ *     NULL as the empty string
+ */
+static char *dupBlockStr(scmsrcha *s, scmblock *blk, int col, size_t row) {
+  char *val = (char *)blockvalscm(s, blk, col, row);
 
-typedef struct _PropDataList {
-  int size;
-  int maxSize;
-  PropData *data;
-} PropDataList;
+  return strdup(val != NULL ? val : "");
+}
 
-PropDataList vPropData = {0, 200, NULL};
-PropDataList iPropData = {0, 200, NULL};
+/**
+ * @brief
+ *     copy an unsigned int column out of a block of search results
+ */
+static unsigned int blockUInt(scmsrcha *s, scmblock *blk, int col,
+                              size_t row) {
+  unsigned int *val = (unsigned int *)blockvalscm(s, blk, col, row);
 
-PropDataList *currPropData = NULL;
-PropDataList *prevPropData = NULL;
+  return val != NULL ? *val : 0;
+}
 
 /**
  * @brief
  *     callback function for verifyOrNotChildren()
  */
-static sqlvaluefunc registerChild;
-err_code registerChild(scmcon *conp, scmsrcha *s, ssize_t idx) {
-  LOG(LOG_DEBUG, "registerChild(conp=%p, scmsrcha=%p, idx=%zi)", conp, s, idx);
+static sqlblockfunc registerChild;
+err_code registerChild(scmcon *conp, scmsrcha *s, scmblock *blk) {
+  struct validation_ctx *vc = getvctx(conp);
+  LOG(LOG_DEBUG, "registerChild(conp=%p, scmsrcha=%p, nrows=%zu)", conp, s,
+      blk->nrows);
 
   PropData *propData;
+  size_t row;
 
-  UNREFERENCED_PARAMETER(s);
-  UNREFERENCED_PARAMETER(conp);
-  UNREFERENCED_PARAMETER(idx);
   // push onto stack of children to propagate
-  if (currPropData->size == currPropData->maxSize) {
-    currPropData->maxSize *= 2;
-    propData = (PropData *)calloc(currPropData->maxSize, sizeof(PropData));
-    memcpy(propData, currPropData->data, currPropData->size * sizeof(PropData));
-    free(currPropData->data);
-    currPropData->data = propData;
-  } else {
-    propData = currPropData->data;
-  }
-  propData[currPropData->size].dirname = strdup(s->vec[0].valptr);
-  propData[currPropData->size].filename = strdup(s->vec[1].valptr);
-  propData[currPropData->size].flags = *((unsigned int *)(s->vec[2].valptr));
-  propData[currPropData->size].ski = strdup(s->vec[3].valptr);
-  propData[currPropData->size].subject = strdup(s->vec[4].valptr);
-  propData[currPropData->size].id = *((unsigned int *)(s->vec[5].valptr));
-  propData[currPropData->size].aki = strdup(s->vec[6].valptr);
-  propData[currPropData->size].issuer = strdup(s->vec[7].valptr);
-  currPropData->size++;
+  if (vc->currPropData->data == NULL ||
+      vc->currPropData->size + blk->nrows > (size_t)vc->currPropData->maxSize) {
+    while (vc->currPropData->size + blk->nrows >
+           (size_t)vc->currPropData->maxSize)
+      vc->currPropData->maxSize *= 2;
+    propData = (PropData *)calloc(vc->currPropData->maxSize, sizeof(PropData));
+    memcpy(propData, vc->currPropData->data,
+           vc->currPropData->size * sizeof(PropData));
+    free(vc->currPropData->data);
+    vc->currPropData->data = propData;
+  }
+  propData = vc->currPropData->data;
+  for (row = 0; row < blk->nrows; row++) {
+    propData[vc->currPropData->size].dirname = dupBlockStr(s, blk, 0, row);
+    propData[vc->currPropData->size].filename = dupBlockStr(s, blk, 1, row);
+    propData[vc->currPropData->size].flags = blockUInt(s, blk, 2, row);
+    propData[vc->currPropData->size].ski = dupBlockStr(s, blk, 3, row);
+    propData[vc->currPropData->size].subject = dupBlockStr(s, blk, 4, row);
+    propData[vc->currPropData->size].id = blockUInt(s, blk, 5, row);
+    propData[vc->currPropData->size].aki = dupBlockStr(s, blk, 6, row);
+    propData[vc->currPropData->size].issuer = dupBlockStr(s, blk, 7, row);
+    vc->currPropData->size++;
+  }
 
   err_code sta = 0;
   LOG(LOG_DEBUG, "registerChild() returning %s: %s", err2name(sta),
@@ -2679,6 +4397,7 @@ err_code registerChild(scmcon *conp, scmsrcha *s, ssize_t idx) {
 static err_code verifyOrNotChildren(scmcon *conp, char *ski, char *subject,
                                     char *aki, char *issuer,
                                     unsigned int cert_id, int doVerify) {
+  struct validation_ctx *vc = getvctx(conp);
   LOG(LOG_DEBUG, "verifyOrNotChildren(conp=%p, ski=\"%s\", subject=\"%s\""
                  ", aki=\"%s\", issuer=\"%s\", cert_id=%u, doVerify=%i)",
       conp, ski, subject, aki, issuer, cert_id, doVerify);
@@ -2687,55 +4406,78 @@ static err_code verifyOrNotChildren(scmcon *conp, char *ski, char *subject,
   int doIt;
   int idx;
   err_code sta = 0;
-
-  prevPropData = currPropData;
-  currPropData = doVerify ? &vPropData : &iPropData;
+  char *child_ski;
+  char *child_subject;
+  const char *params[3];
+  // kept on the stack, since this can be called again from within the loop
+  PropDataList *prevPropData = vc->currPropData;
+  PropDataList nested = {0, 200, NULL, false};
 
   // initialize query first time through
-  if (childrenSrch == NULL) {
-    childrenSrch = newsrchscm(NULL, 8, 0, 1);
-    ADDCOL(childrenSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
-    ADDCOL(childrenSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
-    ADDCOL(childrenSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta, sta);
-    ADDCOL(childrenSrch, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
-    ADDCOL(childrenSrch, "subject", SQL_C_CHAR, SUBJSIZE, sta, sta);
-    ADDCOL(childrenSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+  if (vc->childrenSrch == NULL) {
+    vc->childrenSrch = newsrchscm(NULL, 8, 0, 1);
+    ADDCOL(vc->childrenSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "flags", SQL_C_ULONG, sizeof(unsigned int), sta,
            sta);
-    ADDCOL(childrenSrch, "aki", SQL_C_CHAR, SKISIZE, sta, sta);
-    ADDCOL(childrenSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "ski", SQL_C_CHAR, SKISIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "subject", SQL_C_CHAR, SUBJSIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "local_id", SQL_C_ULONG, sizeof(unsigned int), sta,
+           sta);
+    ADDCOL(vc->childrenSrch, "aki", SQL_C_CHAR, SKISIZE, sta, sta);
+    ADDCOL(vc->childrenSrch, "issuer", SQL_C_CHAR, SUBJSIZE, sta, sta);
   }
 
+  vc->currPropData = doVerify ? &vc->vPropData : &vc->iPropData;
+  if (vc->currPropData->busy)
+    vc->currPropData = &nested;
+  vc->currPropData->busy = true;
+
   // iterate through all children, verifying
-  if (currPropData->data == NULL)
-    currPropData->data =
-        (PropData *)calloc(currPropData->maxSize, sizeof(PropData));
-  currPropData->data[0].ski = ski;
-  currPropData->data[0].subject = subject;
-  currPropData->data[0].aki = aki;
-  currPropData->data[0].issuer = issuer;
-  currPropData->data[0].id = cert_id;
-  currPropData->size = 1;
-  while (currPropData->size > 0) {
-    currPropData->size--;
-    idx = currPropData->size;
+  if (vc->currPropData->data == NULL)
+    vc->currPropData->data =
+        (PropData *)calloc(vc->currPropData->maxSize, sizeof(PropData));
+  vc->currPropData->data[0].ski = ski;
+  vc->currPropData->data[0].subject = subject;
+  vc->currPropData->data[0].aki = aki;
+  vc->currPropData->data[0].issuer = issuer;
+  vc->currPropData->data[0].id = cert_id;
+  vc->currPropData->size = 1;
+  while (vc->currPropData->size > 0) {
+    vc->currPropData->size--;
+    idx = vc->currPropData->size;
+    // registerChild() reuses this slot, so keep the search values here
+    child_ski = vc->currPropData->data[idx].ski;
+    child_subject = vc->currPropData->data[idx].subject;
     if (doVerify)
       /** @bug ignores error code without explanation */
-      doIt = verifyChildCert(conp, &currPropData->data[idx],
+      doIt = verifyChildCert(conp, &vc->currPropData->data[idx],
                              !already_verified) == 0;
     else
       /** @bug ignores error code without explanation */
-      doIt = invalidateChildCert(conp, &currPropData->data[idx],
+      doIt = invalidateChildCert(conp, &vc->currPropData->data[idx],
                                  !already_verified) == 0;
     LOG(LOG_DEBUG, "doIt=%i", doIt);
+    if (!already_verified) {
+      free(vc->currPropData->data[idx].filename);
+      free(vc->currPropData->data[idx].dirname);
+      free(vc->currPropData->data[idx].aki);
+      free(vc->currPropData->data[idx].issuer);
+    }
     if (doIt) {
-      char escaped[strlen(currPropData->data[idx].subject) * 2 + 1];
-      mysql_escape_string(escaped, currPropData->data[idx].subject,
-                          strlen(currPropData->data[idx].subject));
-
-      xsnprintf(childrenSrch->wherestr, WHERESTR_SIZE,
-                "aki=\"%s\" and ski<>\"%s\" and issuer=\"%s\"",
-                currPropData->data[idx].ski, currPropData->data[idx].ski,
-                escaped);
+      /*
+       * The verification above can get here again (e.g. through a
+       * manifest that revokes a cert), and that call points the shared
+       * search at its own parameters, so set them up right before every
+       * search.
+       */
+      params[0] = child_ski;
+      params[1] = child_ski;
+      params[2] = child_subject;
+      vc->childrenSrch->params = params;
+      vc->childrenSrch->nparams = 3;
+      xsnprintf(vc->childrenSrch->wherestr, WHERESTR_SIZE,
+                "aki=? and ski<>? and issuer=?");
       /**
        * @bug
        *     This WHERE clause addition skips children that are
@@ -2762,26 +4504,181 @@ static err_code verifyOrNotChildren(scmcon *conp, char *ski, char *subject,
        *                 that should now be valid
        *     @endverbatim
        */
-      addFlagTest(childrenSrch->wherestr, SCM_FLAG_VALID, !doVerify, 1);
+      addFlagTest(vc->childrenSrch->wherestr, SCM_FLAG_VALID, !doVerify, 1);
+      /** @bug ignores error code without explanation */
+      searchblockscm(conp, theCertTable, vc->childrenSrch, &registerChild,
+                     SCM_SRCH_DO_JOIN, NULL, CHILDREN_BLOCK_ROWS);
+      vc->childrenSrch->params = NULL;
+      vc->childrenSrch->nparams = 0;
     }
     if (!already_verified) {
-      free(currPropData->data[idx].filename);
-      free(currPropData->data[idx].dirname);
-      free(currPropData->data[idx].ski);
-      free(currPropData->data[idx].subject);
-      free(currPropData->data[idx].aki);
-      free(currPropData->data[idx].issuer);
+      free(child_ski);
+      free(child_subject);
     }
-    if (doIt)
-      /** @bug ignores error code without explanation */
-      searchscm(conp, theCertTable, childrenSrch, NULL, &registerChild,
-                SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
     already_verified = 0;
   }
-  currPropData = prevPropData;
+  vc->currPropData->busy = false;
+  free(nested.data);
+  vc->currPropData = prevPropData;
+
+  LOG(LOG_DEBUG, "verifyOrNotChildren() returning %s: %s", err2name(sta),
+      err2string(sta));
+  return sta;
+}
+
+err_code revalidate_children(scm *scmp, scmcon *conp, unsigned int local_id) {
+  LOG(LOG_DEBUG, "revalidate_children(scmp=%p, conp=%p, local_id=%u)", scmp,
+      conp, local_id);
+
+  unsigned int flags = 0;
+  char ski[SKISIZE] = "";
+  char subject[SUBJSIZE] = "";
+  char aki[SKISIZE] = "";
+  char issuer[SUBJSIZE] = "";
+  char dirname[DNAMESIZE] = "";
+  char filename[FNAMESIZE] = "";
+  char fullname[PATH_MAX];
+  char lid[24];
+  char where[WHERESTR_SIZE] = "local_id=?";
+  const char *params[1] = {lid};
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "flags",
+       .valptr = &flags, .valsize = sizeof(flags)},
+      {.colno = 2, .sqltype = SQL_C_CHAR, .colname = "ski",
+       .valptr = ski, .valsize = sizeof(ski)},
+      {.colno = 3, .sqltype = SQL_C_CHAR, .colname = "subject",
+       .valptr = subject, .valsize = sizeof(subject)},
+      {.colno = 4, .sqltype = SQL_C_CHAR, .colname = "aki",
+       .valptr = aki, .valsize = sizeof(aki)},
+      {.colno = 5, .sqltype = SQL_C_CHAR, .colname = "issuer",
+       .valptr = issuer, .valsize = sizeof(issuer)},
+      {.colno = 6, .sqltype = SQL_C_CHAR, .colname = "dirname",
+       .valptr = dirname, .valsize = sizeof(dirname)},
+      {.colno = 7, .sqltype = SQL_C_CHAR, .colname = "filename",
+       .valptr = filename, .valsize = sizeof(filename)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where, .params = params, .nparams = 1,
+  };
+  err_code sta;
+
+  initTables(scmp);
+  xsnprintf(lid, sizeof(lid), "%u", local_id);
+  sta = searchscm(conp, theCertTable, &srch, NULL, &ok,
+                  SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
+  if (sta == ERR_SCM_NODATA) {
+    // deleted again, or its batch was rolled back
+    sta = 0;
+    goto done;
+  }
+  if (sta < 0)
+    goto done;
+
+  // the certificate was added by another process, so the index lacks it
+  xsnprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
+  cert_index_update(conp, local_id, flags, ski, subject, aki, issuer,
+                    fullname);
+  if (flags & SCM_FLAG_VALID)
+    sta = verifyOrNotChildren(conp, ski, subject, aki, issuer, local_id, 1);
+
+done:
+  LOG(LOG_DEBUG, "revalidate_children() returning %s: %s", err2name(sta),
+      err2string(sta));
+  return sta;
+}
+
+err_code get_cert_sia(scm *scmp, scmcon *conp, unsigned int local_id,
+                      char *sia, size_t siasize) {
+  char lid[24];
+  char where[WHERESTR_SIZE] = "local_id=?";
+  const char *params[1] = {lid};
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_CHAR, .colname = "sia",
+       .valptr = sia, .valsize = siasize},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where, .params = params, .nparams = 1,
+  };
+
+  initTables(scmp);
+  sia[0] = 0;
+  xsnprintf(lid, sizeof(lid), "%u", local_id);
+  return searchscm(conp, theCertTable, &srch, NULL, &ok,
+                   SCM_SRCH_DOVALUE_ALWAYS, NULL);
+}
+
+void defer_validation(scmcon *conp, bool defer) {
+  getvctx(conp)->deferValidation = defer;
+}
+
+struct valid_cert_list {
+  unsigned int *ids;
+  size_t n;
+  size_t alloc;
+};
+
+static sqlvaluefunc add_valid_cert;
+err_code add_valid_cert(scmcon *conp, scmsrcha *s, ssize_t idx) {
+  struct valid_cert_list *list = s->context;
+  unsigned int *ids;
+
+  UNREFERENCED_PARAMETER(conp);
+  UNREFERENCED_PARAMETER(idx);
+  if (list->n == list->alloc) {
+    list->alloc = list->alloc ? 2 * list->alloc : 64;
+    ids = realloc(list->ids, list->alloc * sizeof(*ids));
+    if (ids == NULL)
+      return ERR_SCM_NOMEM;
+    list->ids = ids;
+  }
+  list->ids[list->n++] = *(unsigned int *)s->vec[0].valptr;
+  return 0;
+}
+
+err_code list_valid_certs(scm *scmp, scmcon *conp, unsigned int **idsp,
+                          size_t *nidsp) {
+  struct valid_cert_list list = {NULL, 0, 0};
+  unsigned int lid = 0;
+  char where[WHERESTR_SIZE];
+  scmsrch srchvec[] = {
+      {
+          .colno = 1,
+          .sqltype = SQL_C_ULONG,
+          .colname = "local_id",
+          .valptr = &lid,
+          .valsize = sizeof(lid),
+      },
+  };
+  scmsrcha srch = {
+      .vec = srchvec,
+      .ntot = ELTS(srchvec),
+      .nused = ELTS(srchvec),
+      .wherestr = where,
+      .context = &list,
+  };
+  err_code sta = 0;
+  int trusted;
 
-  LOG(LOG_DEBUG, "verifyOrNotChildren() returning %s: %s", err2name(sta),
-      err2string(sta));
+  initTables(scmp);
+  // trust anchors first, so that most of the tree is done from the top
+  for (trusted = 1; trusted >= 0 && sta == 0; trusted--) {
+    xsnprintf(where, sizeof(where),
+              "(`flags` & 0x%x) != 0 AND (`flags` & 0x%x) %s 0",
+              SCM_FLAG_VALID, SCM_FLAG_TRUSTED, trusted ? "!=" : "=");
+    sta = searchscm(conp, theCertTable, &srch, NULL, &add_valid_cert,
+                    SCM_SRCH_DOVALUE_ALWAYS, NULL);
+    if (sta == ERR_SCM_NODATA)
+      sta = 0;
+  }
+  if (sta < 0) {
+    free(list.ids);
+    list.ids = NULL;
+    list.n = 0;
+  }
+  *idsp = list.ids;
+  *nidsp = list.n;
   return sta;
 }
 
@@ -2790,20 +4687,19 @@ static err_code verifyOrNotChildren(scmcon *conp, char *ski, char *subject,
  * that can either confirm or deny the hash
  */
 
-static scmsrcha *validManSrch = NULL;
-static char validManPath[PATH_MAX];
-
 static sqlvaluefunc handleValidMan;
 err_code handleValidMan(scmcon *conp, scmsrcha *s, ssize_t idx) {
+  struct validation_ctx *vc = getvctx(conp);
   (void)conp;
   (void)idx;
-  xsnprintf(validManPath, PATH_MAX, "%s/%s", (char *)s->vec[0].valptr,
+  xsnprintf(vc->validManPath, PATH_MAX, "%s/%s", (char *)s->vec[0].valptr,
             (char *)s->vec[1].valptr);
   return 0;
 }
 
 err_code addStateToFlags(unsigned int *flags, int isValid, char *filename,
                          char *fullpath, scm *scmp, scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
   err_code sta;
   int fd;
   struct CMS cms;
@@ -2817,25 +4713,27 @@ err_code addStateToFlags(unsigned int *flags, int isValid, char *filename,
   }
   if (fullpath == NULL)
     return 0;
-  if (validManSrch == NULL) {
-    validManSrch = newsrchscm(NULL, 2, 0, 1);
-    ADDCOL(validManSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
-    ADDCOL(validManSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
-  }
-  xsnprintf(validManSrch->wherestr, WHERESTR_SIZE, "files regexp binary \"%s\"",
-            filename);
-  addFlagTest(validManSrch->wherestr, SCM_FLAG_VALID, 1, 1);
+  if (vc->validManSrch == NULL) {
+    vc->validManSrch = newsrchscm(NULL, 2, 0, 1);
+    ADDCOL(vc->validManSrch, "dirname", SQL_C_CHAR, DNAMESIZE, sta, sta);
+    ADDCOL(vc->validManSrch, "filename", SQL_C_CHAR, FNAMESIZE, sta, sta);
+  }
+  const char *params[1] = {filename};
+  vc->validManSrch->params = params;
+  vc->validManSrch->nparams = 1;
+  xsnprintf(vc->validManSrch->wherestr, WHERESTR_SIZE, "files regexp binary ?");
+  addFlagTest(vc->validManSrch->wherestr, SCM_FLAG_VALID, 1, 1);
   initTables(scmp);
-  validManPath[0] = 0;
+  vc->validManPath[0] = 0;
   /** @bug ignores error code without explanation */
-  searchscm(conp, theManifestTable, validManSrch, NULL, &handleValidMan,
+  searchscm(conp, theManifestTable, vc->validManSrch, NULL, &handleValidMan,
             SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_DO_JOIN, NULL);
-  if (!validManPath[0])
+  if (!vc->validManPath[0])
     return 0;
 
   CMS(&cms, 0);
   /** @bug ignores error code without explanation */
-  get_casn_file(&cms.self, validManPath, 0);
+  get_casn_file(&cms.self, vc->validManPath, 0);
   struct Manifest *manifest =
       &cms.content.signedData.encapContentInfo.eContent.manifest;
   simple_constructor(&ccasn, (ushort)0, ASN_IA5_STRING);
@@ -2888,45 +4786,83 @@ struct Extension *get_extension(struct Certificate *certp, char *idp,
   return ret;
 }
 
+/*
+ * Objects are loaded from their DER bytes, which are read once and then
+ * decoded from memory into both the OpenSSL and the casn forms that
+ * add_cert_2() needs, rather than each library reading and decoding the
+ * file on its own.
+ */
+
+/*
+ * Decode a DER certificate into both forms. On success the caller owns
+ * *xp and must delete_casn() the certificate.
+ */
+static err_code decode_cert_der(unsigned char *der, size_t len, X509 **xp,
+                                struct Certificate *certp) {
+  const unsigned char *p = der;
+
+  *xp = d2i_X509(NULL, &p, len);
+  if (*xp == NULL)
+    return ERR_SCM_BADCERT;
+  Certificate(certp, (ushort)0);
+  if (get_casn_buf(&certp->self, der, len) < 0) {
+    LOG(LOG_DEBUG, "get_casn_buf() returned an error code");
+    delete_casn(&certp->self);
+    X509_free(*xp);
+    *xp = NULL;
+    return ERR_SCM_BADCERT;
+  }
+  return 0;
+}
+
 /*
  * do the work of add_cert(). Factored out so we can call it from elsewhere.
  *
  * We should eventually merge this with add_cert_internal()
  *
+ * If certp is not NULL, it is the already decoded casn form of x, which
+ * remains the caller's. Otherwise the certificate is read from fullpath.
+ *
  * Note: caller is responsible for invoking freecf(cf).
  */
 
 static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
-                           unsigned int id, int utrust, unsigned int *cert_id,
-                           char *fullpath) {
-  LOG(LOG_DEBUG, "add_cert_2(scmp=%p, conp=%p, cf=%p, x=%p, id=%u"
+                           struct Certificate *certp, unsigned int id,
+                           int utrust, unsigned int *cert_id, char *fullpath) {
+  LOG(LOG_DEBUG, "add_cert_2(scmp=%p, conp=%p, cf=%p, x=%p, certp=%p, id=%u"
                  ", utrust=%d, cert_id=%p, fullpath=%s)",
-      scmp, conp, cf, x, id, utrust, cert_id, fullpath);
+      scmp, conp, cf, x, certp, id, utrust, cert_id, fullpath);
 
   err_code sta = 0;
   int ct = UN_CERT;
+  RS *result = NULL;
 
   cf->dirid = id;
   struct Certificate cert;
-  Certificate(&cert, (ushort)0);
   struct Extension *ski_extp;
   struct Extension *aki_extp;
   err_code locerr = 0;
-  if (get_casn_file(&cert.self, fullpath, 0) < 0) {
-    LOG(LOG_DEBUG, "get_casn_file() returned an error code");
-    locerr = ERR_SCM_BADCERT;
-  } else if (!(ski_extp = find_extension(&cert.toBeSigned.extensions,
-                                         id_subjectKeyIdentifier, false))) {
+  if (certp == NULL) {
+    certp = &cert;
+    Certificate(&cert, (ushort)0);
+    if (get_casn_file(&cert.self, fullpath, 0) < 0) {
+      LOG(LOG_DEBUG, "get_casn_file() returned an error code");
+      locerr = ERR_SCM_BADCERT;
+    }
+  }
+  if (!locerr && !(ski_extp = find_extension(&certp->toBeSigned.extensions,
+                                             id_subjectKeyIdentifier, false))) {
     LOG(LOG_DEBUG, "no SKI extension found");
     locerr = ERR_SCM_NOSKI;
   }
   if (locerr) {
-    delete_casn(&cert.self);
+    if (certp == &cert)
+      delete_casn(&cert.self);
     sta = locerr;
     goto done;
   }
   if (utrust > 0) {
-    if ((aki_extp = find_extension(&cert.toBeSigned.extensions, id_authKeyId,
+    if ((aki_extp = find_extension(&certp->toBeSigned.extensions, id_authKeyId,
                                    false)) &&
         diff_casn(&ski_extp->extnValue.subjectKeyIdentifier,
                   &aki_extp->extnValue.authKeyId.keyIdentifier)) {
@@ -2936,17 +4872,18 @@ static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
                       cf->fields[CF_FIELD_ISSUER]) != 0) {
       LOG(LOG_DEBUG, "subject and issuer don't match");
       locerr = 1;
-    } else if (vsize_casn(&cert.signature) < 256) {
+    } else if (vsize_casn(&certp->signature) < 256) {
       LOG(LOG_DEBUG, "signature too small");
       locerr = ERR_SCM_SMALLKEY;
     } else if (vsize_casn(
-                   &cert.toBeSigned.subjectPublicKeyInfo.subjectPublicKey) <
+                   &certp->toBeSigned.subjectPublicKeyInfo.subjectPublicKey) <
                265) {
       LOG(LOG_DEBUG, "key too small");
       locerr = ERR_SCM_SMALLKEY;
     }
     if (locerr) {
-      delete_casn(&cert.self);
+      if (certp == &cert)
+        delete_casn(&cert.self);
       sta = (locerr < 0) ? locerr : ERR_SCM_NOTSS;
       goto done;
     }
@@ -2957,8 +4894,9 @@ static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
     ct = TA_CERT;
   else
     ct = (cf->flags & SCM_FLAG_CA) ? CA_CERT : EE_CERT;
-  sta = rescert_profile_chk(x, &cert, ct);
-  delete_casn(&cert.self);
+  sta = rescert_profile_chk(x, certp, ct);
+  if (certp == &cert)
+    delete_casn(&cert.self);
   if (sta) {
     LOG(LOG_DEBUG, "rescert_profile_chk() returned %s: %s", err2name(sta),
         err2string(sta));
@@ -2984,28 +4922,16 @@ static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
                     cf->fields[CF_FIELD_ISSUER]);
 
   // validation reconsidered
-  RS *result = InitializeRSNode();
-
-  char *vrs_dir = config_get_string(config_find("VRSCacheDir"));
-  char vrs_file_path[4096];
-  int pos;
-  for (pos = strlen(fullpath) - 1; pos >= 0; pos--) {
-    if (fullpath[pos] == '/') {
-      break;
-    }
+  if ((result = InitializeRSNode()) == NULL) {
+    sta = ERR_SCM_NOMEM;
+    goto done;
   }
-  sprintf(vrs_file_path, "%s/%s.txt", vrs_dir, fullpath + pos + 1);
 
   err_code verify_result = sta;
   sta = validation_reconsidered(conp, cf->fields[CF_FIELD_AKI],
                                 cf->fields[CF_FIELD_ISSUER], x, result,
                                 verify_result, isROA_file(fullpath));
 
-  if (verify_result != ERR_SCM_NOTVALID) {
-    // save to file
-    save_node_as_file(result, vrs_file_path);
-  }
-  freeRSNode(result);
   if (sta == ERR_SCM_NODATA) {
     sta = (ct == TA_CERT) ? 0 : ERR_SCM_NOTVALID;
   }
@@ -3036,16 +4962,22 @@ static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
         err2string(sta));
     goto done;
   }
+  cert_index_added(conp, *cert_id, cf->flags, cf->fields[CF_FIELD_SKI],
+                   cf->fields[CF_FIELD_SUBJECT], cf->fields[CF_FIELD_AKI],
+                   cf->fields[CF_FIELD_ISSUER], fullpath);
   if (verify_result != ERR_SCM_NOTVALID) {
     if ((sta = add_cert_validation_reconsidered(conp, cf->fields[CF_FIELD_SKI],
                                                 cf->fields[CF_FIELD_SUBJECT],
-                                                *cert_id, vrs_file_path))) {
+                                                *cert_id, result))) {
       LOG(LOG_DEBUG, "add_cert_validation_reconsidered() returned %s: %s",
           err2name(sta), err2string(sta));
       goto done;
     }
   }
-  if (is_valid) {
+  // deferred validation reaches the children from the trust anchors later
+  if (is_valid && !getvctx(conp)->deferValidation) {
+    if (mark_dirty_cert(getvctx(conp), *cert_id))
+      goto done;
     if ((sta = verifyOrNotChildren(conp, cf->fields[CF_FIELD_SKI],
                                    cf->fields[CF_FIELD_SUBJECT],
                                    cf->fields[CF_FIELD_AKI],
@@ -3058,6 +4990,7 @@ static err_code add_cert_2(scm *scmp, scmcon *conp, cert_fields *cf, X509 *x,
   }
 
 done:
+  freeRSNode(result);
   LOG(LOG_DEBUG, "add_cert_2() returning %s: %s", err2name(sta),
       err2string(sta));
   return (sta);
@@ -3065,30 +4998,62 @@ done:
 
 err_code add_cert(scm *scmp, scmcon *conp, char *outfile, char *outfull,
                   unsigned int id, int utrust, object_type typ,
-                  unsigned int *cert_id) {
+                  unsigned int *cert_id, struct file_contents *contents) {
   LOG(LOG_DEBUG, "add_cert(scmp=%p, conp=%p, outfile=\"%s\""
                  ", outfull=\"%s\", id=%u, utrust=%d, typ=%d"
                  ", cert_id=%p)",
       scmp, conp, outfile, outfull, id, utrust, typ, cert_id);
 
-  cert_fields *cf;
+  cert_fields *cf = NULL;
   X509 *x = NULL;
+  struct Certificate cert;
+  bool haveCert = false;
+  struct file_contents ownContents;
+  bool haveContents = false;
+  struct stat st;
   int x509sta = 0;
   err_code sta = 0;
 
   initTables(scmp);
+  if (typ < OT_PEM_OFFSET) {
+    // read the file once and decode both forms from it
+    if (contents == NULL) {
+      if (!file_contents_open(&ownContents, outfull)) {
+        sta = ERR_SCM_BADFILE;
+        goto done;
+      }
+      haveContents = true;
+      contents = &ownContents;
+    }
+    if ((sta = decode_cert_der(contents->data, contents->size, &x, &cert)) < 0)
+      goto done;
+    haveCert = true;
+  }
   /** @bug ignores error code without explanation if cf && x */
   /** @bug ignores x509sta without explanation */
-  cf = cert2fields(outfile, outfull, typ, &x, &sta, &x509sta);
+  if (x != NULL) {
+    cf = cert2fields(outfile, NULL, typ, &x, &sta, &x509sta);
+  } else {
+    cf = cert2fields(outfile, outfull, typ, &x, &sta, &x509sta);
+  }
   LOG(LOG_DEBUG, "cert2fields() returned error code %s: %s", err2name(sta),
       err2string(sta));
   if (cf == NULL || x == NULL) {
     goto done;
   }
-  sta = add_cert_2(scmp, conp, cf, x, id, utrust, cert_id, outfull);
+  sta = add_cert_2(scmp, conp, cf, x, haveCert ? &cert : NULL, id, utrust,
+                   cert_id, outfull);
   LOG(LOG_DEBUG, "add_cert_2() returned error code %s: %s", err2name(sta),
       err2string(sta));
+  // path searches below this CA will want it, so save decoding it again
+  if (sta == 0 && haveCert && (cf->flags & SCM_FLAG_CA) &&
+      stat(outfull, &st) == 0)
+    cert_cache_put(getvctx(conp), outfull, strlen(outfull), &st, x);
 done:
+  if (haveCert)
+    delete_casn(&cert.self);
+  if (haveContents)
+    file_contents_close(&ownContents);
   freecf(cf);
   X509_free(x);
   LOG(LOG_DEBUG, "add_cert() returning %s: %s", err2name(sta), err2string(sta));
@@ -3096,7 +5061,8 @@ done:
 }
 
 err_code add_crl(scm *scmp, scmcon *conp, char *outfile, char *outfull,
-                 unsigned int id, int utrust, object_type typ) {
+                 unsigned int id, int utrust, object_type typ,
+                 struct file_contents *contents) {
   LOG(LOG_DEBUG, "add_crl(scmp=%p, conp=%p, outfile=\"%s\""
                  ", outfull=\"%s\", id=%u, utrust=%i, typ=%i)",
       scmp, conp, outfile, outfull, id, utrust, typ);
@@ -3109,13 +5075,13 @@ err_code add_crl(scm *scmp, scmcon *conp, char *outfile, char *outfull,
   int chainOK;
   struct CertificateRevocationList crl;
 
-  if (!goodoids[0].lth)
-    make_goodoids();
+  pthread_once(&goodoidsOnce, make_goodoids);
   UNREFERENCED_PARAMETER(utrust);
 
   // standalone profile check against draft-ietf-sidr-res-certs
   CertificateRevocationList(&crl, 0);
-  if (get_casn_file(&crl.self, outfull, 0) < 0) {
+  if ((contents ? get_casn_buf(&crl.self, contents->data, contents->size)
+                : get_casn_file(&crl.self, outfull, 0)) < 0) {
     LOG(LOG_ERR, "Failed to load CRL: %s", outfile);
     delete_casn(&crl.self);
     sta = ERR_SCM_INVALASN;
@@ -3321,14 +5287,36 @@ static err_code extractAndAddCert(struct CMS *cmsp, scm *scmp, scmcon *conp,
     strcpy(certfilenamep, certname);
   // pull out the fields
   int x509sta;
-  // write the cert there, because cert2fields needs that
-  if (put_casn_file(&certp->self, pathname, 0) < 0)
+  int der_lth;
+  unsigned char *der = NULL;
+  const unsigned char *derp;
+  int fd = -1;
+  // encode the cert once, both to write it there (as put_casn_file()
+  // would) and to hand it to OpenSSL
+  (void)unlink(pathname);
+  if ((der_lth = size_casn(&certp->self)) <= 0 ||
+      (der = malloc(der_lth)) == NULL ||
+      encode_casn(&certp->self, der) != der_lth) {
+    sta = ERR_SCM_BADCERT;
+  } else if ((fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC | O_EXCL,
+                        0644)) < 0 ||
+             write(fd, der, der_lth) != der_lth) {
     sta = ERR_SCM_WRITE_EE;
-  else
-    cf = cert2fields(certname, pathname, typ, &x509p, &sta, &x509sta);
+  } else {
+    derp = der;
+    x509p = d2i_X509(NULL, &derp, der_lth);
+    if (x509p == NULL)
+      sta = ERR_SCM_BADCERT;
+    else
+      cf = cert2fields(certname, NULL, typ, &x509p, &sta, &x509sta);
+  }
+  if (fd >= 0)
+    (void)close(fd);
+  free(der);
   if (cf != NULL && sta == 0) {
     // add the X509 cert to the db with the right directory
-    sta = add_cert_2(scmp, conp, cf, x509p, dir_id, utrust, &cert_id, pathname);
+    sta = add_cert_2(scmp, conp, cf, x509p, certp, dir_id, utrust, &cert_id,
+                     pathname);
     if (typ == OT_ROA && sta == ERR_SCM_DUPSIG)
       sta = 0; // dup roas OK
     else if (sta < 0) {
@@ -3395,11 +5383,10 @@ static err_code add_roa_internal(scm *scmp, scmcon *conp, char *outfile,
   if (sta < 0) {
     goto done;
   }
-  sta = getmaxidscm(scmp, conp, "local_id", theROATable, &roa_id);
+  sta = getnextidscm(scmp, conp, "local_id", theROATable, &roa_id);
   if (sta < 0) {
     goto done;
   }
-  roa_id++;
   // fill in insertion structure
   xsnprintf(did, sizeof(did), "%u", dirid);
   xsnprintf(asn, sizeof(asn), "%" PRIu32, asid);
@@ -3552,7 +5539,8 @@ done:
  */
 
 err_code add_roa(scm *scmp, scmcon *conp, char *outfile, char *outdir,
-                 char *outfull, unsigned int id, int utrust, object_type typ) {
+                 char *outfull, unsigned int id, int utrust, object_type typ,
+                 struct file_contents *contents) {
   LOG(LOG_DEBUG, "add_roa(scmp=%p, conp=%p, outfile=\"%s\", outdir=\"%s\""
                  ", outfull=\"%s\", id=%u, utrust=%i, typ=%i)",
       scmp, conp, outfile, outdir, outfull, id, utrust, typ);
@@ -3584,7 +5572,16 @@ err_code add_roa(scm *scmp, scmcon *conp, char *outfile, char *outdir,
     sta = ERR_SCM_INVALARG;
     goto done;
   }
-  sta = roaFromFile(outfull, typ >= OT_PEM_OFFSET ? FMT_PEM : FMT_DER, 1, &roa);
+  if (contents != NULL && typ < OT_PEM_OFFSET) {
+    CMS(&roa, 0);
+    if (get_casn_buf(&roa.self, contents->data, contents->size) < 0)
+      sta = ERR_SCM_INVALASN;
+    else
+      sta = roaValidate(&roa);
+  } else {
+    sta = roaFromFile(outfull, typ >= OT_PEM_OFFSET ? FMT_PEM : FMT_DER, 1,
+                      &roa);
+  }
   if (sta < 0) {
     goto done;
   }
@@ -3651,7 +5648,8 @@ done:
 
 err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                       char *outfull, unsigned int id, int utrust,
-                      object_type typ) {
+                      object_type typ, struct file_contents *contents) {
+  struct validation_ctx *vc = getvctx(conp);
   LOG(LOG_DEBUG, "add_manifest(scmp=%p, conp=%p, outfile=\"%s\""
                  ", outdir=\"%s\", outfull=\"%s\", id=%u, utrust=%d, typ=%d)",
       scmp, conp, outfile, outdir, outfull, id, utrust, typ);
@@ -3669,7 +5667,8 @@ err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
 
   CMS(&cms, 0);
   initTables(scmp);
-  if (get_casn_file(&cms.self, outfull, 0) < 0) {
+  if ((contents ? get_casn_buf(&cms.self, contents->data, contents->size)
+                : get_casn_file(&cms.self, outfull, 0)) < 0) {
     LOG(LOG_ERR, "invalid manifest %s", outfull);
     delete_casn(&cms.self);
     sta = ERR_SCM_INVALASN;
@@ -3686,13 +5685,18 @@ err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   // read the list of files
   uchar file[200];
   struct FileAndHash *fahp;
-  manFiles[0] = 0;
+  if (vc->manFiles == NULL && (vc->manFiles = malloc(MANFILES_SIZE)) == NULL) {
+    delete_casn(&cms.self);
+    sta = ERR_SCM_NOMEM;
+    goto done;
+  }
+  vc->manFiles[0] = 0;
   int manFilesLen = 0;
   for (fahp = (struct FileAndHash *)member_casn(&manifest->fileList.self, 0);
        fahp != NULL; fahp = (struct FileAndHash *)next_of(&fahp->self)) {
     int flth = read_casn(&fahp->file, file);
     file[flth] = 0;
-    xsnprintf(manFiles + manFilesLen, MANFILES_SIZE - manFilesLen, "%s%s",
+    xsnprintf(vc->manFiles + manFilesLen, MANFILES_SIZE - manFilesLen, "%s%s",
               manFilesLen ? " " : "", file);
     if (manFilesLen)
       manFilesLen++;
@@ -3742,10 +5746,9 @@ err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
       break;
     cert_added = 1;
     v = sta;
-    if ((sta = getmaxidscm(scmp, conp, "local_id", theManifestTable, &man_id)) <
-        0)
+    if ((sta = getnextidscm(scmp, conp, "local_id", theManifestTable,
+                            &man_id)) < 0)
       break;
-    man_id++;
   } while (0);
   if (sta < 0) {
     if (cert_added)
@@ -3776,7 +5779,7 @@ err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   scmkv cols[] = {
       {"filename", outfile},    {"dir_id", did},          {"ski", ski},
       {"this_upd", thisUpdate}, {"next_upd", nextUpdate}, {"flags", flagn},
-      {"local_id", mid},        {"files", manFiles},      {"fileslen", lenbuf},
+      {"local_id", mid},        {"files", vc->manFiles},  {"fileslen", lenbuf},
   };
   scmkva aone = {
       .vec = cols, .ntot = ELTS(cols), .nused = ELTS(cols), .vald = 0,
@@ -3805,19 +5808,19 @@ done:
 
 err_code add_ghostbusters(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                           char *outfull, unsigned int id, int utrust,
-                          object_type typ) {
+                          object_type typ, struct file_contents *contents) {
   err_code sta;
   struct CMS cms;
   char ski[60];
   char certfilename[PATH_MAX]; // FIXME: this could allow a buffer overflow
-  unsigned int local_id_old = 0;
   unsigned int local_id = 0;
   unsigned int flags = 0;
 
   CMS(&cms, 0);
   initTables(scmp);
 
-  if (get_casn_file(&cms.self, outfull, 0) < 0) {
+  if ((contents ? get_casn_buf(&cms.self, contents->data, contents->size)
+                : get_casn_file(&cms.self, outfull, 0)) < 0) {
     LOG(LOG_ERR, "invalid ghostbusters %s", outfull);
     delete_casn(&cms.self);
     return ERR_SCM_INVALASN;
@@ -3840,24 +5843,16 @@ err_code add_ghostbusters(scm *scmp, scmcon *conp, char *outfile, char *outdir,
     flags |= SCM_FLAG_VALID;
   }
 
-  sta = getmaxidscm(scmp, conp, "local_id", theGBRTable, &local_id_old);
+  sta = getnextidscm(scmp, conp, "local_id", theGBRTable, &local_id);
   if (sta < 0) {
+    if (sta == ERR_SCM_NOIDS)
+      LOG(LOG_ERR, "There are too many ghostbusters records in the database.");
     /** @bug ignores error code without explanation */
     (void)delete_object(scmp, conp, certfilename, outdir, outfull, 0);
     delete_casn(&cms.self);
     return sta;
   }
 
-  local_id = local_id_old + 1;
-  if (local_id <= local_id_old) {
-    // there was an integer overflow
-    LOG(LOG_ERR, "There are too many ghostbusters records in the database.");
-    /** @bug ignores error code without explanation */
-    (void)delete_object(scmp, conp, certfilename, outdir, outfull, 0);
-    delete_casn(&cms.self);
-    return ERR_SCM_INTERNAL;
-  }
-
   char dir_id_str[24];
   xsnprintf(dir_id_str, sizeof(dir_id_str), "%u", id);
   char local_id_str[24];
@@ -3886,8 +5881,89 @@ err_code add_ghostbusters(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   return 0;
 }
 
+/*
+ * The table that holds objects of the given type, or NULL.
+ */
+static scmtab *object_table(object_type typ) {
+  switch (typ) {
+  case OT_CER:
+  case OT_CER_PEM:
+  case OT_UNKNOWN:
+  case OT_UNKNOWN + OT_PEM_OFFSET:
+    return theCertTable;
+  case OT_CRL:
+  case OT_CRL_PEM:
+    return theCRLTable;
+  case OT_ROA:
+  case OT_ROA_PEM:
+    return theROATable;
+  case OT_MAN:
+  case OT_MAN_PEM:
+    return theManifestTable;
+  case OT_GBR:
+    return theGBRTable;
+  default:
+    return NULL;
+  }
+}
+
+err_code contents_hash(const struct file_contents *contents, char *hash,
+                       size_t hashsize) {
+  unsigned char md[SHA256_DIGEST_LENGTH];
+  char *h;
+
+  SHA256(contents->data, contents->size, md);
+  h = hexify(sizeof(md), md, HEXIFY_NO);
+  if (h == NULL)
+    return ERR_SCM_NOMEM;
+  xsnprintf(hash, hashsize, "%s", h);
+  free(h);
+  return 0;
+}
+
+static err_code file_hash(const char *fullpath, char *hash, size_t hashsize) {
+  struct file_contents contents;
+  err_code sta;
+
+  if (!file_contents_open(&contents, fullpath))
+    return ERR_SCM_BADFILE;
+  sta = contents_hash(&contents, hash, hashsize);
+  file_contents_close(&contents);
+  return sta;
+}
+
+/*
+ * Remember the hash of an object that was just added, so that an update
+ * that does not change it can be recognized. updateManifestObjs() also
+ * relies on the column holding the hash of the file's contents.
+ */
+static void record_object_hash(scmcon *conp, scmtab *tabp, char *outfile,
+                               unsigned int dir_id, const char *outfull,
+                               const char *hash) {
+  size_t len = strlen(outfile);
+  char escaped[len * 2 + 1];
+  char stmt[200 + HASHSIZE + sizeof(escaped)];
+
+  if (tabp == NULL)
+    return;
+  mysql_escape_string(escaped, outfile, len);
+  xsnprintf(stmt, sizeof(stmt),
+            "update %s set hash=\"%s\" where filename=\"%s\" and dir_id=%u;",
+            tabp->tabname, hash, escaped, dir_id);
+  if (statementscm_no_data(conp, stmt) < 0)
+    LOG(LOG_WARNING, "could not record the hash of %s", outfull);
+}
+
 err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                     char *outfull, int utrust) {
+  return add_object_contents(scmp, conp, outfile, outdir, outfull, utrust,
+                             NULL, NULL);
+}
+
+err_code add_object_contents(scm *scmp, scmcon *conp, char *outfile,
+                             char *outdir, char *outfull, int utrust,
+                             struct file_contents *contents,
+                             const char *hash) {
   LOG(LOG_DEBUG, "add_object(scmp=%p, conp=%p, outfile=\"%s\""
                  ", outdir=\"%s\", outfull=\"%s\", utrust=%d)",
       scmp, conp, outfile, outdir, outfull, utrust);
@@ -3895,6 +5971,9 @@ err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   unsigned int id = 0;
   unsigned int obj_id = 0;
   object_type typ;
+  struct file_contents ownContents;
+  bool haveContents = false;
+  char ownHash[HASHSIZE] = "";
   err_code sta;
 
   if (scmp == NULL || conp == NULL || conp->connected == 0 || outfile == NULL ||
@@ -3909,6 +5988,15 @@ err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   if (sta < 0) {
     goto done;
   }
+  // read it once, for both the parser and the hash column
+  if (contents == NULL) {
+    if (!file_contents_open(&ownContents, outfull)) {
+      sta = ERR_SCM_BADFILE;
+      goto done;
+    }
+    haveContents = true;
+    contents = &ownContents;
+  }
   // determine its filetype
   LOG(LOG_DEBUG, "calling infer_filetype(\"%s\")", outfull);
   typ = infer_filetype(outfull);
@@ -3930,29 +6018,32 @@ err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   case OT_UNKNOWN + OT_PEM_OFFSET:
     LOG(LOG_DEBUG, "calling add_cert(%p, %p, \"%s\", \"%s\", %d, %d, %d, %p)",
         scmp, conp, outfile, outfull, id, utrust, typ, &obj_id);
-    sta = add_cert(scmp, conp, outfile, outfull, id, utrust, typ, &obj_id);
+    sta = add_cert(scmp, conp, outfile, outfull, id, utrust, typ, &obj_id,
+                   contents);
     LOG(LOG_DEBUG, "add_cert() returned %s: %s", err2name(sta),
         err2string(sta));
     break;
   case OT_CRL:
   case OT_CRL_PEM:
-    sta = add_crl(scmp, conp, outfile, outfull, id, utrust, typ);
+    sta = add_crl(scmp, conp, outfile, outfull, id, utrust, typ, contents);
     LOG(LOG_DEBUG, "add_crl() returned %s: %s", err2name(sta), err2string(sta));
     break;
   case OT_ROA:
   case OT_ROA_PEM:
-    sta = add_roa(scmp, conp, outfile, outdir, outfull, id, utrust, typ);
+    sta = add_roa(scmp, conp, outfile, outdir, outfull, id, utrust, typ,
+                  contents);
     LOG(LOG_DEBUG, "add_roa() returned %s: %s", err2name(sta), err2string(sta));
     break;
   case OT_MAN:
   case OT_MAN_PEM:
-    sta = add_manifest(scmp, conp, outfile, outdir, outfull, id, utrust, typ);
+    sta = add_manifest(scmp, conp, outfile, outdir, outfull, id, utrust, typ,
+                       contents);
     LOG(LOG_DEBUG, "add_manifest() returned %s: %s", err2name(sta),
         err2string(sta));
     break;
   case OT_GBR:
-    sta =
-        add_ghostbusters(scmp, conp, outfile, outdir, outfull, id, utrust, typ);
+    sta = add_ghostbusters(scmp, conp, outfile, outdir, outfull, id, utrust,
+                           typ, contents);
     LOG(LOG_DEBUG, "add_ghostbusters() returned %s: %s", err2name(sta),
         err2string(sta));
     break;
@@ -3960,7 +6051,15 @@ err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
     sta = ERR_SCM_INTERNAL;
     break;
   }
+  // a failure here only costs recognizing an unchanged update later
+  if (sta == 0 && (hash == NULL || hash[0] == 0) &&
+      contents_hash(contents, ownHash, sizeof(ownHash)) == 0)
+    hash = ownHash;
+  if (sta == 0 && hash != NULL && hash[0] != 0)
+    record_object_hash(conp, object_table(typ), outfile, id, outfull, hash);
 done:
+  if (haveContents)
+    file_contents_close(&ownContents);
   LOG(LOG_DEBUG, "add_object() returning %s: %s", err2name(sta),
       err2string(sta));
   return (sta);
@@ -4046,9 +6145,8 @@ err_code crliterator(scmcon *conp, scmsrcha *s, ssize_t idx) {
   return (sta);
 }
 
-static uint8_t *snlist = NULL;
-
 err_code iterate_crl(scm *scmp, scmcon *conp, crlfunc *cfunc) {
+  struct validation_ctx *vc = getvctx(conp);
   unsigned int snlen = 0;
   unsigned int sninuse = 0;
   unsigned int flags = 0;
@@ -4058,15 +6156,15 @@ err_code iterate_crl(scm *scmp, scmcon *conp, crlfunc *cfunc) {
   err_code sta;
 
   // go for broke and allocate a blob large enough that it can hold
-  // the entire snlist if necessary
+  // the entire vc->snlist if necessary
   /** @bug magic number */
   static const size_t snlist_len = 16 * 1024 * 1024;
-  if (snlist == NULL)
-    snlist = calloc(1, snlist_len);
-  if (snlist == NULL)
+  if (vc->snlist == NULL)
+    vc->snlist = calloc(1, snlist_len);
+  if (vc->snlist == NULL)
     return (ERR_SCM_NOMEM);
   initTables(scmp);
-  // set up a search for issuer, snlen, sninuse, flags, snlist and aki
+  // set up a search for issuer, snlen, sninuse, flags, vc->snlist and aki
   issuer[0] = 0;
   aki[0] = 0;
   scmsrch srch1[] = {
@@ -4114,7 +6212,7 @@ err_code iterate_crl(scm *scmp, scmcon *conp, crlfunc *cfunc) {
           .colno = 6,
           .sqltype = SQL_C_BINARY,
           .colname = "snlist",
-          .valptr = snlist,
+          .valptr = vc->snlist,
           .valsize = snlist_len,
           .avalsize = 0,
       },
@@ -4145,6 +6243,229 @@ err_code iterate_crl(scm *scmp, scmcon *conp, crlfunc *cfunc) {
   return (sta);
 }
 
+/*
+ * Revocation sweep, see sweep_crl_revocations().  The serials of the CRLs
+ * being swept are staged in a temporary table keyed like rpki_cert's
+ * (issuer, sn) index, so that the certificates they revoke are found by one
+ * join instead of one query per serial.
+ */
+#define SWEEP_TABLE "rpki_crl_sweep"
+#define SWEEP_ROWS_PER_INSERT 512
+
+struct sweep_ctx {
+  char *stmt; // INSERT statement being built
+  size_t stmtlen;
+  size_t stmtsize;
+  unsigned int nrows;
+  size_t nstaged;
+};
+
+static err_code flush_sweep_rows(scmcon *conp, struct sweep_ctx *sc) {
+  err_code sta;
+
+  if (sc->nrows == 0)
+    return 0;
+  sc->stmt[sc->stmtlen - 1] = ';'; // replace the trailing comma
+  sta = statementscm_no_data(conp, sc->stmt);
+  sc->stmtlen = 0;
+  sc->nrows = 0;
+  return sta;
+}
+
+static sqlvaluefunc stage_crl_serials;
+err_code stage_crl_serials(scmcon *conp, scmsrcha *s, ssize_t idx) {
+  struct sweep_ctx *sc = s->context;
+  unsigned int lid = *(unsigned int *)s->vec[0].valptr;
+  unsigned int snlen = *(unsigned int *)s->vec[1].valptr;
+  uint8_t *snlist = s->vec[2].valptr;
+  static const uint8_t sn_zero[SER_NUM_MAX_SZ] = {0};
+  unsigned int i;
+  int j;
+  err_code sta;
+
+  UNREFERENCED_PARAMETER(idx);
+  if (s->vec[2].avalsize < (SQLLEN)((size_t)snlen * SER_NUM_MAX_SZ))
+    return 0;
+  for (i = 0; i < snlen; i++) {
+    uint8_t *sn = &snlist[SER_NUM_MAX_SZ * i];
+    char *p;
+    if (memcmp(sn, sn_zero, SER_NUM_MAX_SZ) == 0)
+      continue;
+    if (sc->nrows == 0)
+      sc->stmtlen = xsnprintf(sc->stmt, sc->stmtsize,
+                              "INSERT INTO " SWEEP_TABLE " VALUES ");
+    p = sc->stmt + sc->stmtlen;
+    p += sprintf(p, "(%u,0x", lid);
+    for (j = 0; j < SER_NUM_MAX_SZ; j++)
+      p += sprintf(p, "%02x", sn[j]);
+    p += sprintf(p, "),");
+    sc->stmtlen = p - sc->stmt;
+    sc->nstaged++;
+    if (++sc->nrows == SWEEP_ROWS_PER_INSERT &&
+        (sta = flush_sweep_rows(conp, sc)) < 0)
+      return sta;
+  }
+  return 0;
+}
+
+struct revoked_cert {
+  unsigned int lid;
+  char ski[SKISIZE];
+  char subject[SUBJSIZE];
+};
+
+err_code sweep_crl_revocations(scm *scmp, scmcon *conp, const char *since) {
+  LOG(LOG_DEBUG, "sweep_crl_revocations(scmp=%p, conp=%p, since=%s)", scmp,
+      conp, since ? since : "(null)");
+
+  struct validation_ctx *vc = getvctx(conp);
+  static const size_t snlist_len = 16 * 1024 * 1024;
+  unsigned int lid = 0;
+  unsigned int snlen = 0;
+  char where[WHERESTR_SIZE];
+  char stmt[1024];
+  struct revoked_cert cur;
+  struct revoked_cert *certs = NULL;
+  size_t ncerts = 0;
+  size_t alloc = 0;
+  size_t i;
+  SQLRETURN rc;
+  err_code sta;
+  struct sweep_ctx sc = {
+      .stmtsize = 64 + SWEEP_ROWS_PER_INSERT * (2 * SER_NUM_MAX_SZ + 20),
+  };
+
+  if (scmp == NULL || conp == NULL || conp->connected == 0)
+    return ERR_SCM_INVALARG;
+  if (vc->snlist == NULL && (vc->snlist = calloc(1, snlist_len)) == NULL)
+    return ERR_SCM_NOMEM;
+  if ((sc.stmt = malloc(sc.stmtsize)) == NULL)
+    return ERR_SCM_NOMEM;
+  initTables(scmp);
+
+  // stage the serials of the valid CRLs changed since the last sweep
+  sta = statementscm_no_data(
+      conp, "CREATE TEMPORARY TABLE IF NOT EXISTS " SWEEP_TABLE " ("
+            "crl_id INT UNSIGNED NOT NULL,"
+            "sn     BINARY(20) NOT NULL,"
+            "       KEY crl_sn (crl_id, sn));");
+  if (sta >= 0)
+    sta = statementscm_no_data(conp, "TRUNCATE TABLE " SWEEP_TABLE ";");
+  if (sta < 0)
+    goto done;
+  scmsrch srch1[] = {
+      {
+          .colno = 1,
+          .sqltype = SQL_C_ULONG,
+          .colname = "local_id",
+          .valptr = &lid,
+          .valsize = sizeof(lid),
+          .avalsize = 0,
+      },
+      {
+          .colno = 2,
+          .sqltype = SQL_C_ULONG,
+          .colname = "snlen",
+          .valptr = &snlen,
+          .valsize = sizeof(snlen),
+          .avalsize = 0,
+      },
+      {
+          .colno = 3,
+          .sqltype = SQL_C_BINARY,
+          .colname = "snlist",
+          .valptr = vc->snlist,
+          .valsize = snlist_len,
+          .avalsize = 0,
+      },
+  };
+  scmsrcha srch = {
+      .vec = srch1,
+      .sname = NULL,
+      .ntot = ELTS(srch1),
+      .nused = ELTS(srch1),
+      .vald = 0,
+      .where = NULL,
+      .wherestr = where,
+      .context = &sc,
+  };
+  if (since != NULL)
+    xsnprintf(where, sizeof(where), "snlen>0 and ts_mod>=\"%s\"", since);
+  else
+    xsnprintf(where, sizeof(where), "snlen>0");
+  addFlagTest(where, SCM_FLAG_VALID, 1, 1);
+  sta = searchscm(conp, theCRLTable, &srch, NULL, &stage_crl_serials,
+                  SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_BREAK_VERR, NULL);
+  if (sta == ERR_SCM_NODATA) {
+    sta = 0;
+    goto done;
+  }
+  if (sta >= 0)
+    sta = flush_sweep_rows(conp, &sc);
+  if (sta < 0)
+    goto done;
+  LOG(LOG_DEBUG, "staged %zu serials for the revocation sweep", sc.nstaged);
+  if (sc.nstaged == 0)
+    goto done;
+
+  // find every certificate they revoke at once
+  xsnprintf(stmt, sizeof(stmt),
+            "SELECT DISTINCT c.local_id,c.ski,c.subject FROM " SWEEP_TABLE
+            " s JOIN %s r ON r.local_id=s.crl_id JOIN %s c ON "
+            "c.issuer=r.issuer AND c.sn=s.sn AND c.aki=r.aki;",
+            theCRLTable->tabname, theCertTable->tabname);
+  rc = newhstmt(conp);
+  if (!SQLOK(rc)) {
+    sta = ERR_SCM_SQL;
+    goto done;
+  }
+  sta = statementscm(conp, stmt);
+  if (sta >= 0) {
+    SQLBindCol(conp->hstmtp->hstmt, 1, SQL_C_ULONG, &cur.lid, sizeof(cur.lid),
+               NULL);
+    SQLBindCol(conp->hstmtp->hstmt, 2, SQL_C_CHAR, cur.ski, sizeof(cur.ski),
+               NULL);
+    SQLBindCol(conp->hstmtp->hstmt, 3, SQL_C_CHAR, cur.subject,
+               sizeof(cur.subject), NULL);
+    while (SQLOK(rc = SQLFetch(conp->hstmtp->hstmt))) {
+      if (ncerts == alloc) {
+        struct revoked_cert *p;
+        alloc = alloc ? 2 * alloc : 16;
+        if ((p = realloc(certs, alloc * sizeof(*certs))) == NULL) {
+          sta = ERR_SCM_NOMEM;
+          break;
+        }
+        certs = p;
+      }
+      certs[ncerts++] = cur;
+    }
+    if (sta >= 0 && rc != SQL_NO_DATA)
+      sta = ERR_SCM_SQL;
+    SQLCloseCursor(conp->hstmtp->hstmt);
+  }
+  pophstmt(conp);
+  if (sta < 0)
+    goto done;
+
+  // then revoke them, as revoke_cert_and_children() does
+  LOG(LOG_DEBUG, "revocation sweep found %zu revoked certificates", ncerts);
+  for (i = 0; i < ncerts; i++) {
+    if ((sta = deletebylid(conp, theCertTable, certs[i].lid)) < 0)
+      break;
+    sta = verifyOrNotChildren(conp, certs[i].ski, certs[i].subject, NULL, NULL,
+                              certs[i].lid, 0);
+    if (sta < 0)
+      break;
+  }
+
+done:
+  free(certs);
+  free(sc.stmt);
+  LOG(LOG_DEBUG, "sweep_crl_revocations() returning %s: %s", err2name(sta),
+      err2string(sta));
+  return sta;
+}
+
 /**
  * @brief
  *     Fill in the columns for a search with revoke_cert_and_children()
@@ -4219,7 +6540,7 @@ err_code delete_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   unsigned int id;
   unsigned int lid;
   unsigned int flags;
-  scmsrcha srch;
+  scmsrcha srch = {0};
   scmsrch srch2[5];
   scmtab *thetab;
   object_type typ;
@@ -4297,6 +6618,23 @@ err_code delete_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
   case OT_CRL:
   case OT_CRL_PEM:
     thetab = theCRLTable;
+    srch2[0] = (scmsrch){
+        .colno = 1,
+        .sqltype = SQL_C_ULONG,
+        .colname = "local_id",
+        .valptr = &lid,
+        .valsize = sizeof(lid),
+        .avalsize = 0,
+    };
+    srch = (scmsrcha){
+        .vec = srch2, .ntot = 1, .nused = 1, .where = &dwhere,
+    };
+    sta = searchscm(conp, thetab, &srch, NULL, &ok, SCM_SRCH_DOVALUE_ALWAYS,
+                    NULL);
+    if (sta == 0)
+      forget_crl_serials(conp, lid);
+    else if (sta == ERR_SCM_NODATA)
+      sta = 0;
     break;
   case OT_ROA:
   case OT_ROA_PEM:
@@ -4339,11 +6677,179 @@ err_code delete_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
     strcat(noutfull, ".cer");
     strcat(strcpy(noutfile, outfile), ".cer");
 
-    if ((sta = delete_object(scmp, conp, noutfile, noutdir, noutfull,
-                             ndir_id)) < 0)
-      return sta;
+    if ((sta = delete_object(scmp, conp, noutfile, noutdir, noutfull,
+                             ndir_id)) < 0)
+      return sta;
+  }
+  return (sta);
+}
+
+static bool same_extension(X509 *a, X509 *b, int nid) {
+  int ia = X509_get_ext_by_NID(a, nid, -1);
+  int ib = X509_get_ext_by_NID(b, nid, -1);
+
+  if (ia < 0 || ib < 0)
+    return ia == ib;
+  return ASN1_STRING_cmp(X509_EXTENSION_get_data(X509_get_ext(a, ia)),
+                         X509_EXTENSION_get_data(X509_get_ext(b, ib))) == 0;
+}
+
+/*
+ * Whether a new version of a certificate can take the place of the old one
+ * without revisiting anything below it: the same names, key and resources,
+ * and the same SIA, AIA and CRL distribution points, which say where the
+ * objects around it are published. Validity dates and the signature may
+ * differ.
+ */
+static bool same_key_and_resources(X509 *old, X509 *new) {
+  static const int nids[] = {
+      NID_subject_key_identifier, NID_authority_key_identifier,
+      NID_basic_constraints,      NID_key_usage,
+      NID_sbgp_ipAddrBlock,       NID_sbgp_autonomousSysNum,
+      NID_sinfo_access,           NID_info_access,
+      NID_crl_distribution_points,
+  };
+  size_t i;
+
+  if (X509_NAME_cmp(X509_get_subject_name(old), X509_get_subject_name(new)) ||
+      X509_NAME_cmp(X509_get_issuer_name(old), X509_get_issuer_name(new)) ||
+      ASN1_STRING_cmp(X509_get0_pubkey_bitstr(old),
+                      X509_get0_pubkey_bitstr(new)))
+    return false;
+  for (i = 0; i < ELTS(nids); i++)
+    if (!same_extension(old, new, nids[i]))
+      return false;
+  return true;
+}
+
+err_code begin_update_object(scm *scmp, scmcon *conp, char *outfile,
+                             char *outdir, char *outfull, const char *newhash,
+                             bool *unchanged) {
+  struct validation_ctx *vc = getvctx(conp);
+  unsigned int dir_id;
+  unsigned int lid = 0;
+  unsigned int flags = 0;
+  char hash[HASHSIZE] = "";
+  char ownHash[HASHSIZE];
+  char ski[SKISIZE] = "";
+  char subject[SUBJSIZE] = "";
+  char aki[SKISIZE] = "";
+  char issuer[SUBJSIZE] = "";
+  char did[24];
+  char where[WHERESTR_SIZE] = "filename=? and dir_id=?";
+  const char *params[2] = {outfile, did};
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "local_id",
+       .valptr = &lid, .valsize = sizeof(lid)},
+      {.colno = 2, .sqltype = SQL_C_ULONG, .colname = "flags",
+       .valptr = &flags, .valsize = sizeof(flags)},
+      {.colno = 3, .sqltype = SQL_C_CHAR, .colname = "hash",
+       .valptr = hash, .valsize = sizeof(hash)},
+      // certificates only
+      {.colno = 4, .sqltype = SQL_C_CHAR, .colname = "ski",
+       .valptr = ski, .valsize = sizeof(ski)},
+      {.colno = 5, .sqltype = SQL_C_CHAR, .colname = "subject",
+       .valptr = subject, .valsize = sizeof(subject)},
+      {.colno = 6, .sqltype = SQL_C_CHAR, .colname = "aki",
+       .valptr = aki, .valsize = sizeof(aki)},
+      {.colno = 7, .sqltype = SQL_C_CHAR, .colname = "issuer",
+       .valptr = issuer, .valsize = sizeof(issuer)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = 3,
+      .wherestr = where, .params = params, .nparams = 2,
+  };
+  scmtab *tabp;
+  X509 *oldx;
+  X509 *newx;
+  bool inplace = false;
+  err_code sta;
+
+  *unchanged = false;
+  vc->replacePending = false;
+  if (conp == NULL || conp->connected == 0 || outfile == NULL ||
+      outdir == NULL || outfull == NULL)
+    return ERR_SCM_INVALARG;
+  initTables(scmp);
+  tabp = object_table(infer_filetype(outfile));
+  if (tabp == NULL)
+    return delete_object(scmp, conp, outfile, outdir, outfull, 0);
+  if (tabp == theCertTable)
+    srch.nused = ELTS(srchvec);
+  if ((sta = findorcreatedir(scmp, conp, outdir, &dir_id)) < 0)
+    return sta;
+  xsnprintf(did, sizeof(did), "%u", dir_id);
+  sta = searchscm(conp, tabp, &srch, NULL, &ok, SCM_SRCH_DOVALUE_ALWAYS, NULL);
+  if (sta == ERR_SCM_NODATA) // nothing to replace
+    return 0;
+  if (sta < 0)
+    return sta;
+
+  // the common case: rsync noticed the file, but its contents are the same
+  if (hash[0] != 0 && (newhash == NULL || newhash[0] == 0) &&
+      file_hash(outfull, ownHash, sizeof(ownHash)) == 0)
+    newhash = ownHash;
+  if (hash[0] != 0 && newhash != NULL && strcasecmp(hash, newhash) == 0) {
+    LOG(LOG_DEBUG, "%s is unchanged", outfull);
+    *unchanged = true;
+    return 0;
   }
-  return (sta);
+
+  if (tabp == theCertTable && (flags & SCM_FLAG_VALID) &&
+      (oldx = cachedCert(vc, outfull)) != NULL) {
+    newx = readCertFromFileUncached(outfull, NULL);
+    inplace = newx != NULL && same_key_and_resources(oldx, newx);
+    X509_free(oldx);
+    if (newx != NULL)
+      X509_free(newx);
+  }
+  if (!inplace)
+    return delete_object(scmp, conp, outfile, outdir, outfull, dir_id);
+
+  // keep the subtree; end_update_object() sorts it out if the add fails
+  if ((sta = deletebylid(conp, theCertTable, lid)) < 0)
+    return sta;
+  LOG(LOG_DEBUG, "replacing %s in place", outfull);
+  vc->replacePending = true;
+  vc->replaceLid = lid;
+  xsnprintf(vc->replaceSki, sizeof(vc->replaceSki), "%s", ski);
+  xsnprintf(vc->replaceSubject, sizeof(vc->replaceSubject), "%s", subject);
+  xsnprintf(vc->replaceAki, sizeof(vc->replaceAki), "%s", aki);
+  xsnprintf(vc->replaceIssuer, sizeof(vc->replaceIssuer), "%s", issuer);
+  return 0;
+}
+
+err_code end_update_object(scm *scmp, scmcon *conp) {
+  struct validation_ctx *vc = getvctx(conp);
+  unsigned int lid;
+  char where[WHERESTR_SIZE];
+  const char *params[2] = {vc->replaceSki, vc->replaceSubject};
+  scmsrch srchvec[] = {
+      {.colno = 1, .sqltype = SQL_C_ULONG, .colname = "local_id",
+       .valptr = &lid, .valsize = sizeof(lid)},
+  };
+  scmsrcha srch = {
+      .vec = srchvec, .ntot = ELTS(srchvec), .nused = ELTS(srchvec),
+      .wherestr = where, .params = params, .nparams = 2,
+  };
+  err_code sta;
+
+  if (!vc->replacePending)
+    return 0;
+  vc->replacePending = false;
+  initTables(scmp);
+  xsnprintf(where, sizeof(where), "ski=? and subject=?");
+  addFlagTest(where, SCM_FLAG_VALID, 1, 1);
+  sta = searchscm(conp, theCertTable, &srch, NULL, &ok,
+                  SCM_SRCH_DOVALUE_ALWAYS | SCM_SRCH_BREAK_VERR, NULL);
+  if (sta != ERR_SCM_NODATA)
+    return sta < 0 ? sta : 0;
+  // the new version did not make it; do what deleting the old one would have
+  LOG(LOG_DEBUG, "in-place replacement of certificate %u failed",
+      vc->replaceLid);
+  return verifyOrNotChildren(conp, vc->replaceSki, vc->replaceSubject,
+                             vc->replaceAki, vc->replaceIssuer,
+                             vc->replaceLid, 0);
 }
 
 err_code revoke_cert_by_serial(scm *scmp, scmcon *conp, char *issuer, char *aki,
@@ -4354,7 +6860,7 @@ err_code revoke_cert_by_serial(scm *scmp, scmcon *conp, char *issuer, char *aki,
 
   unsigned int lid;
   unsigned int flags;
-  scmsrcha srch;
+  scmsrcha srch = {0};
   /** @bug magic constant */
   scmsrch srch1[5];
   mcf mymcf;
@@ -4383,10 +6889,9 @@ err_code revoke_cert_by_serial(scm *scmp, scmcon *conp, char *issuer, char *aki,
     goto done;
   }
   {
-    char escaped[strlen(issuer) * 2 + 1];
-    mysql_escape_string(escaped, issuer, strlen(issuer));
+    // the values are bound as parameters, so the issuer is not escaped
     scmkv w[] = {
-        {"issuer", escaped}, {"sn", sno}, {"aki", aki},
+        {"issuer", issuer}, {"sn", sno}, {"aki", aki},
     };
     scmkva where = {
         .vec = w, .ntot = ELTS(w), .nused = ELTS(w), .vald = 0,
@@ -4427,6 +6932,10 @@ err_code deletebylid(scmcon *conp, scmtab *tabp, unsigned int lid) {
       .vec = where, .ntot = ELTS(where), .nused = ELTS(where), .vald = 0,
   };
   sta = deletescm(conp, tabp, &lids);
+  if (sta == 0 && tabp == theCertTable)
+    cert_index_deleted(conp, lid);
+  else if (sta == 0 && tabp == theCRLTable)
+    forget_crl_serials(conp, lid);
   return (sta);
 }
 
@@ -4511,7 +7020,7 @@ err_code certtooold(scmcon *conp, scmsrcha *s, ssize_t idx) {
 
 err_code certificate_validity(scm *scmp, scmcon *conp) {
   unsigned int lid, flags;
-  scmsrcha srch;
+  scmsrcha srch = {0};
   scmsrch srch1[5];
   mcf mymcf;
   char skistr[512];
@@ -4609,451 +7118,549 @@ void stopSyslog(void) {
 }
 
 /*
- * Free all memory held in global variables
+ * Free a validation context (see getvctx()). Called by disconnectscm().
  */
+static void free_vctx(void *ptr) {
+  struct validation_ctx *vc = ptr;
+  scmsrcha **srchs[] = {
+      &vc->revokedSrch,       &vc->updateManSrch,  &vc->updateManSrch2,
+      &vc->crlSrch,           &vc->manSrch,        &vc->roaSrch,
+      &vc->invalidateCRLSrch, &vc->childrenSrch,   &vc->validManSrch,
+      &vc->certSigvalSrch,    &vc->roaSigvalSrch,  &vc->findCertsSrch,
+      &vc->akiCertsSrch,      &vc->taCertsSrch,
+  };
+  size_t i;
 
-void sqcleanup(void) {
-  if (revokedSrch != NULL) {
-    freesrchscm(revokedSrch);
-    revokedSrch = NULL;
-  }
-  if (updateManSrch != NULL) {
-    freesrchscm(updateManSrch);
-    updateManSrch = NULL;
-  }
-  if (updateManSrch2 != NULL) {
-    freesrchscm(updateManSrch2);
-    updateManSrch2 = NULL;
-  }
-  if (crlSrch != NULL) {
-    freesrchscm(crlSrch);
-    crlSrch = NULL;
-  }
-  if (manSrch != NULL) {
-    freesrchscm(manSrch);
-    manSrch = NULL;
-  }
-  if (roaSrch != NULL) {
-    freesrchscm(roaSrch);
-    roaSrch = NULL;
-  }
-  if (invalidateCRLSrch != NULL) {
-    freesrchscm(invalidateCRLSrch);
-    invalidateCRLSrch = NULL;
-  }
-  if (childrenSrch != NULL) {
-    freesrchscm(childrenSrch);
-    childrenSrch = NULL;
-  }
-  if (validManSrch != NULL) {
-    freesrchscm(validManSrch);
-    validManSrch = NULL;
-  }
-  if (snlist != NULL) {
-    free(snlist);
-    snlist = NULL;
+  if (vc == NULL)
+    return;
+  for (i = 0; i < sizeof(srchs) / sizeof(srchs[0]); i++) {
+    if (*srchs[i] != NULL) {
+      freesrchscm(*srchs[i]);
+      *srchs[i] = NULL;
+    }
   }
+  free(vc->akiAnswers.cert_ansrp);
+  free(vc->taAnswers.cert_ansrp);
+  free(vc->snlist);
+  free(vc->vrsBuf);
+  free(vc->manFiles);
+  if (vc->verifyStore != NULL)
+    X509_STORE_free(vc->verifyStore);
+  clear_cert_index(vc);
+  free(vc->certIndexChanges);
+  clear_cert_cache(vc);
+  HashTable_free(vc->crlSerials, free);
+  work_pool_free(vc->hashPool);
+  free(vc->validatedIds);
+  HashTable_free(vc->dirtyCerts, NULL);
+  if (vc->sigvalCache != NULL) {
+    LOG(LOG_DEBUG, "signature cache: %zu hits, %zu misses, %zu unwritten",
+        vc->sigvalHits, vc->sigvalMisses, vc->sigvalDirty);
+    HashTable_free(vc->sigvalCache, free_sigval_entry);
+  }
+  free(vc->iPropData.data);
+  free(vc->vPropData.data);
+  free(vc);
+}
 
-  if (iPropData.data)
-    free(iPropData.data);
-  if (vPropData.data)
-    free(vPropData.data);
+/*
+ * Forget the tables found by initTables(). Validation state is per
+ * connection and is freed by disconnectscm().
+ */
+void sqcleanup(void) {
+  pthread_mutex_lock(&initTablesLock);
+  theCertTable = NULL;
+  theROATable = NULL;
+  theROAPrefixTable = NULL;
+  theCRLTable = NULL;
+  theManifestTable = NULL;
+  theGBRTable = NULL;
+  theDirTable = NULL;
+  theMetaTable = NULL;
+  theSCMP = NULL;
+  pthread_mutex_unlock(&initTablesLock);
 }
 
 /*
-*
-*/
+ * Resource sets for validation reconsidered (RFC 8360).
+ */
 RS *InitializeRSNode() {
-  //
-  RS *node = (RS *)malloc(sizeof(RS));
-  node->as_set = NULL;
-  node->ipv4_set = NULL;
-  node->ipv6_set = NULL;
-  return node;
+  return (RS *)calloc(1, sizeof(RS));
 }
 
-void get_resources_set_from_file(RS *node, char *path) {
-  FILE *fp;
-  fp = fopen(path, "r");
-  char buf[120];
-  enum Mode mode = Read;
-  while (fgets(buf, sizeof(buf), fp) != NULL) {
-    char *line = buf;
-    trim_string(line);
-    if (strlen(line) == 0) {
-      mode = Read;
-      continue;
-    }
-    if (mode == Read) {
-      if (strcmp(line, "IPv4 Resource Set:") == 0) {
-        mode = IPv4_Read;
-        continue;
-      } else if (strcmp(line, "IPv6 Resource Set:") == 0) {
-        mode = IPv6_Read;
-        continue;
-      } else if (strcmp(line, "AS Resource Set:") == 0) {
-        mode = AS_Read;
-        continue;
-      }
-    }
-    if (mode == IPv4_Read) {
-      char *buffer = strstr(line, "-");
-      if (buffer != NULL) { // IP looks like "024.152.000.000-024.152.127.255"
-        char min[16], max[16];
-        for (size_t i = 0; i < strlen(line) - strlen(buffer); i++) {
-          min[i] = line[i];
-        }
-        min[strlen(line) - strlen(buffer)] = '\0';
-        for (size_t i = 0; i < strlen(buffer) - 1; i++) {
-          max[i] = buffer[i + 1];
-        }
-        max[strlen(buffer) - 1] = '\0';
-        AddIPv4ToRSNode(node, min, max);
-        continue;
-      }
-    }
-    if (mode == IPv6_Read) {
-      char *buffer = strstr(line, "-");
-      if (buffer != NULL) { // IP looks like
-                            // "2800:68:a::-2800:68:d:ffff:ffff:ffff:ffff:ffff"
-        char min[40], max[40];
-        for (size_t i = 0; i < strlen(line) - strlen(buffer); i++) {
-          min[i] = line[i];
-        }
-        min[strlen(line) - strlen(buffer)] = '\0';
-        for (size_t i = 0; i < strlen(buffer) - 1; i++) {
-          max[i] = buffer[i + 1];
-        }
-        max[strlen(buffer) - 1] = '\0';
-        AddIPv6ToRSNode(node, min, max);
-        continue;
-      }
-    }
-    if (mode == AS_Read) {
-      char *buffer = strstr(line, "-");
-      if (buffer != NULL) {
-        char *p;
-        AddASToRSNode(node, strtoull(line, &p, 10), strtoull(++p, NULL, 10));
-        continue;
-      }
-    }
+/*
+ * Make room for one more element in an interval array of count elements
+ * of the given size.  Returns the (possibly moved) array, or NULL with the
+ * old array untouched if there is no memory.
+ */
+static void *rs_reserve(void *set, size_t *allocp, size_t count, size_t size) {
+  size_t alloc;
+
+  if (count < *allocp)
+    return set;
+  alloc = *allocp ? *allocp * 2 : 8;
+  set = realloc(set, alloc * size);
+  if (set != NULL)
+    *allocp = alloc;
+  return set;
+}
+
+static err_code range32_append(_Range32 **setp, size_t *countp, size_t *allocp,
+                               uint32_t min, uint32_t max) {
+  _Range32 *set = rs_reserve(*setp, allocp, *countp, sizeof(*set));
+
+  if (set == NULL)
+    return ERR_SCM_NOMEM;
+  set[*countp].min = min;
+  set[*countp].max = max;
+  (*countp)++;
+  *setp = set;
+  return 0;
+}
+
+static int ipv6_cmp(const _IPv6Addr *a, const _IPv6Addr *b) {
+  if (a->hi != b->hi)
+    return a->hi < b->hi ? -1 : 1;
+  if (a->lo != b->lo)
+    return a->lo < b->lo ? -1 : 1;
+  return 0;
+}
+
+static _IPv6Addr ipv6_from_bytes(const unsigned char bytes[16]) {
+  _IPv6Addr a = {0, 0};
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    a.hi = (a.hi << 8) | bytes[i];
+    a.lo = (a.lo << 8) | bytes[i + 8];
   }
-  fclose(fp);
-  return;
+  return a;
 }
 
-void get_resources_set_from_X509(RS *node, X509 *x) {
-  STACK_OF(IPAddressFamily) *addr =
-      X509_get_ext_d2i(x, NID_sbgp_ipAddrBlock, NULL, NULL);
+/*
+ * Whether an interval starting at next must be merged with one ending at
+ * prev, i.e. next <= prev + 1.
+ */
+static bool range32_joins(uint32_t prev, uint32_t next) {
+  return prev == UINT32_MAX || next <= prev + 1;
+}
 
-  if (addr != NULL) {
-    IPAddressFamily *ipac;
-    while ((ipac = sk_IPAddressFamily_pop(addr)) != NULL) {
-      if (ipac->ipAddressChoice->type == IPAddressChoice_inherit) {
-        switch (v3_addr_get_afi(ipac)) {
-        case IANA_AFI_IPV4:
-          AddIPv4ToRSNode(node, "000.000.000.000\0", "255.255.255.255\0");
-          break;
-        case IANA_AFI_IPV6:
-          AddIPv6ToRSNode(node, "0000:0000:0000:0000:0000:0000:0000:0000\0",
-                          "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff\0");
-          break;
-        default:
-          return;
-        }
-      } else {
-        IPAddressOrRange *ipaor;
-        while ((ipaor = sk_IPAddressOrRange_pop(
-                    ipac->ipAddressChoice->u.addressesOrRanges)) != NULL) {
-          unsigned char min[16], max[16];
-          switch (v3_addr_get_afi(ipac)) {
-          case IANA_AFI_IPV4:
-            memset(min, 0, sizeof(unsigned char) * 16);
-            memset(max, 0, sizeof(unsigned char) * 16);
-            v3_addr_get_range(ipaor, IANA_AFI_IPV4, min, max, 4);
-            char buf[20];
-            int flag = 0;
-            int count = 0;
-            for (size_t i = 0; i < 4; i++) {
-              flag += sprintf(buf + flag, "%03d.", min[i]);
-              count++;
-            }
-            for (size_t i = count; i < 4; i++) {
-              flag += sprintf(buf + flag, "%03d.", 0);
-            }
-            buf[15] = '\0';
-            char min_ipv4[16];
-            strcpy(min_ipv4, buf);
-            flag = 0;
-            for (int j = 0; j < 4; j++) {
-              flag += sprintf(buf + flag, "%03d.", max[j]);
-            }
-            buf[15] = '\0';
-            char max_ipv4[16];
-            strcpy(max_ipv4, buf);
-            AddIPv4ToRSNode(node, min_ipv4, max_ipv4);
-            break;
-          case IANA_AFI_IPV6:
-            memset(min, 0, sizeof(unsigned char) * 16);
-            memset(max, 0, sizeof(unsigned char) * 16);
-            v3_addr_get_range(ipaor, IANA_AFI_IPV6, min, max, 16);
-            char buf_v6[40];
-            int flag_v6 = 0;
-            int count_v6 = 0;
-            for (size_t i = 0; i < 8; i += 2) {
-              flag_v6 +=
-                  sprintf(buf_v6 + flag_v6, "%02x%02x:", min[i], min[i + 1]);
-              count_v6++;
-            }
-            for (size_t i = count_v6; i < 8; i++) {
-              flag_v6 += sprintf(buf_v6 + flag_v6, "%02x%02x:", 0, 0);
-            }
-            buf_v6[39] = '\0';
-            char min_ipv6[40];
-            strcpy(min_ipv6, buf_v6);
-            flag_v6 = 0;
-            for (int j = 0; j < 16; j += 2) {
-              flag_v6 +=
-                  sprintf(buf_v6 + flag_v6, "%02x%02x:", max[j], max[j + 1]);
-            }
-            buf_v6[39] = '\0';
-            char max_ipv6[40];
-            strcpy(max_ipv6, buf_v6);
-            AddIPv6ToRSNode(node, min_ipv6, max_ipv6);
-            break;
-          default:
-            return;
-          }
-        }
-      }
+static bool ipv6_joins(const _IPv6Addr *prev, const _IPv6Addr *next) {
+  _IPv6Addr succ = *prev;
+
+  if (++succ.lo == 0 && ++succ.hi == 0)
+    return true;
+  return ipv6_cmp(next, &succ) <= 0;
+}
+
+static err_code ipv6_append(RS *node, const _IPv6Addr *min,
+                            const _IPv6Addr *max) {
+  _IPv6 *set = rs_reserve(node->ipv6_set, &node->ipv6_alloc, node->ipv6_count,
+                          sizeof(*set));
+
+  if (set == NULL)
+    return ERR_SCM_NOMEM;
+  set[node->ipv6_count].min = *min;
+  set[node->ipv6_count].max = *max;
+  node->ipv6_count++;
+  node->ipv6_set = set;
+  return 0;
+}
+
+err_code AddIPv4ToRSNode(RS *node, uint32_t min, uint32_t max) {
+  return range32_append(&node->ipv4_set, &node->ipv4_count, &node->ipv4_alloc,
+                        min, max);
+}
+
+err_code AddIPv6ToRSNode(RS *node, const unsigned char min[16],
+                         const unsigned char max[16]) {
+  _IPv6Addr lo = ipv6_from_bytes(min);
+  _IPv6Addr hi = ipv6_from_bytes(max);
+
+  return ipv6_append(node, &lo, &hi);
+}
+
+err_code AddASToRSNode(RS *node, uint32_t min, uint32_t max) {
+  return range32_append(&node->as_set, &node->as_count, &node->as_alloc, min,
+                        max);
+}
+
+static int range32_cmp(const void *a, const void *b) {
+  const _Range32 *x = a;
+  const _Range32 *y = b;
+
+  if (x->min != y->min)
+    return x->min < y->min ? -1 : 1;
+  if (x->max != y->max)
+    return x->max < y->max ? -1 : 1;
+  return 0;
+}
+
+static int ipv6_range_cmp(const void *a, const void *b) {
+  const _IPv6 *x = a;
+  const _IPv6 *y = b;
+  int c = ipv6_cmp(&x->min, &y->min);
+
+  return c ? c : ipv6_cmp(&x->max, &y->max);
+}
+
+/*
+ * Sort and merge an interval array in place, returning its new length.
+ * An array that is already normalized is left alone after one pass.
+ */
+static size_t range32_normalize(_Range32 *set, size_t count) {
+  size_t i, n;
+
+  for (i = 1; i < count; i++)
+    if (range32_joins(set[i - 1].max, set[i].min))
+      break;
+  if (i >= count)
+    return count;
+  qsort(set, count, sizeof(*set), range32_cmp);
+  for (n = 0, i = 1; i < count; i++) {
+    if (range32_joins(set[n].max, set[i].min)) {
+      if (set[i].max > set[n].max)
+        set[n].max = set[i].max;
+    } else {
+      set[++n] = set[i];
     }
   }
+  return n + 1;
+}
 
-  struct ASIdentifiers_st *asid =
-      X509_get_ext_d2i(x, NID_sbgp_autonomousSysNum, NULL, NULL);
-  if (asid == NULL) {
-    return;
-  }
-  if (asid->asnum->type == ASIdentifierChoice_inherit) {
-    AddASToRSNode(node, 1, 4294967295);
-  } else {
-    ASIdOrRange *tmp;
-    int min = 0, max = 0;
-    while ((tmp = sk_ASIdOrRange_pop(asid->asnum->u.asIdsOrRanges)) != NULL) {
-      if (tmp->type == ASIdOrRange_id) {
-        min = max = ASN1_INTEGER_get(tmp->u.id);
-      } else {
-        min = ASN1_INTEGER_get(tmp->u.range->min);
-        max = ASN1_INTEGER_get(tmp->u.range->max);
-      }
-      AddASToRSNode(node, min, max);
+static size_t ipv6_normalize(_IPv6 *set, size_t count) {
+  size_t i, n;
+
+  for (i = 1; i < count; i++)
+    if (ipv6_joins(&set[i - 1].max, &set[i].min))
+      break;
+  if (i >= count)
+    return count;
+  qsort(set, count, sizeof(*set), ipv6_range_cmp);
+  for (n = 0, i = 1; i < count; i++) {
+    if (ipv6_joins(&set[n].max, &set[i].min)) {
+      if (ipv6_cmp(&set[i].max, &set[n].max) > 0)
+        set[n].max = set[i].max;
+    } else {
+      set[++n] = set[i];
     }
   }
+  return n + 1;
 }
 
-void save_node_as_file(RS *node, char *path) {
-  FILE *fp;
-  fp = fopen(path, "w+");
-  fputs("IPv4 Resource Set:\n", fp);
-  char buf[120];
-  for (_IPv4 *i = node->ipv4_set; i != NULL; i = i->next) {
-    sprintf(buf, "\t%s-%s\n", i->min, i->max);
-    fputs(buf, fp);
-  }
-  fputs("\n", fp);
-  fputs("IPv6 Resource Set:\n", fp);
-  for (_IPv6 *i = node->ipv6_set; i != NULL; i = i->next) {
-    sprintf(buf, "\t%s-%s\n", i->min, i->max);
-    fputs(buf, fp);
-  }
-  fputs("\n", fp);
-  fputs("AS Resource Set:", fp);
-  for (_AS *i = node->as_set; i != NULL; i = i->next) {
-    sprintf(buf, "\n\t%llu-%llu", i->min, i->max);
-    fputs(buf, fp);
+void rs_normalize(RS *node) {
+  node->ipv4_count = range32_normalize(node->ipv4_set, node->ipv4_count);
+  node->ipv6_count = ipv6_normalize(node->ipv6_set, node->ipv6_count);
+  node->as_count = range32_normalize(node->as_set, node->as_count);
+}
+
+/*
+ * Append the intersection of two normalized interval arrays to *setp.
+ */
+static err_code range32_intersect(const _Range32 *a, size_t na,
+                                  const _Range32 *b, size_t nb,
+                                  _Range32 **setp, size_t *countp,
+                                  size_t *allocp) {
+  size_t i = 0, j = 0;
+  err_code sta;
+
+  while (i < na && j < nb) {
+    uint32_t min = a[i].min > b[j].min ? a[i].min : b[j].min;
+    uint32_t max = a[i].max < b[j].max ? a[i].max : b[j].max;
+
+    if (min <= max &&
+        (sta = range32_append(setp, countp, allocp, min, max)) != 0)
+      return sta;
+    if (a[i].max < b[j].max)
+      i++;
+    else
+      j++;
   }
-  fclose(fp);
-  return;
+  return 0;
 }
 
-void trim_string(char *str) {
-  char *start, *end;
-  int len = strlen(str);
-  if (str[len - 1] == '\n') {
-    len--;
-    str[len] = 0;
+static err_code ipv6_intersect(const _IPv6 *a, size_t na, const _IPv6 *b,
+                               size_t nb, RS *result) {
+  size_t i = 0, j = 0;
+  err_code sta;
+
+  while (i < na && j < nb) {
+    const _IPv6Addr *min =
+        ipv6_cmp(&a[i].min, &b[j].min) > 0 ? &a[i].min : &b[j].min;
+    const _IPv6Addr *max =
+        ipv6_cmp(&a[i].max, &b[j].max) < 0 ? &a[i].max : &b[j].max;
+
+    if (ipv6_cmp(min, max) <= 0 && (sta = ipv6_append(result, min, max)) != 0)
+      return sta;
+    if (ipv6_cmp(&a[i].max, &b[j].max) < 0)
+      i++;
+    else
+      j++;
   }
-  start = str;
-  end = str + len - 1;
-  while (*start && isspace(*start)) {
-    start++;
+  return 0;
+}
+
+/*
+ * Whether every interval of the normalized array b lies within one of the
+ * normalized array a.
+ */
+static bool range32_contains(const _Range32 *a, size_t na, const _Range32 *b,
+                             size_t nb) {
+  size_t i = 0, j;
+
+  for (j = 0; j < nb; j++) {
+    while (i < na && a[i].max < b[j].min)
+      i++;
+    if (i == na || a[i].min > b[j].min || a[i].max < b[j].max)
+      return false;
   }
-  while (*end && isspace(*end)) {
-    *end-- = 0;
+  return true;
+}
+
+static bool ipv6_contains(const _IPv6 *a, size_t na, const _IPv6 *b,
+                          size_t nb) {
+  size_t i = 0, j;
+
+  for (j = 0; j < nb; j++) {
+    while (i < na && ipv6_cmp(&a[i].max, &b[j].min) < 0)
+      i++;
+    if (i == na || ipv6_cmp(&a[i].min, &b[j].min) > 0 ||
+        ipv6_cmp(&a[i].max, &b[j].max) < 0)
+      return false;
   }
-  strcpy(str, start);
+  return true;
 }
 
-void AddIPv4ToRSNode(RS *node, char min[16], char max[16]) {
-  _IPv4 *tmp = node->ipv4_set;
-  _IPv4 *p = (_IPv4 *)malloc(sizeof(_IPv4));
-  strcpy(p->min, min);
-  strcpy(p->max, max);
-  p->next = tmp;
-  node->ipv4_set = p;
-  return;
+/*
+ * A verified resource set is stored in rpki_cert.vrs as a struct
+ * vrs_header followed by the IPv6, IPv4 and AS intervals exactly as they
+ * lie in an RS, in host byte order, so that reading one back is a few
+ * memcpy()s.  A blob without the right magic, e.g. one written on a host
+ * of the other byte order, is ignored and the parent's resources are
+ * taken from its certificate instead.
+ */
+#define VRS_MAGIC 0x56525331 /* "VRS1" */
+#define VRS_BLOB_MAX (16 * 1024 * 1024)
+
+struct vrs_header {
+  uint32_t magic;
+  uint32_t ipv4_count;
+  uint32_t ipv6_count;
+  uint32_t as_count;
+};
+
+/*
+ * Serialize a resource set, returning a malloc'd blob of *lenp bytes or
+ * NULL if there is no memory.
+ */
+static uint8_t *rs_to_blob(RS *node, size_t *lenp) {
+  struct vrs_header hdr;
+  uint8_t *blob;
+  uint8_t *p;
+
+  rs_normalize(node);
+  hdr.magic = VRS_MAGIC;
+  hdr.ipv4_count = node->ipv4_count;
+  hdr.ipv6_count = node->ipv6_count;
+  hdr.as_count = node->as_count;
+  *lenp = sizeof(hdr) + node->ipv6_count * sizeof(_IPv6) +
+          node->ipv4_count * sizeof(_IPv4) + node->as_count * sizeof(_AS);
+  if ((blob = malloc(*lenp)) == NULL)
+    return NULL;
+  p = blob;
+  memcpy(p, &hdr, sizeof(hdr));
+  p += sizeof(hdr);
+  if (node->ipv6_count > 0)
+    memcpy(p, node->ipv6_set, node->ipv6_count * sizeof(_IPv6));
+  p += node->ipv6_count * sizeof(_IPv6);
+  if (node->ipv4_count > 0)
+    memcpy(p, node->ipv4_set, node->ipv4_count * sizeof(_IPv4));
+  p += node->ipv4_count * sizeof(_IPv4);
+  if (node->as_count > 0)
+    memcpy(p, node->as_set, node->as_count * sizeof(_AS));
+  return blob;
 }
 
-void AddIPv6ToRSNode(RS *node, char min[40], char max[40]) {
-  _IPv6 *p = (_IPv6 *)malloc(sizeof(_IPv6));
-  strcpy(p->min, min);
-  strcpy(p->max, max);
-  p->next = node->ipv6_set;
-  node->ipv6_set = p;
-  return;
+/*
+ * Append the count elements of the given size at src to an interval array.
+ */
+static err_code rs_extend(void **setp, size_t *countp, size_t *allocp,
+                          const uint8_t *src, size_t count, size_t size) {
+  void *set;
+
+  if (count == 0)
+    return 0;
+  if (*countp + count > *allocp) {
+    if ((set = realloc(*setp, (*countp + count) * size)) == NULL)
+      return ERR_SCM_NOMEM;
+    *setp = set;
+    *allocp = *countp + count;
+  }
+  memcpy((uint8_t *)*setp + *countp * size, src, count * size);
+  *countp += count;
+  return 0;
 }
 
-void AddASToRSNode(RS *node, unsigned long long min, unsigned long long max) {
-  _AS *p = (_AS *)malloc(sizeof(_AS));
-  p->min = min;
-  p->max = max;
-  p->next = node->as_set;
-  node->as_set = p;
-  return;
+/*
+ * Add the resource set stored in a blob written by rs_to_blob().
+ */
+static err_code rs_from_blob(RS *node, const uint8_t *blob, size_t len) {
+  struct vrs_header hdr;
+  void *set;
+  err_code sta;
+
+  if (len < sizeof(hdr))
+    return ERR_SCM_INVALARG;
+  memcpy(&hdr, blob, sizeof(hdr));
+  if (hdr.magic != VRS_MAGIC ||
+      len != sizeof(hdr) + (size_t)hdr.ipv6_count * sizeof(_IPv6) +
+                 (size_t)hdr.ipv4_count * sizeof(_IPv4) +
+                 (size_t)hdr.as_count * sizeof(_AS))
+    return ERR_SCM_INVALARG;
+  blob += sizeof(hdr);
+  set = node->ipv6_set;
+  sta = rs_extend(&set, &node->ipv6_count, &node->ipv6_alloc, blob,
+                  hdr.ipv6_count, sizeof(_IPv6));
+  node->ipv6_set = set;
+  if (sta)
+    return sta;
+  blob += hdr.ipv6_count * sizeof(_IPv6);
+  set = node->ipv4_set;
+  sta = rs_extend(&set, &node->ipv4_count, &node->ipv4_alloc, blob,
+                  hdr.ipv4_count, sizeof(_IPv4));
+  node->ipv4_set = set;
+  if (sta)
+    return sta;
+  blob += hdr.ipv4_count * sizeof(_IPv4);
+  set = node->as_set;
+  sta = rs_extend(&set, &node->as_count, &node->as_alloc, blob, hdr.as_count,
+                  sizeof(_AS));
+  node->as_set = set;
+  if (sta)
+    return sta;
+  rs_normalize(node);
+  return 0;
 }
 
-err_code get_result_rs(RS *up_rs, RS *self_rs, RS *result_rs) {
-  err_code sta = 0;
-  for (_IPv4 *i = self_rs->ipv4_set; i != NULL; i = i->next) {
-    for (_IPv4 *j = up_rs->ipv4_set; j != NULL; j = j->next) {
+void get_resources_set_from_X509(RS *node, X509 *x) {
+  STACK_OF(IPAddressFamily) *addr =
+      X509_get_ext_d2i(x, NID_sbgp_ipAddrBlock, NULL, NULL);
 
-      if (strcmp(j->min, i->max) > 0 || strcmp(i->min, j->max) > 0) {
-        /* nothing to do,go next of index j */
-        continue;
-      }
-      _IPv4 *tmp = (_IPv4 *)malloc(sizeof(_IPv4));
-      if (strcmp(i->max, j->max) > 0) {
-        strcpy(tmp->max, j->max);
-      } else {
-        strcpy(tmp->max, i->max);
-      }
-      if (strcmp(i->min, j->min) >= 0) {
-        strcpy(tmp->min, i->min);
-      } else {
-        strcpy(tmp->min, j->min);
-      }
-      tmp->next = result_rs->ipv4_set;
-      result_rs->ipv4_set = tmp;
-    }
-  }
-  for (_IPv6 *i = self_rs->ipv6_set; i != NULL; i = i->next) {
-    for (_IPv6 *j = up_rs->ipv6_set; j != NULL; j = j->next) {
-      if (strcmp(j->min, i->max) > 0 || strcmp(i->min, j->max) > 0) {
-        /* nothing to do,go next of index j */
+  if (addr != NULL) {
+    for (int f = 0; f < sk_IPAddressFamily_num(addr); f++) {
+      IPAddressFamily *ipac = sk_IPAddressFamily_value(addr, f);
+      unsigned int afi = v3_addr_get_afi(ipac);
+      unsigned char min[16], max[16];
+      if (afi != IANA_AFI_IPV4 && afi != IANA_AFI_IPV6) {
         continue;
       }
-      _IPv6 *tmp = (_IPv6 *)malloc(sizeof(_IPv6));
-      if (strcmp(i->max, j->max) > 0) {
-        strcpy(tmp->max, j->max);
-      } else {
-        strcpy(tmp->max, i->max);
-      }
-      if (strcmp(i->min, j->min) >= 0) {
-        strcpy(tmp->min, i->min);
-      } else {
-        strcpy(tmp->min, j->min);
-      }
-      tmp->next = result_rs->ipv6_set;
-      result_rs->ipv6_set = tmp;
-    }
-  }
-  for (_AS *i = self_rs->as_set; i != NULL; i = i->next) {
-    for (_AS *j = up_rs->as_set; j != NULL; j = j->next) {
-      if (j->min > i->max || i->min > j->max) {
-        /* nothing to do,go next of index j */
+      if (ipac->ipAddressChoice->type == IPAddressChoice_inherit) {
+        memset(min, 0, sizeof(min));
+        memset(max, 0xff, sizeof(max));
+        if (afi == IANA_AFI_IPV4) {
+          AddIPv4ToRSNode(node, 0, UINT32_MAX);
+        } else {
+          AddIPv6ToRSNode(node, min, max);
+        }
         continue;
       }
-      _AS *tmp = (_AS *)malloc(sizeof(_AS));
-      if (i->max > j->max) {
-        tmp->max = j->max;
-      } else {
-        tmp->max = i->max;
-      }
-      if (i->min > j->min) {
-        tmp->min = i->min;
-      } else {
-        tmp->min = j->min;
+      STACK_OF(IPAddressOrRange) *aors =
+          ipac->ipAddressChoice->u.addressesOrRanges;
+      for (int r = 0; r < sk_IPAddressOrRange_num(aors); r++) {
+        IPAddressOrRange *ipaor = sk_IPAddressOrRange_value(aors, r);
+        memset(min, 0, sizeof(min));
+        memset(max, 0, sizeof(max));
+        if (afi == IANA_AFI_IPV4) {
+          v3_addr_get_range(ipaor, IANA_AFI_IPV4, min, max, 4);
+          AddIPv4ToRSNode(node,
+                          ((uint32_t)min[0] << 24) | ((uint32_t)min[1] << 16) |
+                              ((uint32_t)min[2] << 8) | min[3],
+                          ((uint32_t)max[0] << 24) | ((uint32_t)max[1] << 16) |
+                              ((uint32_t)max[2] << 8) | max[3]);
+        } else {
+          v3_addr_get_range(ipaor, IANA_AFI_IPV6, min, max, 16);
+          AddIPv6ToRSNode(node, min, max);
+        }
       }
-      tmp->next = result_rs->as_set;
-      result_rs->as_set = tmp;
     }
+    sk_IPAddressFamily_pop_free(addr, IPAddressFamily_free);
   }
-  if (result_rs->as_set == NULL && result_rs->ipv4_set == NULL &&
-      result_rs->ipv6_set == NULL) {
-    sta = ERR_SCM_NOTVALID;
-  }
-  return sta;
-}
 
-_Bool rs_changed(RS *result, RS *node) {
-  for (_IPv4 *i = result->ipv4_set; i != NULL; i = i->next) {
-    for (_IPv4 *j = node->ipv4_set; j != NULL; j = j->next) {
-      if (strcmp(i->min, j->min) == 0 && strcmp(i->max, j->max) == 0)
-        break;
-      if (j->next == NULL)
-        return true;
-    }
-  }
-  for (_IPv6 *i = result->ipv6_set; i != NULL; i = i->next) {
-    for (_IPv6 *j = node->ipv6_set; j != NULL; j = j->next) {
-      if (strcmp(i->min, j->min) == 0 && strcmp(i->max, j->max) == 0)
-        break;
-      if (j->next == NULL)
-        return true;
+  struct ASIdentifiers_st *asid =
+      X509_get_ext_d2i(x, NID_sbgp_autonomousSysNum, NULL, NULL);
+  if (asid != NULL && asid->asnum != NULL) {
+    if (asid->asnum->type == ASIdentifierChoice_inherit) {
+      AddASToRSNode(node, 1, UINT32_MAX);
+    } else {
+      for (int r = 0; r < sk_ASIdOrRange_num(asid->asnum->u.asIdsOrRanges);
+           r++) {
+        ASIdOrRange *tmp = sk_ASIdOrRange_value(asid->asnum->u.asIdsOrRanges, r);
+        unsigned long min, max;
+        if (tmp->type == ASIdOrRange_id) {
+          min = max = ASN1_INTEGER_get(tmp->u.id);
+        } else {
+          min = ASN1_INTEGER_get(tmp->u.range->min);
+          max = ASN1_INTEGER_get(tmp->u.range->max);
+        }
+        AddASToRSNode(node, (uint32_t)min, (uint32_t)max);
+      }
     }
   }
-  for (_AS *i = result->as_set; i != NULL; i = i->next) {
-    for (_AS *j = node->as_set; j != NULL; j = j->next) {
-      if (i->min == j->min && i->max == j->max)
-        break;
-      if (j->next == NULL)
-        return true;
-    }
+  if (asid != NULL) {
+    ASIdentifiers_free(asid);
   }
-  return false;
+  rs_normalize(node);
 }
 
-void free_ipv4_set(_IPv4 *v4set) {
-  if (v4set->next != NULL) {
-    free_ipv4_set(v4set->next);
+/*
+ * Add to result_rs the resources that self_rs shares with up_rs.  Both
+ * inputs are normalized first, so each family is one linear merge.
+ */
+err_code get_result_rs(RS *up_rs, RS *self_rs, RS *result_rs) {
+  err_code sta;
+  rs_normalize(up_rs);
+  rs_normalize(self_rs);
+  if ((sta = range32_intersect(up_rs->ipv4_set, up_rs->ipv4_count,
+                               self_rs->ipv4_set, self_rs->ipv4_count,
+                               &result_rs->ipv4_set, &result_rs->ipv4_count,
+                               &result_rs->ipv4_alloc)) ||
+      (sta = ipv6_intersect(up_rs->ipv6_set, up_rs->ipv6_count,
+                            self_rs->ipv6_set, self_rs->ipv6_count,
+                            result_rs)) ||
+      (sta = range32_intersect(up_rs->as_set, up_rs->as_count, self_rs->as_set,
+                               self_rs->as_count, &result_rs->as_set,
+                               &result_rs->as_count, &result_rs->as_alloc))) {
+    return sta;
   }
-  free(v4set);
-}
-
-void free_ipv6_set(_IPv6 *v6set) {
-  if (v6set->next != NULL) {
-    free_ipv6_set(v6set->next);
+  rs_normalize(result_rs);
+  if (result_rs->as_count == 0 && result_rs->ipv4_count == 0 &&
+      result_rs->ipv6_count == 0) {
+    sta = ERR_SCM_NOTVALID;
   }
-  free(v6set);
+  return sta;
 }
 
-void free_as_set(_AS *asset) {
-  if (asset->next != NULL) {
-    free_as_set(asset->next);
-  }
-  free(asset);
+/*
+ * Whether result, which is a subset of node, lost any of node's resources.
+ */
+_Bool rs_changed(RS *result, RS *node) {
+  rs_normalize(result);
+  rs_normalize(node);
+  return !range32_contains(result->ipv4_set, result->ipv4_count,
+                           node->ipv4_set, node->ipv4_count) ||
+         !ipv6_contains(result->ipv6_set, result->ipv6_count, node->ipv6_set,
+                        node->ipv6_count) ||
+         !range32_contains(result->as_set, result->as_count, node->as_set,
+                           node->as_count);
 }
 
 void freeRSNode(RS *node) {
-  if (node->ipv4_set != NULL) {
-    free_ipv4_set(node->ipv4_set);
-  }
-  if (node->ipv6_set != NULL) {
-    free_ipv6_set(node->ipv6_set);
-  }
-  if (node->as_set != NULL) {
-    free_as_set(node->as_set);
+  if (node == NULL) {
+    return;
   }
+  free(node->ipv4_set);
+  free(node->ipv6_set);
+  free(node->as_set);
   free(node);
 }
 
@@ -5075,18 +7682,23 @@ err_code validation_reconsidered(scmcon *conp, char *aki, char *issuer, X509 *x,
 
   char stmt[1024];
   memset(stmt, 0, sizeof(stmt));
-  char parent_vrs[4096];
+  struct validation_ctx *vc = getvctx(conp);
+  SQLLEN parent_vrs_len = 0;
   char parent_filename[256];
   char parent_dir[4096];
   char pathname[PATH_MAX];
   SQLRETURN rc;
 
+  if (vc->vrsBuf == NULL && (vc->vrsBuf = malloc(VRS_BLOB_MAX)) == NULL) {
+    sta = ERR_SCM_NOMEM;
+    goto done;
+  }
   RS *parentNode = InitializeRSNode();
   RS *childNode = InitializeRSNode();
   get_resources_set_from_X509(childNode, x);
 
   // build the SELECT query
-  sprintf(stmt, "SELECT filename,dirname,vrs_file FROM rpki_cert LEFT JOIN "
+  sprintf(stmt, "SELECT filename,dirname,vrs FROM rpki_cert LEFT JOIN "
                 "rpki_dir on rpki_cert.dir_id = rpki_dir.dir_id WHERE "
                 "rpki_cert.dir_id=rpki_dir.dir_id AND (flags & 0x%x)!=0 "
                 "AND subject='%s';",
@@ -5108,7 +7720,8 @@ err_code validation_reconsidered(scmcon *conp, char *aki, char *issuer, X509 *x,
   {
     SQLBindCol(conp->hstmtp->hstmt, 1, SQL_C_CHAR, parent_filename, 256, NULL);
     SQLBindCol(conp->hstmtp->hstmt, 2, SQL_C_CHAR, parent_dir, 4096, NULL);
-    SQLBindCol(conp->hstmtp->hstmt, 3, SQL_C_CHAR, parent_vrs, 4096, NULL);
+    SQLBindCol(conp->hstmtp->hstmt, 3, SQL_C_BINARY, vc->vrsBuf, VRS_BLOB_MAX,
+               &parent_vrs_len);
   }
 
   while (1) {
@@ -5122,14 +7735,15 @@ err_code validation_reconsidered(scmcon *conp, char *aki, char *issuer, X509 *x,
       sta = ERR_SCM_SQL;
       break;
     }
-    // get the resource set from the VRS file;
-    get_resources_set_from_file(parentNode, parent_vrs);
+    // get the parent's verified resource set, if it has one
+    if (parent_vrs_len > 0 && parent_vrs_len <= VRS_BLOB_MAX)
+      rs_from_blob(parentNode, vc->vrsBuf, parent_vrs_len);
     // get the compare result
     if ((sta = get_result_rs(parentNode, childNode, result))) {
       if (verify_result == ERR_SCM_NOERR) {
         // something error, get VRS from certificate and retry
         xsnprintf(pathname, PATH_MAX, "%s/%s", parent_dir, parent_filename);
-        X509 *px = readCertFromFile(pathname, &sta);
+        X509 *px = readCertFromFile(getvctx(conp), pathname, &sta);
         if (px == NULL) {
           sta = ERR_SCM_X509;
           break;
@@ -5153,12 +7767,9 @@ err_code validation_reconsidered(scmcon *conp, char *aki, char *issuer, X509 *x,
   SQLCloseCursor(conp->hstmtp->hstmt);
   pophstmt(conp);
   if (sta) {
-    result->as_set = childNode->as_set;
-    result->ipv4_set = childNode->ipv4_set;
-    result->ipv6_set = childNode->ipv6_set;
-    childNode->as_set = NULL;
-    childNode->ipv4_set = NULL;
-    childNode->ipv6_set = NULL;
+    RS tmp = *result;
+    *result = *childNode;
+    *childNode = tmp;
   }
 
   freeRSNode(childNode);
@@ -5170,25 +7781,38 @@ done:
   return sta;
 }
 
+/*
+ * Store the verified resource set of a certificate.  MySQL leaves a row
+ * alone when a column is set to the value it already has, so an unchanged
+ * set is not rewritten.
+ */
 err_code add_cert_validation_reconsidered(scmcon *conp, char *ski,
                                           char *subject, unsigned int cert_id,
-                                          char *resource_file_path) {
-  err_code sta = 0;
-  char stmt[1024];
-  sprintf(stmt, "UPDATE rpki_cert SET vrs_file='%s' WHERE ski='%s' AND "
-                "subject='%s' AND local_id=%d;",
-          resource_file_path, ski, subject, cert_id);
+                                          RS *result) {
+  err_code sta;
+  uint8_t *blob;
+  size_t blob_len;
+  char *hexs;
+  char *stmt;
+  size_t leen;
 
-  SQLRETURN rc = newhstmt(conp);
-  if (!SQLOK(rc)) {
-    sta = ERR_SCM_SQL;
-  }
-  sta = statementscm(conp, stmt);
-  if (sta < 0) {
-    sta = ERR_SCM_SQL;
-  }
-  SQLCloseCursor(conp->hstmtp->hstmt);
-  pophstmt(conp);
+  if ((blob = rs_to_blob(result, &blob_len)) == NULL)
+    return ERR_SCM_NOMEM;
+  hexs = hexify(blob_len, blob, HEXIFY_X);
+  free(blob);
+  if (hexs == NULL)
+    return ERR_SCM_NOMEM;
+  leen = strlen(hexs) + strlen(ski) + strlen(subject) + 128;
+  if ((stmt = malloc(leen)) == NULL) {
+    free(hexs);
+    return ERR_SCM_NOMEM;
+  }
+  xsnprintf(stmt, leen, "UPDATE rpki_cert SET vrs=%s WHERE ski='%s' AND "
+                        "subject='%s' AND local_id=%u;",
+            hexs, ski, subject, cert_id);
+  sta = statementscm_no_data(conp, stmt);
+  free(stmt);
+  free(hexs);
   return sta;
 }
 
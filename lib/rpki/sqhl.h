@@ -7,10 +7,13 @@
 #include "scm.h"
 #include "scmf.h"
 #include <openssl/x509v3.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "rpki-object/certificate.h"
 #include "configlib/configlib.h"
+#include "util/file.h"
 
 /**
  * @brief
@@ -105,6 +108,103 @@ struct goodoid {
 err_code findorcreatedir(scm *scmp, scmcon *conp, const char *dirname,
                          unsigned int *idp);
 
+/*
+ * Load every row of the directory table into the connection's directory
+ * cache so that findorcreatedir() does not have to query the database for
+ * directories that already exist. This is an optimization only; the cache is
+ * also filled on demand.
+ */
+err_code fill_dir_cache(scm *scmp, scmcon *conp);
+
+/*
+ * Load the valid CA certificates into an in-memory index and use it,
+ * instead of one query per level, to find certification paths. The index
+ * follows the connection's own changes to the table. Inside a transaction,
+ * call cert_index_savepoint() with each savepoint, and cert_index_commit()
+ * or cert_index_rollback() when it is committed or rolled back, so that
+ * only the changes rolled back are undone. refresh_cert_index() picks up
+ * changes made by other processes with one light query. reset_cert_index()
+ * drops the index, e.g. after the tables were replaced; it is reloaded the
+ * next time it is needed.
+ */
+err_code load_cert_index(scm *scmp, scmcon *conp);
+err_code refresh_cert_index(scm *scmp, scmcon *conp);
+void reset_cert_index(scmcon *conp);
+void cert_index_savepoint(scmcon *conp);
+void cert_index_rollback(scmcon *conp, bool to_savepoint);
+void cert_index_commit(scmcon *conp);
+
+/*
+ * Support for several loader processes sharing one database. When enabled,
+ * remember the local_id of every CA certificate that this connection marks
+ * valid. take_validated_certs() returns the ids remembered so far (the
+ * caller must free the array) and forgets them; once its transaction has
+ * been committed, a process passes each one to the process that loads the
+ * certificate's publication point, found from the SIA that get_cert_sia()
+ * returns (empty if the certificate has none).
+ */
+void track_validated_certs(scmcon *conp, bool enable);
+size_t take_validated_certs(scmcon *conp, unsigned int **ids);
+err_code get_cert_sia(scm *scmp, scmcon *conp, unsigned int local_id,
+                      char *sia, size_t siasize);
+
+/*
+ * Catch up with a certificate that another process added or validated: add
+ * it to the certificate index and, if it is valid, validate its children
+ * that were loaded before it was. A certificate that no longer exists is
+ * ignored.
+ */
+err_code revalidate_children(scm *scmp, scmcon *conp, unsigned int local_id);
+
+/*
+ * Bulk loading. While deferred, add_object() stores certificates other than
+ * trust anchors without looking for their paths, so they and everything
+ * below them are stored as unvalidated, and nothing is validated from the
+ * top down. Afterwards, list_valid_certs() returns the local_ids of the
+ * valid certificates, trust anchors first (the caller must free the
+ * array); passing each to revalidate_children() validates the rest of the
+ * tree in a single pass.
+ */
+void defer_validation(scmcon *conp, bool defer);
+err_code list_valid_certs(scm *scmp, scmcon *conp, unsigned int **idsp,
+                          size_t *nidsp);
+
+/*
+ * Coalescing revalidation. When enabled, a certificate that becomes valid
+ * is only remembered, instead of its subtree being validated right away.
+ * take_dirty_certs() returns the remembered local_ids, each one once (the
+ * caller must free the array), and forgets them; pass each to
+ * revalidate_children(). Since that only descends into children that are
+ * not valid yet, a subtree below several remembered certificates is
+ * validated only once. Invalidation is never put off.
+ */
+void coalesce_revalidation(scmcon *conp, bool enable);
+size_t dirty_cert_count(scmcon *conp);
+size_t take_dirty_certs(scmcon *conp, unsigned int **ids);
+
+/*
+ * Number of threads that read and hash the files listed on a manifest when
+ * it becomes valid, in addition to the thread using the connection. A new
+ * connection hashes inline, i.e. that thread hashes them one at a time,
+ * until this is called. rcli sets it from RPKIManifestHashThreads, which
+ * defaults to 4.
+ */
+void set_manifest_hash_threads(scmcon *conp, size_t nthreads);
+
+/*
+ * Write the signature verdicts computed since the last flush to the sigval
+ * column of the certificate table. Verdicts are cached in memory as they
+ * are computed and written back in batches; call this before committing a
+ * transaction that should include them.
+ */
+err_code sigval_cache_flush(scmcon *conp);
+
+/*
+ * Get the number of signature checks answered from, or missed by, the
+ * in-memory signature cache.
+ */
+void sigval_cache_stats(scmcon *conp, size_t *hits, size_t *misses);
+
 /*
  * Add the indicated object to the DB. If "trusted" is set then verify that
  * the object is self-signed. Note that this add operation may result in the
@@ -112,11 +212,34 @@ err_code findorcreatedir(scm *scmp, scmcon *conp, const char *dirname,
  *
  * Symlinks and files that are not regular files are not processed.
  *
+ * Everything that validation remembers between calls (caches, prepared
+ * searches, the certificate index) belongs to conp and is freed by
+ * disconnectscm(), so threads may add and validate objects at the same
+ * time as long as each one uses its own connection.
+ *
  * This function returns 0 on success and a negative error code on failure.
  */
 err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                     char *outfull, int utrust);
 
+/*
+ * Like add_object(), for a file the caller has already read with
+ * file_contents_open(), and possibly hashed with contents_hash(); hash may
+ * be NULL. The caller keeps ownership of contents.
+ */
+err_code add_object_contents(scm *scmp, scmcon *conp, char *outfile,
+                             char *outdir, char *outfull, int utrust,
+                             struct file_contents *contents,
+                             const char *hash);
+
+/*
+ * Compute the SHA-256 hash of a file's contents, in the form kept in the
+ * hash column. Unlike the rest of this file, it may be called from any
+ * thread.
+ */
+err_code contents_hash(const struct file_contents *contents, char *hash,
+                       size_t hashsize);
+
 /**
  * @brief
  *     Delete an object.
@@ -129,6 +252,26 @@ err_code add_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
 err_code delete_object(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                        char *outfull, unsigned int dir_id);
 
+/*
+ * Replace an object whose file has been updated; used in place of
+ * delete_object() before add_object() and end_update_object().
+ *
+ * If the file's contents are what was loaded before, *unchanged is set and
+ * nothing else needs to be done. newhash is the hash of the new contents
+ * from contents_hash(), or NULL to hash outfull here. If a valid certificate
+ * changed but kept its names, key, resources, SIA, AIA and CRL distribution
+ * points, the old version is removed without invalidating anything below
+ * it. Otherwise the object is deleted as by delete_object().
+ *
+ * end_update_object() must be called after the add, whether or not it
+ * succeeded. If a certificate was replaced in place but no valid
+ * certificate took its place, it invalidates the subtree below the old one.
+ */
+err_code begin_update_object(scm *scmp, scmcon *conp, char *outfile,
+                             char *outdir, char *outfull, const char *newhash,
+                             bool *unchanged);
+err_code end_update_object(scm *scmp, scmcon *conp);
+
 /**
  * @brief
  *     Infer the object type based on which file extensions are present.
@@ -156,34 +299,40 @@ object_type infer_filetype(const char *fname);
  * first. Validate the cert and add it.
  *
  * This function returns 0 on success and a negative error code on failure.
+ *
+ * Like the other add_ functions below, it decodes DER from contents if
+ * that is not NULL, and otherwise reads outfull itself. add_object()
+ * passes what it read, so that the file is read only once.
  */
 err_code add_cert(scm *scmp, scmcon *conp, char *outfile, char *outfull,
                   unsigned int id, int utrust, object_type typ,
-                  unsigned int *cert_id);
+                  unsigned int *cert_id, struct file_contents *contents);
 
 /*
  * Add a CRL to the DB.  This function returns 0 on success and a negative
  * error code on failure.
  */
 err_code add_crl(scm *scmp, scmcon *conp, char *outfile, char *outfull,
-                 unsigned int id, int utrust, object_type typ);
+                 unsigned int id, int utrust, object_type typ,
+                 struct file_contents *contents);
 
 err_code add_roa(scm *scmp, scmcon *conp, char *outfile, char *outdir,
-                 char *outfull, unsigned int id, int utrust, object_type typ);
+                 char *outfull, unsigned int id, int utrust, object_type typ,
+                 struct file_contents *contents);
 
 /*
  * Add a manifest to the database
  */
 err_code add_manifest(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                       char *outfull, unsigned int id, int utrust,
-                      object_type typ);
+                      object_type typ, struct file_contents *contents);
 
 /*
     Add a ghostbusters record to the database
 */
 err_code add_ghostbusters(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                           char *outfull, unsigned int id, int utrust,
-                          object_type typ);
+                          object_type typ, struct file_contents *contents);
 
 extern int add_rta(scm *scmp, scmcon *conp, char *outfile, char *outdir,
                    char *outfull, unsigned int id, int utrust, int typ);
@@ -202,6 +351,21 @@ extern int add_rta(scm *scmp, scmcon *conp, char *outfile, char *outdir,
  */
 err_code iterate_crl(scm *scmp, scmcon *conp, crlfunc *cfunc);
 
+/**
+ * @brief
+ *     Revoke the certificates listed on valid CRLs, as
+ *     iterate_crl(scmp, conp, &revoke_cert_by_serial) does, but with
+ *     one join instead of one search per serial number.
+ *
+ * @param since
+ *     If not NULL, only CRLs whose rows changed at or after this
+ *     database time are considered.
+ *
+ * @return
+ *     0 on success or a negative error code on failure.
+ */
+err_code sweep_crl_revocations(scm *scmp, scmcon *conp, const char *since);
+
 /**
  * @brief
  *     model callback function for iterate_crl()
@@ -271,39 +435,49 @@ extern void setallowexpired(int v);
 
 extern void sqcleanup(void);
 
-enum Mode { Read, IPv4_Read, IPv6_Read, AS_Read };
-
-typedef struct _IPv4 {
-  char min[16];
-  char max[16];
-  struct _IPv4 *next;
-} _IPv4;
+/*
+ * A resource set holds, for each of IPv4, IPv6 and AS numbers, an array
+ * of closed intervals.  Once normalized, each array is sorted and no two
+ * of its intervals overlap or touch, so that intersection and
+ * containment are single linear merges.
+ */
+typedef struct _Range32 {
+  uint32_t min;
+  uint32_t max;
+} _Range32;
+typedef _Range32 _IPv4;
+typedef _Range32 _AS;
+typedef struct _IPv6Addr {
+  uint64_t hi;
+  uint64_t lo;
+} _IPv6Addr;
 typedef struct _IPv6 {
-  char min[40];
-  char max[40];
-  struct _IPv6 *next;
+  _IPv6Addr min;
+  _IPv6Addr max;
 } _IPv6;
-typedef struct _AS {
-  unsigned long long min;
-  unsigned long long max;
-  struct _AS *next;
-} _AS;
 typedef struct _RS {
   _IPv4 *ipv4_set;
+  size_t ipv4_count;
+  size_t ipv4_alloc;
   _IPv6 *ipv6_set;
+  size_t ipv6_count;
+  size_t ipv6_alloc;
   _AS *as_set;
+  size_t as_count;
+  size_t as_alloc;
 } RS;
 
-void trim_string(char *str);
-void AddIPv4ToRSNode(RS *node, char min[16], char max[16]);
-void AddIPv6ToRSNode(RS *node, char min[40], char max[40]);
-void AddASToRSNode(RS *node, unsigned long long min, unsigned long long max);
+err_code AddIPv4ToRSNode(RS *node, uint32_t min, uint32_t max);
+err_code AddIPv6ToRSNode(RS *node, const unsigned char min[16],
+                         const unsigned char max[16]);
+err_code AddASToRSNode(RS *node, uint32_t min, uint32_t max);
+void rs_normalize(RS *node);
 err_code get_result_rs(RS *up_rs, RS *self_rs, RS *result_rs);
+_Bool rs_changed(RS *result, RS *node);
 RS *InitializeRSNode();
 void freeRSNode(RS *node);
-void save_node_as_file(RS *result, char *filename);
 err_code add_cert_validation_reconsidered(scmcon *conp, char *ski,
                                           char *subject, unsigned int cert_id,
-                                          char *resource_file_path);
+                                          RS *result);
 _Bool isROA_file(char *filename);
 #endif
@@ -0,0 +1,320 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "rpki/sqhl.h"
+#include "util/macros.h"
+#include "test/unittest.h"
+
+struct range {
+    uint32_t min;
+    uint32_t max;
+};
+
+static RS *new_v4(
+    const struct range *ranges,
+    size_t n)
+{
+    RS *node = InitializeRSNode();
+    size_t i;
+
+    if (node == NULL)
+        return NULL;
+    for (i = 0; i < n; i++)
+    {
+        if (AddIPv4ToRSNode(node, ranges[i].min, ranges[i].max) != 0)
+        {
+            freeRSNode(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+static bool check_set(
+    const _Range32 *set,
+    size_t count,
+    const struct range *expected,
+    size_t n)
+{
+    size_t i;
+
+    TEST(size_t, "%zu", count, ==, n);
+    for (i = 0; i < n; i++)
+    {
+        TEST(uint32_t, "%" PRIu32, set[i].min, ==, expected[i].min);
+        TEST(uint32_t, "%" PRIu32, set[i].max, ==, expected[i].max);
+    }
+    return true;
+}
+
+static void ipv6_bytes(
+    unsigned char bytes[16],
+    uint64_t hi,
+    uint64_t lo)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        bytes[i] = hi & 0xff;
+        bytes[i + 8] = lo & 0xff;
+        hi >>= 8;
+        lo >>= 8;
+    }
+}
+
+static bool test_normalize(
+    void)
+{
+    // out of order, overlapping and nested
+    const struct range in[] = {
+        {40, 50}, {15, 30}, {10, 20}, {42, 45}, {100, 100},
+    };
+    const struct range out[] = {{10, 30}, {40, 50}, {100, 100}};
+    // touching intervals merge, a gap of one address does not
+    const struct range adj_in[] = {{6, 9}, {1, 5}, {11, 12}};
+    const struct range adj_out[] = {{1, 9}, {11, 12}};
+    // the end of the address space does not wrap around
+    const struct range top_in[] = {{5, UINT32_MAX}, {0, 3}};
+    const struct range top_out[] = {{0, 3}, {5, UINT32_MAX}};
+    const struct range all_in[] = {{7, 9}, {0, UINT32_MAX}, {5, 6}};
+    const struct range all_out[] = {{0, UINT32_MAX}};
+    RS *node;
+
+    node = new_v4(in, ELTS(in));
+    TEST_BOOL(node != NULL, true);
+    rs_normalize(node);
+    if (!check_set(node->ipv4_set, node->ipv4_count, out, ELTS(out)))
+        return false;
+    // normalizing again changes nothing
+    rs_normalize(node);
+    if (!check_set(node->ipv4_set, node->ipv4_count, out, ELTS(out)))
+        return false;
+    freeRSNode(node);
+
+    node = new_v4(adj_in, ELTS(adj_in));
+    TEST_BOOL(node != NULL, true);
+    rs_normalize(node);
+    if (!check_set(node->ipv4_set, node->ipv4_count, adj_out,
+                   ELTS(adj_out)))
+        return false;
+    freeRSNode(node);
+
+    node = new_v4(top_in, ELTS(top_in));
+    TEST_BOOL(node != NULL, true);
+    rs_normalize(node);
+    if (!check_set(node->ipv4_set, node->ipv4_count, top_out,
+                   ELTS(top_out)))
+        return false;
+    freeRSNode(node);
+
+    node = new_v4(all_in, ELTS(all_in));
+    TEST_BOOL(node != NULL, true);
+    rs_normalize(node);
+    if (!check_set(node->ipv4_set, node->ipv4_count, all_out,
+                   ELTS(all_out)))
+        return false;
+    freeRSNode(node);
+
+    // AS numbers use the same code
+    node = InitializeRSNode();
+    TEST_BOOL(node != NULL, true);
+    TEST(err_code, "%d", AddASToRSNode(node, 65000, 65010), ==, 0);
+    TEST(err_code, "%d", AddASToRSNode(node, 64999, 64999), ==, 0);
+    TEST(err_code, "%d", AddASToRSNode(node, 65011, 65011), ==, 0);
+    rs_normalize(node);
+    TEST(size_t, "%zu", node->as_count, ==, 1);
+    TEST(uint32_t, "%" PRIu32, node->as_set[0].min, ==, 64999);
+    TEST(uint32_t, "%" PRIu32, node->as_set[0].max, ==, 65011);
+    freeRSNode(node);
+
+    // empty sets stay empty
+    node = InitializeRSNode();
+    TEST_BOOL(node != NULL, true);
+    rs_normalize(node);
+    TEST(size_t, "%zu", node->ipv4_count, ==, 0);
+    TEST(size_t, "%zu", node->ipv6_count, ==, 0);
+    TEST(size_t, "%zu", node->as_count, ==, 0);
+    freeRSNode(node);
+
+    return true;
+}
+
+static bool test_normalize_ipv6(
+    void)
+{
+    unsigned char min[16];
+    unsigned char max[16];
+    RS *node = InitializeRSNode();
+
+    TEST_BOOL(node != NULL, true);
+    // adjacent across the boundary of the low 64 bits
+    ipv6_bytes(min, 1, 0);
+    ipv6_bytes(max, 1, 10);
+    TEST(err_code, "%d", AddIPv6ToRSNode(node, min, max), ==, 0);
+    ipv6_bytes(min, 0, UINT64_C(0xffffffff00000000));
+    ipv6_bytes(max, 0, UINT64_MAX);
+    TEST(err_code, "%d", AddIPv6ToRSNode(node, min, max), ==, 0);
+    // separate, one address after the gap
+    ipv6_bytes(min, 1, 12);
+    ipv6_bytes(max, 2, 0);
+    TEST(err_code, "%d", AddIPv6ToRSNode(node, min, max), ==, 0);
+    rs_normalize(node);
+
+    TEST(size_t, "%zu", node->ipv6_count, ==, 2);
+    TEST(uint64_t, "%" PRIu64, node->ipv6_set[0].min.hi, ==, 0);
+    TEST(uint64_t, "%" PRIx64, node->ipv6_set[0].min.lo, ==,
+         UINT64_C(0xffffffff00000000));
+    TEST(uint64_t, "%" PRIu64, node->ipv6_set[0].max.hi, ==, 1);
+    TEST(uint64_t, "%" PRIu64, node->ipv6_set[0].max.lo, ==, 10);
+    TEST(uint64_t, "%" PRIu64, node->ipv6_set[1].min.hi, ==, 1);
+    TEST(uint64_t, "%" PRIu64, node->ipv6_set[1].min.lo, ==, 12);
+    freeRSNode(node);
+
+    return true;
+}
+
+static bool test_intersect(
+    void)
+{
+    const struct range up[] = {{0, 100}, {200, 300}, {400, 500}};
+    const struct range self[] = {{50, 250}, {300, 300}, {301, 399}};
+    const struct range out[] = {{50, 100}, {200, 250}, {300, 300}};
+    const struct range disjoint[] = {{101, 199}};
+    RS *up_rs;
+    RS *self_rs;
+    RS *result;
+
+    up_rs = new_v4(up, ELTS(up));
+    self_rs = new_v4(self, ELTS(self));
+    result = InitializeRSNode();
+    TEST_BOOL(up_rs != NULL && self_rs != NULL && result != NULL, true);
+    TEST(err_code, "%d", get_result_rs(up_rs, self_rs, result), ==, 0);
+    if (!check_set(result->ipv4_set, result->ipv4_count, out, ELTS(out)))
+        return false;
+    // the certificate lost resources its parent does not have
+    TEST_BOOL(rs_changed(result, self_rs), true);
+    // but nothing was lost from what the two share
+    TEST_BOOL(rs_changed(self_rs, result), false);
+    freeRSNode(self_rs);
+    freeRSNode(result);
+
+    // nothing in common
+    self_rs = new_v4(disjoint, ELTS(disjoint));
+    result = InitializeRSNode();
+    TEST_BOOL(self_rs != NULL && result != NULL, true);
+    TEST(err_code, "%d", get_result_rs(up_rs, self_rs, result), ==,
+         ERR_SCM_NOTVALID);
+    TEST(size_t, "%zu", result->ipv4_count, ==, 0);
+    freeRSNode(self_rs);
+    freeRSNode(result);
+
+    // an empty certificate has nothing to keep
+    self_rs = InitializeRSNode();
+    result = InitializeRSNode();
+    TEST_BOOL(self_rs != NULL && result != NULL, true);
+    TEST(err_code, "%d", get_result_rs(up_rs, self_rs, result), ==,
+         ERR_SCM_NOTVALID);
+    TEST_BOOL(rs_changed(result, self_rs), false);
+    freeRSNode(self_rs);
+    freeRSNode(result);
+    freeRSNode(up_rs);
+
+    return true;
+}
+
+static bool test_inherit(
+    void)
+{
+    // an inherited family is read as the whole space (see
+    // get_resources_set_from_X509()), so the parent's set is kept as is
+    const struct range up[] = {{10, 20}, {30, 40}};
+    RS *up_rs;
+    RS *self_rs;
+    RS *result;
+
+    up_rs = new_v4(up, ELTS(up));
+    self_rs = InitializeRSNode();
+    result = InitializeRSNode();
+    TEST_BOOL(up_rs != NULL && self_rs != NULL && result != NULL, true);
+    TEST(err_code, "%d", AddIPv4ToRSNode(self_rs, 0, UINT32_MAX), ==, 0);
+    TEST(err_code, "%d", AddASToRSNode(self_rs, 1, UINT32_MAX), ==, 0);
+    TEST(err_code, "%d", AddASToRSNode(up_rs, 64512, 65534), ==, 0);
+    TEST(err_code, "%d", get_result_rs(up_rs, self_rs, result), ==, 0);
+    if (!check_set(result->ipv4_set, result->ipv4_count, up, ELTS(up)))
+        return false;
+    TEST(size_t, "%zu", result->as_count, ==, 1);
+    TEST(uint32_t, "%" PRIu32, result->as_set[0].min, ==, 64512);
+    TEST(uint32_t, "%" PRIu32, result->as_set[0].max, ==, 65534);
+    TEST_BOOL(rs_changed(result, up_rs), false);
+    TEST_BOOL(rs_changed(result, self_rs), true);
+    freeRSNode(up_rs);
+    freeRSNode(self_rs);
+    freeRSNode(result);
+
+    return true;
+}
+
+static bool test_contains(
+    void)
+{
+    const struct range outer[] = {{10, 20}, {30, 40}};
+    const struct range inside[] = {{10, 10}, {12, 20}, {35, 40}};
+    const struct range spans_gap[] = {{15, 35}};
+    const struct range past_end[] = {{35, 41}};
+    const struct range before[] = {{5, 9}};
+    RS *outer_rs = new_v4(outer, ELTS(outer));
+    RS *node;
+
+    TEST_BOOL(outer_rs != NULL, true);
+
+    node = new_v4(inside, ELTS(inside));
+    TEST_BOOL(node != NULL, true);
+    TEST_BOOL(rs_changed(outer_rs, node), false);
+    freeRSNode(node);
+
+    node = new_v4(spans_gap, ELTS(spans_gap));
+    TEST_BOOL(node != NULL, true);
+    TEST_BOOL(rs_changed(outer_rs, node), true);
+    freeRSNode(node);
+
+    node = new_v4(past_end, ELTS(past_end));
+    TEST_BOOL(node != NULL, true);
+    TEST_BOOL(rs_changed(outer_rs, node), true);
+    freeRSNode(node);
+
+    node = new_v4(before, ELTS(before));
+    TEST_BOOL(node != NULL, true);
+    TEST_BOOL(rs_changed(outer_rs, node), true);
+    freeRSNode(node);
+
+    // everything contains the empty set, and only it
+    node = InitializeRSNode();
+    TEST_BOOL(node != NULL, true);
+    TEST_BOOL(rs_changed(outer_rs, node), false);
+    TEST_BOOL(rs_changed(node, outer_rs), true);
+    TEST_BOOL(rs_changed(node, node), false);
+    freeRSNode(node);
+    freeRSNode(outer_rs);
+
+    return true;
+}
+
+int main(
+    void)
+{
+    if (!test_normalize())
+        return EXIT_FAILURE;
+    if (!test_normalize_ipv6())
+        return EXIT_FAILURE;
+    if (!test_intersect())
+        return EXIT_FAILURE;
+    if (!test_inherit())
+        return EXIT_FAILURE;
+    if (!test_contains())
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#include "aur_frame.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+void aur_frame_init(
+    struct aur_frame *frame)
+{
+    frame->buf = NULL;
+    frame->len = 0;
+    frame->alloc = 0;
+    frame->nrecords = 0;
+}
+
+bool aur_frame_add(
+    struct aur_frame *frame,
+    char tag,
+    const char *valu,
+    size_t valulen)
+{
+    size_t need;
+    size_t alloc;
+    unsigned char *buf;
+    unsigned char *p;
+
+    if (valulen > AUR_RECORD_VALUE_MAX)
+        return false;
+    if (frame->len == 0)
+        frame->len = AUR_FRAME_HEADER_SIZE;
+    need = frame->len + AUR_RECORD_HEADER_SIZE + valulen + 1;
+    if (need > UINT32_MAX)
+        return false;
+    if (need > frame->alloc)
+    {
+        for (alloc = frame->alloc ? frame->alloc : 4096; alloc < need;
+             alloc *= 2)
+            ;
+        buf = (unsigned char *)realloc(frame->buf, alloc);
+        if (buf == NULL)
+        {
+            if (frame->nrecords == 0)
+                frame->len = 0;
+            return false;
+        }
+        frame->buf = buf;
+        frame->alloc = alloc;
+    }
+
+    p = frame->buf + frame->len;
+    p[0] = (unsigned char)tag;
+    p[1] = (unsigned char)((valulen + 1) >> 8);
+    p[2] = (unsigned char)(valulen + 1);
+    memcpy(p + AUR_RECORD_HEADER_SIZE, valu, valulen);
+    p[AUR_RECORD_HEADER_SIZE + valulen] = 0;
+    frame->len = need;
+    frame->nrecords++;
+
+    return true;
+}
+
+size_t aur_frame_finish(
+    struct aur_frame *frame)
+{
+    size_t rest;
+
+    if (frame->nrecords == 0)
+        return 0;
+    rest = frame->len - AUR_FRAME_HEADER_SIZE;
+    frame->buf[0] = AUR_FRAME_MAGIC;
+    frame->buf[1] = (unsigned char)(rest >> 24);
+    frame->buf[2] = (unsigned char)(rest >> 16);
+    frame->buf[3] = (unsigned char)(rest >> 8);
+    frame->buf[4] = (unsigned char)rest;
+
+    return frame->len;
+}
+
+void aur_frame_reset(
+    struct aur_frame *frame)
+{
+    frame->len = 0;
+    frame->nrecords = 0;
+}
+
+void aur_frame_free(
+    struct aur_frame *frame)
+{
+    free((void *)frame->buf);
+    aur_frame_init(frame);
+}
+
+/** Parse a text line, which ends with CRLF. */
+static int aur_frame_parse_line(
+    const char *buf,
+    size_t len,
+    struct aur_msg *msg)
+{
+    const char *nl;
+    size_t linelen;
+    size_t i;
+
+    for (nl = memchr(buf, '\n', len); nl != NULL;
+         nl = memchr(nl + 1, '\n', len - (nl + 1 - buf)))
+    {
+        if (nl > buf && nl[-1] == '\r')
+            break;
+    }
+    if (nl == NULL)
+        return 0;
+
+    linelen = nl - 1 - buf;
+    msg->size = linelen + 2;
+    msg->tag = linelen > 0 ? buf[0] : 0;
+    msg->valid = linelen >= 2 && isspace((int)(unsigned char)buf[1]);
+    for (i = 1; i < linelen && isspace((int)(unsigned char)buf[i]); ++i)
+        ;
+    msg->valu = buf + i;
+    msg->valulen = linelen > i ? linelen - i : 0;
+
+    return 1;
+}
+
+int aur_frame_parse(
+    const char *buf,
+    size_t len,
+    size_t *framerem,
+    struct aur_msg *msg)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t rest;
+    size_t n;
+
+    if (*framerem == 0)
+    {
+        if (len == 0)
+            return 0;
+        if (p[0] != AUR_FRAME_MAGIC)
+            return aur_frame_parse_line(buf, len, msg);
+        if (len < AUR_FRAME_HEADER_SIZE)
+            return 0;
+        rest = ((size_t)p[1] << 24) | ((size_t)p[2] << 16) |
+            ((size_t)p[3] << 8) | (size_t)p[4];
+        *framerem = rest;
+        msg->tag = 0;
+        msg->valid = true;
+        msg->valu = buf + AUR_FRAME_HEADER_SIZE;
+        msg->valulen = 0;
+        msg->size = AUR_FRAME_HEADER_SIZE;
+        return 1;
+    }
+
+    if (*framerem < AUR_RECORD_HEADER_SIZE)
+        return -1;
+    if (len < AUR_RECORD_HEADER_SIZE)
+        return 0;
+    n = ((size_t)p[1] << 8) | (size_t)p[2];
+    if (n == 0 || AUR_RECORD_HEADER_SIZE + n > *framerem)
+        return -1;
+    if (len < AUR_RECORD_HEADER_SIZE + n)
+        return 0;
+    if (p[AUR_RECORD_HEADER_SIZE + n - 1] != 0)
+        return -1;
+
+    *framerem -= AUR_RECORD_HEADER_SIZE + n;
+    msg->tag = buf[0];
+    msg->valid = true;
+    msg->valu = buf + AUR_RECORD_HEADER_SIZE;
+    msg->valulen = n - 1;
+    msg->size = AUR_RECORD_HEADER_SIZE + n;
+
+    return 1;
+}
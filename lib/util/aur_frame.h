@@ -0,0 +1,92 @@
+#ifndef _UTILS_AUR_FRAME_H
+#define _UTILS_AUR_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+	Messages from rsync_aur to rcli, in either of two encodings that may
+	be mixed freely on one connection (see doc/AUR.readme):
+
+	A text line is TAG whitespace VALUE CRLF.
+
+	A frame carries any number of messages. It is AUR_FRAME_MAGIC, the
+	length of the rest of the frame as a 4-byte big-endian number, and
+	then one record per message: the TAG byte, the length of the value
+	as a 2-byte big-endian number, and the value itself including a
+	terminating NUL, so that the receiver can use it where it lies. A
+	text line never starts with AUR_FRAME_MAGIC.
+*/
+#define AUR_FRAME_MAGIC 0x01
+#define AUR_FRAME_HEADER_SIZE 5
+#define AUR_RECORD_HEADER_SIZE 3
+
+/** Largest value a record can carry, not counting its NUL. */
+#define AUR_RECORD_VALUE_MAX 0xfffe
+
+/** A frame being built by a sender. */
+struct aur_frame {
+    unsigned char *buf;
+    size_t len;                 // bytes used, including the header
+    size_t alloc;
+    size_t nrecords;
+};
+
+/** Start an empty frame. */
+void aur_frame_init(
+    struct aur_frame *frame);
+
+/**
+	Append a message to the frame.
+
+	@return Whether or not there was memory for it. The frame is
+	unchanged on failure.
+*/
+bool aur_frame_add(
+    struct aur_frame *frame,
+    char tag,
+    const char *valu,
+    size_t valulen);
+
+/**
+	Fill in the frame's header.
+
+	@return the number of bytes at frame->buf to send, or 0 if the frame
+	holds no messages.
+*/
+size_t aur_frame_finish(
+    struct aur_frame *frame);
+
+/** Empty the frame, keeping its buffer for the next one. */
+void aur_frame_reset(
+    struct aur_frame *frame);
+
+/** Release the frame's buffer. */
+void aur_frame_free(
+    struct aur_frame *frame);
+
+/** One message found by aur_frame_parse(). */
+struct aur_msg {
+    char tag;                   // 0 for a frame header or an empty line
+    bool valid;                 // false for a malformed text line
+    const char *valu;           // not NUL-terminated for text lines
+    size_t valulen;
+    size_t size;                // bytes taken from the input
+};
+
+/**
+	Parse the next message in buf[0..len) without modifying the input.
+
+	@param framerem Bytes left in the frame being parsed, or 0 between
+	frames. It is updated as frames and records are taken.
+	@return 1 if a message was found (msg->size bytes should then be
+	skipped), 0 if more input is needed, or -1 if the input is not
+	valid framing and the connection cannot be resynchronized.
+*/
+int aur_frame_parse(
+    const char *buf,
+    size_t len,
+    size_t *framerem,
+    struct aur_msg *msg);
+
+#endif
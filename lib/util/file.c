@@ -1,9 +1,11 @@
 #include "file.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <string.h>
 #include <stdlib.h>
@@ -73,3 +75,184 @@ bool mkdir_recursive(
         return false;
     }
 }
+
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/**
+ * Regular files at least this big are mapped rather than read. Below it,
+ * setting up and tearing down a mapping costs more than copying.
+ *
+ * @bug magic number
+ */
+#define FILE_CONTENTS_MAP_MIN (64 * 1024)
+
+/**
+ * Map size bytes of fd, followed by at least one page of zeros: reserve
+ * anonymous (zero) pages for the whole span, then map the file over the
+ * start of it.
+ */
+static bool file_contents_map(
+    struct file_contents *contents,
+    int fd,
+    size_t size)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t map_size;
+    void *map;
+
+    if (pagesize <= 0)
+        return false;
+    map_size = (size / pagesize + 1) * pagesize + pagesize;
+    map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+               0);
+    if (map == MAP_FAILED)
+        return false;
+    if (mmap(map, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+        MAP_FAILED)
+    {
+        (void)munmap(map, map_size);
+        return false;
+    }
+    (void)posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    contents->data = (unsigned char *)map;
+    contents->size = size;
+    contents->map = map;
+    contents->map_size = map_size;
+    return true;
+}
+
+/**
+ * Read fd to the end into a buffer, starting with room for hint bytes
+ * and doubling as needed.
+ */
+static bool file_contents_read(
+    struct file_contents *contents,
+    int fd,
+    size_t hint)
+{
+    unsigned char *buf;
+    unsigned char *newbuf;
+    size_t alloc = hint + 1;
+    size_t size = 0;
+    ssize_t len;
+
+    if (alloc < 4096)
+        alloc = 4096;
+    buf = (unsigned char *)malloc(alloc + FILE_CONTENTS_PAD);
+    if (buf == NULL)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+    for (;;)
+    {
+        if (size == alloc)
+        {
+            alloc *= 2;
+            newbuf = (unsigned char *)realloc(buf, alloc + FILE_CONTENTS_PAD);
+            if (newbuf == NULL)
+            {
+                free(buf);
+                errno = ENOMEM;
+                return false;
+            }
+            buf = newbuf;
+        }
+        len = read(fd, buf + size, alloc - size);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            // errno was set by read()
+            return false;
+        }
+        if (len == 0)
+            break;
+        size += len;
+    }
+    memset(buf + size, 0, FILE_CONTENTS_PAD);
+
+    contents->data = buf;
+    contents->size = size;
+    contents->map = NULL;
+    contents->map_size = 0;
+    return true;
+}
+
+bool file_contents_fd(
+    struct file_contents *contents,
+    int fd)
+{
+    struct stat st;
+    off_t offset;
+
+    if (contents == NULL)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        // errno was set by fstat()
+        return false;
+    }
+    if (!S_ISREG(st.st_mode))
+        return file_contents_read(contents, fd, 0);
+
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset == 0 && st.st_size >= FILE_CONTENTS_MAP_MIN &&
+        file_contents_map(contents, fd, st.st_size))
+        return true;
+    return file_contents_read(contents, fd,
+                              (offset >= 0 && offset < st.st_size) ?
+                              (size_t)(st.st_size - offset) : 0);
+}
+
+bool file_contents_open(
+    struct file_contents *contents,
+    const char *pathname)
+{
+    int fd;
+    int saved_errno;
+    bool ret;
+
+    if (pathname == NULL)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    fd = open(pathname, O_RDONLY);
+    if (fd < 0)
+    {
+        // errno was set by open()
+        return false;
+    }
+    ret = file_contents_fd(contents, fd);
+    saved_errno = errno;
+    (void)close(fd);
+    errno = saved_errno;
+    return ret;
+}
+
+void file_contents_close(
+    struct file_contents *contents)
+{
+    if (contents == NULL)
+        return;
+
+    if (contents->map != NULL)
+        (void)munmap(contents->map, contents->map_size);
+    else
+        free((void *)contents->data);
+    contents->data = NULL;
+    contents->size = 0;
+    contents->map = NULL;
+    contents->map_size = 0;
+}
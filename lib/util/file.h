@@ -2,6 +2,7 @@
 #define _LIB_UTIL_FILE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -20,4 +21,60 @@ bool mkdir_recursive(
     const char *pathname,
     mode_t mode);
 
+
+/**
+ * Number of zero bytes that are guaranteed to follow the data of a
+ * file_contents, so that a decoder looking slightly past the end of
+ * truncated input still reads valid memory.
+ */
+#define FILE_CONTENTS_PAD 4
+
+/**
+ * The whole contents of a file, read-only.
+ *
+ * Large regular files are mapped into memory, with a hint that they will
+ * be read sequentially, instead of being copied into a buffer. Anything
+ * else is read into a buffer. Either way, callers work on @c data
+ * directly and MUST NOT modify it.
+ *
+ * @note A mapped file that is truncated while it is open makes accesses
+ *       past the new end fault. Files in the repository are replaced by
+ *       renaming, not rewritten in place, so this does not arise there.
+ */
+struct file_contents {
+    unsigned char *data;
+    size_t size;
+    void *map;                  // the mapping, or NULL if data was read
+    size_t map_size;
+};
+
+/**
+ * Get the contents of a file by name.
+ *
+ * @return true on success, false on error. If false is returned, errno
+ *         will be set to an appropriate value and there is nothing to
+ *         close.
+ */
+bool file_contents_open(
+    struct file_contents *contents,
+    const char *pathname);
+
+/**
+ * Get the contents of an open file, from its current offset to the end.
+ * The descriptor is left open, and is left at an unspecified offset.
+ *
+ * @return true on success, false on error. If false is returned, errno
+ *         will be set to an appropriate value and there is nothing to
+ *         close.
+ */
+bool file_contents_fd(
+    struct file_contents *contents,
+    int fd);
+
+/**
+ * Release what file_contents_open() or file_contents_fd() got.
+ */
+void file_contents_close(
+    struct file_contents *contents);
+
 #endif
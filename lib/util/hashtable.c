@@ -0,0 +1,316 @@
+#include "hashtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef DEBUG
+#include <assert.h>
+#else
+#define assert(x)                                                       \
+    do {                                                                \
+    } while (false)
+#endif
+
+
+#define HASHTABLE_INITIAL_BUCKETS 64
+
+struct _HashTable_Entry {
+    struct _HashTable_Entry *next;
+    uint64_t hash;
+    size_t key_len;
+    void *value;
+    unsigned char key[];
+};
+
+struct _HashTable {
+    struct _HashTable_Entry **buckets;
+    size_t num_buckets;         // always a power of 2
+    size_t size;
+};
+
+
+uint64_t HashTable_hash(
+    void const *key,
+    size_t key_len)
+{
+    const unsigned char *p = key;
+    uint64_t hash = UINT64_C(14695981039346656037);
+    size_t i;
+
+    for (i = 0; i < key_len; ++i)
+    {
+        hash ^= p[i];
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+HashTable *HashTable_new(
+    void)
+{
+    HashTable *table = (HashTable *) malloc(sizeof(HashTable));
+    if (table == NULL)
+        return NULL;
+
+    table->buckets = (struct _HashTable_Entry **)
+        calloc(HASHTABLE_INITIAL_BUCKETS, sizeof(struct _HashTable_Entry *));
+    if (table->buckets == NULL)
+    {
+        free((void *)table);
+        return NULL;
+    }
+    table->num_buckets = HASHTABLE_INITIAL_BUCKETS;
+    table->size = 0;
+
+    return table;
+}
+
+void HashTable_free(
+    HashTable * table,
+    HashTable_free_value_func * free_value)
+{
+    if (table == NULL)
+        return;
+
+    HashTable_clear(table, free_value);
+    free((void *)table->buckets);
+    free((void *)table);
+}
+
+size_t HashTable_size(
+    HashTable const *table)
+{
+    assert(table != NULL);
+
+    return table->size;
+}
+
+static struct _HashTable_Entry **HashTable_find(
+    HashTable const *table,
+    void const *key,
+    size_t key_len,
+    uint64_t hash)
+{
+    struct _HashTable_Entry **entryp;
+
+    for (entryp = &table->buckets[hash & (table->num_buckets - 1)];
+         *entryp != NULL; entryp = &(*entryp)->next)
+    {
+        if ((*entryp)->hash == hash && (*entryp)->key_len == key_len &&
+            memcmp((*entryp)->key, key, key_len) == 0)
+            break;
+    }
+
+    return entryp;
+}
+
+/** Double the number of buckets. Failure just leaves the chains longer. */
+static void HashTable_grow(
+    HashTable * table)
+{
+    struct _HashTable_Entry **buckets;
+    struct _HashTable_Entry *entry;
+    struct _HashTable_Entry *next;
+    size_t num_buckets = table->num_buckets * 2;
+    size_t i;
+
+    buckets = (struct _HashTable_Entry **)
+        calloc(num_buckets, sizeof(struct _HashTable_Entry *));
+    if (buckets == NULL)
+        return;
+
+    for (i = 0; i < table->num_buckets; ++i)
+    {
+        for (entry = table->buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (num_buckets - 1)];
+            buckets[entry->hash & (num_buckets - 1)] = entry;
+        }
+    }
+
+    free((void *)table->buckets);
+    table->buckets = buckets;
+    table->num_buckets = num_buckets;
+}
+
+void *HashTable_get(
+    HashTable const *table,
+    void const *key,
+    size_t key_len)
+{
+    struct _HashTable_Entry **entryp;
+
+    assert(table != NULL);
+
+    entryp = HashTable_find(table, key, key_len,
+                            HashTable_hash(key, key_len));
+
+    return (*entryp == NULL) ? NULL : (*entryp)->value;
+}
+
+bool HashTable_contains(
+    HashTable const *table,
+    void const *key,
+    size_t key_len)
+{
+    assert(table != NULL);
+
+    return *HashTable_find(table, key, key_len,
+                           HashTable_hash(key, key_len)) != NULL;
+}
+
+bool HashTable_put(
+    HashTable * table,
+    void const *key,
+    size_t key_len,
+    void *value,
+    void **old_value)
+{
+    struct _HashTable_Entry **entryp;
+    struct _HashTable_Entry *entry;
+    uint64_t hash;
+
+    assert(table != NULL);
+
+    hash = HashTable_hash(key, key_len);
+    entryp = HashTable_find(table, key, key_len, hash);
+    if (*entryp != NULL)
+    {
+        if (old_value != NULL)
+            *old_value = (*entryp)->value;
+        (*entryp)->value = value;
+        return true;
+    }
+
+    entry = (struct _HashTable_Entry *)
+        malloc(sizeof(struct _HashTable_Entry) + key_len);
+    if (entry == NULL)
+        return false;
+
+    entry->hash = hash;
+    entry->key_len = key_len;
+    entry->value = value;
+    memcpy(entry->key, key, key_len);
+    entry->next = table->buckets[hash & (table->num_buckets - 1)];
+    table->buckets[hash & (table->num_buckets - 1)] = entry;
+    table->size += 1;
+
+    if (old_value != NULL)
+        *old_value = NULL;
+
+    if (table->size > table->num_buckets)
+        HashTable_grow(table);
+
+    return true;
+}
+
+bool HashTable_remove(
+    HashTable * table,
+    void const *key,
+    size_t key_len,
+    void **value)
+{
+    struct _HashTable_Entry **entryp;
+    struct _HashTable_Entry *entry;
+
+    assert(table != NULL);
+
+    entryp = HashTable_find(table, key, key_len,
+                            HashTable_hash(key, key_len));
+    entry = *entryp;
+    if (entry == NULL)
+        return false;
+
+    *entryp = entry->next;
+    table->size -= 1;
+
+    if (value != NULL)
+        *value = entry->value;
+    free((void *)entry);
+
+    return true;
+}
+
+size_t HashTable_remove_if(
+    HashTable * table,
+    bool (*predicate)(void const *key, size_t key_len, void *value,
+                      void *arg),
+    void *arg,
+    HashTable_free_value_func * free_value)
+{
+    struct _HashTable_Entry **entryp;
+    struct _HashTable_Entry *entry;
+    size_t removed = 0;
+    size_t i;
+
+    assert(table != NULL);
+    assert(predicate != NULL);
+
+    for (i = 0; i < table->num_buckets; ++i)
+    {
+        entryp = &table->buckets[i];
+        while ((entry = *entryp) != NULL)
+        {
+            if (!predicate(entry->key, entry->key_len, entry->value, arg))
+            {
+                entryp = &entry->next;
+                continue;
+            }
+            *entryp = entry->next;
+            if (free_value != NULL)
+                free_value(entry->value);
+            free((void *)entry);
+            ++removed;
+        }
+    }
+
+    table->size -= removed;
+
+    return removed;
+}
+
+void HashTable_clear(
+    HashTable * table,
+    HashTable_free_value_func * free_value)
+{
+    struct _HashTable_Entry *entry;
+    struct _HashTable_Entry *next;
+    size_t i;
+
+    assert(table != NULL);
+
+    for (i = 0; i < table->num_buckets; ++i)
+    {
+        for (entry = table->buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            if (free_value != NULL)
+                free_value(entry->value);
+            free((void *)entry);
+        }
+        table->buckets[i] = NULL;
+    }
+
+    table->size = 0;
+}
+
+void HashTable_foreach(
+    HashTable * table,
+    void (*func)(void const *key, size_t key_len, void *value, void *arg),
+    void *arg)
+{
+    struct _HashTable_Entry *entry;
+    size_t i;
+
+    assert(table != NULL);
+    assert(func != NULL);
+
+    for (i = 0; i < table->num_buckets; ++i)
+    {
+        for (entry = table->buckets[i]; entry != NULL; entry = entry->next)
+            func(entry->key, entry->key_len, entry->value, arg);
+    }
+}
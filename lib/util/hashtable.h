@@ -0,0 +1,116 @@
+#ifndef _UTILS_HASHTABLE_H
+#define _UTILS_HASHTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+	A hash table mapping arbitrary byte strings to pointers. Keys are
+	copied into the table; values are owned by the caller unless a
+	free_value function is passed to one of the functions below.
+
+	A HashTable is not thread safe. Callers that share one between
+	threads must provide their own locking.
+*/
+struct _HashTable;
+typedef struct _HashTable HashTable;
+
+/** Function used to release values that are removed from a table. */
+typedef void HashTable_free_value_func(
+    void *value);
+
+/** Create a new, empty HashTable. */
+HashTable *HashTable_new(
+    void);
+
+/**
+	Free the HashTable and all of its keys. If free_value is not NULL, it
+	is called on every value still in the table.
+*/
+void HashTable_free(
+    HashTable * table,
+    HashTable_free_value_func * free_value);
+
+/** @return the number of entries in the table. */
+size_t HashTable_size(
+    HashTable const *table);
+
+/**
+	Look up a key.
+
+	@return the value stored for the key, or NULL if the key is not in the
+	table. Use HashTable_contains() if NULL values are stored.
+*/
+void *HashTable_get(
+    HashTable const *table,
+    void const *key,
+    size_t key_len);
+
+/** @return whether or not the key is in the table. */
+bool HashTable_contains(
+    HashTable const *table,
+    void const *key,
+    size_t key_len);
+
+/**
+	Add or replace the value stored for a key. This can fail if there
+	isn't enough memory, in which case the table is unchanged.
+
+	@param old_value If not NULL, receives the value that was replaced,
+	or NULL if the key was not in the table.
+	@return Whether or not the put was successful.
+*/
+bool HashTable_put(
+    HashTable * table,
+    void const *key,
+    size_t key_len,
+    void *value,
+    void **old_value);
+
+/**
+	Remove a key from the table.
+
+	@param value If not NULL and the key was in the table, receives the
+	value that was stored for it.
+	@return Whether or not the key was in the table.
+*/
+bool HashTable_remove(
+    HashTable * table,
+    void const *key,
+    size_t key_len,
+    void **value);
+
+/**
+	Remove every entry for which predicate returns true. If free_value
+	is not NULL, it is called on the value of every removed entry.
+
+	@return the number of entries removed.
+*/
+size_t HashTable_remove_if(
+    HashTable * table,
+    bool (*predicate)(void const *key, size_t key_len, void *value,
+                      void *arg),
+    void *arg,
+    HashTable_free_value_func * free_value);
+
+/** Remove all entries, calling free_value (if not NULL) on each value. */
+void HashTable_clear(
+    HashTable * table,
+    HashTable_free_value_func * free_value);
+
+/**
+	Call func on every entry in the table, in no particular order. func
+	MUST NOT add or remove entries.
+*/
+void HashTable_foreach(
+    HashTable * table,
+    void (*func)(void const *key, size_t key_len, void *value, void *arg),
+    void *arg);
+
+/** The 64-bit FNV-1a hash of a byte string, as used by the table. */
+uint64_t HashTable_hash(
+    void const *key,
+    size_t key_len);
+
+#endif
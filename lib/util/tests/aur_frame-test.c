@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/aur_frame.h"
+#include "test/unittest.h"
+
+static bool expect(
+    const char *buf,
+    size_t len,
+    size_t *framerem,
+    char tag,
+    const char *valu,
+    size_t *offset)
+{
+    struct aur_msg msg;
+
+    TEST(int, "%d", aur_frame_parse(buf + *offset, len - *offset, framerem,
+                                    &msg), ==, 1);
+    TEST(int, "%d", msg.tag, ==, tag);
+    TEST_BOOL(msg.valid, true);
+    TEST(size_t, "%zu", msg.valulen, ==, strlen(valu));
+    TEST_MEMCMP(msg.valu, ==, valu, msg.valulen);
+    *offset += msg.size;
+
+    return true;
+}
+
+static bool run_test(
+    void)
+{
+    struct aur_frame frame;
+    struct aur_msg msg;
+    char buf[1024];
+    size_t framelen;
+    size_t framerem = 0;
+    size_t offset = 0;
+    size_t len;
+    size_t i;
+
+    aur_frame_init(&frame);
+    TEST(size_t, "%zu", aur_frame_finish(&frame), ==, 0);
+    TEST_BOOL(aur_frame_add(&frame, 'C', "/repo", 5), true);
+    TEST_BOOL(aur_frame_add(&frame, 'A', "a/b.cer", 7), true);
+    TEST_BOOL(aur_frame_add(&frame, 'R', "", 0), true);
+    framelen = aur_frame_finish(&frame);
+    TEST(size_t, "%zu", framelen, ==,
+         AUR_FRAME_HEADER_SIZE + 3 * AUR_RECORD_HEADER_SIZE + 6 + 8 + 1);
+    TEST(unsigned int, "%u", frame.buf[0], ==, AUR_FRAME_MAGIC);
+
+    // a text line, then the frame, then another text line
+    len = snprintf(buf, sizeof(buf), "B  Mon Jan  1\r\n");
+    memcpy(buf + len, frame.buf, framelen);
+    len += framelen;
+    len += snprintf(buf + len, sizeof(buf) - len, "E x\r\n");
+    aur_frame_free(&frame);
+
+    if (!expect(buf, len, &framerem, 'B', "Mon Jan  1", &offset) ||
+        !expect(buf, len, &framerem, 0, "", &offset) ||
+        !expect(buf, len, &framerem, 'C', "/repo", &offset) ||
+        !expect(buf, len, &framerem, 'A', "a/b.cer", &offset))
+        return false;
+    // record values are NUL-terminated in place
+    TEST(int, "%d", buf[offset - 1], ==, 0);
+    if (!expect(buf, len, &framerem, 'R', "", &offset))
+        return false;
+    TEST(size_t, "%zu", framerem, ==, 0);
+    if (!expect(buf, len, &framerem, 'E', "x", &offset))
+        return false;
+    TEST(size_t, "%zu", offset, ==, len);
+
+    // every proper prefix of a message needs more input
+    for (i = 0; i < len; ++i)
+    {
+        size_t rem = 0;
+        size_t off = 0;
+        int ret;
+
+        while ((ret = aur_frame_parse(buf + off, i - off, &rem, &msg)) == 1)
+            off += msg.size;
+        TEST(int, "%d", ret, ==, 0);
+    }
+
+    // a lone LF does not end a line, and a bad line is reported
+    framerem = 0;
+    TEST(int, "%d", aur_frame_parse("A x\nB", 5, &framerem, &msg), ==, 0);
+    TEST(int, "%d", aur_frame_parse("Ax\r\n", 4, &framerem, &msg), ==, 1);
+    TEST_BOOL(msg.valid, false);
+
+    // a record that overruns its frame, or lacks its NUL, is an error
+    framerem = 4;
+    TEST(int, "%d", aur_frame_parse("A\0\2x\0", 5, &framerem, &msg), ==, -1);
+    framerem = 5;
+    TEST(int, "%d", aur_frame_parse("A\0\2xy", 5, &framerem, &msg), ==, -1);
+
+    return true;
+}
+
+int main(
+    void)
+{
+    if (!run_test())
+        return -1;
+    return 0;
+}
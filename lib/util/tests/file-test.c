@@ -0,0 +1,106 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/file.h"
+#include "test/unittest.h"
+
+static bool write_file(
+    char *template,
+    const unsigned char *buf,
+    size_t size)
+{
+    int fd = mkstemp(template);
+
+    TEST(int, "%d", fd, >=, 0);
+    TEST(ssize_t, "%zd", write(fd, buf, size), ==, (ssize_t) size);
+    TEST(int, "%d", close(fd), ==, 0);
+
+    return true;
+}
+
+static bool check_contents(
+    struct file_contents *contents,
+    const unsigned char *buf,
+    size_t size)
+{
+    size_t i;
+
+    TEST(size_t, "%zu", contents->size, ==, size);
+    TEST_MEMCMP(contents->data, ==, buf, size);
+    for (i = 0; i < FILE_CONTENTS_PAD; ++i)
+        TEST(unsigned int, "%u", contents->data[size + i], ==, 0);
+
+    return true;
+}
+
+/** Read a file of the given size by name and by descriptor. */
+static bool test_size(
+    size_t size)
+{
+    char path[] = "/tmp/file-test.XXXXXX";
+    struct file_contents contents;
+    unsigned char *buf;
+    size_t i;
+    bool ok;
+    int fd;
+
+    buf = malloc(size + 1);
+    TEST_BOOL(buf != NULL, true);
+    for (i = 0; i < size; ++i)
+        buf[i] = (unsigned char)(i * 7 + 1);
+    if (!write_file(path, buf, size))
+        return false;
+
+    TEST_BOOL(file_contents_open(&contents, path), true);
+    ok = check_contents(&contents, buf, size);
+    file_contents_close(&contents);
+    if (!ok)
+        return false;
+
+    // from the middle of an open file
+    fd = open(path, O_RDONLY);
+    TEST(int, "%d", fd, >=, 0);
+    TEST(long, "%ld", (long)lseek(fd, size / 2, SEEK_SET), ==,
+         (long)(size / 2));
+    TEST_BOOL(file_contents_fd(&contents, fd), true);
+    ok = check_contents(&contents, buf + size / 2, size - size / 2);
+    file_contents_close(&contents);
+    close(fd);
+    if (!ok)
+        return false;
+
+    unlink(path);
+    free(buf);
+
+    return true;
+}
+
+static bool run_test(
+    void)
+{
+    struct file_contents contents;
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    TEST_BOOL(file_contents_open(&contents, "/nonexistent/file"), false);
+
+    if (!test_size(0) || !test_size(1) || !test_size(2048) ||
+        !test_size(4096 * 3))
+        return false;
+    // mapped, including sizes that end exactly on a page boundary
+    if (!test_size(256 * 1024) || !test_size(256 * pagesize) ||
+        !test_size(256 * pagesize - 1))
+        return false;
+
+    return true;
+}
+
+int main(
+    void)
+{
+    if (!run_test())
+        return -1;
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "util/hashtable.h"
+#include "test/unittest.h"
+
+static bool put_range(
+    HashTable * table,
+    uintptr_t start,
+    uintptr_t stop)
+{
+    char key[32];
+    uintptr_t i;
+    void *old;
+
+    for (i = start; i < stop; ++i)
+    {
+        snprintf(key, sizeof(key), "key%" PRIuPTR, i);
+        TEST_BOOL(HashTable_put(table, key, strlen(key), (void *)i, &old),
+                  true);
+        TEST(void *, "%p", old, ==, NULL);
+    }
+
+    return true;
+}
+
+static bool get_range(
+    HashTable * table,
+    uintptr_t start,
+    uintptr_t stop,
+    bool present)
+{
+    char key[32];
+    uintptr_t i;
+
+    for (i = start; i < stop; ++i)
+    {
+        snprintf(key, sizeof(key), "key%" PRIuPTR, i);
+        TEST_BOOL(HashTable_contains(table, key, strlen(key)), present);
+        TEST(uintptr_t, "%" PRIuPTR,
+             (uintptr_t) HashTable_get(table, key, strlen(key)), ==,
+             present ? i : 0);
+    }
+
+    return true;
+}
+
+static bool is_odd(
+    void const *key,
+    size_t key_len,
+    void *value,
+    void *arg)
+{
+    (void)key;
+    (void)key_len;
+    (void)arg;
+    return ((uintptr_t) value & 1) != 0;
+}
+
+static void count_entry(
+    void const *key,
+    size_t key_len,
+    void *value,
+    void *arg)
+{
+    (void)key;
+    (void)key_len;
+    (void)value;
+    ++*(size_t *)arg;
+}
+
+static size_t freed;
+
+static void count_free(
+    void *value)
+{
+    (void)value;
+    ++freed;
+}
+
+static bool run_test(
+    void)
+{
+    HashTable *table;
+    void *old;
+    size_t count;
+
+    table = HashTable_new();
+    TEST_BOOL(table != NULL, true);
+    TEST(size_t, "%zu", HashTable_size(table), ==, 0);
+    if (!get_range(table, 0, 10, false))
+        return false;
+
+    // enough entries to force the table to grow several times
+    if (!put_range(table, 0, 5000))
+        return false;
+    TEST(size_t, "%zu", HashTable_size(table), ==, 5000);
+    if (!get_range(table, 0, 5000, true))
+        return false;
+    if (!get_range(table, 5000, 5100, false))
+        return false;
+
+    // replacing a value reports the old one and keeps the size
+    TEST_BOOL(HashTable_put(table, "key7", 4, (void *)7000, &old), true);
+    TEST(uintptr_t, "%" PRIuPTR, (uintptr_t) old, ==, 7);
+    TEST(size_t, "%zu", HashTable_size(table), ==, 5000);
+    TEST_BOOL(HashTable_put(table, "key7", 4, (void *)7, NULL), true);
+
+    // keys are compared by length as well as content
+    TEST_BOOL(HashTable_contains(table, "key7", 3), false);
+    TEST_BOOL(HashTable_put(table, "", 0, NULL, NULL), true);
+    TEST_BOOL(HashTable_contains(table, "", 0), true);
+    TEST_BOOL(HashTable_remove(table, "", 0, NULL), true);
+
+    TEST_BOOL(HashTable_remove(table, "key10", 5, &old), true);
+    TEST(uintptr_t, "%" PRIuPTR, (uintptr_t) old, ==, 10);
+    TEST_BOOL(HashTable_remove(table, "key10", 5, &old), false);
+    TEST(size_t, "%zu", HashTable_size(table), ==, 4999);
+    if (!put_range(table, 10, 11))
+        return false;
+
+    TEST(size_t, "%zu",
+         HashTable_remove_if(table, is_odd, NULL, NULL), ==, 2500);
+    TEST(size_t, "%zu", HashTable_size(table), ==, 2500);
+    TEST_BOOL(HashTable_contains(table, "key3", 4), false);
+    TEST_BOOL(HashTable_contains(table, "key4", 4), true);
+
+    count = 0;
+    HashTable_foreach(table, count_entry, &count);
+    TEST(size_t, "%zu", count, ==, 2500);
+
+    freed = 0;
+    HashTable_clear(table, count_free);
+    TEST(size_t, "%zu", freed, ==, 2500);
+    TEST(size_t, "%zu", HashTable_size(table), ==, 0);
+    if (!get_range(table, 0, 5000, false))
+        return false;
+
+    if (!put_range(table, 0, 100))
+        return false;
+    freed = 0;
+    HashTable_free(table, count_free);
+    TEST(size_t, "%zu", freed, ==, 100);
+
+    return true;
+}
+
+int main(
+    void)
+{
+    if (!run_test())
+        return -1;
+    return 0;
+}
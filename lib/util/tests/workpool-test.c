@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "util/workpool.h"
+#include "test/unittest.h"
+
+struct item {
+    size_t in;
+    size_t out;
+    size_t calls;
+};
+
+static void square(
+    void *item,
+    void *arg)
+{
+    struct item *it = (struct item *)item;
+
+    it->out = it->in * it->in + *(size_t *)arg;
+    it->calls++;
+}
+
+static bool run_batch(
+    struct work_pool *pool,
+    size_t nitems,
+    size_t offset)
+{
+    struct item *items;
+    size_t i;
+
+    items = (struct item *)calloc(nitems ? nitems : 1, sizeof(*items));
+    TEST_BOOL(items != NULL, true);
+    for (i = 0; i < nitems; i++)
+        items[i].in = i;
+
+    work_pool_run(pool, items, nitems, sizeof(*items), square, &offset);
+
+    for (i = 0; i < nitems; i++)
+    {
+        TEST(size_t, "%zu", items[i].calls, ==, 1);
+        TEST(size_t, "%zu", items[i].out, ==, i * i + offset);
+    }
+    free(items);
+
+    return true;
+}
+
+static bool run_pool(
+    struct work_pool *pool)
+{
+    size_t round;
+
+    // several batches on one pool, so that threads go back to waiting
+    // between them, including empty and single-element batches
+    for (round = 0; round < 50; round++)
+    {
+        if (!run_batch(pool, round * 37 % 1000, round))
+            return false;
+    }
+    if (!run_batch(pool, 0, 0))
+        return false;
+    if (!run_batch(pool, 1, 7))
+        return false;
+    if (!run_batch(pool, 100000, 3))
+        return false;
+
+    return true;
+}
+
+static bool run_test(
+    void)
+{
+    struct work_pool *pool;
+    size_t nthreads;
+
+    if (!run_pool(NULL))
+        return false;
+
+    for (nthreads = 0; nthreads <= 4; nthreads++)
+    {
+        pool = work_pool_new(nthreads);
+        TEST_BOOL(pool != NULL, true);
+        if (!run_pool(pool))
+            return false;
+        work_pool_free(pool);
+    }
+
+    // a pool that never ran anything still stops cleanly
+    pool = work_pool_new(3);
+    TEST_BOOL(pool != NULL, true);
+    work_pool_free(pool);
+    work_pool_free(NULL);
+
+    return true;
+}
+
+int main(
+    void)
+{
+    if (!run_test())
+        return -1;
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "workpool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+struct work_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // a batch started, or the pool is stopping
+    pthread_cond_t finished;    // the last element of a batch is done
+    pthread_t *threads;
+    size_t nthreads;
+    bool stop;
+
+    // the batch being run, all protected by lock
+    char *items;
+    size_t nitems;
+    size_t size;
+    work_pool_func *func;
+    void *arg;
+    size_t next;                // first element nobody has taken
+    size_t done;                // elements whose call has returned
+};
+
+
+/**
+	Take elements of the current batch, with pool->lock held, until
+	there are none left. The lock is released around each call.
+*/
+static void work_pool_drain(
+    struct work_pool *pool)
+{
+    void *item;
+
+    while (pool->next < pool->nitems)
+    {
+        item = pool->items + pool->next * pool->size;
+        pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->func(item, pool->arg);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->done == pool->nitems)
+            pthread_cond_signal(&pool->finished);
+    }
+}
+
+static void *work_pool_thread(
+    void *arg)
+{
+    struct work_pool *pool = (struct work_pool *)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop)
+    {
+        work_pool_drain(pool);
+        if (!pool->stop)
+            pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+struct work_pool *work_pool_new(
+    size_t nthreads)
+{
+    struct work_pool *pool;
+
+    pool = (struct work_pool *)calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+    if (nthreads > 0)
+    {
+        pool->threads = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+        if (pool->threads == NULL)
+        {
+            free(pool);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++)
+    {
+        if (pthread_create(&pool->threads[pool->nthreads], NULL,
+                           work_pool_thread, pool) != 0)
+            break;
+    }
+
+    return pool;
+}
+
+void work_pool_run(
+    struct work_pool *pool,
+    void *items,
+    size_t nitems,
+    size_t size,
+    work_pool_func * func,
+    void *arg)
+{
+    size_t i;
+
+    if (pool == NULL || pool->nthreads == 0 || nitems <= 1)
+    {
+        for (i = 0; i < nitems; i++)
+            func((char *)items + i * size, arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->items = (char *)items;
+    pool->nitems = nitems;
+    pool->size = size;
+    pool->func = func;
+    pool->arg = arg;
+    pool->next = 0;
+    pool->done = 0;
+    pthread_cond_broadcast(&pool->work);
+
+    work_pool_drain(pool);
+    while (pool->done < pool->nitems)
+        pthread_cond_wait(&pool->finished, &pool->lock);
+
+    pool->items = NULL;
+    pool->nitems = 0;
+    pool->next = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void work_pool_free(
+    struct work_pool *pool)
+{
+    size_t i;
+
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,51 @@
+#ifndef _UTILS_WORKPOOL_H
+#define _UTILS_WORKPOOL_H
+
+#include <stddef.h>
+
+/**
+	A fixed set of threads that apply one function to every element of
+	an array, together with the thread that hands them the array. The
+	function is called on different elements at the same time, so it
+	must not touch anything but its element and what is safe to share.
+*/
+struct work_pool;
+
+/** Function applied to each element by work_pool_run(). */
+typedef void work_pool_func(
+    void *item,
+    void *arg);
+
+/**
+	Start a pool.
+
+	@param nthreads Number of threads to start in addition to the
+	calling thread. Zero is allowed: work_pool_run() then does all the
+	work itself. If fewer threads can be started, the pool runs with
+	those that were.
+	@return the pool, or NULL if there is no memory.
+*/
+struct work_pool *work_pool_new(
+    size_t nthreads);
+
+/**
+	Call func(item, arg) once for each of the nitems elements of the
+	given size that start at items, and return when every call has
+	returned. The calling thread takes elements too, so that a pool
+	whose threads are all busy, or a NULL pool, still makes progress.
+
+	Only one thread at a time may run a batch on a given pool.
+*/
+void work_pool_run(
+    struct work_pool *pool,
+    void *items,
+    size_t nitems,
+    size_t size,
+    work_pool_func * func,
+    void *arg);
+
+/** Stop the pool's threads and free it. NULL is allowed. */
+void work_pool_free(
+    struct work_pool *pool);
+
+#endif
@@ -2,7 +2,6 @@ examplesdir = $(docdir)/examples
 sampletadir = $(examplesdir)/sample-ta
 conformancetadir = $(sampletadir)/bbn_conformance
 pkgcachedir = $(localstatedir)/cache/$(PACKAGE_NAME)
-vrscachedir = $(localstatedir)/cache/$(PACKAGE_NAME)-tmp
 pkglogdir = $(localstatedir)/log/$(PACKAGE_NAME)
 pkgsysconfdir = $(sysconfdir)/$(PACKAGE_NAME)
 pkgvarlibdir = $(localstatedir)/lib/$(PACKAGE_NAME)
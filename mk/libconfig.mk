@@ -11,7 +11,6 @@ lib_config_libconfig_a_SOURCES = \
 lib_config_libconfig_a_CPPFLAGS = \
 	$(AM_CPPFLAGS) \
 	-DPKGCACHEDIR='"$(pkgcachedir)"' \
-	-DVRSCACHEDIR='"$(vrscachedir)"' \
 	-DPKGDATADIR='"$(pkgdatadir)"' \
 	-DPKGLOGDIR='"$(pkglogdir)"' \
 	-DPKGVARLIBDIR='"$(pkgvarlibdir)"' \
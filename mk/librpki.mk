@@ -31,3 +31,11 @@ lib_rpki_librpki_a_SOURCES = \
 	lib/rpki/sqcon.c \
 	lib/rpki/sqhl.c \
 	lib/rpki/sqhl.h
+
+
+check_PROGRAMS += lib/rpki/tests/resource_set-test
+
+lib_rpki_tests_resource_set_test_LDADD = \
+	$(LDADD_LIBRPKI)
+
+TESTS += lib/rpki/tests/resource_set-test
@@ -4,12 +4,16 @@ LDADD_LIBUTIL = \
 	lib/util/libutil.a
 
 lib_util_libutil_a_SOURCES = \
+	lib/util/aur_frame.c \
+	lib/util/aur_frame.h \
 	lib/util/bag.c \
 	lib/util/bag.h \
 	lib/util/cryptlib_compat.c \
 	lib/util/cryptlib_compat.h \
 	lib/util/file.c \
 	lib/util/file.h \
+	lib/util/hashtable.c \
+	lib/util/hashtable.h \
 	lib/util/hashutils.c \
 	lib/util/hashutils.h \
 	lib/util/inet.c \
@@ -24,7 +28,9 @@ lib_util_libutil_a_SOURCES = \
 	lib/util/semaphore_compat.c \
 	lib/util/semaphore_compat.h \
 	lib/util/stringutils.c \
-	lib/util/stringutils.h
+	lib/util/stringutils.h \
+	lib/util/workpool.c \
+	lib/util/workpool.h
 
 
 check_LIBRARIES += lib/util/libutildebug.a
@@ -37,6 +43,14 @@ lib_util_libutildebug_a_CPPFLAGS = \
 	-DDEBUG
 
 
+check_PROGRAMS += lib/util/tests/aur_frame-test
+
+lib_util_tests_aur_frame_test_LDADD = \
+	lib/util/libutildebug.a
+
+TESTS += lib/util/tests/aur_frame-test
+
+
 check_PROGRAMS += lib/util/tests/bag-test
 
 lib_util_tests_bag_test_LDADD = \
@@ -45,6 +59,22 @@ lib_util_tests_bag_test_LDADD = \
 TESTS += lib/util/tests/bag-test
 
 
+check_PROGRAMS += lib/util/tests/file-test
+
+lib_util_tests_file_test_LDADD = \
+	lib/util/libutildebug.a
+
+TESTS += lib/util/tests/file-test
+
+
+check_PROGRAMS += lib/util/tests/hashtable-test
+
+lib_util_tests_hashtable_test_LDADD = \
+	lib/util/libutildebug.a
+
+TESTS += lib/util/tests/hashtable-test
+
+
 check_PROGRAMS += lib/util/tests/queue-test
 
 lib_util_tests_queue_test_LDADD = \
@@ -66,7 +96,16 @@ lib_util_tests_logging_test_LDADD = lib/util/libutildebug.a
 TESTS += lib/util/tests/logging-test
 
 
+check_PROGRAMS += lib/util/tests/workpool-test
+
+lib_util_tests_workpool_test_LDADD = \
+	lib/util/libutildebug.a
+
+TESTS += lib/util/tests/workpool-test
+
+
 dist_pkgdata_DATA += lib/util/shell_utils
 
 
 dist_pkgdata_DATA += lib/util/trap_errors
+